@@ -0,0 +1,196 @@
+/*  _______         ____    __         ___    ___
+ * \    _  \       \    /  \  /       \   \  /   /       '   '  '
+ *  |  | \  \       |  |    ||         |   \/   |         .      .
+ *  |  |  |  |      |  |    ||         ||\  /|  |
+ *  |  |  |  |      |  |    ||         || \/ |  |         '  '  '
+ *  |  |  |  |      |  |    ||         ||    |  |         .      .
+ *  |  |_/  /        \  \__//          ||    |  |
+ * /_______/ynamic    \____/niversal  /__\  /____\usic   /|  .  . ibliotheque
+ *                                                      /  \
+ *                                                     / .  \
+ * dumbbench.c - Offline render benchmark.            / / \  \
+ *                                                   | <  /   \_
+ * Renders modules as fast as possible, once with    |  \/ /\   /
+ * the SIMD resampler and mixer paths and once        \_  /  > /
+ * without, and reports how long each took and how      | \ / /
+ * far apart their output is.                           |  ' /
+ *                                                       \__/
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dumb.h"
+#include "internal/it.h"
+#include "internal/resampler.h"
+
+#define BLOCK_SIZE 4096
+
+
+
+/* The player normally provides this. Vorbis-compressed XM samples are left
+ * silent here. */
+short *DUMBCALLBACK dumb_decode_vorbis(int outlen, const void *oggstream, int sizebytes)
+{
+	return NULL;
+}
+
+
+
+static double now(void)
+{
+	return (double)clock() / CLOCKS_PER_SEC;
+}
+
+
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"Usage: dumbbench [options] file...\n"
+		"  -q <0-7>    resampling quality (default %d)\n"
+		"  -r <rate>   output rate (default 44100)\n"
+		"  -s <secs>   seconds of music to render (default 60)\n"
+		"  -n <count>  renders per pass, best time is kept (default 3)\n"
+		"  -t <max>    maximum allowed sample difference (default 64)\n",
+		dumb_resampling_quality);
+	exit(1);
+}
+
+
+
+/* Renders the requested length into out (if not NULL) and returns the CPU
+ * time taken. */
+static double render(DUH *duh, int quality, int rate, int32 length, sample_t *out, int32 *rendered)
+{
+	DUH_SIGRENDERER *sr;
+	sample_t *buffer = malloc(BLOCK_SIZE * 2 * sizeof(sample_t));
+	sample_t *bufptr = buffer;
+	double delta = 65536.0 / rate;
+	double start, elapsed;
+	int32 pos = 0;
+
+	sr = duh_start_sigrenderer(duh, 0, 2, 0);
+	if (!sr) {
+		free(buffer);
+		return -1;
+	}
+	dumb_it_set_resampling_quality(duh_get_it_sigrenderer(sr), quality);
+	dumb_it_set_loop_callback(duh_get_it_sigrenderer(sr), &dumb_it_callback_terminate, NULL);
+
+	start = now();
+	while (pos < length) {
+		int32 todo = length - pos < BLOCK_SIZE ? length - pos : BLOCK_SIZE;
+		int32 got;
+		dumb_silence(buffer, todo * 2);
+		got = duh_sigrenderer_generate_samples(sr, 1.0, delta, todo, &bufptr);
+		if (out) memcpy(out + pos * 2, buffer, got * 2 * sizeof(sample_t));
+		pos += got;
+		if (got < todo) break;
+	}
+	elapsed = now() - start;
+
+	duh_end_sigrenderer(sr);
+	free(buffer);
+	*rendered = pos;
+	return elapsed;
+}
+
+
+
+static double best_render(DUH *duh, int quality, int rate, int32 length, int repeats, sample_t *out, int32 *rendered)
+{
+	double best = -1;
+	int i;
+	for (i = 0; i < repeats; i++) {
+		double t = render(duh, quality, rate, length, i == 0 ? out : NULL, rendered);
+		if (t < 0) return t;
+		if (best < 0 || t < best) best = t;
+	}
+	return best;
+}
+
+
+
+int main(int argc, const char *const *argv)
+{
+	int quality = dumb_resampling_quality;
+	int rate = 44100;
+	int seconds = 60;
+	int repeats = 3;
+	int tolerance = 64;
+	int failed = 0;
+	int i;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (i + 1 >= argc) usage();
+		switch (argv[i][1]) {
+			case 'q': quality = atoi(argv[++i]); break;
+			case 'r': rate = atoi(argv[++i]); break;
+			case 's': seconds = atoi(argv[++i]); break;
+			case 'n': repeats = atoi(argv[++i]); break;
+			case 't': tolerance = atoi(argv[++i]); break;
+			default: usage();
+		}
+	}
+	if (i >= argc || rate <= 0 || seconds <= 0 || repeats <= 0) usage();
+
+	dumb_register_stdfiles();
+	/* Make sure the CPU has been probed before switching paths. */
+	_dumb_init_cubic();
+
+	for (; i < argc; i++) {
+		int32 length = (int32)rate * seconds;
+		int32 simd_len, scalar_len, j;
+		sample_t *simd_out, *scalar_out;
+		double simd_time, scalar_time;
+		int simd_level, maxdiff = 0;
+		DUH *duh = dumb_load_any(argv[i], 0, 0);
+
+		if (!duh) {
+			fprintf(stderr, "%s: could not load\n", argv[i]);
+			failed = 1;
+			continue;
+		}
+
+		simd_out = malloc(length * 2 * sizeof(sample_t));
+		scalar_out = malloc(length * 2 * sizeof(sample_t));
+
+		resampler_set_simd(1);
+		simd_level = resampler_get_simd();
+		simd_time = best_render(duh, quality, rate, length, repeats, simd_out, &simd_len);
+
+		resampler_set_simd(0);
+		scalar_time = best_render(duh, quality, rate, length, repeats, scalar_out, &scalar_len);
+		resampler_set_simd(1);
+
+		if (simd_time < 0 || scalar_time < 0) {
+			fprintf(stderr, "%s: could not start renderer\n", argv[i]);
+			failed = 1;
+		} else {
+			for (j = 0; j < simd_len * 2 && j < scalar_len * 2; j++) {
+				int diff = abs(simd_out[j] - scalar_out[j]);
+				if (diff > maxdiff) maxdiff = diff;
+			}
+			printf("%s: %.2f s rendered at quality %d\n", argv[i], (double)simd_len / rate, quality);
+			printf("  %-7s %8.3f s  %7.1fx realtime\n", simd_level == 2 ? "SSE2" : simd_level == 1 ? "SSE" : "none",
+				simd_time, simd_time > 0 ? simd_len / (double)rate / simd_time : 0);
+			printf("  %-7s %8.3f s  %7.1fx realtime\n", "scalar",
+				scalar_time, scalar_time > 0 ? scalar_len / (double)rate / scalar_time : 0);
+			printf("  max difference %d (24-bit), lengths %d/%d\n", maxdiff, (int)simd_len, (int)scalar_len);
+			if (maxdiff > tolerance || simd_len != scalar_len) {
+				printf("  MISMATCH\n");
+				failed = 1;
+			}
+		}
+
+		free(simd_out);
+		free(scalar_out);
+		unload_duh(duh);
+	}
+
+	dumb_exit();
+	return failed;
+}
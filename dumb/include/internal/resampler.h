@@ -21,6 +21,11 @@
 #define resampler_get_sample EVALUATE(RESAMPLER_DECORATE,_resampler_get_sample)
 #define resampler_get_sample_float EVALUATE(RESAMPLER_DECORATE,_resampler_get_sample_float)
 #define resampler_remove_sample EVALUATE(RESAMPLER_DECORATE,_resampler_remove_sample)
+#define resampler_read_samples EVALUATE(RESAMPLER_DECORATE,_resampler_read_samples)
+#define resampler_mix_mono EVALUATE(RESAMPLER_DECORATE,_resampler_mix_mono)
+#define resampler_mix_stereo EVALUATE(RESAMPLER_DECORATE,_resampler_mix_stereo)
+#define resampler_set_simd EVALUATE(RESAMPLER_DECORATE,_resampler_set_simd)
+#define resampler_get_simd EVALUATE(RESAMPLER_DECORATE,_resampler_get_simd)
 #endif
 
 void resampler_init(void);
@@ -55,4 +60,11 @@ int resampler_get_sample(void *);
 float resampler_get_sample_float(void *);
 void resampler_remove_sample(void *, int decay);
 
+int resampler_read_samples(void *, int *out, int count);
+void resampler_mix_mono(int *dst, const int *src, int count, int lvol, int rvol);
+void resampler_mix_stereo(int *dst, const int *srcl, const int *srcr, int count, int lvol, int rvol);
+
+void resampler_set_simd(int enable);
+int resampler_get_simd(void);
+
 #endif
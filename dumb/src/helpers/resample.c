@@ -69,6 +69,12 @@
 
 
 
+/* Maximum number of FIR resampled samples mixed in one go while the volume
+ * is not ramping. */
+#define DUMB_FIR_BLOCK 256
+
+
+
 /* A global variable for controlling resampling quality wherever a local
  * specification doesn't override it. The following values are valid:
  *
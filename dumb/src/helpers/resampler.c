@@ -5,6 +5,10 @@
 #if (defined(_M_IX86) || defined(__i386__) || defined(_M_X64) || defined(__amd64__))
 #include <xmmintrin.h>
 #define RESAMPLER_SSE
+#if defined(_M_X64) || defined(__amd64__) || defined(__SSE2__) || defined(_MSC_VER)
+#include <emmintrin.h>
+#define RESAMPLER_SSE2
+#endif
 #endif
 #ifdef __APPLE__
 #include <TargetConditionals.h>
@@ -119,9 +123,21 @@ static int query_cpu_feature_sse() {
     return 1;
 }
 
+static int query_cpu_feature_sse2() {
+    int buffer[4];
+    __cpuid(buffer,1);
+    if ((buffer[3]&(1<<26)) == 0) return 0;
+    return 1;
+}
+
+static int resampler_cpu_sse = 0;
+static int resampler_cpu_sse2 = 0;
 static int resampler_has_sse = 0;
+static int resampler_has_sse2 = 0;
 #endif
 
+static int resampler_simd_enabled = 1;
+
 void resampler_init(void)
 {
     unsigned i;
@@ -155,8 +171,30 @@ void resampler_init(void)
         cubic_lut[i*4+3] = (float)( 0.5 * x * x * x - 0.5 * x * x);
     }
 #ifdef RESAMPLER_SSE
-    resampler_has_sse = query_cpu_feature_sse();
+    resampler_cpu_sse = query_cpu_feature_sse();
+    resampler_cpu_sse2 = query_cpu_feature_sse2();
+#endif
+    resampler_set_simd(resampler_simd_enabled);
+}
+
+/* Turning SIMD off makes every path use the plain C version, which is
+ * what the SIMD versions are checked against. */
+void resampler_set_simd(int enable)
+{
+    resampler_simd_enabled = enable;
+#ifdef RESAMPLER_SSE
+    resampler_has_sse = enable && resampler_cpu_sse;
+    resampler_has_sse2 = enable && resampler_cpu_sse2;
+#endif
+}
+
+int resampler_get_simd(void)
+{
+#ifdef RESAMPLER_SSE
+    if (resampler_has_sse2) return 2;
+    if (resampler_has_sse) return 1;
 #endif
+    return 0;
 }
 
 typedef struct resampler
@@ -1510,3 +1548,115 @@ void resampler_remove_sample(void *_r, int decay)
         r->read_pos = ( r->read_pos + 1 ) % resampler_buffer_size;
     }
 }
+
+/* Block versions of resampler_get_sample() and resampler_remove_sample(r, 1)
+ * for the mixer. This reads up to count samples that are already resampled,
+ * without refilling, and returns how many it read. */
+int resampler_read_samples(void *_r, int *out, int count)
+{
+    resampler * r = ( resampler * ) _r;
+    int done = 0;
+
+    if ( count > r->read_filled )
+        count = r->read_filled;
+
+    if ( r->quality == RESAMPLER_QUALITY_BLEP || r->quality == RESAMPLER_QUALITY_BLAM )
+    {
+        /* The accumulator makes every sample depend on the previous one. */
+        double accumulator = r->accumulator;
+        int read_pos = r->read_pos;
+        for ( ; done < count; ++done )
+        {
+            out[done] = (int)(r->buffer_out[ read_pos ] + accumulator);
+            accumulator += r->buffer_out[ read_pos ];
+            r->buffer_out[ read_pos ] = 0;
+            accumulator -= accumulator * (1.0f / 8192.0f);
+            if (fabs(accumulator) < 1e-20f)
+                accumulator = 0;
+            read_pos = ( read_pos + 1 ) % resampler_buffer_size;
+        }
+        r->accumulator = accumulator;
+        r->read_pos = read_pos;
+    }
+    else
+    {
+        while ( done < count )
+        {
+            const float * in = r->buffer_out + r->read_pos;
+            int todo = resampler_buffer_size - r->read_pos;
+            int i = 0;
+            if ( todo > count - done )
+                todo = count - done;
+#ifdef RESAMPLER_SSE2
+            if ( resampler_has_sse2 )
+            {
+                for ( ; i + 4 <= todo; i += 4 )
+                    _mm_storeu_si128( (__m128i *)( out + done + i ), _mm_cvttps_epi32( _mm_loadu_ps( in + i ) ) );
+            }
+#endif
+            for ( ; i < todo; ++i )
+                out[done + i] = (int)in[i];
+            done += todo;
+            r->read_pos = ( r->read_pos + todo ) % resampler_buffer_size;
+        }
+    }
+    r->read_filled -= count;
+    return count;
+}
+
+/* Accumulates resampled samples into an interleaved stereo buffer, scaling
+ * each one exactly as MULSC() does: (sample * vol) >> 16, rounded down.
+ * The SSE2 version does the math in doubles, which hold the full product,
+ * so its results are identical to the C version. */
+#ifdef RESAMPLER_SSE2
+static inline __m128d resampler_floor_pd(__m128d x)
+{
+    __m128d t = _mm_cvtepi32_pd( _mm_cvttpd_epi32( x ) );
+    return _mm_sub_pd( t, _mm_and_pd( _mm_cmpgt_pd( t, x ), _mm_set1_pd( 1.0 ) ) );
+}
+
+static inline void resampler_mix_pair(int * dst, __m128d s, __m128d vol)
+{
+    __m128d d = resampler_floor_pd( _mm_mul_pd( s, vol ) );
+    __m128i sum = _mm_add_epi32( _mm_loadl_epi64( (const __m128i *)dst ), _mm_cvttpd_epi32( d ) );
+    _mm_storel_epi64( (__m128i *)dst, sum );
+}
+#endif
+
+void resampler_mix_mono(int *dst, const int *src, int count, int lvol, int rvol)
+{
+    int i = 0;
+#ifdef RESAMPLER_SSE2
+    if ( resampler_has_sse2 )
+    {
+        __m128d vol = _mm_set_pd( rvol * (1.0 / 65536.0), lvol * (1.0 / 65536.0) );
+        for ( ; i < count; ++i )
+            resampler_mix_pair( dst + i * 2, _mm_set1_pd( (double)src[i] ), vol );
+        return;
+    }
+#endif
+    for ( ; i < count; ++i )
+    {
+        dst[i * 2] += (int)(((long long)src[i] * lvol) >> 16);
+        dst[i * 2 + 1] += (int)(((long long)src[i] * rvol) >> 16);
+    }
+}
+
+void resampler_mix_stereo(int *dst, const int *srcl, const int *srcr, int count, int lvol, int rvol)
+{
+    int i = 0;
+#ifdef RESAMPLER_SSE2
+    if ( resampler_has_sse2 )
+    {
+        __m128d vol = _mm_set_pd( rvol * (1.0 / 65536.0), lvol * (1.0 / 65536.0) );
+        for ( ; i < count; ++i )
+            resampler_mix_pair( dst + i * 2, _mm_set_pd( (double)srcr[i], (double)srcl[i] ), vol );
+        return;
+    }
+#endif
+    for ( ; i < count; ++i )
+    {
+        dst[i * 2] += (int)(((long long)srcl[i] * lvol) >> 16);
+        dst[i * 2 + 1] += (int)(((long long)srcr[i] * rvol) >> 16);
+    }
+}
@@ -140,6 +140,9 @@ void D_LoadWadSettings ();
 // PRIVATE FUNCTION PROTOTYPES ---------------------------------------------
 
 void D_DoomLoop ();
+static bool D_DrawLevelOverlay ();
+static void D_DrawTopOverlay ();
+static void D_PresentFrame (bool hw2d);
 static const char *BaseFileSearch (const char *file, const char *ext, bool lookfirstinprogdir=false);
 
 // EXTERNAL DATA DECLARATIONS ----------------------------------------------
@@ -187,6 +190,7 @@ CUSTOM_CVAR (Int, fraglimit, 0, CVAR_SERVERINFO)
 CVAR (Float, timelimit, 0.f, CVAR_SERVERINFO);
 CVAR (Int, wipetype, 1, CVAR_ARCHIVE);
 CVAR (Int, snd_drawoutput, 0, 0);
+CVAR (Bool, r_pipelined, false, CVAR_ARCHIVE);
 CUSTOM_CVAR (String, vid_cursor, "None", CVAR_ARCHIVE | CVAR_NOINITCALL)
 {
 	bool res = false;
@@ -238,6 +242,7 @@ cycle_t FrameCycles;
 
 static int demosequence;
 static int pagetic;
+static bool FramePending;		// 3D view is still being drawn for the last frame
 
 // CODE --------------------------------------------------------------------
 
@@ -633,6 +638,160 @@ CVAR (Flag, compat_multiexit,			compatflags2, COMPATF2_MULTIEXIT);
 CVAR (Flag, compat_teleport,			compatflags2, COMPATF2_TELEPORT);
 CVAR (Flag, compat_pushwindow,			compatflags2, COMPATF2_PUSHWINDOW);
 
+//==========================================================================
+//
+// D_DrawLevelOverlay
+//
+// Draws everything that goes on top of the 3D view in a level.
+//
+//==========================================================================
+
+static bool D_DrawLevelOverlay ()
+{
+	bool hw2d;
+
+	if ((hw2d = screen->Begin2D(viewactive)))
+	{
+		// Redraw everything every frame when using 2D accel
+		ST_SetNeedRefresh();
+		V_SetBorderNeedRefresh();
+	}
+	Renderer->DrawRemainingPlayerSprites();
+	screen->DrawBlendingRect();
+	if (automapactive)
+	{
+		int saved_ST_Y = ST_Y;
+		if (hud_althud && viewheight == SCREENHEIGHT)
+		{
+			ST_Y = viewheight;
+		}
+		AM_Drawer ();
+		ST_Y = saved_ST_Y;
+	}
+	if (!automapactive || viewactive)
+	{
+		V_RefreshViewBorder ();
+	}
+
+	if (hud_althud && viewheight == SCREENHEIGHT && screenblocks > 10)
+	{
+		StatusBar->DrawBottomStuff (HUD_AltHud);
+		if (DrawFSHUD || automapactive) DrawHUD();
+		StatusBar->Draw (HUD_AltHud);
+		StatusBar->DrawTopStuff (HUD_AltHud);
+	}
+	else 
+	if (viewheight == SCREENHEIGHT && viewactive && screenblocks > 10)
+	{
+		EHudState state = DrawFSHUD ? HUD_Fullscreen : HUD_None;
+		StatusBar->DrawBottomStuff (state);
+		StatusBar->Draw (state);
+		StatusBar->DrawTopStuff (state);
+	}
+	else
+	{
+		StatusBar->DrawBottomStuff (HUD_StatusBar);
+		StatusBar->Draw (HUD_StatusBar);
+		StatusBar->DrawTopStuff (HUD_StatusBar);
+	}
+	CT_Drawer ();
+	return hw2d;
+}
+
+//==========================================================================
+//
+// D_DrawTopOverlay
+//
+// Draws what goes on top of every screen: the pause sign and icons.
+//
+//==========================================================================
+
+static void D_DrawTopOverlay ()
+{
+	// draw pause pic
+	if ((paused || pauseext) && menuactive == MENU_Off)
+	{
+		FTexture *tex;
+		int x;
+		FString pstring = "By ";
+
+		tex = TexMan(gameinfo.PauseSign);
+		x = (SCREENWIDTH - tex->GetScaledWidth() * CleanXfac)/2 +
+			tex->GetScaledLeftOffset() * CleanXfac;
+		screen->DrawTexture (tex, x, 4, DTA_CleanNoMove, true, TAG_DONE);
+		if (paused && multiplayer)
+		{
+			pstring += players[paused - 1].userinfo.GetName();
+			screen->DrawText(SmallFont, CR_RED,
+				(screen->GetWidth() - SmallFont->StringWidth(pstring)*CleanXfac) / 2,
+				(tex->GetScaledHeight() * CleanYfac) + 4, pstring, DTA_CleanNoMove, true, TAG_DONE);
+		}
+	}
+
+	// [RH] Draw icon, if any
+	if (D_DrawIcon)
+	{
+		FTextureID picnum = TexMan.CheckForTexture (D_DrawIcon, FTexture::TEX_MiscPatch);
+
+		D_DrawIcon = NULL;
+		if (picnum.isValid())
+		{
+			FTexture *tex = TexMan[picnum];
+			screen->DrawTexture (tex, 160 - tex->GetScaledWidth()/2, 100 - tex->GetScaledHeight()/2,
+				DTA_320x200, true, TAG_DONE);
+		}
+		NoWipe = 10;
+	}
+
+	if (snd_drawoutput)
+	{
+		GSnd->DrawWaveDebug(snd_drawoutput);
+	}
+}
+
+//==========================================================================
+//
+// D_PresentFrame
+//
+// Adds the console and menus and shows the finished frame.
+//
+//==========================================================================
+
+static void D_PresentFrame (bool hw2d)
+{
+	NetUpdate ();			// send out any new accumulation
+	// normal update
+	C_DrawConsole (hw2d);	// draw console
+	M_Drawer ();			// menu is drawn even on top of everything
+	FStat::PrintStat ();
+	screen->Update ();		// page flip or blit buffer
+}
+
+//==========================================================================
+//
+// D_FinishPendingFrame
+//
+// With r_pipelined, D_Display returns while the 3D view is still being
+// drawn, so the game can already run the next tic. This waits for it
+// and adds the rest of the frame. The status bar and the menus show the
+// state they have at this point. Anything that needs the screen or
+// changes the level has to call this first.
+//
+//==========================================================================
+
+void D_FinishPendingFrame ()
+{
+	if (!FramePending)
+	{
+		return;
+	}
+	FramePending = false;
+	Renderer->FinishView();
+	bool hw2d = D_DrawLevelOverlay();
+	D_DrawTopOverlay();
+	D_PresentFrame(hw2d);
+}
+
 //==========================================================================
 //
 // D_Display
@@ -648,6 +807,8 @@ void D_Display ()
 
 	if (nodrawers || screen == NULL)
 		return; 				// for comparative timing / profiling
+
+	D_FinishPendingFrame ();
 	
 	cycle_t cycles;
 	
@@ -769,53 +930,20 @@ void D_Display ()
 			screen->SetBlendingRect(viewwindowx, viewwindowy,
 				viewwindowx + viewwidth, viewwindowy + viewheight);
 
-			Renderer->RenderView(&players[consoleplayer]);
-
-			if ((hw2d = screen->Begin2D(viewactive)))
-			{
-				// Redraw everything every frame when using 2D accel
-				ST_SetNeedRefresh();
-				V_SetBorderNeedRefresh();
-			}
-			Renderer->DrawRemainingPlayerSprites();
-			screen->DrawBlendingRect();
-			if (automapactive)
-			{
-				int saved_ST_Y = ST_Y;
-				if (hud_althud && viewheight == SCREENHEIGHT)
-				{
-					ST_Y = viewheight;
-				}
-				AM_Drawer ();
-				ST_Y = saved_ST_Y;
-			}
-			if (!automapactive || viewactive)
+			if (!r_pipelined || wipe)
 			{
-				V_RefreshViewBorder ();
+				Renderer->RenderView(&players[consoleplayer]);
 			}
-
-			if (hud_althud && viewheight == SCREENHEIGHT && screenblocks > 10)
+			else if (Renderer->StartView(&players[consoleplayer]))
 			{
-				StatusBar->DrawBottomStuff (HUD_AltHud);
-				if (DrawFSHUD || automapactive) DrawHUD();
-				StatusBar->Draw (HUD_AltHud);
-				StatusBar->DrawTopStuff (HUD_AltHud);
-			}
-			else 
-			if (viewheight == SCREENHEIGHT && viewactive && screenblocks > 10)
-			{
-				EHudState state = DrawFSHUD ? HUD_Fullscreen : HUD_None;
-				StatusBar->DrawBottomStuff (state);
-				StatusBar->Draw (state);
-				StatusBar->DrawTopStuff (state);
-			}
-			else
-			{
-				StatusBar->DrawBottomStuff (HUD_StatusBar);
-				StatusBar->Draw (HUD_StatusBar);
-				StatusBar->DrawTopStuff (HUD_StatusBar);
+				// Let the drawers finish while the next tic is played. The
+				// frame is completed by D_FinishPendingFrame.
+				FramePending = true;
+				cycles.Unclock();
+				FrameCycles = cycles;
+				return;
 			}
-			CT_Drawer ();
+			hw2d = D_DrawLevelOverlay();
 			break;
 
 		case GS_INTERMISSION:
@@ -843,54 +971,11 @@ void D_Display ()
 			break;
 		}
 	}
-	// draw pause pic
-	if ((paused || pauseext) && menuactive == MENU_Off)
-	{
-		FTexture *tex;
-		int x;
-		FString pstring = "By ";
-
-		tex = TexMan(gameinfo.PauseSign);
-		x = (SCREENWIDTH - tex->GetScaledWidth() * CleanXfac)/2 +
-			tex->GetScaledLeftOffset() * CleanXfac;
-		screen->DrawTexture (tex, x, 4, DTA_CleanNoMove, true, TAG_DONE);
-		if (paused && multiplayer)
-		{
-			pstring += players[paused - 1].userinfo.GetName();
-			screen->DrawText(SmallFont, CR_RED,
-				(screen->GetWidth() - SmallFont->StringWidth(pstring)*CleanXfac) / 2,
-				(tex->GetScaledHeight() * CleanYfac) + 4, pstring, DTA_CleanNoMove, true, TAG_DONE);
-		}
-	}
-
-	// [RH] Draw icon, if any
-	if (D_DrawIcon)
-	{
-		FTextureID picnum = TexMan.CheckForTexture (D_DrawIcon, FTexture::TEX_MiscPatch);
-
-		D_DrawIcon = NULL;
-		if (picnum.isValid())
-		{
-			FTexture *tex = TexMan[picnum];
-			screen->DrawTexture (tex, 160 - tex->GetScaledWidth()/2, 100 - tex->GetScaledHeight()/2,
-				DTA_320x200, true, TAG_DONE);
-		}
-		NoWipe = 10;
-	}
-
-	if (snd_drawoutput)
-	{
-		GSnd->DrawWaveDebug(snd_drawoutput);
-	}
+	D_DrawTopOverlay ();
 
 	if (!wipe || NoWipe < 0)
 	{
-		NetUpdate ();			// send out any new accumulation
-		// normal update
-		C_DrawConsole (hw2d);	// draw console
-		M_Drawer ();			// menu is drawn even on top of everything
-		FStat::PrintStat ();
-		screen->Update ();		// page flip or blit buffer
+		D_PresentFrame (hw2d);
 	}
 	else
 	{
@@ -938,6 +1023,11 @@ void D_Display ()
 
 void D_ErrorCleanup ()
 {
+	if (FramePending)
+	{
+		FramePending = false;
+		Renderer->FinishView();
+	}
 	savegamerestore = false;
 	screen->Unlock ();
 	bglobal.RemoveAllBots (true);
@@ -46,6 +46,7 @@ void D_DoomMain (void);
 
 
 void D_Display ();
+void D_FinishPendingFrame ();
 
 
 //
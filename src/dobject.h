@@ -258,6 +258,9 @@ namespace GC
 	// Is this the final collection just before exit?
 	extern bool FinalGC;
 
+	// Does the ACS string pool have collection work to do?
+	extern bool ACSStringsPending;
+
 	// Current white value for known-dead objects.
 	static inline uint32 OtherWhite()
 	{
@@ -295,7 +298,7 @@ namespace GC
 	// Check if it's time to collect, and do a collection step if it is.
 	static inline void CheckGC()
 	{
-		if (AllocBytes >= Threshold)
+		if (AllocBytes >= Threshold || ACSStringsPending)
 			Step();
 	}
 
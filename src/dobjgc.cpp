@@ -155,6 +155,7 @@ int StepMul = DEFAULT_GCMUL;
 int StepCount;
 size_t Dept;
 bool FinalGC;
+bool ACSStringsPending;
 
 // PRIVATE DATA DEFINITIONS ------------------------------------------------
 
@@ -490,6 +491,12 @@ void Step()
 	{
 		lim = (~(size_t)0) / 2;		// no limit
 	}
+	// The ACS string pool is collected in steps alongside the objects.
+	P_StepACSStrings(lim);
+	if (AllocBytes < Threshold)
+	{ // Only stepped for the string pool.
+		return;
+	}
 	Dept += AllocBytes - Threshold;
 	do
 	{
@@ -28,6 +28,7 @@
 #include "p_3dmidtex.h"
 #include "r_data/r_interpolate.h"
 #include "statnums.h"
+#include "p_acs.h"
 #include "serializer.h"
 #include "doomstat.h"
 
@@ -55,6 +56,7 @@ void DSectorEffect::Destroy()
 		{
 			m_Sector->lightingdata = NULL;
 		}
+		P_WakeACSTagWaiters(m_Sector);
 	}
 	Super::Destroy();
 }
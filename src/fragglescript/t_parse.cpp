@@ -53,6 +53,7 @@
 
 
 CVAR(Bool, script_debug, false, 0)
+CVAR(Bool, script_compile, true, 0)
 
 /************ Divide into tokens **************/
 #define isnum(c) ( ((c)>='0' && (c)<='9') || (c)=='.')
@@ -196,6 +197,7 @@ char *FParser::GetTokens(char *s)
 	char *tokn = NULL;
 
 	Rover = s;
+	Tokens[0] = TokenBuffer;
 	NumTokens = 1;
 	Tokens[0][0] = 0; TokenType[NumTokens-1] = name_;
 	
@@ -300,6 +302,68 @@ char *FParser::GetTokens(char *s)
 }
 
 
+//==========================================================================
+//
+// GetStatement
+//
+// Same as GetTokens(Rover), but each statement of the script is only
+// tokenized the first time it is run. After that the tokens are taken
+// from the script's list of statements.
+//
+//==========================================================================
+
+void FParser::GetStatement()
+{
+	int offset = Script->MakeIndex(Rover);
+	FFsStatement **found = Script->Statements.CheckKey(offset);
+	FFsStatement *st;
+	int i;
+
+	if (found != NULL)
+	{
+		st = *found;
+		NumTokens = st->TokenType.Size();
+		for (i = 0; i < NumTokens; i++)
+		{
+			Tokens[i] = &st->Text[st->TokenStart[i]];
+			TokenType[i] = st->TokenType[i];
+		}
+		Section = st->Section;
+		if (Section != NULL)
+		{
+			BraceType = st->BraceType;
+		}
+		LineStart = Script->data + st->LineStart;
+		Rover = Script->data + st->Next;
+		Compiled = st;
+		return;
+	}
+
+	// If this throws, nothing is kept and the error comes up again
+	// the next time.
+	Compiled = NULL;
+	GetTokens(Rover);
+
+	st = new FFsStatement;
+	if (NumTokens > 0)
+	{
+		char *end = Tokens[NumTokens-1] + strlen(Tokens[NumTokens-1]) + 1;
+		st->Text.Resize(unsigned(end - Tokens[0]));
+		memcpy(&st->Text[0], Tokens[0], end - Tokens[0]);
+		for (i = 0; i < NumTokens; i++)
+		{
+			st->TokenStart.Push(int(Tokens[i] - Tokens[0]));
+			st->TokenType.Push(TokenType[i]);
+		}
+	}
+	st->Section = Section;
+	st->BraceType = BraceType;
+	st->LineStart = Script->MakeIndex(LineStart);
+	st->Next = Script->MakeIndex(Rover);
+	Script->Statements[offset] = st;
+	Compiled = st;
+}
+
 //==========================================================================
 //
 // PrintTokens: add one character to the current token
@@ -348,6 +412,10 @@ void FParser::PrintTokens()	// DEBUG
 
 void FParser::Run(char *rover, char *data, char *end)
 {
+	// Included lumps are run from a temporary copy, so only the script's
+	// own statements can be kept.
+	bool compile = script_compile && data == Script->data;
+
 	Rover = rover;
 	try
 	{
@@ -362,7 +430,15 @@ void FParser::Run(char *rover, char *data, char *end)
 			PrevSection = Section; // store from prev. statement
 			
 			// get the line and tokens
-			GetTokens(Rover);
+			if (compile)
+			{
+				GetStatement();
+			}
+			else
+			{
+				Compiled = NULL;
+				GetTokens(Rover);
+			}
 			
 			if(!NumTokens)
 			{
@@ -488,6 +564,21 @@ int FParser::FindOperator(int start, int stop, const char *value)
 {
 	int i;
 	int bracketlevel = 0;
+	DWORD key = 0;
+
+	// Operators are never longer than 2 characters, so the range and
+	// the operator fit in the key.
+	bool keep = Compiled != NULL && (unsigned)start < T_MAXTOKENS && (unsigned)stop < T_MAXTOKENS &&
+		value[0] != 0 && (value[1] == 0 || value[2] == 0);
+	if (keep)
+	{
+		key = start | (stop << 8) | (BYTE(value[0]) << 16) | (BYTE(value[1]) << 24);
+		int *found = Compiled->Operators.CheckKey(key);
+		if (found != NULL)
+		{
+			return *found;
+		}
+	}
 	
 	for(i=start; i<=stop; i++)
     {
@@ -501,10 +592,17 @@ int FParser::FindOperator(int start, int stop, const char *value)
 		
 		// only check when we are not in brackets
 		if(!bracketlevel && !strcmp(value, Tokens[i]))
-			return i;
+			break;
     }
-	
-	return -1;
+	if (i > stop)
+	{
+		i = -1;
+	}
+	if (keep)
+	{
+		Compiled->Operators[key] = i;
+	}
+	return i;
 }
 
 //==========================================================================
@@ -650,43 +748,79 @@ void FParser::PointlessBrackets(int *start, int *stop)
 
 void FParser::EvaluateExpression(svalue_t &result, int start, int stop)
 {
-	int i, n;
-	
-	// possible pointless brackets
-	if(TokenType[start] == operator_ && TokenType[stop] == operator_)
-		PointlessBrackets(&start, &stop);
+	int i, n = -1;
+	DWORD key = 0;
+	bool keep = Compiled != NULL && (unsigned)start < T_MAXTOKENS && (unsigned)stop < T_MAXTOKENS;
+	FFsExpression *expr = NULL;
 
-	if(start == stop)       // only 1 thing to evaluate
-    {
-		SimpleEvaluate(result, start);
-		return;
-    }
-	
-	// go through each operator in order of precedence
-	for(i=0; i<num_operators; i++)
-    {
-		// check backwards for the token. it has to be
-		// done backwards for left-to-right reading: eg so
-		// 5-3-2 is (5-3)-2 not 5-(3-2)
-		
-		if (operators[i].direction==forward)
+	if (keep)
+	{
+		key = start | (stop << 8);
+		expr = Compiled->Expressions.CheckKey(key);
+	}
+	if (expr != NULL)
+	{
+		start = expr->Start;
+		stop = expr->Stop;
+		i = expr->Operator;
+		n = expr->Split;
+	}
+	else
+	{
+		// possible pointless brackets
+		if(TokenType[start] == operator_ && TokenType[stop] == operator_)
+			PointlessBrackets(&start, &stop);
+
+		if(start == stop)       // only 1 thing to evaluate
 		{
-			n = FindOperatorBackwards(start, stop, operators[i].string);
+			i = FFsExpression::EXPR_Simple;
 		}
 		else
 		{
-			n = FindOperator(start, stop, operators[i].string);
+			// go through each operator in order of precedence
+			for(i=0; i<num_operators; i++)
+			{
+				// check backwards for the token. it has to be
+				// done backwards for left-to-right reading: eg so
+				// 5-3-2 is (5-3)-2 not 5-(3-2)
+				
+				if (operators[i].direction==forward)
+				{
+					n = FindOperatorBackwards(start, stop, operators[i].string);
+				}
+				else
+				{
+					n = FindOperator(start, stop, operators[i].string);
+				}
+				if (n != -1) break;
+			}
+			if (i == num_operators)
+			{
+				i = TokenType[start] == function ? FFsExpression::EXPR_Function : FFsExpression::EXPR_Error;
+			}
 		}
-
-		if( n != -1)
+		if (keep)
 		{
-			// call the operator function and evaluate this chunk of tokens
-			(this->*operators[i].handler)(result, start, n, stop);
-			return;
+			FFsExpression &newexpr = Compiled->Expressions[key];
+			newexpr.Start = BYTE(start);
+			newexpr.Stop = BYTE(stop);
+			newexpr.Operator = BYTE(i);
+			newexpr.Split = BYTE(n);
 		}
-    }
-	
-	if(TokenType[start] == function)
+	}
+
+	if (i == FFsExpression::EXPR_Simple)
+	{
+		SimpleEvaluate(result, start);
+		return;
+	}
+	if (i < num_operators)
+	{
+		// call the operator function and evaluate this chunk of tokens
+		(this->*operators[i].handler)(result, start, n, stop);
+		return;
+	}
+	if (i == FFsExpression::EXPR_Function)
 	{
 		EvaluateFunction(result, start, stop);
 		return;
@@ -402,6 +402,7 @@ void DFsScript::DryRunScript()
 
 void DFsScript::Preprocess()
 {
+	ClearStatements();
 	len = (int)strlen(data);
 	ProcessFindChar(data, 0);  // fill in everything
 	DryRunScript();
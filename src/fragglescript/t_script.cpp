@@ -55,6 +55,9 @@
 #include "doomerrors.h"
 #include "doomstat.h"
 #include "serializer.h"
+#include "w_wad.h"
+#include "cmdlib.h"
+#include "stats.h"
 
 //==========================================================================
 //
@@ -142,6 +145,24 @@ void DFsScript::ClearChildren()
 	}
 }
 
+//==========================================================================
+//
+// Forgets the tokenized statements. Needed whenever data changes.
+//
+//==========================================================================
+
+void DFsScript::ClearStatements()
+{
+	TMap<int, FFsStatement *>::Iterator it(Statements);
+	TMap<int, FFsStatement *>::Pair *pair;
+
+	while (it.NextPair(pair))
+	{
+		delete pair->Value;
+	}
+	Statements.Clear();
+}
+
 //==========================================================================
 //
 //
@@ -173,6 +194,7 @@ DFsScript::DFsScript()
 
 DFsScript::~DFsScript()
 {
+	ClearStatements();
 	if (data != NULL) delete[] data;
 	data = NULL;
 }
@@ -188,6 +210,7 @@ void DFsScript::Destroy()
 	ClearVariables(true);
 	ClearSections();
 	ClearChildren();
+	ClearStatements();
 	parent = NULL;
 	if (data != NULL) delete [] data;
 	data = NULL;
@@ -207,6 +230,7 @@ void DFsScript::Serialize(FSerializer &arc)
 	Super::Serialize(arc);
 	// don't save a reference to the global script
 	if (parent == global_script) parent = nullptr;
+	if (arc.isReading()) ClearStatements();
 
 	arc("data", data)
 		("scriptnum", scriptnum)
@@ -723,3 +747,76 @@ CCMD(fpuke)
 		T_RunScript(atoi(argv[1]), players[consoleplayer].mo);
 	}
 }
+
+//==========================================================================
+//
+// fsbench <lump or script text> [runs]
+//
+// Runs a piece of FraggleScript repeatedly as a child of the current
+// level's script, once with statements being tokenized every time they
+// are run and once with script_compile on, and reports the times. The
+// script must not wait or it will be left queued after the first run.
+//
+//==========================================================================
+
+EXTERN_CVAR(Bool, script_compile)
+
+CCMD(fsbench)
+{
+	DFraggleThinker *th = DFraggleThinker::ActiveThinker;
+
+	if (argv.argc() < 2)
+	{
+		Printf (" fsbench <lump or script text> [runs]\n");
+		return;
+	}
+	if (th == NULL || th->LevelScript == NULL)
+	{
+		Printf ("No FraggleScript level is running\n");
+		return;
+	}
+
+	FString text;
+	int lumpnum = Wads.CheckNumForName(argv[1]);
+	if (lumpnum >= 0)
+	{
+		FMemLump lump = Wads.ReadLump(lumpnum);
+		text = FString((const char *)lump.GetMem(), Wads.LumpLength(lumpnum));
+	}
+	else
+	{
+		text = argv[1];
+	}
+	int runs = argv.argc() > 2 ? MAX(1, atoi(argv[2])) : 100;
+
+	DFsScript *script = new DFsScript;
+	GC::AddSoftRoot(script);
+	script->parent = th->LevelScript;
+	script->scriptnum = MAXSCRIPTS;
+	script->trigger = players[consoleplayer].mo;
+	script->data = copystring(text);
+	script->Preprocess();
+
+	bool compile = script_compile;
+	double times[2];
+	for (int pass = 0; pass < 2; pass++)
+	{
+		cycle_t clock;
+		clock.Reset();
+		script_compile = pass == 1;
+		for (int i = 0; i < runs; i++)
+		{
+			clock.Clock();
+			script->ParseScript();
+			clock.Unclock();
+		}
+		times[pass] = clock.TimeMS() / runs;
+	}
+	script_compile = compile;
+
+	Printf ("%d runs, %d statements\n", runs, script->Statements.CountUsed());
+	Printf ("  tokenized %9.4f ms per run\n", times[0]);
+	Printf ("  compiled  %9.4f ms per run  %.1fx\n", times[1], times[1] > 0 ? times[0] / times[1] : 0.);
+	GC::DelSoftRoot(script);
+	script->Destroy();
+}
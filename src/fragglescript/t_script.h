@@ -300,6 +300,42 @@ class CFsTerminator
 	int fill;
 };
 
+//==========================================================================
+//
+// A statement as GetTokens leaves it, kept by its script so that running
+// it again does not need to go through the text again. How expressions
+// split at their operators is worked out the first time they are
+// evaluated and kept here as well, by token range.
+//
+//==========================================================================
+
+struct FFsExpression
+{
+	BYTE Start, Stop;		// without pointless brackets
+	BYTE Operator;			// index into FParser::operators or one of the below
+	BYTE Split;				// operator token
+
+	enum
+	{
+		EXPR_Error = 0xFD,
+		EXPR_Function,
+		EXPR_Simple
+	};
+};
+
+struct FFsStatement
+{
+	TArray<char> Text;				// all tokens, each 0-terminated
+	TArray<int> TokenStart;			// offset of each token in Text
+	TArray<tokentype_t> TokenType;
+	DFsSection *Section;
+	int BraceType;
+	int LineStart;					// offsets into the script's data
+	int Next;
+	TMap<DWORD, FFsExpression> Expressions;
+	TMap<DWORD, int> Operators;		// FindOperator results
+};
+
 //==========================================================================
 //
 // Scripts
@@ -345,6 +381,9 @@ public:
 	bool lastiftrue;     // haleyjd: whether last "if" statement was 
 	// true or false
 
+	// statements that have been run, by offset into data. Not saved.
+	TMap<int, FFsStatement *> Statements;
+
 	DFsScript();
 	~DFsScript();
 	void Destroy() override;
@@ -364,6 +403,7 @@ public:
 	char *SectionLoop(const DFsSection *sec);
 	void ClearSections();
 	void ClearChildren();
+	void ClearStatements();
 
 	int MakeIndex(const char *p) { return int(p-data); }
 
@@ -411,6 +451,8 @@ struct FParser
 	char *Tokens[T_MAXTOKENS];
 	tokentype_t TokenType[T_MAXTOKENS];
 	int NumTokens;
+	char *TokenBuffer;
+	FFsStatement *Compiled;  // the current statement, if it is kept
 	DFsScript *Script;       // the current script
 	DFsSection *Section;
 	DFsSection *PrevSection;
@@ -425,8 +467,9 @@ struct FParser
 	{
 		LineStart = NULL;
 		Rover = NULL;
-		Tokens[0] = new char[scr->len+32];	// 32 for safety. FS seems to need a few bytes more than the script's actual length.
+		Tokens[0] = TokenBuffer = new char[scr->len+32];	// 32 for safety. FS seems to need a few bytes more than the script's actual length.
 		NumTokens = 0;
+		Compiled = NULL;
 		Script = scr;
 		Section = PrevSection = NULL;
 		BraceType = 0;
@@ -434,11 +477,12 @@ struct FParser
 
 	~FParser()
 	{
-		if (Tokens[0]) delete [] Tokens[0];
+		if (TokenBuffer) delete [] TokenBuffer;
 	}
 
 	void NextToken();
 	char *GetTokens(char *s);
+	void GetStatement();
 	void PrintTokens();
 	void ErrorMessage(FString msg);
 
@@ -1051,6 +1051,11 @@ void G_Ticker ()
 
 	// do things to change the game state
 	oldgamestate = gamestate;
+	if (gameaction != ga_nothing)
+	{
+		// The last frame may still be drawn from the current level.
+		D_FinishPendingFrame ();
+	}
 	while (gameaction != ga_nothing)
 	{
 		if (gameaction == ga_newgame2)
@@ -311,3 +311,22 @@ FString OPLMIDIDevice::GetStats()
 	}
 	return out;
 }
+
+//==========================================================================
+//
+// OPLMIDIDevice :: GetVoiceCount
+//
+//==========================================================================
+
+int OPLMIDIDevice::GetVoiceCount()
+{
+	int used = 0;
+	for (uint i = 0; i < io->OPLchannels; ++i)
+	{
+		if (!(channels[i].flags & CH_FREE))
+		{
+			used++;
+		}
+	}
+	return used;
+}
@@ -18,6 +18,8 @@
 
 EXTERN_CVAR (Int, opl_numchips)
 
+extern thread_local cycle_t MusicEventCycles, MusicSynthCycles;
+
 OPLmusicBlock::OPLmusicBlock()
 {
 	scoredata = NULL;
@@ -236,10 +238,12 @@ bool OPLmusicBlock::ServiceStream (void *buff, int numbytes)
 
 		if (samplesleft > 0)
 		{
+			MusicSynthCycles.Clock();
 			for (i = 0; i < io->NumChips; ++i)
 			{
 				io->chips[i]->Update(samples1, samplesleft);
 			}
+			MusicSynthCycles.Unclock();
 			OffsetSamples(samples1, samplesleft << stereoshift);
 			assert(NextTickIn == ticky);
 			NextTickIn -= samplesleft;
@@ -250,7 +254,9 @@ bool OPLmusicBlock::ServiceStream (void *buff, int numbytes)
 		
 		if (NextTickIn < 1)
 		{
+			MusicEventCycles.Clock();
 			int next = PlayTick();
+			MusicEventCycles.Unclock();
 			assert(next >= 0);
 			if (next == 0)
 			{ // end of song
@@ -258,10 +264,12 @@ bool OPLmusicBlock::ServiceStream (void *buff, int numbytes)
 				{
 					if (numsamples > 0)
 					{
+						MusicSynthCycles.Clock();
 						for (i = 0; i < io->NumChips; ++i)
 						{
 							io->chips[i]->Update(samples1, numsamples);
 						}
+						MusicSynthCycles.Unclock();
 						OffsetSamples(samples1, numsamples << stereoshift);
 					}
 					res = false;
@@ -85,6 +85,7 @@
 #include "a_pickups.h"
 #include "a_armor.h"
 #include "a_ammo.h"
+#include "stats.h"
 
 extern FILE *Logfile;
 
@@ -94,6 +95,10 @@ FRandom pr_acs ("ACS");
 // potentially get used with recursive functions.
 #define STACK_SIZE 4096
 
+// Most work the string pool collector does per tic: one unit per string
+// or variable looked at.
+#define STRGC_TICWORK 8192
+
 #define CLAMPCOLOR(c)		(EColorRange)((unsigned)(c) >= NUM_TEXT_COLORS ? CR_UNTRANSLATED : (c))
 #define LANGREGIONMASK		MAKE_ID(0,0,0xff,0xff)
 
@@ -187,23 +192,28 @@ inline int PitchToACS(DAngle ang)
 
 struct CallReturn
 {
-	CallReturn(int pc, ScriptFunction *func, FBehavior *module, SDWORD *locals, ACSLocalArrays *arrays, bool discard, unsigned int runaway)
+	CallReturn(int *pc, ScriptFunction *func, FBehavior *module, SDWORD *locals, ACSLocalArrays *arrays, bool discard, unsigned int runaway,
+		bool compare = false, int vmresult = 0)
 		: ReturnFunction(func),
 		  ReturnModule(module),
 		  ReturnLocals(locals),
 		  ReturnArrays(arrays),
 		  ReturnAddress(pc),
 		  bDiscardResult(discard),
-		  EntryInstrCount(runaway)
+		  EntryInstrCount(runaway),
+		  bCompareVM(compare),
+		  VMResult(vmresult)
 	{}
 
 	ScriptFunction *ReturnFunction;
 	FBehavior *ReturnModule;
 	SDWORD *ReturnLocals;
 	ACSLocalArrays *ReturnArrays;
-	int ReturnAddress;
+	int *ReturnAddress;
 	int bDiscardResult;
 	unsigned int EntryInstrCount;
+	bool bCompareVM;		// for acs_vmcompare
+	int VMResult;
 };
 
 static DLevelScript *P_GetScriptGoing (AActor *who, line_t *where, int num, const ScriptPtr *code, FBehavior *module,
@@ -343,10 +353,29 @@ FACSStack::~FACSStack()
 
 ACSStringPool GlobalACSStrings;
 
+// Where P_StepACSStrings is in the collection it is running.
+static struct FStringGCState
+{
+	unsigned int Unit;			// World array, then global array to mark
+	unsigned int Module;		// Then each module's map arrays
+	unsigned int Array;
+	unsigned int Pos;
+	int Tic;
+	size_t TicWork;
+	unsigned int NumMinor, NumFull;
+	double LastPause, MaxPause;
+} StringGC;
+
 ACSStringPool::ACSStringPool()
 {
 	memset(PoolBuckets, 0xFF, sizeof(PoolBuckets));
 	FirstFreeEntry = 0;
+	MarkEpoch = 1;
+	LiveCount = 0;
+	FullThreshold = MIN_GC_SIZE;
+	SweepPos = 0;
+	State = GCS_Idle;
+	FullCollection = false;
 }
 
 //============================================================================
@@ -362,6 +391,11 @@ void ACSStringPool::Clear()
 	Pool.Clear();
 	memset(PoolBuckets, 0xFF, sizeof(PoolBuckets));
 	FirstFreeEntry = 0;
+	YoungList.Clear();
+	SweepList.Clear();
+	LiveCount = 0;
+	FullThreshold = MIN_GC_SIZE;
+	State = GCS_Idle;
 }
 
 //============================================================================
@@ -382,6 +416,7 @@ int ACSStringPool::AddString(const char *str)
 	int i = FindString(str, len, h, bucketnum);
 	if (i >= 0)
 	{
+		if (State != GCS_Idle) Pool[i].Mark = MarkEpoch;
 		return i | STRPOOL_LIBRARYID_OR;
 	}
 	FString fstr(str);
@@ -395,6 +430,7 @@ int ACSStringPool::AddString(FString &str)
 	int i = FindString(str, str.Len(), h, bucketnum);
 	if (i >= 0)
 	{
+		if (State != GCS_Idle) Pool[i].Mark = MarkEpoch;
 		return i | STRPOOL_LIBRARYID_OR;
 	}
 	return InsertString(str, h, bucketnum);
@@ -454,8 +490,9 @@ void ACSStringPool::UnlockString(int strnum)
 //
 // ACSStringPool :: MarkString
 //
-// Prevent this string from being purged during the next call to PurgeStrings.
-// This does not carry over to subsequent calls of PurgeStrings.
+// Prevent this string from being purged during the next call to PurgeStrings
+// or by the collection in progress. This does not carry over to subsequent
+// collections.
 //
 //============================================================================
 
@@ -464,7 +501,7 @@ void ACSStringPool::MarkString(int strnum)
 	assert((strnum & LIBRARYID_MASK) == STRPOOL_LIBRARYID_OR);
 	strnum &= ~LIBRARYID_MASK;
 	assert((unsigned)strnum < Pool.Size());
-	Pool[strnum].LockCount |= 0x80000000;
+	Pool[strnum].Mark = MarkEpoch;
 }
 
 //============================================================================
@@ -538,7 +575,7 @@ void ACSStringPool::MarkStringArray(const int *strnum, unsigned int count)
 			num &= ~LIBRARYID_MASK;
 			if ((unsigned)num < Pool.Size())
 			{
-				Pool[num].LockCount |= 0x80000000;
+				Pool[num].Mark = MarkEpoch;
 			}
 		}
 	}
@@ -565,7 +602,7 @@ void ACSStringPool::MarkStringMap(const FWorldGlobalArray &aray)
 			num &= ~LIBRARYID_MASK;
 			if ((unsigned)num < Pool.Size())
 			{
-				Pool[num].LockCount |= 0x80000000;
+				Pool[num].Mark = MarkEpoch;
 			}
 		}
 	}
@@ -598,6 +635,12 @@ void ACSStringPool::UnlockAll()
 
 void ACSStringPool::PurgeStrings()
 {
+	// This replaces whatever collection was in progress. Its marks are
+	// still good, so keeping them only means keeping more strings.
+	State = GCS_Idle;
+	YoungList.Clear();
+	SweepList.Clear();
+
 	// Clear the hash buckets. We'll rebuild them as we decide what strings
 	// to keep and which to toss.
 	memset(PoolBuckets, 0xFF, sizeof(PoolBuckets));
@@ -607,7 +650,7 @@ void ACSStringPool::PurgeStrings()
 		PoolEntry *entry = &Pool[i];
 		if (entry->Next != FREE_ENTRY)
 		{
-			if (entry->LockCount == 0)
+			if (entry->LockCount == 0 && entry->Mark != MarkEpoch)
 			{
 				freedcount++;
 				// Mark this entry as free.
@@ -626,9 +669,245 @@ void ACSStringPool::PurgeStrings()
 				unsigned int h = entry->Hash % NUM_BUCKETS;
 				entry->Next = PoolBuckets[h];
 				PoolBuckets[h] = i;
-				// Remove MarkString's mark.
-				entry->LockCount &= 0x7FFFFFFF;
+				entry->Young = false;
+			}
+		}
+	}
+	LiveCount = (unsigned int)usedcount;
+	FullThreshold = MAX<unsigned int>(MIN_GC_SIZE, LiveCount * 2);
+	// Remove MarkString's marks.
+	NextEpoch();
+}
+
+//============================================================================
+//
+// ACSStringPool :: NextEpoch
+//
+// Strings are marked by storing the current epoch in them, so starting a
+// new one unmarks everything at once.
+//
+//============================================================================
+
+void ACSStringPool::NextEpoch()
+{
+	if (++MarkEpoch == 0)
+	{
+		for (unsigned int i = 0; i < Pool.Size(); ++i)
+		{
+			Pool[i].Mark = 0;
+		}
+		MarkEpoch = 1;
+	}
+}
+
+//============================================================================
+//
+// ACSStringPool :: CollectionDue
+//
+// A full collection is due when the pool has doubled in size since the
+// last one, a minor one when enough strings were created since the last
+// collection of any kind.
+//
+//============================================================================
+
+bool ACSStringPool::CollectionDue() const
+{
+	return State == GCS_Idle && (FullCollectionDue() || YoungList.Size() >= MINOR_GC_SIZE);
+}
+
+//============================================================================
+//
+// ACSStringPool :: BeginCollection
+//
+// Starts the mark phase. Strings that are created or looked up from now on
+// until the sweep is over are kept.
+//
+//============================================================================
+
+void ACSStringPool::BeginCollection(bool full)
+{
+	NextEpoch();
+	State = GCS_Mark;
+	FullCollection = full;
+}
+
+//============================================================================
+//
+// ACSStringPool :: AbortMarking
+//
+// Called when something the mark phase is walking goes away. The strings
+// that are already marked will simply survive the next collection.
+//
+//============================================================================
+
+void ACSStringPool::AbortMarking()
+{
+	if (State == GCS_Mark)
+	{
+		State = GCS_Idle;
+	}
+}
+
+//============================================================================
+//
+// ACSStringPool :: FinishMarking
+//
+// Everything that can refer to a string has been marked; set up the sweep.
+// A full collection sweeps the whole pool a bucket at a time, a minor one
+// only the strings that are young at this point. Strings created during
+// the sweep are young in the next collection.
+//
+//============================================================================
+
+void ACSStringPool::FinishMarking()
+{
+	assert(State == GCS_Mark);
+	if (FullCollection)
+	{
+		for (unsigned int i = 0; i < YoungList.Size(); ++i)
+		{
+			Pool[YoungList[i]].Young = false;
+		}
+		YoungList.Clear();
+	}
+	else
+	{
+		SweepList = std::move(YoungList);
+	}
+	SweepPos = 0;
+	State = GCS_Sweep;
+}
+
+//============================================================================
+//
+// ACSStringPool :: SweepStep
+//
+// Frees unmarked strings until work reaches budget. Returns true once the
+// collection is over.
+//
+//============================================================================
+
+bool ACSStringPool::SweepStep(size_t &work, size_t budget)
+{
+	assert(State == GCS_Sweep);
+	bool done;
+
+	if (FullCollection)
+	{
+		while (SweepPos < NUM_BUCKETS && work < budget)
+		{
+			unsigned int *prev = &PoolBuckets[SweepPos++];
+			while (*prev != NO_ENTRY)
+			{
+				unsigned int i = *prev;
+				PoolEntry *entry = &Pool[i];
+				if (entry->LockCount == 0 && entry->Mark != MarkEpoch)
+				{
+					*prev = entry->Next;
+					FreeEntry(i);
+				}
+				else
+				{
+					prev = &entry->Next;
+				}
+				work++;
 			}
+			work++;
+		}
+		done = SweepPos == NUM_BUCKETS;
+	}
+	else
+	{
+		while (SweepPos < SweepList.Size() && work < budget)
+		{
+			unsigned int i = SweepList[SweepPos++];
+			PoolEntry *entry = &Pool[i];
+			work++;
+			// Entries that a write barrier promoted are no longer ours.
+			if (entry->Next == FREE_ENTRY || !entry->Young)
+			{
+				continue;
+			}
+			entry->Young = false;
+			if (entry->LockCount == 0 && entry->Mark != MarkEpoch)
+			{
+				UnlinkEntry(i);
+				FreeEntry(i);
+			}
+		}
+		done = SweepPos == SweepList.Size();
+	}
+	if (done)
+	{
+		if (FullCollection)
+		{
+			FullThreshold = MAX<unsigned int>(MIN_GC_SIZE, LiveCount * 2);
+		}
+		SweepList.Clear();
+		State = GCS_Idle;
+	}
+	return done;
+}
+
+//============================================================================
+//
+// ACSStringPool :: UnlinkEntry
+//
+// Removes an entry from its hash chain.
+//
+//============================================================================
+
+void ACSStringPool::UnlinkEntry(unsigned int index)
+{
+	unsigned int *prev = &PoolBuckets[Pool[index].Hash % NUM_BUCKETS];
+	while (*prev != index)
+	{
+		assert(*prev != NO_ENTRY);
+		prev = &Pool[*prev].Next;
+	}
+	*prev = Pool[index].Next;
+}
+
+//============================================================================
+//
+// ACSStringPool :: FreeEntry
+//
+// Frees an entry that is no longer in any hash chain.
+//
+//============================================================================
+
+void ACSStringPool::FreeEntry(unsigned int index)
+{
+	PoolEntry *entry = &Pool[index];
+	entry->Next = FREE_ENTRY;
+	entry->Str = "";
+	entry->Young = false;
+	if (index < FirstFreeEntry)
+	{
+		FirstFreeEntry = index;
+	}
+	LiveCount--;
+}
+
+//============================================================================
+//
+// ACSStringPool :: Barrier
+//
+// A string was stored in a world, global or map array. Minor collections
+// do not look at those, so the string is treated as old from now on. If
+// a full collection is marking, the array may already have been looked
+// at, so it is marked as well.
+//
+//============================================================================
+
+void ACSStringPool::Barrier(unsigned int index)
+{
+	if (index < Pool.Size())
+	{
+		Pool[index].Young = false;
+		if (State == GCS_Mark)
+		{
+			Pool[index].Mark = MarkEpoch;
 		}
 	}
 }
@@ -670,8 +949,9 @@ int ACSStringPool::FindString(const char *str, size_t len, unsigned int h, unsig
 int ACSStringPool::InsertString(FString &str, unsigned int h, unsigned int bucketnum)
 {
 	unsigned int index = FirstFreeEntry;
-	if (index >= MIN_GC_SIZE && index == Pool.Max())
-	{ // We will need to grow the array. Try a garbage collection first.
+	if (index >= MIN_GC_SIZE && index == Pool.Max() && LiveCount >= FullThreshold * 2)
+	{ // We will need to grow the array, and the incremental collector has
+	  // not kept up. Try a full collection right now first.
 		P_CollectACSGlobalStrings();
 		index = FirstFreeEntry;
 	}
@@ -693,7 +973,16 @@ int ACSStringPool::InsertString(FString &str, unsigned int h, unsigned int bucke
 	entry->Hash = h;
 	entry->Next = PoolBuckets[bucketnum];
 	entry->LockCount = 0;
+	// New strings are not collected by a collection that is already running.
+	entry->Mark = State != GCS_Idle ? MarkEpoch : 0;
+	entry->Young = true;
 	PoolBuckets[bucketnum] = index;
+	YoungList.Push(index);
+	LiveCount++;
+	if (!GC::ACSStringsPending && CollectionDue())
+	{
+		GC::ACSStringsPending = true;
+	}
 	return index | STRPOOL_LIBRARYID_OR;
 }
 
@@ -736,6 +1025,8 @@ void ACSStringPool::ReadStrings(FSerializer &file, const char *key)
 		{
 			p.Next = FREE_ENTRY;
 			p.LockCount = 0;
+			p.Mark = 0;
+			p.Young = false;
 		}
 		if (file.BeginArray("pool"))
 		{
@@ -750,6 +1041,9 @@ void ACSStringPool::ReadStrings(FSerializer &file, const char *key)
 					{
 						file("string", Pool[ii].Str)
 							("lockcount", Pool[ii].LockCount);
+						// Older versions kept MarkString's mark in here.
+						Pool[ii].LockCount &= 0x7FFFFFFF;
+						LiveCount++;
 
 						unsigned h = SuperFastHash(Pool[ii].Str, Pool[ii].Str.Len());
 						unsigned bucketnum = h % NUM_BUCKETS;
@@ -762,6 +1056,8 @@ void ACSStringPool::ReadStrings(FSerializer &file, const char *key)
 			}
 		}
 	}
+	FindFirstFreeEntry(0);
+	FullThreshold = MAX<unsigned int>(MIN_GC_SIZE, LiveCount * 2);
 }
 
 //============================================================================
@@ -879,6 +1175,171 @@ void P_CollectACSGlobalStrings()
 	GlobalACSStrings.PurgeStrings();
 }
 
+//============================================================================
+//
+// P_MarkACSStringScalars
+//
+// Marks everything but the world, global and map arrays. This is small and
+// is done in one go when a collection's mark phase is finished.
+//
+//============================================================================
+
+static void P_MarkACSStringScalars()
+{
+	for (FACSStack *stack = FACSStack::head; stack != NULL; stack = stack->next)
+	{
+		GlobalACSStrings.MarkStringArray(stack->buffer, stack->sp);
+	}
+	FBehavior::StaticMarkLevelVarStrings(false);
+	GlobalACSStrings.MarkStringArray(ACS_WorldVars, countof(ACS_WorldVars));
+	GlobalACSStrings.MarkStringArray(ACS_GlobalVars, countof(ACS_GlobalVars));
+}
+
+//============================================================================
+//
+// P_MarkACSStringArrays
+//
+// The incremental part of a full collection's mark phase. Goes through the
+// world and global arrays one array at a time (they are hash maps that can
+// be rehashed between steps) and the map arrays in pieces. Returns true
+// when everything has been looked at.
+//
+//============================================================================
+
+static bool P_MarkACSStringArrays(size_t &work, size_t budget)
+{
+	while (work < budget)
+	{
+		if (StringGC.Unit < NUM_WORLDVARS)
+		{
+			GlobalACSStrings.MarkStringMap(ACS_WorldArrays[StringGC.Unit]);
+			work += ACS_WorldArrays[StringGC.Unit].CountUsed() + 1;
+			StringGC.Unit++;
+		}
+		else if (StringGC.Unit < NUM_WORLDVARS + NUM_GLOBALVARS)
+		{
+			GlobalACSStrings.MarkStringMap(ACS_GlobalArrays[StringGC.Unit - NUM_WORLDVARS]);
+			work += ACS_GlobalArrays[StringGC.Unit - NUM_WORLDVARS].CountUsed() + 1;
+			StringGC.Unit++;
+		}
+		else
+		{
+			FBehavior *module = FBehavior::StaticGetModule(StringGC.Module);
+			if (module == NULL)
+			{
+				return true;
+			}
+			unsigned int size;
+			const SDWORD *elements = module->GetMapArray(StringGC.Array, size);
+			if (elements == NULL)
+			{
+				StringGC.Module++;
+				StringGC.Array = 0;
+				StringGC.Pos = 0;
+				continue;
+			}
+			unsigned int count = (unsigned int)MIN<size_t>(size - StringGC.Pos, budget - work);
+			GlobalACSStrings.MarkStringArray(elements + StringGC.Pos, count);
+			StringGC.Pos += count;
+			work += count + 1;
+			if (StringGC.Pos >= size)
+			{
+				StringGC.Array++;
+				StringGC.Pos = 0;
+			}
+		}
+	}
+	return false;
+}
+
+//============================================================================
+//
+// P_StepACSStrings
+//
+// Called by the object garbage collector's steps to do a bounded amount of
+// work on the string pool. How much is done per tic is capped separately,
+// so a busy object heap cannot turn this into a pause.
+//
+//============================================================================
+
+void P_StepACSStrings(size_t budget)
+{
+	if (StringGC.Tic != gametic)
+	{
+		StringGC.Tic = gametic;
+		StringGC.TicWork = 0;
+	}
+	// The stacks of running scripts are not stable enough to look at.
+	if (FACSStack::head != NULL || StringGC.TicWork >= STRGC_TICWORK)
+	{
+		return;
+	}
+	budget = MIN<size_t>(budget, STRGC_TICWORK - StringGC.TicWork);
+
+	cycle_t clock;
+	size_t work = 0;
+
+	clock.Reset();
+	clock.Clock();
+	if (GlobalACSStrings.GetGCState() == ACSStringPool::GCS_Idle && GlobalACSStrings.CollectionDue())
+	{
+		bool full = GlobalACSStrings.FullCollectionDue();
+		GlobalACSStrings.BeginCollection(full);
+		StringGC.Unit = StringGC.Module = StringGC.Array = StringGC.Pos = 0;
+		if (full)
+		{
+			StringGC.NumFull++;
+		}
+		else
+		{ // Minor collections only need the roots that are not arrays.
+			StringGC.NumMinor++;
+			P_MarkACSStringScalars();
+			GlobalACSStrings.FinishMarking();
+		}
+	}
+	while (work < budget)
+	{
+		ACSStringPool::EGCState state = GlobalACSStrings.GetGCState();
+		if (state == ACSStringPool::GCS_Mark)
+		{
+			if (P_MarkACSStringArrays(work, budget))
+			{
+				P_MarkACSStringScalars();
+				GlobalACSStrings.FinishMarking();
+			}
+		}
+		else if (state == ACSStringPool::GCS_Sweep)
+		{
+			GlobalACSStrings.SweepStep(work, budget);
+		}
+		else
+		{
+			break;
+		}
+	}
+	clock.Unclock();
+
+	StringGC.TicWork += work;
+	if (work > 0)
+	{
+		StringGC.LastPause = clock.TimeMS();
+		StringGC.MaxPause = MAX(StringGC.MaxPause, StringGC.LastPause);
+	}
+	GC::ACSStringsPending = GlobalACSStrings.GetGCState() != ACSStringPool::GCS_Idle || GlobalACSStrings.CollectionDue();
+}
+
+ADD_STAT(acsstrings)
+{
+	static const char *const statenames[] = { "idle", "mark", "sweep" };
+	FString out;
+	out.Format("Strings: %u live, %u young, pool %u  [%s%s]  minor %u, full %u  pause %.3f ms (max %.3f)",
+		GlobalACSStrings.GetLiveCount(), GlobalACSStrings.GetYoungCount(), GlobalACSStrings.GetPoolSize(),
+		GlobalACSStrings.GetGCState() != ACSStringPool::GCS_Idle && GlobalACSStrings.IsFullCollection() ? "full " : "",
+		statenames[GlobalACSStrings.GetGCState()], StringGC.NumMinor, StringGC.NumFull,
+		StringGC.LastPause, StringGC.MaxPause);
+	return out;
+}
+
 #ifdef _DEBUG
 CCMD(acsgc)
 {
@@ -898,7 +1359,7 @@ CCMD(globstr)
 //
 //============================================================================
 
-static FString ScriptPresentation(int script)
+FString ScriptPresentation(int script)
 {
 	FString out = "script ";
 
@@ -1495,6 +1956,7 @@ FBehavior *FBehavior::StaticLoadModule (int lumpnum, FileReader *fr, int len)
 	}
 
 	FBehavior * behavior = new FBehavior ();
+	GlobalACSStrings.AbortMarking();
 	if (behavior->Init(lumpnum, fr, len))
 	{
 		return behavior;
@@ -1526,6 +1988,7 @@ void FBehavior::StaticUnloadModules ()
 		delete StaticModules[i];
 	}
 	StaticModules.Clear ();
+	GlobalACSStrings.AbortMarking();
 }
 
 FBehavior *FBehavior::StaticGetModule (int lib)
@@ -1537,12 +2000,12 @@ FBehavior *FBehavior::StaticGetModule (int lib)
 	return StaticModules[lib];
 }
 
-void FBehavior::StaticMarkLevelVarStrings()
+void FBehavior::StaticMarkLevelVarStrings(bool arrays)
 {
 	// Mark map variables.
 	for (DWORD modnum = 0; modnum < StaticModules.Size(); ++modnum)
 	{
-		StaticModules[modnum]->MarkMapVarStrings();
+		StaticModules[modnum]->MarkMapVarStrings(arrays);
 	}
 	// Mark running scripts' local variables.
 	if (DACSThinker::ActiveThinker != NULL)
@@ -1588,10 +2051,10 @@ void FBehavior::StaticUnlockLevelVarStrings()
 	}
 }
 
-void FBehavior::MarkMapVarStrings() const
+void FBehavior::MarkMapVarStrings(bool arrays) const
 {
 	GlobalACSStrings.MarkStringArray(MapVarStore, NUM_MAPVARS);
-	for (int i = 0; i < NumArrays; ++i)
+	for (int i = 0; arrays && i < NumArrays; ++i)
 	{
 		GlobalACSStrings.MarkStringArray(ArrayStore[i].Elements, ArrayStore[i].ArraySize);
 	}
@@ -2224,6 +2687,8 @@ bool FBehavior::Init(int lumpnum, FileReader * fr, int len)
 		}
 	}
 
+	DecodeCode ();
+
 	DPrintf (DMSG_NOTIFY, "Loaded %d scripts, %d functions\n", NumScripts, NumFunctions);
 	return true;
 }
@@ -2263,6 +2728,7 @@ FBehavior::~FBehavior ()
 		delete[] FunctionProfileData;
 		FunctionProfileData = NULL;
 	}
+	FreeCompiledFunctions ();
 	if (Data != NULL)
 	{
 		delete[] Data;
@@ -2270,6 +2736,378 @@ FBehavior::~FBehavior ()
 	}
 }
 
+//==========================================================================
+//
+// DLevelScript :: PCodeOperands
+//
+// Describes the operands an instruction reads from the code stream:
+//   B  a byte in little-endian ACSe, otherwise a word (NEXTBYTE)
+//   S  a short in little-endian ACSe, otherwise a word (NEXTSHORT)
+//   W  a word
+//   J  a word holding the offset of a jump target
+//   b  a byte in every format
+// PCD_PUSHBYTES and PCD_CASEGOTOSORTED are variable length and are
+// handled by the decoder itself.
+//
+//==========================================================================
+
+const char *DLevelScript::PCodeOperands (int pcd)
+{
+	switch (pcd)
+	{
+	case PCD_LSPEC1:				case PCD_LSPEC2:
+	case PCD_LSPEC3:				case PCD_LSPEC4:
+	case PCD_LSPEC5:				case PCD_LSPEC5RESULT:
+	case PCD_PUSHFUNCTION:
+	case PCD_CALL:					case PCD_CALLDISCARD:
+	case PCD_ASSIGNSCRIPTVAR:		case PCD_ASSIGNMAPVAR:		case PCD_ASSIGNWORLDVAR:	case PCD_ASSIGNGLOBALVAR:
+	case PCD_ASSIGNSCRIPTARRAY:		case PCD_ASSIGNMAPARRAY:	case PCD_ASSIGNWORLDARRAY:	case PCD_ASSIGNGLOBALARRAY:
+	case PCD_PUSHSCRIPTVAR:			case PCD_PUSHMAPVAR:		case PCD_PUSHWORLDVAR:		case PCD_PUSHGLOBALVAR:
+	case PCD_PUSHSCRIPTARRAY:		case PCD_PUSHMAPARRAY:		case PCD_PUSHWORLDARRAY:	case PCD_PUSHGLOBALARRAY:
+	case PCD_ADDSCRIPTVAR:			case PCD_ADDMAPVAR:			case PCD_ADDWORLDVAR:		case PCD_ADDGLOBALVAR:
+	case PCD_ADDSCRIPTARRAY:		case PCD_ADDMAPARRAY:		case PCD_ADDWORLDARRAY:		case PCD_ADDGLOBALARRAY:
+	case PCD_SUBSCRIPTVAR:			case PCD_SUBMAPVAR:			case PCD_SUBWORLDVAR:		case PCD_SUBGLOBALVAR:
+	case PCD_SUBSCRIPTARRAY:		case PCD_SUBMAPARRAY:		case PCD_SUBWORLDARRAY:		case PCD_SUBGLOBALARRAY:
+	case PCD_MULSCRIPTVAR:			case PCD_MULMAPVAR:			case PCD_MULWORLDVAR:		case PCD_MULGLOBALVAR:
+	case PCD_MULSCRIPTARRAY:		case PCD_MULMAPARRAY:		case PCD_MULWORLDARRAY:		case PCD_MULGLOBALARRAY:
+	case PCD_DIVSCRIPTVAR:			case PCD_DIVMAPVAR:			case PCD_DIVWORLDVAR:		case PCD_DIVGLOBALVAR:
+	case PCD_DIVSCRIPTARRAY:		case PCD_DIVMAPARRAY:		case PCD_DIVWORLDARRAY:		case PCD_DIVGLOBALARRAY:
+	case PCD_MODSCRIPTVAR:			case PCD_MODMAPVAR:			case PCD_MODWORLDVAR:		case PCD_MODGLOBALVAR:
+	case PCD_MODSCRIPTARRAY:		case PCD_MODMAPARRAY:		case PCD_MODWORLDARRAY:		case PCD_MODGLOBALARRAY:
+	case PCD_ANDSCRIPTVAR:			case PCD_ANDMAPVAR:			case PCD_ANDWORLDVAR:		case PCD_ANDGLOBALVAR:
+	case PCD_ANDSCRIPTARRAY:		case PCD_ANDMAPARRAY:		case PCD_ANDWORLDARRAY:		case PCD_ANDGLOBALARRAY:
+	case PCD_EORSCRIPTVAR:			case PCD_EORMAPVAR:			case PCD_EORWORLDVAR:		case PCD_EORGLOBALVAR:
+	case PCD_EORSCRIPTARRAY:		case PCD_EORMAPARRAY:		case PCD_EORWORLDARRAY:		case PCD_EORGLOBALARRAY:
+	case PCD_ORSCRIPTVAR:			case PCD_ORMAPVAR:			case PCD_ORWORLDVAR:		case PCD_ORGLOBALVAR:
+	case PCD_ORSCRIPTARRAY:			case PCD_ORMAPARRAY:		case PCD_ORWORLDARRAY:		case PCD_ORGLOBALARRAY:
+	case PCD_LSSCRIPTVAR:			case PCD_LSMAPVAR:			case PCD_LSWORLDVAR:		case PCD_LSGLOBALVAR:
+	case PCD_LSSCRIPTARRAY:			case PCD_LSMAPARRAY:		case PCD_LSWORLDARRAY:		case PCD_LSGLOBALARRAY:
+	case PCD_RSSCRIPTVAR:			case PCD_RSMAPVAR:			case PCD_RSWORLDVAR:		case PCD_RSGLOBALVAR:
+	case PCD_RSSCRIPTARRAY:			case PCD_RSMAPARRAY:		case PCD_RSWORLDARRAY:		case PCD_RSGLOBALARRAY:
+	case PCD_INCSCRIPTVAR:			case PCD_INCMAPVAR:			case PCD_INCWORLDVAR:		case PCD_INCGLOBALVAR:
+	case PCD_INCSCRIPTARRAY:		case PCD_INCMAPARRAY:		case PCD_INCWORLDARRAY:		case PCD_INCGLOBALARRAY:
+	case PCD_DECSCRIPTVAR:			case PCD_DECMAPVAR:			case PCD_DECWORLDVAR:		case PCD_DECGLOBALVAR:
+	case PCD_DECSCRIPTARRAY:		case PCD_DECMAPARRAY:		case PCD_DECWORLDARRAY:		case PCD_DECGLOBALARRAY:
+		return "B";
+
+	case PCD_LSPEC1DIRECT:			return "BW";
+	case PCD_LSPEC2DIRECT:			return "BWW";
+	case PCD_LSPEC3DIRECT:			return "BWWW";
+	case PCD_LSPEC4DIRECT:			return "BWWWW";
+	case PCD_LSPEC5DIRECT:			return "BWWWWW";
+	case PCD_CALLFUNC:				return "BS";
+
+	case PCD_PUSHNUMBER:
+	case PCD_LSPEC5EX:				case PCD_LSPEC5EXRESULT:
+	case PCD_DELAYDIRECT:
+	case PCD_TAGWAITDIRECT:			case PCD_POLYWAITDIRECT:	case PCD_SCRIPTWAITDIRECT:
+	case PCD_SETFONTDIRECT:			case PCD_SETGRAVITYDIRECT:	case PCD_SETAIRCONTROLDIRECT:
+	case PCD_CHECKINVENTORYDIRECT:
+		return "W";
+
+	case PCD_RANDOMDIRECT:			case PCD_THINGCOUNTDIRECT:
+	case PCD_CHANGEFLOORDIRECT:		case PCD_CHANGECEILINGDIRECT:
+	case PCD_GIVEINVENTORYDIRECT:	case PCD_TAKEINVENTORYDIRECT:
+		return "WW";
+
+	case PCD_SETMUSICDIRECT:		case PCD_LOCALSETMUSICDIRECT:
+	case PCD_CONSOLECOMMANDDIRECT:
+		return "WWW";
+
+	case PCD_SPAWNSPOTDIRECT:		return "WWWW";
+	case PCD_SPAWNDIRECT:			return "WWWWWW";
+
+	case PCD_GOTO:					case PCD_IFGOTO:			case PCD_IFNOTGOTO:
+		return "J";
+	case PCD_CASEGOTO:				return "WJ";
+
+	case PCD_PUSHBYTE:				case PCD_DELAYDIRECTB:
+		return "b";
+	case PCD_PUSH2BYTES:			case PCD_LSPEC1DIRECTB:		case PCD_RANDOMDIRECTB:
+		return "bb";
+	case PCD_PUSH3BYTES:			case PCD_LSPEC2DIRECTB:		return "bbb";
+	case PCD_PUSH4BYTES:			case PCD_LSPEC3DIRECTB:		return "bbbb";
+	case PCD_PUSH5BYTES:			case PCD_LSPEC4DIRECTB:		return "bbbbb";
+	case PCD_LSPEC5DIRECTB:			return "bbbbbb";
+
+	default:
+		return "";
+	}
+}
+
+//==========================================================================
+//
+// FACSCodeReader
+//
+// Bounds checked reads from a module's code in its on-disk format.
+//
+//==========================================================================
+
+struct FACSCodeReader
+{
+	const BYTE *Data;
+	DWORD Size;
+	DWORD Pos;
+	ACSFormat Format;
+	bool Overrun;
+
+	bool Need(DWORD bytes)
+	{
+		if (Pos < Size && Size - Pos >= bytes) return true;
+		Overrun = true;
+		return false;
+	}
+	int Byte()
+	{
+		if (!Need(1)) return 0;
+		return Data[Pos++];
+	}
+	int Short()
+	{
+		if (!Need(2)) return 0;
+		int res = (SWORD)(Data[Pos] | (Data[Pos+1] << 8));
+		Pos += 2;
+		return res;
+	}
+	int Word()
+	{
+		if (!Need(4)) return 0;
+		int res = Data[Pos] | (Data[Pos+1] << 8) | (Data[Pos+2] << 16) | (Data[Pos+3] << 24);
+		Pos += 4;
+		return res;
+	}
+	int Opcode()
+	{
+		if (Format != ACS_LittleEnhanced)
+		{
+			return Word();
+		}
+		int pcd = Byte();
+		if (pcd >= 256-16)
+		{
+			pcd = (256-16) + ((pcd - (256-16)) << 8) + Byte();
+		}
+		return pcd;
+	}
+};
+
+//==========================================================================
+//
+// FBehavior :: DecodeCode
+//
+// Translates the module's code into the form RunScript executes: every
+// opcode and operand gets an int of its own, so nothing needs to know the
+// module's format or deal with unaligned data anymore, and jumps go
+// straight to their target without converting offsets.
+//
+// The code is followed from every script, function and jump point, so
+// data mixed in with the code is never touched. Code that runs into
+// something that has already been decoded gets an extra PCD_GOTO to it.
+//
+//==========================================================================
+
+void FBehavior::DecodeCode ()
+{
+	struct JumpFixup
+	{
+		unsigned int Slot;
+		DWORD Target;
+	};
+	TArray<JumpFixup> fixups;
+	TArray<DWORD> pending;
+	FACSCodeReader reader = { Data, (DWORD)DataSize, 0, Format, false };
+	int i;
+
+	Code.Clear();
+	CodeMap.Clear();
+	InstrIndex.Clear();
+	InstrOffset.Clear();
+
+	Code.Push(DLevelScript::PCD_TERMINATE);
+	InstrIndex.Push(0);
+	InstrOffset.Push(0);
+
+	for (i = 0; i < NumScripts; ++i)
+	{
+		pending.Push(Scripts[i].Address);
+	}
+	for (i = 0; i < NumFunctions; ++i)
+	{
+		if (Functions[i].ImportNum == 0 && Functions[i].Address != 0)
+		{
+			pending.Push(Functions[i].Address);
+		}
+	}
+	for (i = 0; i < (int)JumpPoints.Size(); ++i)
+	{
+		pending.Push(JumpPoints[i]);
+	}
+
+	DWORD start;
+	while (pending.Pop(start))
+	{
+		bool fallthrough = false;
+		reader.Pos = start;
+
+		for (;;)
+		{
+			DWORD ofs = reader.Pos;
+			int *known = CodeMap.CheckKey(ofs);
+			if (known != NULL)
+			{
+				if (fallthrough)
+				{
+					InstrIndex.Push(Code.Size());
+					InstrOffset.Push(ofs);
+					Code.Push(DLevelScript::PCD_GOTO);
+					Code.Push(*known);
+				}
+				break;
+			}
+
+			unsigned int index = Code.Size();
+			unsigned int numfixups = fixups.Size();
+			CodeMap[ofs] = index;
+			InstrIndex.Push(index);
+			InstrOffset.Push(ofs);
+
+			int pcd = reader.Opcode();
+			Code.Push(pcd);
+
+			if (pcd == DLevelScript::PCD_PUSHBYTES)
+			{
+				int count = reader.Byte();
+				Code.Push(count);
+				while (count-- > 0)
+				{
+					Code.Push(reader.Byte());
+				}
+			}
+			else if (pcd == DLevelScript::PCD_CASEGOTOSORTED)
+			{
+				// The count and jump table are 4-byte aligned
+				reader.Pos = (reader.Pos + 3) & ~3;
+				int numcases = reader.Word();
+				if (reader.Overrun || (unsigned)numcases > (reader.Size - reader.Pos) / 8)
+				{
+					reader.Overrun = true;
+				}
+				else
+				{
+					Code.Push(numcases);
+					while (numcases-- > 0)
+					{
+						Code.Push(reader.Word());
+						JumpFixup fixup = { Code.Push(0), (DWORD)reader.Word() };
+						fixups.Push(fixup);
+					}
+				}
+			}
+			else
+			{
+				for (const char *op = DLevelScript::PCodeOperands(pcd); *op != 0; ++op)
+				{
+					switch (*op)
+					{
+					case 'B':	Code.Push(Format == ACS_LittleEnhanced ? reader.Byte() : reader.Word());	break;
+					case 'S':	Code.Push(Format == ACS_LittleEnhanced ? reader.Short() : reader.Word());	break;
+					case 'W':	Code.Push(reader.Word());	break;
+					case 'b':	Code.Push(reader.Byte());	break;
+					case 'J':
+						{
+							JumpFixup fixup = { Code.Push(0), (DWORD)reader.Word() };
+							fixups.Push(fixup);
+						}
+						break;
+					}
+				}
+			}
+
+			if (reader.Overrun)
+			{
+				// Ran off the end of the lump; this instruction becomes
+				// a PCD_TERMINATE instead.
+				Code.Resize(index);
+				fixups.Resize(numfixups);
+				Code.Push(DLevelScript::PCD_TERMINATE);
+				reader.Overrun = false;
+				break;
+			}
+			for (unsigned int j = numfixups; j < fixups.Size(); ++j)
+			{
+				pending.Push(fixups[j].Target);
+			}
+			if (pcd < 0 || pcd >= DLevelScript::PCODE_COMMAND_COUNT ||
+				pcd == DLevelScript::PCD_TERMINATE || pcd == DLevelScript::PCD_RESTART ||
+				pcd == DLevelScript::PCD_GOTO || pcd == DLevelScript::PCD_GOTOSTACK ||
+				pcd == DLevelScript::PCD_RETURNVOID || pcd == DLevelScript::PCD_RETURNVAL)
+			{ // Execution never continues with the next instruction.
+				break;
+			}
+			fallthrough = true;
+		}
+	}
+
+	for (unsigned int j = 0; j < fixups.Size(); ++j)
+	{
+		int *target = CodeMap.CheckKey(fixups[j].Target);
+		Code[fixups[j].Slot] = target != NULL ? *target : 0;
+	}
+	for (unsigned int j = 0; j < JumpPoints.Size(); ++j)
+	{
+		JumpPoints[j] = *CodeMap.CheckKey(JumpPoints[j]);
+	}
+	FunctionCode.Resize(NumFunctions);
+	for (i = 0; i < NumFunctions; ++i)
+	{
+		int *entry = Functions[i].ImportNum == 0 ? CodeMap.CheckKey(Functions[i].Address) : NULL;
+		FunctionCode[i] = entry != NULL ? *entry : 0;
+	}
+	Code.ShrinkToFit();
+}
+
+//==========================================================================
+//
+// FBehavior :: Ofs2PC
+//
+// Finds the decoded instruction that started at the given lump offset.
+//
+//==========================================================================
+
+int *FBehavior::Ofs2PC (DWORD ofs) const
+{
+	const int *index = CodeMap.CheckKey(ofs);
+	return Index2PC(index != NULL ? *index : 0);
+}
+
+//==========================================================================
+//
+// FBehavior :: PC2Ofs
+//
+// The reverse of Ofs2PC. pc must point to the start of an instruction.
+//
+//==========================================================================
+
+DWORD FBehavior::PC2Ofs (int *pc) const
+{
+	int index = int(pc - &Code[0]);
+	unsigned int min = 0, max = InstrIndex.Size() - 1;
+
+	while (min < max)
+	{
+		unsigned int mid = (min + max + 1) / 2;
+		if (InstrIndex[mid] <= index)
+		{
+			min = mid;
+		}
+		else
+		{
+			max = mid - 1;
+		}
+	}
+	return InstrOffset[min];
+}
+
 void FBehavior::LoadScriptsDirectory ()
 {
 	union
@@ -2702,6 +3540,26 @@ void FBehavior::SetArrayVal (int arraynum, int index, int value)
 	if ((unsigned)index >= (unsigned)array->ArraySize)
 		return;
 	array->Elements[index] = value;
+	GlobalACSStrings.WriteBarrier(value);
+}
+
+//============================================================================
+//
+// FBehavior :: GetMapArray
+//
+// Returns the elements of one of this module's own arrays, or NULL if
+// there are no more.
+//
+//============================================================================
+
+const SDWORD *FBehavior::GetMapArray (int arraynum, unsigned int &size) const
+{
+	if ((unsigned)arraynum >= (unsigned)NumArrays)
+	{
+		return NULL;
+	}
+	size = ArrayStore[arraynum].ArraySize;
+	return ArrayStore[arraynum].Elements;
 }
 
 inline bool FBehavior::CopyStringToArray(int arraynum, int index, int maxLength, const char *string)
@@ -2961,7 +3819,10 @@ void DACSThinker::Tick ()
 	while (script)
 	{
 		DLevelScript *next = script->next;
-		script->RunScript ();
+		if (script->WaitQueue < 0)
+		{
+			script->RunScript ();
+		}
 		script = next;
 	}
 
@@ -3048,6 +3909,8 @@ void DLevelScript::Serialize(FSerializer &arc)
 DLevelScript::DLevelScript ()
 {
 	next = prev = NULL;
+	WaitQueue = -1;
+	NextWaiting = NULL;
 	if (DACSThinker::ActiveThinker == NULL)
 		new DACSThinker;
 	activefont = SmallFont;
@@ -3099,7 +3962,136 @@ void DLevelScript::Link ()
 	GC::WriteBarrier(controller, this);
 	if (controller->LastScript == NULL)
 	{
-		controller->LastScript = this;
+		controller->LastScript = this;
+	}
+}
+
+//==========================================================================
+//
+// DLevelScript :: Sleep
+//
+// Stops DACSThinker::Tick from running this script until whatever it is
+// waiting for (given by statedata) wakes it up. The script then checks
+// again at its usual place in the list, so the order scripts run in is
+// the same as if they had checked every tic.
+//
+//==========================================================================
+
+void DLevelScript::Sleep (int queue)
+{
+	TMap<int, DLevelScript *> &waiters = DACSThinker::ActiveThinker->WaitQueues[queue];
+
+	WakeUp ();
+	DLevelScript **head = waiters.CheckKey(statedata);
+	NextWaiting = head != NULL ? *head : NULL;
+	waiters[statedata] = this;
+	WaitQueue = queue;
+}
+
+//==========================================================================
+//
+// DLevelScript :: WakeUp
+//
+//==========================================================================
+
+void DLevelScript::WakeUp ()
+{
+	DACSThinker *controller = DACSThinker::ActiveThinker;
+
+	if (WaitQueue < 0)
+	{
+		return;
+	}
+	if (controller != NULL)
+	{
+		TMap<int, DLevelScript *> &queue = controller->WaitQueues[WaitQueue];
+		DLevelScript **link = queue.CheckKey(statedata);
+
+		while (link != NULL && *link != NULL)
+		{
+			if (*link == this)
+			{
+				*link = NextWaiting;
+				break;
+			}
+			link = &(*link)->NextWaiting;
+		}
+		if ((link = queue.CheckKey(statedata)) != NULL && *link == NULL)
+		{
+			queue.Remove(statedata);
+		}
+	}
+	WaitQueue = -1;
+	NextWaiting = NULL;
+}
+
+//==========================================================================
+//
+// DACSThinker :: WakeScripts
+//
+// Wakes every script in the queue that is waiting for key.
+//
+//==========================================================================
+
+void DACSThinker::WakeScripts (int queue, int key)
+{
+	DLevelScript **head = WaitQueues[queue].CheckKey(key);
+
+	if (head != NULL)
+	{
+		DLevelScript *script = *head;
+		WaitQueues[queue].Remove(key);
+		while (script != NULL)
+		{
+			DLevelScript *next = script->NextWaiting;
+			script->WaitQueue = -1;
+			script->NextWaiting = NULL;
+			script = next;
+		}
+	}
+}
+
+//==========================================================================
+//
+// P_WakeACSTagWaiters
+//
+// Called when a sector effect goes away, which may leave the sector idle.
+//
+//==========================================================================
+
+void P_WakeACSTagWaiters (sector_t *sector)
+{
+	static TArray<int> tags;
+	DACSThinker *controller = DACSThinker::ActiveThinker;
+
+	if (controller == NULL || !controller->HasSleepers(DACSThinker::WAIT_Tag))
+	{
+		return;
+	}
+	tagManager.GetSectorTags(sector, tags);
+	if (tags.Size() == 0)
+	{ // Waiting for tag 0 waits for untagged sectors.
+		tags.Push(0);
+	}
+	for (unsigned int i = 0; i < tags.Size(); ++i)
+	{
+		controller->WakeScripts(DACSThinker::WAIT_Tag, tags[i]);
+	}
+}
+
+//==========================================================================
+//
+// P_WakeACSPolyWaiters
+//
+//==========================================================================
+
+void P_WakeACSPolyWaiters (int polynum)
+{
+	DACSThinker *controller = DACSThinker::ActiveThinker;
+
+	if (controller != NULL)
+	{
+		controller->WakeScripts(DACSThinker::WAIT_Poly, polynum);
 	}
 }
 
@@ -6063,28 +7055,32 @@ enum
 };
 
 
-#define NEXTWORD	(LittleLong(*pc++))
-#define NEXTBYTE	(fmt==ACS_LittleEnhanced?getbyte(pc):NEXTWORD)
-#define NEXTSHORT	(fmt==ACS_LittleEnhanced?getshort(pc):NEXTWORD)
+// The code has been decoded by FBehavior::DecodeCode, so every operand
+// takes up a whole int regardless of the module's format.
+#define NEXTWORD	(*pc++)
+#define NEXTBYTE	(*pc++)
+#define NEXTSHORT	(*pc++)
+#define ACS_RUNAWAY_LIMIT	2000000
+
+// The decoded p-codes are dispatched through a table of labels where the
+// compiler supports that. Instructions that cannot end the script's run
+// then go straight to the next one instead of back through the loop.
+#if !defined(ACS_COMPGOTO) && defined(__GNUC__)
+#define ACS_COMPGOTO 1
+#endif
+
+#if ACS_COMPGOTO
+#define ACSOP(x)	case PCD_##x: acsop_##x
+#define NEXTOP		if (runaway < ACS_RUNAWAY_LIMIT && !profiling) { runaway++; pcd = NEXTWORD; goto *ops[pcd]; } break
+#else
+#define ACSOP(x)	case PCD_##x
+#define NEXTOP		break
+#endif
 #define STACK(a)	(Stack[sp - (a)])
 #define PushToStack(a)	(Stack[sp++] = (a))
 // Direct instructions that take strings need to have the tag applied.
 #define TAGSTR(a)	(a|activeBehavior->GetLibraryID())
 
-inline int getbyte (int *&pc)
-{
-	int res = *(BYTE *)pc;
-	pc = (int *)((BYTE *)pc+1);
-	return res;
-}
-
-inline int getshort (int *&pc)
-{
-	int res = LittleShort( *(SWORD *)pc);
-	pc = (int *)((BYTE *)pc+2);
-	return res;
-}
-
 static bool CharArrayParms(int &capacity, int &offset, int &a, int *Stack, int &sp, bool ranged)
 {
 	if (ranged)
@@ -6131,6 +7127,50 @@ static void SetMarineSprite(AActor *marine, PClassActor *source)
 	}
 }
 
+// Totals over every script run, for acsprofile. Scripts can run other
+// scripts from inside RunScript, so only the outermost run is timed.
+static ACSProfileInfo ACSTotalProfile;
+static cycle_t ACSTotalCycles;
+static int ACSRunDepth;
+
+//==========================================================================
+//
+// ACS_ProfileSample
+//
+// Hands the function or script that is running to the script profiler.
+// ACS has no line numbers, so the position is the offset in the module.
+//
+//==========================================================================
+
+static void ACS_ProfileSample(FBehavior *module, int script, ScriptFunction *func, int *pc)
+{
+	FString name, line;
+	const void *id;
+
+	if (func != NULL)
+	{
+		name.Format("%s: %s", module->GetModuleName(), module->GetFunctionName(module->GetFunctionIndex(func)).GetChars());
+		id = func;
+	}
+	else
+	{
+		name.Format("%s: %s", module->GetModuleName(), ScriptPresentation(script).GetChars());
+		id = module->FindScript(script);
+	}
+	line.Format("%s+%u (%s)", module->GetModuleName(), module->PC2Ofs(pc), name.GetChars());
+	VMProfileSample(id, name, line);
+}
+
+// Functions and scripts that only compute things are run as VM code once
+// they have been translated (see p_acsvm.cpp). acs_vmcompare runs the
+// functions that do not change any variables through the interpreter as
+// well and reports any differences in what they return. Translated
+// scripts are compared tic by tic: the VM's tic is undone before the
+// interpreter runs it, and the two have to leave the script and all
+// variables the same.
+CVAR (Bool, acs_vm, true, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+CVAR (Bool, acs_vmcompare, false, 0)
+
 int DLevelScript::RunScript ()
 {
 	DACSThinker *controller = DACSThinker::ActiveThinker;
@@ -6172,7 +7212,10 @@ int DLevelScript::RunScript ()
 		while ((secnum = it.Next()) >= 0)
 		{
 			if (sectors[secnum].floordata || sectors[secnum].ceilingdata)
+			{
+				Sleep (DACSThinker::WAIT_Tag);
 				return resultValue;
+			}
 		}
 
 		// If we got here, none of the tagged sectors were busy
@@ -6186,18 +7229,27 @@ int DLevelScript::RunScript ()
 		{
 			state = SCRIPT_Running;
 		}
+		else
+		{
+			Sleep (DACSThinker::WAIT_Poly);
+		}
 		break;
 
 	case SCRIPT_ScriptWaitPre:
 		// Wait for a script to start running, then enter state scriptwait
 		if (controller->RunningScripts.CheckKey(statedata) != NULL)
 			state = SCRIPT_ScriptWait;
+		else
+			Sleep (DACSThinker::WAIT_Script);
 		break;
 
 	case SCRIPT_ScriptWait:
 		// Wait for a script to stop running, then enter state running
 		if (controller->RunningScripts.CheckKey(statedata) != NULL)
+		{
+			Sleep (DACSThinker::WAIT_Script);
 			return resultValue;
+		}
 
 		state = SCRIPT_Running;
 		PutFirst ();
@@ -6221,127 +7273,166 @@ int DLevelScript::RunScript ()
 	int optstart = -1;
 	int temp;
 
+#if ACS_COMPGOTO
+	static const void * const ops[PCODE_COMMAND_COUNT] =
+	{
+#define xx(op) &&acsop_##op,
+#include "p_acsops.h"
+	};
+#endif
+
+	if (ACSRunDepth++ == 0)
+	{
+		ACSTotalCycles.Clock();
+	}
+	bool profiling = VMProfiling;
+	if (profiling)
+	{
+		VMProfileEnter();
+	}
+
+	// A translated script never leaves the VM while it is still running,
+	// so this skips the loop below unless the VM's tic is to be compared.
+	VMScriptFunction *vmscript = state == SCRIPT_Running && acs_vm ? GetCompiledScript(pc) : NULL;
+	bool comparevm = vmscript != NULL && acs_vmcompare;
+	FACSVMTic vmtic;
+	if (comparevm)
+	{
+		StartVMCompare(vmscript, pc, vmtic);
+	}
+	else if (vmscript != NULL)
+	{
+		RunCompiledScript(vmscript, pc);
+	}
+
 	while (state == SCRIPT_Running)
 	{
-		if (++runaway > 2000000)
+		if (++runaway > ACS_RUNAWAY_LIMIT)
 		{
 			Printf ("Runaway %s terminated\n", ScriptPresentation(script).GetChars());
 			state = SCRIPT_PleaseRemove;
 			break;
 		}
-
-		if (fmt == ACS_LittleEnhanced)
-		{
-			pcd = getbyte(pc);
-			if (pcd >= 256-16)
-			{
-				pcd = (256-16) + ((pcd - (256-16)) << 8) + getbyte(pc);
-			}
-		}
-		else
+		if (profiling && VMProfilePending.load(std::memory_order_relaxed) > 0)
 		{
-			pcd = NEXTWORD;
+			ACS_ProfileSample(activeBehavior, script, activeFunction, pc);
 		}
 
+		pcd = NEXTWORD;
+#if ACS_COMPGOTO
+		// DecodeCode only lets through p-codes that are in the table.
+		goto *ops[pcd];
+#endif
+
 		switch (pcd)
 		{
 		default:
+		// P-codes that nothing implements.
+		ACSOP(PLAYERBLUESKULL): ACSOP(PLAYERREDSKULL): ACSOP(PLAYERYELLOWSKULL):
+		ACSOP(PLAYERMASTERSKULL): ACSOP(PLAYERBLUECARD): ACSOP(PLAYERREDCARD):
+		ACSOP(PLAYERYELLOWCARD): ACSOP(PLAYERMASTERCARD): ACSOP(PLAYERBLACKSKULL):
+		ACSOP(PLAYERSILVERSKULL): ACSOP(PLAYERGOLDSKULL): ACSOP(PLAYERBLACKCARD):
+		ACSOP(PLAYERSILVERCARD): ACSOP(PLAYEREXPERT): ACSOP(BLUETEAMCOUNT):
+		ACSOP(REDTEAMCOUNT): ACSOP(BLUETEAMSCORE): ACSOP(REDTEAMSCORE):
+		ACSOP(ISONEFLAGCTF): ACSOP(LSPEC6): ACSOP(LSPEC6DIRECT):
+		ACSOP(SETSTYLE): ACSOP(SETSTYLEDIRECT): ACSOP(WRITETOINI):
+		ACSOP(GETFROMINI): ACSOP(GRABINPUT): ACSOP(SETMOUSEPOINTER):
+		ACSOP(MOVEMOUSEPOINTER):
 			Printf ("Unknown P-Code %d in %s\n", pcd, ScriptPresentation(script).GetChars());
 			activeBehavior = savedActiveBehavior;
 			// fall through
-		case PCD_TERMINATE:
+		ACSOP(TERMINATE):
 			DPrintf (DMSG_NOTIFY, "%s finished\n", ScriptPresentation(script).GetChars());
 			state = SCRIPT_PleaseRemove;
 			break;
 
-		case PCD_NOP:
-			break;
+		ACSOP(NOP):
+			NEXTOP;
 
-		case PCD_SUSPEND:
+		ACSOP(SUSPEND):
 			state = SCRIPT_Suspended;
 			break;
 
-		case PCD_TAGSTRING:
+		ACSOP(TAGSTRING):
 			//Stack[sp-1] |= activeBehavior->GetLibraryID();
 			Stack[sp-1] = GlobalACSStrings.AddString(activeBehavior->LookupString(Stack[sp-1]));
 			break;
 
-		case PCD_PUSHNUMBER:
-			PushToStack (uallong(pc[0]));
+		ACSOP(PUSHNUMBER):
+			PushToStack (pc[0]);
 			pc++;
-			break;
+			NEXTOP;
 
-		case PCD_PUSHBYTE:
-			PushToStack (*(BYTE *)pc);
-			pc = (int *)((BYTE *)pc + 1);
-			break;
+		ACSOP(PUSHBYTE):
+			PushToStack (*pc);
+			pc += 1;
+			NEXTOP;
 
-		case PCD_PUSH2BYTES:
-			Stack[sp] = ((BYTE *)pc)[0];
-			Stack[sp+1] = ((BYTE *)pc)[1];
+		ACSOP(PUSH2BYTES):
+			Stack[sp] = pc[0];
+			Stack[sp+1] = pc[1];
 			sp += 2;
-			pc = (int *)((BYTE *)pc + 2);
-			break;
+			pc += 2;
+			NEXTOP;
 
-		case PCD_PUSH3BYTES:
-			Stack[sp] = ((BYTE *)pc)[0];
-			Stack[sp+1] = ((BYTE *)pc)[1];
-			Stack[sp+2] = ((BYTE *)pc)[2];
+		ACSOP(PUSH3BYTES):
+			Stack[sp] = pc[0];
+			Stack[sp+1] = pc[1];
+			Stack[sp+2] = pc[2];
 			sp += 3;
-			pc = (int *)((BYTE *)pc + 3);
-			break;
+			pc += 3;
+			NEXTOP;
 
-		case PCD_PUSH4BYTES:
-			Stack[sp] = ((BYTE *)pc)[0];
-			Stack[sp+1] = ((BYTE *)pc)[1];
-			Stack[sp+2] = ((BYTE *)pc)[2];
-			Stack[sp+3] = ((BYTE *)pc)[3];
+		ACSOP(PUSH4BYTES):
+			Stack[sp] = pc[0];
+			Stack[sp+1] = pc[1];
+			Stack[sp+2] = pc[2];
+			Stack[sp+3] = pc[3];
 			sp += 4;
-			pc = (int *)((BYTE *)pc + 4);
-			break;
-
-		case PCD_PUSH5BYTES:
-			Stack[sp] = ((BYTE *)pc)[0];
-			Stack[sp+1] = ((BYTE *)pc)[1];
-			Stack[sp+2] = ((BYTE *)pc)[2];
-			Stack[sp+3] = ((BYTE *)pc)[3];
-			Stack[sp+4] = ((BYTE *)pc)[4];
+			pc += 4;
+			NEXTOP;
+
+		ACSOP(PUSH5BYTES):
+			Stack[sp] = pc[0];
+			Stack[sp+1] = pc[1];
+			Stack[sp+2] = pc[2];
+			Stack[sp+3] = pc[3];
+			Stack[sp+4] = pc[4];
 			sp += 5;
-			pc = (int *)((BYTE *)pc + 5);
-			break;
+			pc += 5;
+			NEXTOP;
 
-		case PCD_PUSHBYTES:
-			temp = *(BYTE *)pc;
-			pc = (int *)((BYTE *)pc + temp + 1);
-			for (temp = -temp; temp; temp++)
+		ACSOP(PUSHBYTES):
+			temp = NEXTBYTE;
+			for (; temp > 0; temp--)
 			{
-				PushToStack (*((BYTE *)pc + temp));
+				PushToStack (NEXTBYTE);
 			}
 			break;
 
-		case PCD_DUP:
+		ACSOP(DUP):
 			Stack[sp] = Stack[sp-1];
 			sp++;
-			break;
+			NEXTOP;
 
-		case PCD_SWAP:
+		ACSOP(SWAP):
 			swapvalues(Stack[sp-2], Stack[sp-1]);
-			break;
+			NEXTOP;
 
-		case PCD_LSPEC1:
+		ACSOP(LSPEC1):
 			P_ExecuteSpecial(NEXTBYTE, activationline, activator, backSide,
 									STACK(1) & specialargmask, 0, 0, 0, 0);
 			sp -= 1;
 			break;
 
-		case PCD_LSPEC2:
+		ACSOP(LSPEC2):
 			P_ExecuteSpecial(NEXTBYTE, activationline, activator, backSide,
 									STACK(2) & specialargmask,
 									STACK(1) & specialargmask, 0, 0, 0);
 			sp -= 2;
 			break;
 
-		case PCD_LSPEC3:
+		ACSOP(LSPEC3):
 			P_ExecuteSpecial(NEXTBYTE, activationline, activator, backSide,
 									STACK(3) & specialargmask,
 									STACK(2) & specialargmask,
@@ -6349,7 +7440,7 @@ int DLevelScript::RunScript ()
 			sp -= 3;
 			break;
 
-		case PCD_LSPEC4:
+		ACSOP(LSPEC4):
 			P_ExecuteSpecial(NEXTBYTE, activationline, activator, backSide,
 									STACK(4) & specialargmask,
 									STACK(3) & specialargmask,
@@ -6358,7 +7449,7 @@ int DLevelScript::RunScript ()
 			sp -= 4;
 			break;
 
-		case PCD_LSPEC5:
+		ACSOP(LSPEC5):
 			P_ExecuteSpecial(NEXTBYTE, activationline, activator, backSide,
 									STACK(5) & specialargmask,
 									STACK(4) & specialargmask,
@@ -6368,7 +7459,7 @@ int DLevelScript::RunScript ()
 			sp -= 5;
 			break;
 
-		case PCD_LSPEC5RESULT:
+		ACSOP(LSPEC5RESULT):
 			STACK(5) = P_ExecuteSpecial(NEXTBYTE, activationline, activator, backSide,
 									STACK(5) & specialargmask,
 									STACK(4) & specialargmask,
@@ -6378,7 +7469,7 @@ int DLevelScript::RunScript ()
 			sp -= 4;
 			break;
 
-		case PCD_LSPEC5EX:
+		ACSOP(LSPEC5EX):
 			P_ExecuteSpecial(NEXTWORD, activationline, activator, backSide,
 									STACK(5) & specialargmask,
 									STACK(4) & specialargmask,
@@ -6388,7 +7479,7 @@ int DLevelScript::RunScript ()
 			sp -= 5;
 			break;
 
-		case PCD_LSPEC5EXRESULT:
+		ACSOP(LSPEC5EXRESULT):
 			STACK(5) = P_ExecuteSpecial(NEXTWORD, activationline, activator, backSide,
 									STACK(5) & specialargmask,
 									STACK(4) & specialargmask,
@@ -6398,85 +7489,85 @@ int DLevelScript::RunScript ()
 			sp -= 4;
 			break;
 
-		case PCD_LSPEC1DIRECT:
+		ACSOP(LSPEC1DIRECT):
 			temp = NEXTBYTE;
 			P_ExecuteSpecial(temp, activationline, activator, backSide,
-								uallong(pc[0]) & specialargmask ,0, 0, 0, 0);
+								pc[0] & specialargmask ,0, 0, 0, 0);
 			pc += 1;
 			break;
 
-		case PCD_LSPEC2DIRECT:
+		ACSOP(LSPEC2DIRECT):
 			temp = NEXTBYTE;
 			P_ExecuteSpecial(temp, activationline, activator, backSide,
-								uallong(pc[0]) & specialargmask,
-								uallong(pc[1]) & specialargmask, 0, 0, 0);
+								pc[0] & specialargmask,
+								pc[1] & specialargmask, 0, 0, 0);
 			pc += 2;
 			break;
 
-		case PCD_LSPEC3DIRECT:
+		ACSOP(LSPEC3DIRECT):
 			temp = NEXTBYTE;
 			P_ExecuteSpecial(temp, activationline, activator, backSide,
-								uallong(pc[0]) & specialargmask,
-								uallong(pc[1]) & specialargmask,
-								uallong(pc[2]) & specialargmask, 0, 0);
+								pc[0] & specialargmask,
+								pc[1] & specialargmask,
+								pc[2] & specialargmask, 0, 0);
 			pc += 3;
 			break;
 
-		case PCD_LSPEC4DIRECT:
+		ACSOP(LSPEC4DIRECT):
 			temp = NEXTBYTE;
 			P_ExecuteSpecial(temp, activationline, activator, backSide,
-								uallong(pc[0]) & specialargmask,
-								uallong(pc[1]) & specialargmask,
-								uallong(pc[2]) & specialargmask,
-								uallong(pc[3]) & specialargmask, 0);
+								pc[0] & specialargmask,
+								pc[1] & specialargmask,
+								pc[2] & specialargmask,
+								pc[3] & specialargmask, 0);
 			pc += 4;
 			break;
 
-		case PCD_LSPEC5DIRECT:
+		ACSOP(LSPEC5DIRECT):
 			temp = NEXTBYTE;
 			P_ExecuteSpecial(temp, activationline, activator, backSide,
-								uallong(pc[0]) & specialargmask,
-								uallong(pc[1]) & specialargmask,
-								uallong(pc[2]) & specialargmask,
-								uallong(pc[3]) & specialargmask,
-								uallong(pc[4]) & specialargmask);
+								pc[0] & specialargmask,
+								pc[1] & specialargmask,
+								pc[2] & specialargmask,
+								pc[3] & specialargmask,
+								pc[4] & specialargmask);
 			pc += 5;
 			break;
 
 		// Parameters for PCD_LSPEC?DIRECTB are by definition bytes so never need and-ing.
-		case PCD_LSPEC1DIRECTB:
-			P_ExecuteSpecial(((BYTE *)pc)[0], activationline, activator, backSide,
-				((BYTE *)pc)[1], 0, 0, 0, 0);
-			pc = (int *)((BYTE *)pc + 2);
+		ACSOP(LSPEC1DIRECTB):
+			P_ExecuteSpecial(pc[0], activationline, activator, backSide,
+				pc[1], 0, 0, 0, 0);
+			pc += 2;
 			break;
 
-		case PCD_LSPEC2DIRECTB:
-			P_ExecuteSpecial(((BYTE *)pc)[0], activationline, activator, backSide,
-				((BYTE *)pc)[1], ((BYTE *)pc)[2], 0, 0, 0);
-			pc = (int *)((BYTE *)pc + 3);
+		ACSOP(LSPEC2DIRECTB):
+			P_ExecuteSpecial(pc[0], activationline, activator, backSide,
+				pc[1], pc[2], 0, 0, 0);
+			pc += 3;
 			break;
 
-		case PCD_LSPEC3DIRECTB:
-			P_ExecuteSpecial(((BYTE *)pc)[0], activationline, activator, backSide,
-				((BYTE *)pc)[1], ((BYTE *)pc)[2], ((BYTE *)pc)[3], 0, 0);
-			pc = (int *)((BYTE *)pc + 4);
+		ACSOP(LSPEC3DIRECTB):
+			P_ExecuteSpecial(pc[0], activationline, activator, backSide,
+				pc[1], pc[2], pc[3], 0, 0);
+			pc += 4;
 			break;
 
-		case PCD_LSPEC4DIRECTB:
-			P_ExecuteSpecial(((BYTE *)pc)[0], activationline, activator, backSide,
-				((BYTE *)pc)[1], ((BYTE *)pc)[2], ((BYTE *)pc)[3],
-				((BYTE *)pc)[4], 0);
-			pc = (int *)((BYTE *)pc + 5);
+		ACSOP(LSPEC4DIRECTB):
+			P_ExecuteSpecial(pc[0], activationline, activator, backSide,
+				pc[1], pc[2], pc[3],
+				pc[4], 0);
+			pc += 5;
 			break;
 
-		case PCD_LSPEC5DIRECTB:
-			P_ExecuteSpecial(((BYTE *)pc)[0], activationline, activator, backSide,
-				((BYTE *)pc)[1], ((BYTE *)pc)[2], ((BYTE *)pc)[3],
-				((BYTE *)pc)[4], ((BYTE *)pc)[5]);
-			pc = (int *)((BYTE *)pc + 6);
+		ACSOP(LSPEC5DIRECTB):
+			P_ExecuteSpecial(pc[0], activationline, activator, backSide,
+				pc[1], pc[2], pc[3],
+				pc[4], pc[5]);
+			pc += 6;
 			break;
 
-		case PCD_CALLFUNC:
+		ACSOP(CALLFUNC):
 			{
 				int argCount = NEXTBYTE;
 				int funcIndex = NEXTSHORT;
@@ -6487,16 +7578,16 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_PUSHFUNCTION:
+		ACSOP(PUSHFUNCTION):
 		{
 			int funcnum = NEXTBYTE;
 			// Not technically a string, but since we use the same tagging mechanism
 			PushToStack(TAGSTR(funcnum));
 			break;
 		}
-		case PCD_CALL:
-		case PCD_CALLDISCARD:
-		case PCD_CALLSTACK:
+		ACSOP(CALL):
+		ACSOP(CALLDISCARD):
+		ACSOP(CALLSTACK):
 			{
 				int funcnum;
 				int i;
@@ -6525,6 +7616,37 @@ int DLevelScript::RunScript ()
 					state = SCRIPT_PleaseRemove;
 					break;
 				}
+				bool pure = false, compare = false;
+				int vmresult = 0;
+				VMScriptFunction *vmfunc = acs_vm ? module->GetCompiledFunction (func, &pure) : NULL;
+				if (vmfunc != NULL)
+				{
+					int status;
+					vmresult = ACS_CallCompiledFunction (vmfunc, &Stack[sp - func->ArgCount], status);
+					compare = acs_vmcompare && pure && status == ACSVM_Done;
+					if (!compare)
+					{
+						if (status == ACSVM_Runaway)
+						{
+							Printf ("Runaway %s terminated\n", ScriptPresentation(script).GetChars());
+							state = SCRIPT_PleaseRemove;
+						}
+						else if (status != ACSVM_Done)
+						{
+							state = status == ACSVM_DivideBy0 ? SCRIPT_DivideBy0 : SCRIPT_ModulusBy0;
+						}
+						else
+						{
+							module->GetFunctionProfileData(func)->AddVMRun();
+							sp -= func->ArgCount;
+							if (pcd != PCD_CALLDISCARD)
+							{
+								Stack[sp++] = vmresult;
+							}
+						}
+						break;
+					}
+				}
 				if (sp + func->LocalCount + 64 > STACK_SIZE)
 				{ // 64 is the margin for the function's working space
 					Printf ("Out of stack space in %s\n", ScriptPresentation(script).GetChars());
@@ -6540,10 +7662,10 @@ int DLevelScript::RunScript ()
 					Stack[sp+i] = 0;
 				}
 				sp += i;
-				::new(&Stack[sp]) CallReturn(activeBehavior->PC2Ofs(pc), activeFunction,
-					activeBehavior, mylocals, localarrays, pcd == PCD_CALLDISCARD, runaway);
+				::new(&Stack[sp]) CallReturn(pc, activeFunction,
+					activeBehavior, mylocals, localarrays, pcd == PCD_CALLDISCARD, runaway, compare, vmresult);
 				sp += (sizeof(CallReturn) + sizeof(int) - 1) / sizeof(int);
-				pc = module->Ofs2PC (func->Address);
+				pc = module->GetFunctionAddress (func);
 				localarrays = &func->LocalArrays;
 				activeFunction = func;
 				activeBehavior = module;
@@ -6551,8 +7673,8 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_RETURNVOID:
-		case PCD_RETURNVAL:
+		ACSOP(RETURNVOID):
+		ACSOP(RETURNVAL):
 			{
 				int value;
 				union
@@ -6572,8 +7694,12 @@ int DLevelScript::RunScript ()
 				sp -= sizeof(CallReturn)/sizeof(int);
 				retsp = &Stack[sp];
 				activeBehavior->GetFunctionProfileData(activeFunction)->AddRun(runaway - ret->EntryInstrCount);
+				if (ret->bCompareVM && ret->VMResult != value)
+				{
+					ACS_ReportVMMismatch (activeBehavior, activeFunction, ret->VMResult, value);
+				}
 				sp = int(locals - Stack);
-				pc = ret->ReturnModule->Ofs2PC(ret->ReturnAddress);
+				pc = ret->ReturnAddress;
 				activeFunction = ret->ReturnFunction;
 				activeBehavior = ret->ReturnModule;
 				fmt = activeBehavior->GetFormat();
@@ -6587,22 +7713,22 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_ADD:
+		ACSOP(ADD):
 			STACK(2) = STACK(2) + STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_SUBTRACT:
+		ACSOP(SUBTRACT):
 			STACK(2) = STACK(2) - STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_MULTIPLY:
+		ACSOP(MULTIPLY):
 			STACK(2) = STACK(2) * STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_DIVIDE:
+		ACSOP(DIVIDE):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_DivideBy0;
@@ -6614,7 +7740,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_MODULUS:
+		ACSOP(MODULUS):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_ModulusBy0;
@@ -6626,269 +7752,271 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_EQ:
+		ACSOP(EQ):
 			STACK(2) = (STACK(2) == STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_NE:
+		ACSOP(NE):
 			STACK(2) = (STACK(2) != STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_LT:
+		ACSOP(LT):
 			STACK(2) = (STACK(2) < STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_GT:
+		ACSOP(GT):
 			STACK(2) = (STACK(2) > STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_LE:
+		ACSOP(LE):
 			STACK(2) = (STACK(2) <= STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_GE:
+		ACSOP(GE):
 			STACK(2) = (STACK(2) >= STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ASSIGNSCRIPTVAR:
+		ACSOP(ASSIGNSCRIPTVAR):
 			locals[NEXTBYTE] = STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
 
-		case PCD_ASSIGNMAPVAR:
+		ACSOP(ASSIGNMAPVAR):
 			*(activeBehavior->MapVars[NEXTBYTE]) = STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ASSIGNWORLDVAR:
+		ACSOP(ASSIGNWORLDVAR):
 			ACS_WorldVars[NEXTBYTE] = STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ASSIGNGLOBALVAR:
+		ACSOP(ASSIGNGLOBALVAR):
 			ACS_GlobalVars[NEXTBYTE] = STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ASSIGNSCRIPTARRAY:
+		ACSOP(ASSIGNSCRIPTARRAY):
 			localarrays->Set(locals, NEXTBYTE, STACK(2), STACK(1));
 			sp -= 2;
-			break;
+			NEXTOP;
 
-		case PCD_ASSIGNMAPARRAY:
+		ACSOP(ASSIGNMAPARRAY):
 			activeBehavior->SetArrayVal (*(activeBehavior->MapVars[NEXTBYTE]), STACK(2), STACK(1));
 			sp -= 2;
-			break;
+			NEXTOP;
 
-		case PCD_ASSIGNWORLDARRAY:
+		ACSOP(ASSIGNWORLDARRAY):
 			ACS_WorldArrays[NEXTBYTE][STACK(2)] = STACK(1);
+			GlobalACSStrings.WriteBarrier(STACK(1));
 			sp -= 2;
-			break;
+			NEXTOP;
 
-		case PCD_ASSIGNGLOBALARRAY:
+		ACSOP(ASSIGNGLOBALARRAY):
 			ACS_GlobalArrays[NEXTBYTE][STACK(2)] = STACK(1);
+			GlobalACSStrings.WriteBarrier(STACK(1));
 			sp -= 2;
-			break;
+			NEXTOP;
 
-		case PCD_PUSHSCRIPTVAR:
+		ACSOP(PUSHSCRIPTVAR):
 			PushToStack (locals[NEXTBYTE]);
-			break;
+			NEXTOP;
 
-		case PCD_PUSHMAPVAR:
+		ACSOP(PUSHMAPVAR):
 			PushToStack (*(activeBehavior->MapVars[NEXTBYTE]));
-			break;
+			NEXTOP;
 
-		case PCD_PUSHWORLDVAR:
+		ACSOP(PUSHWORLDVAR):
 			PushToStack (ACS_WorldVars[NEXTBYTE]);
-			break;
+			NEXTOP;
 
-		case PCD_PUSHGLOBALVAR:
+		ACSOP(PUSHGLOBALVAR):
 			PushToStack (ACS_GlobalVars[NEXTBYTE]);
-			break;
+			NEXTOP;
 
-		case PCD_PUSHSCRIPTARRAY:
+		ACSOP(PUSHSCRIPTARRAY):
 			STACK(1) = localarrays->Get(locals, NEXTBYTE, STACK(1));
-			break;
+			NEXTOP;
 
-		case PCD_PUSHMAPARRAY:
+		ACSOP(PUSHMAPARRAY):
 			STACK(1) = activeBehavior->GetArrayVal (*(activeBehavior->MapVars[NEXTBYTE]), STACK(1));
-			break;
+			NEXTOP;
 
-		case PCD_PUSHWORLDARRAY:
+		ACSOP(PUSHWORLDARRAY):
 			STACK(1) = ACS_WorldArrays[NEXTBYTE][STACK(1)];
-			break;
+			NEXTOP;
 
-		case PCD_PUSHGLOBALARRAY:
+		ACSOP(PUSHGLOBALARRAY):
 			STACK(1) = ACS_GlobalArrays[NEXTBYTE][STACK(1)];
-			break;
+			NEXTOP;
 
-		case PCD_ADDSCRIPTVAR:
+		ACSOP(ADDSCRIPTVAR):
 			locals[NEXTBYTE] += STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ADDMAPVAR:
+		ACSOP(ADDMAPVAR):
 			*(activeBehavior->MapVars[NEXTBYTE]) += STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ADDWORLDVAR:
+		ACSOP(ADDWORLDVAR):
 			ACS_WorldVars[NEXTBYTE] += STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ADDGLOBALVAR:
+		ACSOP(ADDGLOBALVAR):
 			ACS_GlobalVars[NEXTBYTE] += STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ADDSCRIPTARRAY:
+		ACSOP(ADDSCRIPTARRAY):
 			{
 				int a = NEXTBYTE, i = STACK(2);
 				localarrays->Set(locals, a, i, localarrays->Get(locals, a, i) + STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_ADDMAPARRAY:
+		ACSOP(ADDMAPARRAY):
 			{
 				int a = *(activeBehavior->MapVars[NEXTBYTE]);
 				int i = STACK(2);
 				activeBehavior->SetArrayVal (a, i, activeBehavior->GetArrayVal (a, i) + STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_ADDWORLDARRAY:
+		ACSOP(ADDWORLDARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_WorldArrays[a][STACK(2)] += STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_ADDGLOBALARRAY:
+		ACSOP(ADDGLOBALARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_GlobalArrays[a][STACK(2)] += STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_SUBSCRIPTVAR:
+		ACSOP(SUBSCRIPTVAR):
 			locals[NEXTBYTE] -= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_SUBMAPVAR:
+		ACSOP(SUBMAPVAR):
 			*(activeBehavior->MapVars[NEXTBYTE]) -= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_SUBWORLDVAR:
+		ACSOP(SUBWORLDVAR):
 			ACS_WorldVars[NEXTBYTE] -= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_SUBGLOBALVAR:
+		ACSOP(SUBGLOBALVAR):
 			ACS_GlobalVars[NEXTBYTE] -= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_SUBSCRIPTARRAY:
+		ACSOP(SUBSCRIPTARRAY):
 			{
 				int a = NEXTBYTE, i = STACK(2);
 				localarrays->Set(locals, a, i, localarrays->Get(locals, a, i) - STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_SUBMAPARRAY:
+		ACSOP(SUBMAPARRAY):
 			{
 				int a = *(activeBehavior->MapVars[NEXTBYTE]);
 				int i = STACK(2);
 				activeBehavior->SetArrayVal (a, i, activeBehavior->GetArrayVal (a, i) - STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_SUBWORLDARRAY:
+		ACSOP(SUBWORLDARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_WorldArrays[a][STACK(2)] -= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_SUBGLOBALARRAY:
+		ACSOP(SUBGLOBALARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_GlobalArrays[a][STACK(2)] -= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_MULSCRIPTVAR:
+		ACSOP(MULSCRIPTVAR):
 			locals[NEXTBYTE] *= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_MULMAPVAR:
+		ACSOP(MULMAPVAR):
 			*(activeBehavior->MapVars[NEXTBYTE]) *= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_MULWORLDVAR:
+		ACSOP(MULWORLDVAR):
 			ACS_WorldVars[NEXTBYTE] *= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_MULGLOBALVAR:
+		ACSOP(MULGLOBALVAR):
 			ACS_GlobalVars[NEXTBYTE] *= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_MULSCRIPTARRAY:
+		ACSOP(MULSCRIPTARRAY):
 			{
 				int a = NEXTBYTE, i = STACK(2);
 				localarrays->Set(locals, a, i, localarrays->Get(locals, a, i) * STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_MULMAPARRAY:
+		ACSOP(MULMAPARRAY):
 			{
 				int a = *(activeBehavior->MapVars[NEXTBYTE]);
 				int i = STACK(2);
 				activeBehavior->SetArrayVal (a, i, activeBehavior->GetArrayVal (a, i) * STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_MULWORLDARRAY:
+		ACSOP(MULWORLDARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_WorldArrays[a][STACK(2)] *= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_MULGLOBALARRAY:
+		ACSOP(MULGLOBALARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_GlobalArrays[a][STACK(2)] *= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_DIVSCRIPTVAR:
+		ACSOP(DIVSCRIPTVAR):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_DivideBy0;
@@ -6900,7 +8028,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_DIVMAPVAR:
+		ACSOP(DIVMAPVAR):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_DivideBy0;
@@ -6912,7 +8040,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_DIVWORLDVAR:
+		ACSOP(DIVWORLDVAR):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_DivideBy0;
@@ -6924,7 +8052,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_DIVGLOBALVAR:
+		ACSOP(DIVGLOBALVAR):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_DivideBy0;
@@ -6936,7 +8064,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_DIVSCRIPTARRAY:
+		ACSOP(DIVSCRIPTARRAY):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_DivideBy0;
@@ -6949,7 +8077,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_DIVMAPARRAY:
+		ACSOP(DIVMAPARRAY):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_DivideBy0;
@@ -6963,7 +8091,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_DIVWORLDARRAY:
+		ACSOP(DIVWORLDARRAY):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_DivideBy0;
@@ -6976,7 +8104,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_DIVGLOBALARRAY:
+		ACSOP(DIVGLOBALARRAY):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_DivideBy0;
@@ -6989,7 +8117,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_MODSCRIPTVAR:
+		ACSOP(MODSCRIPTVAR):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_ModulusBy0;
@@ -7001,7 +8129,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_MODMAPVAR:
+		ACSOP(MODMAPVAR):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_ModulusBy0;
@@ -7013,7 +8141,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_MODWORLDVAR:
+		ACSOP(MODWORLDVAR):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_ModulusBy0;
@@ -7025,7 +8153,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_MODGLOBALVAR:
+		ACSOP(MODGLOBALVAR):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_ModulusBy0;
@@ -7037,7 +8165,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_MODSCRIPTARRAY:
+		ACSOP(MODSCRIPTARRAY):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_ModulusBy0;
@@ -7050,7 +8178,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_MODMAPARRAY:
+		ACSOP(MODMAPARRAY):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_ModulusBy0;
@@ -7064,7 +8192,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_MODWORLDARRAY:
+		ACSOP(MODWORLDARRAY):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_ModulusBy0;
@@ -7077,7 +8205,7 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_MODGLOBALARRAY:
+		ACSOP(MODGLOBALARRAY):
 			if (STACK(1) == 0)
 			{
 				state = SCRIPT_ModulusBy0;
@@ -7091,396 +8219,396 @@ int DLevelScript::RunScript ()
 			break;
 
 		//[MW] start
-		case PCD_ANDSCRIPTVAR:
+		ACSOP(ANDSCRIPTVAR):
 			locals[NEXTBYTE] &= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ANDMAPVAR:
+		ACSOP(ANDMAPVAR):
 			*(activeBehavior->MapVars[NEXTBYTE]) &= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ANDWORLDVAR:
+		ACSOP(ANDWORLDVAR):
 			ACS_WorldVars[NEXTBYTE] &= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ANDGLOBALVAR:
+		ACSOP(ANDGLOBALVAR):
 			ACS_GlobalVars[NEXTBYTE] &= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ANDSCRIPTARRAY:
+		ACSOP(ANDSCRIPTARRAY):
 			{
 				int a = NEXTBYTE, i = STACK(2);
 				localarrays->Set(locals, a, i, localarrays->Get(locals, a, i) & STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_ANDMAPARRAY:
+		ACSOP(ANDMAPARRAY):
 			{
 				int a = *(activeBehavior->MapVars[NEXTBYTE]);
 				int i = STACK(2);
 				activeBehavior->SetArrayVal (a, i, activeBehavior->GetArrayVal (a, i) & STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_ANDWORLDARRAY:
+		ACSOP(ANDWORLDARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_WorldArrays[a][STACK(2)] &= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_ANDGLOBALARRAY:
+		ACSOP(ANDGLOBALARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_GlobalArrays[a][STACK(2)] &= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_EORSCRIPTVAR:
+		ACSOP(EORSCRIPTVAR):
 			locals[NEXTBYTE] ^= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_EORMAPVAR:
+		ACSOP(EORMAPVAR):
 			*(activeBehavior->MapVars[NEXTBYTE]) ^= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_EORWORLDVAR:
+		ACSOP(EORWORLDVAR):
 			ACS_WorldVars[NEXTBYTE] ^= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_EORGLOBALVAR:
+		ACSOP(EORGLOBALVAR):
 			ACS_GlobalVars[NEXTBYTE] ^= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_EORSCRIPTARRAY:
+		ACSOP(EORSCRIPTARRAY):
 			{
 				int a = NEXTBYTE, i = STACK(2);
 				localarrays->Set(locals, a, i, localarrays->Get(locals, a, i) ^ STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_EORMAPARRAY:
+		ACSOP(EORMAPARRAY):
 			{
 				int a = *(activeBehavior->MapVars[NEXTBYTE]);
 				int i = STACK(2);
 				activeBehavior->SetArrayVal (a, i, activeBehavior->GetArrayVal (a, i) ^ STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_EORWORLDARRAY:
+		ACSOP(EORWORLDARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_WorldArrays[a][STACK(2)] ^= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_EORGLOBALARRAY:
+		ACSOP(EORGLOBALARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_GlobalArrays[a][STACK(2)] ^= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_ORSCRIPTVAR:
+		ACSOP(ORSCRIPTVAR):
 			locals[NEXTBYTE] |= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ORMAPVAR:
+		ACSOP(ORMAPVAR):
 			*(activeBehavior->MapVars[NEXTBYTE]) |= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ORWORLDVAR:
+		ACSOP(ORWORLDVAR):
 			ACS_WorldVars[NEXTBYTE] |= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ORGLOBALVAR:
+		ACSOP(ORGLOBALVAR):
 			ACS_GlobalVars[NEXTBYTE] |= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ORSCRIPTARRAY:
+		ACSOP(ORSCRIPTARRAY):
 			{
 				int a = NEXTBYTE, i = STACK(2);
 				localarrays->Set(locals, a, i, localarrays->Get(locals, a, i) | STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_ORMAPARRAY:
+		ACSOP(ORMAPARRAY):
 			{
 				int a = *(activeBehavior->MapVars[NEXTBYTE]);
 				int i = STACK(2);
 				activeBehavior->SetArrayVal (a, i, activeBehavior->GetArrayVal (a, i) | STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_ORWORLDARRAY:
+		ACSOP(ORWORLDARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_WorldArrays[a][STACK(2)] |= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_ORGLOBALARRAY:
+		ACSOP(ORGLOBALARRAY):
 			{
 				int a = NEXTBYTE;
 				int i = STACK(2);
 				ACS_GlobalArrays[a][STACK(2)] |= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_LSSCRIPTVAR:
+		ACSOP(LSSCRIPTVAR):
 			locals[NEXTBYTE] <<= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_LSMAPVAR:
+		ACSOP(LSMAPVAR):
 			*(activeBehavior->MapVars[NEXTBYTE]) <<= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_LSWORLDVAR:
+		ACSOP(LSWORLDVAR):
 			ACS_WorldVars[NEXTBYTE] <<= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_LSGLOBALVAR:
+		ACSOP(LSGLOBALVAR):
 			ACS_GlobalVars[NEXTBYTE] <<= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_LSSCRIPTARRAY:
+		ACSOP(LSSCRIPTARRAY):
 			{
 				int a = NEXTBYTE, i = STACK(2);
 				localarrays->Set(locals, a, i, localarrays->Get(locals, a, i) << STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_LSMAPARRAY:
+		ACSOP(LSMAPARRAY):
 			{
 				int a = *(activeBehavior->MapVars[NEXTBYTE]);
 				int i = STACK(2);
 				activeBehavior->SetArrayVal (a, i, activeBehavior->GetArrayVal (a, i) << STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_LSWORLDARRAY:
+		ACSOP(LSWORLDARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_WorldArrays[a][STACK(2)] <<= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_LSGLOBALARRAY:
+		ACSOP(LSGLOBALARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_GlobalArrays[a][STACK(2)] <<= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_RSSCRIPTVAR:
+		ACSOP(RSSCRIPTVAR):
 			locals[NEXTBYTE] >>= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_RSMAPVAR:
+		ACSOP(RSMAPVAR):
 			*(activeBehavior->MapVars[NEXTBYTE]) >>= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_RSWORLDVAR:
+		ACSOP(RSWORLDVAR):
 			ACS_WorldVars[NEXTBYTE] >>= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_RSGLOBALVAR:
+		ACSOP(RSGLOBALVAR):
 			ACS_GlobalVars[NEXTBYTE] >>= STACK(1);
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_RSSCRIPTARRAY:
+		ACSOP(RSSCRIPTARRAY):
 			{
 				int a = NEXTBYTE, i = STACK(2);
 				localarrays->Set(locals, a, i, localarrays->Get(locals, a, i) >> STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_RSMAPARRAY:
+		ACSOP(RSMAPARRAY):
 			{
 				int a = *(activeBehavior->MapVars[NEXTBYTE]);
 				int i = STACK(2);
 				activeBehavior->SetArrayVal (a, i, activeBehavior->GetArrayVal (a, i) >> STACK(1));
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_RSWORLDARRAY:
+		ACSOP(RSWORLDARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_WorldArrays[a][STACK(2)] >>= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_RSGLOBALARRAY:
+		ACSOP(RSGLOBALARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_GlobalArrays[a][STACK(2)] >>= STACK(1);
 				sp -= 2;
 			}
-			break;
+			NEXTOP;
 		//[MW] end
 
-		case PCD_INCSCRIPTVAR:
+		ACSOP(INCSCRIPTVAR):
 			++locals[NEXTBYTE];
-			break;
+			NEXTOP;
 
-		case PCD_INCMAPVAR:
+		ACSOP(INCMAPVAR):
 			*(activeBehavior->MapVars[NEXTBYTE]) += 1;
-			break;
+			NEXTOP;
 
-		case PCD_INCWORLDVAR:
+		ACSOP(INCWORLDVAR):
 			++ACS_WorldVars[NEXTBYTE];
-			break;
+			NEXTOP;
 
-		case PCD_INCGLOBALVAR:
+		ACSOP(INCGLOBALVAR):
 			++ACS_GlobalVars[NEXTBYTE];
-			break;
+			NEXTOP;
 
-		case PCD_INCSCRIPTARRAY:
+		ACSOP(INCSCRIPTARRAY):
 			{
 				int a = NEXTBYTE, i = STACK(1);
 				localarrays->Set(locals, a, i, localarrays->Get(locals, a, i) + 1);
 				sp--;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_INCMAPARRAY:
+		ACSOP(INCMAPARRAY):
 			{
 				int a = *(activeBehavior->MapVars[NEXTBYTE]);
 				int i = STACK(1);
 				activeBehavior->SetArrayVal (a, i, activeBehavior->GetArrayVal (a, i) + 1);
 				sp--;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_INCWORLDARRAY:
+		ACSOP(INCWORLDARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_WorldArrays[a][STACK(1)] += 1;
 				sp--;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_INCGLOBALARRAY:
+		ACSOP(INCGLOBALARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_GlobalArrays[a][STACK(1)] += 1;
 				sp--;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_DECSCRIPTVAR:
+		ACSOP(DECSCRIPTVAR):
 			--locals[NEXTBYTE];
-			break;
+			NEXTOP;
 
-		case PCD_DECMAPVAR:
+		ACSOP(DECMAPVAR):
 			*(activeBehavior->MapVars[NEXTBYTE]) -= 1;
-			break;
+			NEXTOP;
 
-		case PCD_DECWORLDVAR:
+		ACSOP(DECWORLDVAR):
 			--ACS_WorldVars[NEXTBYTE];
-			break;
+			NEXTOP;
 
-		case PCD_DECGLOBALVAR:
+		ACSOP(DECGLOBALVAR):
 			--ACS_GlobalVars[NEXTBYTE];
-			break;
+			NEXTOP;
 
-		case PCD_DECSCRIPTARRAY:
+		ACSOP(DECSCRIPTARRAY):
 			{
 				int a = NEXTBYTE, i = STACK(1);
 				localarrays->Set(locals, a, i, localarrays->Get(locals, a, i) - 1);
 				sp--;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_DECMAPARRAY:
+		ACSOP(DECMAPARRAY):
 			{
 				int a = *(activeBehavior->MapVars[NEXTBYTE]);
 				int i = STACK(1);
 				activeBehavior->SetArrayVal (a, i, activeBehavior->GetArrayVal (a, i) - 1);
 				sp--;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_DECWORLDARRAY:
+		ACSOP(DECWORLDARRAY):
 			{
 				int a = NEXTBYTE;
 				ACS_WorldArrays[a][STACK(1)] -= 1;
 				sp--;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_DECGLOBALARRAY:
+		ACSOP(DECGLOBALARRAY):
 			{
 				int a = NEXTBYTE;
 				int i = STACK(1);
 				ACS_GlobalArrays[a][STACK(1)] -= 1;
 				sp--;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_GOTO:
-			pc = activeBehavior->Ofs2PC (LittleLong(*pc));
-			break;
+		ACSOP(GOTO):
+			pc = activeBehavior->Index2PC (*pc);
+			NEXTOP;
 
-		case PCD_GOTOSTACK:
+		ACSOP(GOTOSTACK):
 			pc = activeBehavior->Jump2PC (STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_IFGOTO:
+		ACSOP(IFGOTO):
 			if (STACK(1))
-				pc = activeBehavior->Ofs2PC (LittleLong(*pc));
+				pc = activeBehavior->Index2PC (*pc);
 			else
 				pc++;
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_SETRESULTVALUE:
+		ACSOP(SETRESULTVALUE):
 			resultValue = STACK(1);
-		case PCD_DROP: //fall through.
+		ACSOP(DROP): //fall through.
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_DELAY:
+		ACSOP(DELAY):
 			statedata = STACK(1) + (fmt == ACS_Old && gameinfo.gametype == GAME_Hexen);
 			if (statedata > 0)
 			{
@@ -7489,8 +8617,8 @@ int DLevelScript::RunScript ()
 			sp--;
 			break;
 
-		case PCD_DELAYDIRECT:
-			statedata = uallong(pc[0]) + (fmt == ACS_Old && gameinfo.gametype == GAME_Hexen);
+		ACSOP(DELAYDIRECT):
+			statedata = pc[0] + (fmt == ACS_Old && gameinfo.gametype == GAME_Hexen);
 			pc++;
 			if (statedata > 0)
 			{
@@ -7498,100 +8626,100 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_DELAYDIRECTB:
-			statedata = *(BYTE *)pc + (fmt == ACS_Old && gameinfo.gametype == GAME_Hexen);
+		ACSOP(DELAYDIRECTB):
+			statedata = *pc + (fmt == ACS_Old && gameinfo.gametype == GAME_Hexen);
 			if (statedata > 0)
 			{
 				state = SCRIPT_Delayed;
 			}
-			pc = (int *)((BYTE *)pc + 1);
+			pc += 1;
 			break;
 
-		case PCD_RANDOM:
+		ACSOP(RANDOM):
 			STACK(2) = Random (STACK(2), STACK(1));
 			sp--;
 			break;
 
-		case PCD_RANDOMDIRECT:
-			PushToStack (Random (uallong(pc[0]), uallong(pc[1])));
+		ACSOP(RANDOMDIRECT):
+			PushToStack (Random (pc[0], pc[1]));
 			pc += 2;
 			break;
 
-		case PCD_RANDOMDIRECTB:
-			PushToStack (Random (((BYTE *)pc)[0], ((BYTE *)pc)[1]));
-			pc = (int *)((BYTE *)pc + 2);
+		ACSOP(RANDOMDIRECTB):
+			PushToStack (Random (pc[0], pc[1]));
+			pc += 2;
 			break;
 
-		case PCD_THINGCOUNT:
+		ACSOP(THINGCOUNT):
 			STACK(2) = ThingCount (STACK(2), -1, STACK(1), -1);
 			sp--;
 			break;
 
-		case PCD_THINGCOUNTDIRECT:
-			PushToStack (ThingCount (uallong(pc[0]), -1, uallong(pc[1]), -1));
+		ACSOP(THINGCOUNTDIRECT):
+			PushToStack (ThingCount (pc[0], -1, pc[1], -1));
 			pc += 2;
 			break;
 
-		case PCD_THINGCOUNTNAME:
+		ACSOP(THINGCOUNTNAME):
 			STACK(2) = ThingCount (-1, STACK(2), STACK(1), -1);
 			sp--;
 			break;
 
-		case PCD_THINGCOUNTNAMESECTOR:
+		ACSOP(THINGCOUNTNAMESECTOR):
 			STACK(3) = ThingCount (-1, STACK(3), STACK(2), STACK(1));
 			sp -= 2;
 			break;
 
-		case PCD_THINGCOUNTSECTOR:
+		ACSOP(THINGCOUNTSECTOR):
 			STACK(3) = ThingCount (STACK(3), -1, STACK(2), STACK(1));
 			sp -= 2;
 			break;
 
-		case PCD_TAGWAIT:
+		ACSOP(TAGWAIT):
 			state = SCRIPT_TagWait;
 			statedata = STACK(1);
 			sp--;
 			break;
 
-		case PCD_TAGWAITDIRECT:
+		ACSOP(TAGWAITDIRECT):
 			state = SCRIPT_TagWait;
-			statedata = uallong(pc[0]);
+			statedata = pc[0];
 			pc++;
 			break;
 
-		case PCD_POLYWAIT:
+		ACSOP(POLYWAIT):
 			state = SCRIPT_PolyWait;
 			statedata = STACK(1);
 			sp--;
 			break;
 
-		case PCD_POLYWAITDIRECT:
+		ACSOP(POLYWAITDIRECT):
 			state = SCRIPT_PolyWait;
-			statedata = uallong(pc[0]);
+			statedata = pc[0];
 			pc++;
 			break;
 
-		case PCD_CHANGEFLOOR:
+		ACSOP(CHANGEFLOOR):
 			ChangeFlat (STACK(2), STACK(1), 0);
 			sp -= 2;
 			break;
 
-		case PCD_CHANGEFLOORDIRECT:
-			ChangeFlat (uallong(pc[0]), TAGSTR(uallong(pc[1])), 0);
+		ACSOP(CHANGEFLOORDIRECT):
+			ChangeFlat (pc[0], TAGSTR(pc[1]), 0);
 			pc += 2;
 			break;
 
-		case PCD_CHANGECEILING:
+		ACSOP(CHANGECEILING):
 			ChangeFlat (STACK(2), STACK(1), 1);
 			sp -= 2;
 			break;
 
-		case PCD_CHANGECEILINGDIRECT:
-			ChangeFlat (uallong(pc[0]), TAGSTR(uallong(pc[1])), 1);
+		ACSOP(CHANGECEILINGDIRECT):
+			ChangeFlat (pc[0], TAGSTR(pc[1]), 1);
 			pc += 2;
 			break;
 
-		case PCD_RESTART:
+		ACSOP(RESTART):
 			{
 				const ScriptPtr *scriptp;
 
@@ -7600,69 +8728,69 @@ int DLevelScript::RunScript ()
 			}
 			break;
 
-		case PCD_ANDLOGICAL:
+		ACSOP(ANDLOGICAL):
 			STACK(2) = (STACK(2) && STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ORLOGICAL:
+		ACSOP(ORLOGICAL):
 			STACK(2) = (STACK(2) || STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ANDBITWISE:
+		ACSOP(ANDBITWISE):
 			STACK(2) = (STACK(2) & STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_ORBITWISE:
+		ACSOP(ORBITWISE):
 			STACK(2) = (STACK(2) | STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_EORBITWISE:
+		ACSOP(EORBITWISE):
 			STACK(2) = (STACK(2) ^ STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_NEGATELOGICAL:
+		ACSOP(NEGATELOGICAL):
 			STACK(1) = !STACK(1);
-			break;
+			NEXTOP;
 
 
 
 
-		case PCD_NEGATEBINARY:
+		ACSOP(NEGATEBINARY):
 			STACK(1) = ~STACK(1);
-			break;
+			NEXTOP;
 
-		case PCD_LSHIFT:
+		ACSOP(LSHIFT):
 			STACK(2) = (STACK(2) << STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_RSHIFT:
+		ACSOP(RSHIFT):
 			STACK(2) = (STACK(2) >> STACK(1));
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_UNARYMINUS:
+		ACSOP(UNARYMINUS):
 			STACK(1) = -STACK(1);
-			break;
+			NEXTOP;
 
-		case PCD_IFNOTGOTO:
+		ACSOP(IFNOTGOTO):
 			if (!STACK(1))
-				pc = activeBehavior->Ofs2PC (LittleLong(*pc));
+				pc = activeBehavior->Index2PC (*pc);
 			else
 				pc++;
 			sp--;
-			break;
+			NEXTOP;
 
-		case PCD_LINESIDE:
+		ACSOP(LINESIDE):
 			PushToStack (backSide);
-			break;
+			NEXTOP;
 
-		case PCD_SCRIPTWAIT:
+		ACSOP(SCRIPTWAIT):
 			statedata = STACK(1);
 			sp--;
 scriptwait:
@@ -7673,17 +8801,17 @@ scriptwait:
 			PutLast ();
 			break;
 
-		case PCD_SCRIPTWAITDIRECT:
-			statedata = uallong(pc[0]);
+		ACSOP(SCRIPTWAITDIRECT):
+			statedata = pc[0];
 			pc++;
 			goto scriptwait;
 
-		case PCD_SCRIPTWAITNAMED:
+		ACSOP(SCRIPTWAITNAMED):
 			statedata = -FName(FBehavior::StaticLookupString(STACK(1)));
 			sp--;
 			goto scriptwait;
 
-		case PCD_CLEARLINESPECIAL:
+		ACSOP(CLEARLINESPECIAL):
 			if (activationline != NULL)
 			{
 				activationline->special = 0;
@@ -7691,31 +8819,29 @@ scriptwait:
 			}
 			break;
 
-		case PCD_CASEGOTO:
-			if (STACK(1) == uallong(pc[0]))
+		ACSOP(CASEGOTO):
+			if (STACK(1) == pc[0])
 			{
-				pc = activeBehavior->Ofs2PC (uallong(pc[1]));
+				pc = activeBehavior->Index2PC (pc[1]);
 				sp--;
 			}
 			else
 			{
 				pc += 2;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_CASEGOTOSORTED:
-			// The count and jump table are 4-byte aligned
-			pc = (int *)(((size_t)pc + 3) & ~3);
+		ACSOP(CASEGOTOSORTED):
 			{
-				int numcases = uallong(pc[0]); pc++;
+				int numcases = NEXTWORD;
 				int min = 0, max = numcases-1;
 				while (min <= max)
 				{
 					int mid = (min + max) / 2;
-					SDWORD caseval = LittleLong(pc[mid*2]);
+					SDWORD caseval = pc[mid*2];
 					if (caseval == STACK(1))
 					{
-						pc = activeBehavior->Ofs2PC (LittleLong(pc[mid*2+1]));
+						pc = activeBehavior->Index2PC (pc[mid*2+1]);
 						sp--;
 						break;
 					}
@@ -7736,12 +8862,12 @@ scriptwait:
 			}
 			break;
 
-		case PCD_BEGINPRINT:
+		ACSOP(BEGINPRINT):
 			STRINGBUILDER_START(work);
 			break;
 
-		case PCD_PRINTSTRING:
-		case PCD_PRINTLOCALIZED:
+		ACSOP(PRINTSTRING):
+		ACSOP(PRINTLOCALIZED):
 			lookup = FBehavior::StaticLookupString (STACK(1));
 			if (pcd == PCD_PRINTLOCALIZED)
 			{
@@ -7754,36 +8880,36 @@ scriptwait:
 			--sp;
 			break;
 
-		case PCD_PRINTNUMBER:
+		ACSOP(PRINTNUMBER):
 			work.AppendFormat ("%d", STACK(1));
 			--sp;
 			break;
 
-		case PCD_PRINTBINARY:
+		ACSOP(PRINTBINARY):
 			IGNORE_FORMAT_PRE
 			work.AppendFormat ("%B", STACK(1));
 			IGNORE_FORMAT_POST
 			--sp;
 			break;
 
-		case PCD_PRINTHEX:
+		ACSOP(PRINTHEX):
 			work.AppendFormat ("%X", STACK(1));
 			--sp;
 			break;
 
-		case PCD_PRINTCHARACTER:
+		ACSOP(PRINTCHARACTER):
 			work += (char)STACK(1);
 			--sp;
-			break;
+			NEXTOP;
 
-		case PCD_PRINTFIXED:
+		ACSOP(PRINTFIXED):
 			work.AppendFormat ("%g", ACSToDouble(STACK(1)));
 			--sp;
 			break;
 
 		// [BC] Print activator's name
 		// [RH] Fancied up a bit
-		case PCD_PRINTNAME:
+		ACSOP(PRINTNAME):
 			{
 				player_t *player = NULL;
 
@@ -7849,8 +8975,8 @@ scriptwait:
 			break;
 
 		// Print script character array
-		case PCD_PRINTSCRIPTCHARARRAY:
-		case PCD_PRINTSCRIPTCHRANGE:
+		ACSOP(PRINTSCRIPTCHARARRAY):
+		ACSOP(PRINTSCRIPTCHRANGE):
 			{
 				int capacity, offset, a, c;
 				if (CharArrayParms(capacity, offset, a, Stack, sp, pcd == PCD_PRINTSCRIPTCHRANGE))
@@ -7865,8 +8991,8 @@ scriptwait:
 			break;
 
 		// [JB] Print map character array
-		case PCD_PRINTMAPCHARARRAY:
-		case PCD_PRINTMAPCHRANGE:
+		ACSOP(PRINTMAPCHARARRAY):
+		ACSOP(PRINTMAPCHRANGE):
 			{
 				int capacity, offset, a, c;
 				if (CharArrayParms(capacity, offset, a, Stack, sp, pcd == PCD_PRINTMAPCHRANGE))
@@ -7881,8 +9007,8 @@ scriptwait:
 			break;
 
 		// [JB] Print world character array
-		case PCD_PRINTWORLDCHARARRAY:
-		case PCD_PRINTWORLDCHRANGE:
+		ACSOP(PRINTWORLDCHARARRAY):
+		ACSOP(PRINTWORLDCHRANGE):
 			{
 				int capacity, offset, a, c;
 				if (CharArrayParms(capacity, offset, a, Stack, sp, pcd == PCD_PRINTWORLDCHRANGE))
@@ -7897,8 +9023,8 @@ scriptwait:
 			break;
 
 		// [JB] Print global character array
-		case PCD_PRINTGLOBALCHARARRAY:
-		case PCD_PRINTGLOBALCHRANGE:
+		ACSOP(PRINTGLOBALCHARARRAY):
+		ACSOP(PRINTGLOBALCHRANGE):
 			{
 				int capacity, offset, a, c;
 				if (CharArrayParms(capacity, offset, a, Stack, sp, pcd == PCD_PRINTGLOBALCHRANGE))
@@ -7913,7 +9039,7 @@ scriptwait:
 			break;
 
 		// [GRB] Print key name(s) for a command
-		case PCD_PRINTBIND:
+		ACSOP(PRINTBIND):
 			lookup = FBehavior::StaticLookupString (STACK(1));
 			if (lookup != NULL)
 			{
@@ -7931,10 +9057,10 @@ scriptwait:
 			--sp;
 			break;
 
-		case PCD_ENDPRINT:
-		case PCD_ENDPRINTBOLD:
-		case PCD_MOREHUDMESSAGE:
-		case PCD_ENDLOG:
+		ACSOP(ENDPRINT):
+		ACSOP(ENDPRINTBOLD):
+		ACSOP(MOREHUDMESSAGE):
+		ACSOP(ENDLOG):
 			if (pcd == PCD_ENDLOG)
 			{
 				Printf ("%s\n", work.GetChars());
@@ -7965,12 +9091,12 @@ scriptwait:
 			}
 			break;
 
-		case PCD_OPTHUDMESSAGE:
+		ACSOP(OPTHUDMESSAGE):
 			optstart = sp;
-			break;
+			NEXTOP;
 
-		case PCD_ENDHUDMESSAGE:
-		case PCD_ENDHUDMESSAGEBOLD:
+		ACSOP(ENDHUDMESSAGE):
+		ACSOP(ENDHUDMESSAGEBOLD):
 			if (optstart == -1)
 			{
 				optstart = sp;
@@ -8076,21 +9202,21 @@ scriptwait:
 			sp = optstart-6;
 			break;
 
-		case PCD_SETFONT:
+		ACSOP(SETFONT):
 			DoSetFont (STACK(1));
 			sp--;
 			break;
 
-		case PCD_SETFONTDIRECT:
-			DoSetFont (TAGSTR(uallong(pc[0])));
+		ACSOP(SETFONTDIRECT):
+			DoSetFont (TAGSTR(pc[0]));
 			pc++;
 			break;
 
-		case PCD_PLAYERCOUNT:
+		ACSOP(PLAYERCOUNT):
 			PushToStack (CountPlayers ());
 			break;
 
-		case PCD_GAMETYPE:
+		ACSOP(GAMETYPE):
 			if (gamestate == GS_TITLELEVEL)
 				PushToStack (GAME_TITLE_MAP);
 			else if (deathmatch)
@@ -8099,32 +9225,32 @@ scriptwait:
 				PushToStack (GAME_NET_COOPERATIVE);
 			else
 				PushToStack (GAME_SINGLE_PLAYER);
-			break;
+			NEXTOP;
 
-		case PCD_GAMESKILL:
+		ACSOP(GAMESKILL):
 			PushToStack (G_SkillProperty(SKILLP_ACSReturn));
 			break;
 
 // [BC] Start ST PCD's
-		case PCD_ISNETWORKGAME:
+		ACSOP(ISNETWORKGAME):
 			PushToStack(netgame);
-			break;
+			NEXTOP;
 
-		case PCD_PLAYERTEAM:
+		ACSOP(PLAYERTEAM):
 			if ( activator && activator->player )
 				PushToStack( activator->player->userinfo.GetTeam() );
 			else
 				PushToStack( 0 );
 			break;
 
-		case PCD_PLAYERHEALTH:
+		ACSOP(PLAYERHEALTH):
 			if (activator)
 				PushToStack (activator->health);
 			else
 				PushToStack (0);
-			break;
+			NEXTOP;
 
-		case PCD_PLAYERARMORPOINTS:
+		ACSOP(PLAYERARMORPOINTS):
 			if (activator)
 			{
 				ABasicArmor *armor = activator->FindInventory<ABasicArmor>();
@@ -8134,16 +9260,16 @@ scriptwait:
 			{
 				PushToStack (0);
 			}
-			break;
+			NEXTOP;
 
-		case PCD_PLAYERFRAGS:
+		ACSOP(PLAYERFRAGS):
 			if (activator && activator->player)
 				PushToStack (activator->player->fragcount);
 			else
 				PushToStack (0);
-			break;
+			NEXTOP;
 
-		case PCD_MUSICCHANGE:
+		ACSOP(MUSICCHANGE):
 			lookup = FBehavior::StaticLookupString (STACK(2));
 			if (lookup != NULL)
 			{
@@ -8152,16 +9278,16 @@ scriptwait:
 			sp -= 2;
 			break;
 
-		case PCD_SINGLEPLAYER:
+		ACSOP(SINGLEPLAYER):
 			PushToStack (!multiplayer);
-			break;
+			NEXTOP;
 // [BC] End ST PCD's
 
-		case PCD_TIMER:
+		ACSOP(TIMER):
 			PushToStack (level.time);
-			break;
+			NEXTOP;
 
-		case PCD_SECTORSOUND:
+		ACSOP(SECTORSOUND):
 			lookup = FBehavior::StaticLookupString (STACK(2));
 			if (lookup != NULL)
 			{
@@ -8186,7 +9312,7 @@ scriptwait:
 			sp -= 2;
 			break;
 
-		case PCD_AMBIENTSOUND:
+		ACSOP(AMBIENTSOUND):
 			lookup = FBehavior::StaticLookupString (STACK(2));
 			if (lookup != NULL)
 			{
@@ -8197,7 +9323,7 @@ scriptwait:
 			sp -= 2;
 			break;
 
-		case PCD_LOCALAMBIENTSOUND:
+		ACSOP(LOCALAMBIENTSOUND):
 			lookup = FBehavior::StaticLookupString (STACK(2));
 			if (lookup != NULL && activator->CheckLocalView (consoleplayer))
 			{
@@ -8208,7 +9334,7 @@ scriptwait:
 			sp -= 2;
 			break;
 
-		case PCD_ACTIVATORSOUND:
+		ACSOP(ACTIVATORSOUND):
 			lookup = FBehavior::StaticLookupString (STACK(2));
 			if (lookup != NULL)
 			{
@@ -8228,7 +9354,7 @@ scriptwait:
 			sp -= 2;
 			break;
 
-		case PCD_SOUNDSEQUENCE:
+		ACSOP(SOUNDSEQUENCE):
 			lookup = FBehavior::StaticLookupString (STACK(1));
 			if (lookup != NULL)
 			{
@@ -8240,17 +9366,17 @@ scriptwait:
 			sp--;
 			break;
 
-		case PCD_SETLINETEXTURE:
+		ACSOP(SETLINETEXTURE):
 			SetLineTexture (STACK(4), STACK(3), STACK(2), STACK(1));
 			sp -= 4;
 			break;
 
-		case PCD_REPLACETEXTURES:
+		ACSOP(REPLACETEXTURES):
 			ReplaceTextures (STACK(3), STACK(2), STACK(1));
 			sp -= 3;
 			break;
 
-		case PCD_SETLINEBLOCKING:
+		ACSOP(SETLINEBLOCKING):
 			{
 				int line;
 
@@ -8286,7 +9412,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_SETLINEMONSTERBLOCKING:
+		ACSOP(SETLINEMONSTERBLOCKING):
 			{
 				int line;
 
@@ -8303,7 +9429,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_SETLINESPECIAL:
+		ACSOP(SETLINESPECIAL):
 			{
 				int linenum = -1;
 				int specnum = STACK(6);
@@ -8333,7 +9459,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_SETTHINGSPECIAL:
+		ACSOP(SETTHINGSPECIAL):
 			{
 				int specnum = STACK(6);
 				int arg0 = STACK(5);
@@ -8373,7 +9499,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_THINGSOUND:
+		ACSOP(THINGSOUND):
 			lookup = FBehavior::StaticLookupString (STACK(2));
 			if (lookup != NULL)
 			{
@@ -8390,68 +9516,68 @@ scriptwait:
 			sp -= 3;
 			break;
 
-		case PCD_FIXEDMUL:
+		ACSOP(FIXEDMUL):
 			STACK(2) = FixedMul (STACK(2), STACK(1));
 			sp--;
 			break;
 
-		case PCD_FIXEDDIV:
+		ACSOP(FIXEDDIV):
 			STACK(2) = FixedDiv (STACK(2), STACK(1));
 			sp--;
 			break;
 
-		case PCD_SETGRAVITY:
+		ACSOP(SETGRAVITY):
 			level.gravity = ACSToDouble(STACK(1));
 			sp--;
 			break;
 
-		case PCD_SETGRAVITYDIRECT:
-			level.gravity = ACSToDouble(uallong(pc[0]));
+		ACSOP(SETGRAVITYDIRECT):
+			level.gravity = ACSToDouble(pc[0]);
 			pc++;
 			break;
 
-		case PCD_SETAIRCONTROL:
+		ACSOP(SETAIRCONTROL):
 			level.aircontrol = ACSToDouble(STACK(1));
 			sp--;
 			G_AirControlChanged ();
 			break;
 
-		case PCD_SETAIRCONTROLDIRECT:
-			level.aircontrol = ACSToDouble(uallong(pc[0]));
+		ACSOP(SETAIRCONTROLDIRECT):
+			level.aircontrol = ACSToDouble(pc[0]);
 			pc++;
 			G_AirControlChanged ();
 			break;
 
-		case PCD_SPAWN:
+		ACSOP(SPAWN):
 			STACK(6) = DoSpawn (STACK(6), STACK(5), STACK(4), STACK(3), STACK(2), STACK(1), false);
 			sp -= 5;
 			break;
 
-		case PCD_SPAWNDIRECT:
-			PushToStack (DoSpawn (TAGSTR(uallong(pc[0])), uallong(pc[1]), uallong(pc[2]), uallong(pc[3]), uallong(pc[4]), uallong(pc[5]), false));
+		ACSOP(SPAWNDIRECT):
+			PushToStack (DoSpawn (TAGSTR(pc[0]), pc[1], pc[2], pc[3], pc[4], pc[5], false));
 			pc += 6;
 			break;
 
-		case PCD_SPAWNSPOT:
+		ACSOP(SPAWNSPOT):
 			STACK(4) = DoSpawnSpot (STACK(4), STACK(3), STACK(2), STACK(1), false);
 			sp -= 3;
 			break;
 
-		case PCD_SPAWNSPOTDIRECT:
-			PushToStack (DoSpawnSpot (TAGSTR(uallong(pc[0])), uallong(pc[1]), uallong(pc[2]), uallong(pc[3]), false));
+		ACSOP(SPAWNSPOTDIRECT):
+			PushToStack (DoSpawnSpot (TAGSTR(pc[0]), pc[1], pc[2], pc[3], false));
 			pc += 4;
 			break;
 
-		case PCD_SPAWNSPOTFACING:
+		ACSOP(SPAWNSPOTFACING):
 			STACK(3) = DoSpawnSpotFacing (STACK(3), STACK(2), STACK(1), false);
 			sp -= 2;
 			break;
 
-		case PCD_CLEARINVENTORY:
+		ACSOP(CLEARINVENTORY):
 			ClearInventory (activator);
 			break;
 
-		case PCD_CLEARACTORINVENTORY:
+		ACSOP(CLEARACTORINVENTORY):
 			if (STACK(1) == 0)
 			{
 				ClearInventory(NULL);
@@ -8468,12 +9594,12 @@ scriptwait:
 			sp--;
 			break;
 
-		case PCD_GIVEINVENTORY:
+		ACSOP(GIVEINVENTORY):
 			GiveInventory (activator, FBehavior::StaticLookupString (STACK(2)), STACK(1));
 			sp -= 2;
 			break;
 
-		case PCD_GIVEACTORINVENTORY:
+		ACSOP(GIVEACTORINVENTORY):
 			{
 				const char *type = FBehavior::StaticLookupString(STACK(2));
 				if (STACK(3) == 0)
@@ -8493,17 +9619,17 @@ scriptwait:
 			}
 			break;
 
-		case PCD_GIVEINVENTORYDIRECT:
-			GiveInventory (activator, FBehavior::StaticLookupString (TAGSTR(uallong(pc[0]))), uallong(pc[1]));
+		ACSOP(GIVEINVENTORYDIRECT):
+			GiveInventory (activator, FBehavior::StaticLookupString (TAGSTR(pc[0])), pc[1]);
 			pc += 2;
 			break;
 
-		case PCD_TAKEINVENTORY:
+		ACSOP(TAKEINVENTORY):
 			TakeInventory (activator, FBehavior::StaticLookupString (STACK(2)), STACK(1));
 			sp -= 2;
 			break;
 
-		case PCD_TAKEACTORINVENTORY:
+		ACSOP(TAKEACTORINVENTORY):
 			{
 				const char *type = FBehavior::StaticLookupString(STACK(2));
 				if (STACK(3) == 0)
@@ -8523,31 +9649,31 @@ scriptwait:
 			}
 			break;
 
-		case PCD_TAKEINVENTORYDIRECT:
-			TakeInventory (activator, FBehavior::StaticLookupString (TAGSTR(uallong(pc[0]))), uallong(pc[1]));
+		ACSOP(TAKEINVENTORYDIRECT):
+			TakeInventory (activator, FBehavior::StaticLookupString (TAGSTR(pc[0])), pc[1]);
 			pc += 2;
 			break;
 
-		case PCD_CHECKINVENTORY:
+		ACSOP(CHECKINVENTORY):
 			STACK(1) = CheckInventory (activator, FBehavior::StaticLookupString (STACK(1)), false);
 			break;
 
-		case PCD_CHECKACTORINVENTORY:
+		ACSOP(CHECKACTORINVENTORY):
 			STACK(2) = CheckInventory (SingleActorFromTID(STACK(2), NULL),
 										FBehavior::StaticLookupString (STACK(1)), false);
 			sp--;
 			break;
 
-		case PCD_CHECKINVENTORYDIRECT:
-			PushToStack (CheckInventory (activator, FBehavior::StaticLookupString (TAGSTR(uallong(pc[0]))), false));
+		ACSOP(CHECKINVENTORYDIRECT):
+			PushToStack (CheckInventory (activator, FBehavior::StaticLookupString (TAGSTR(pc[0])), false));
 			pc += 1;
 			break;
 
-		case PCD_USEINVENTORY:
+		ACSOP(USEINVENTORY):
 			STACK(1) = UseInventory (activator, FBehavior::StaticLookupString (STACK(1)));
 			break;
 
-		case PCD_USEACTORINVENTORY:
+		ACSOP(USEACTORINVENTORY):
 			{
 				int ret = 0;
 				const char *type = FBehavior::StaticLookupString(STACK(1));
@@ -8569,7 +9695,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_GETSIGILPIECES:
+		ACSOP(GETSIGILPIECES):
 			{
 				AInventory *sigil;
 
@@ -8584,7 +9710,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_GETAMMOCAPACITY:
+		ACSOP(GETAMMOCAPACITY):
 			if (activator != NULL)
 			{
 				PClass *type = PClass::FindClass (FBehavior::StaticLookupString (STACK(1)));
@@ -8613,7 +9739,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_SETAMMOCAPACITY:
+		ACSOP(SETAMMOCAPACITY):
 			if (activator != NULL)
 			{
 				PClass *type = PClass::FindClass (FBehavior::StaticLookupString (STACK(2)));
@@ -8640,17 +9766,17 @@ scriptwait:
 			sp -= 2;
 			break;
 
-		case PCD_SETMUSIC:
+		ACSOP(SETMUSIC):
 			S_ChangeMusic (FBehavior::StaticLookupString (STACK(3)), STACK(2));
 			sp -= 3;
 			break;
 
-		case PCD_SETMUSICDIRECT:
-			S_ChangeMusic (FBehavior::StaticLookupString (TAGSTR(uallong(pc[0]))), uallong(pc[1]));
+		ACSOP(SETMUSICDIRECT):
+			S_ChangeMusic (FBehavior::StaticLookupString (TAGSTR(pc[0])), pc[1]);
 			pc += 3;
 			break;
 
-		case PCD_LOCALSETMUSIC:
+		ACSOP(LOCALSETMUSIC):
 			if (activator == players[consoleplayer].mo)
 			{
 				S_ChangeMusic (FBehavior::StaticLookupString (STACK(3)), STACK(2));
@@ -8658,26 +9784,26 @@ scriptwait:
 			sp -= 3;
 			break;
 
-		case PCD_LOCALSETMUSICDIRECT:
+		ACSOP(LOCALSETMUSICDIRECT):
 			if (activator == players[consoleplayer].mo)
 			{
-				S_ChangeMusic (FBehavior::StaticLookupString (TAGSTR(uallong(pc[0]))), uallong(pc[1]));
+				S_ChangeMusic (FBehavior::StaticLookupString (TAGSTR(pc[0])), pc[1]);
 			}
 			pc += 3;
 			break;
 
-		case PCD_FADETO:
+		ACSOP(FADETO):
 			DoFadeTo (STACK(5), STACK(4), STACK(3), STACK(2), STACK(1));
 			sp -= 5;
 			break;
 
-		case PCD_FADERANGE:
+		ACSOP(FADERANGE):
 			DoFadeRange (STACK(9), STACK(8), STACK(7), STACK(6),
 						 STACK(5), STACK(4), STACK(3), STACK(2), STACK(1));
 			sp -= 9;
 			break;
 
-		case PCD_CANCELFADE:
+		ACSOP(CANCELFADE):
 			{
 				TThinkerIterator<DFlashFader> iterator;
 				DFlashFader *fader;
@@ -8692,11 +9818,11 @@ scriptwait:
 			}
 			break;
 
-		case PCD_PLAYMOVIE:
+		ACSOP(PLAYMOVIE):
 			STACK(1) = I_PlayMovie (FBehavior::StaticLookupString (STACK(1)));
 			break;
 
-		case PCD_SETACTORPOSITION:
+		ACSOP(SETACTORPOSITION):
 			{
 				bool result = false;
 				AActor *actor = SingleActorFromTID (STACK(5), activator);
@@ -8707,9 +9833,9 @@ scriptwait:
 			}
 			break;
 
-		case PCD_GETACTORX:
-		case PCD_GETACTORY:
-		case PCD_GETACTORZ:
+		ACSOP(GETACTORX):
+		ACSOP(GETACTORY):
+		ACSOP(GETACTORZ):
 			{
 				AActor *actor = SingleActorFromTID(STACK(1), activator);
 				if (actor == NULL)
@@ -8727,35 +9853,35 @@ scriptwait:
 			}
 			break;
 
-		case PCD_GETACTORFLOORZ:
+		ACSOP(GETACTORFLOORZ):
 			{
 				AActor *actor = SingleActorFromTID(STACK(1), activator);
 				STACK(1) = actor == NULL ? 0 : DoubleToACS(actor->floorz);
 			}
 			break;
 
-		case PCD_GETACTORCEILINGZ:
+		ACSOP(GETACTORCEILINGZ):
 			{
 				AActor *actor = SingleActorFromTID(STACK(1), activator);
 				STACK(1) = actor == NULL ? 0 : DoubleToACS(actor->ceilingz);
 			}
 			break;
 
-		case PCD_GETACTORANGLE:
+		ACSOP(GETACTORANGLE):
 			{
 				AActor *actor = SingleActorFromTID(STACK(1), activator);
 				STACK(1) = actor == NULL ? 0 : AngleToACS(actor->Angles.Yaw);
 			}
 			break;
 
-		case PCD_GETACTORPITCH:
+		ACSOP(GETACTORPITCH):
 			{
 				AActor *actor = SingleActorFromTID(STACK(1), activator);
 				STACK(1) = actor == NULL ? 0 : PitchToACS(actor->Angles.Pitch);
 			}
 			break;
 
-		case PCD_GETLINEROWOFFSET:
+		ACSOP(GETLINEROWOFFSET):
 			if (activationline != NULL)
 			{
 				PushToStack (int(activationline->sidedef[0]->GetTextureYOffset(side_t::mid)));
@@ -8766,8 +9892,8 @@ scriptwait:
 			}
 			break;
 
-		case PCD_GETSECTORFLOORZ:
-		case PCD_GETSECTORCEILINGZ:
+		ACSOP(GETSECTORFLOORZ):
+		ACSOP(GETSECTORCEILINGZ):
 			// Arguments are (tag, x, y). If you don't use slopes, then (x, y) don't
 			// really matter and can be left as (0, 0) if you like.
 			// [Dusk] If tag = 0, then this returns the z height at whatever sector
@@ -8800,7 +9926,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_GETSECTORLIGHTLEVEL:
+		ACSOP(GETSECTORLIGHTLEVEL):
 			{
 				int secnum = P_FindFirstSectorFromTag (STACK(1));
 				int z = -1;
@@ -8813,19 +9939,19 @@ scriptwait:
 			}
 			break;
 
-		case PCD_SETFLOORTRIGGER:
+		ACSOP(SETFLOORTRIGGER):
 			new DPlaneWatcher (activator, activationline, backSide, false, STACK(8),
 				STACK(7), STACK(6), STACK(5), STACK(4), STACK(3), STACK(2), STACK(1));
 			sp -= 8;
 			break;
 
-		case PCD_SETCEILINGTRIGGER:
+		ACSOP(SETCEILINGTRIGGER):
 			new DPlaneWatcher (activator, activationline, backSide, true, STACK(8),
 				STACK(7), STACK(6), STACK(5), STACK(4), STACK(3), STACK(2), STACK(1));
 			sp -= 8;
 			break;
 
-		case PCD_STARTTRANSLATION:
+		ACSOP(STARTTRANSLATION):
 			{
 				int i = STACK(1);
 				sp--;
@@ -8842,7 +9968,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_TRANSLATIONRANGE1:
+		ACSOP(TRANSLATIONRANGE1):
 			{ // translation using palette shifting
 				int start = STACK(4);
 				int end = STACK(3);
@@ -8855,7 +9981,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_TRANSLATIONRANGE2:
+		ACSOP(TRANSLATIONRANGE2):
 			{ // translation using RGB values
 			  // (would HSV be a good idea too?)
 				int start = STACK(8);
@@ -8873,7 +9999,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_TRANSLATIONRANGE3:
+		ACSOP(TRANSLATIONRANGE3):
 			{ // translation using desaturation
 				int start = STACK(8);
 				int end = STACK(7);
@@ -8892,7 +10018,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_ENDTRANSLATION:
+		ACSOP(ENDTRANSLATION):
 			if (translation != NULL)
 			{
 				translation->UpdateNative();
@@ -8900,20 +10026,20 @@ scriptwait:
 			}
 			break;
 
-		case PCD_SIN:
+		ACSOP(SIN):
 			STACK(1) = DoubleToACS(ACSToAngle(STACK(1)).Sin());
 			break;
 
-		case PCD_COS:
+		ACSOP(COS):
 			STACK(1) = DoubleToACS(ACSToAngle(STACK(1)).Cos());
 			break;
 
-		case PCD_VECTORANGLE:
+		ACSOP(VECTORANGLE):
 			STACK(2) = AngleToACS(VecToAngle(STACK(2), STACK(1)).Degrees);
 			sp--;
 			break;
 
-        case PCD_CHECKWEAPON:
+        ACSOP(CHECKWEAPON):
             if (activator == NULL || activator->player == NULL || // Non-players do not have weapons
                 activator->player->ReadyWeapon == NULL)
             {
@@ -8925,7 +10051,7 @@ scriptwait:
             }
             break;
 
-		case PCD_SETWEAPON:
+		ACSOP(SETWEAPON):
 			if (activator == NULL || activator->player == NULL)
 			{
 				STACK(1) = 0;
@@ -8964,7 +10090,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_SETMARINEWEAPON:
+		ACSOP(SETMARINEWEAPON):
 			if (STACK(2) != 0)
 			{
 				AActor *marine;
@@ -8985,7 +10111,7 @@ scriptwait:
 			sp -= 2;
 			break;
 
-		case PCD_SETMARINESPRITE:
+		ACSOP(SETMARINESPRITE):
 			{
 				PClassActor *type = PClass::FindActor(FBehavior::StaticLookupString (STACK(1)));
 
@@ -9017,22 +10143,22 @@ scriptwait:
 			sp -= 2;
 			break;
 
-		case PCD_SETACTORPROPERTY:
+		ACSOP(SETACTORPROPERTY):
 			SetActorProperty (STACK(3), STACK(2), STACK(1));
 			sp -= 3;
 			break;
 
-		case PCD_GETACTORPROPERTY:
+		ACSOP(GETACTORPROPERTY):
 			STACK(2) = GetActorProperty (STACK(2), STACK(1));
 			sp -= 1;
 			break;
 
-		case PCD_GETPLAYERINPUT:
+		ACSOP(GETPLAYERINPUT):
 			STACK(2) = GetPlayerInput (STACK(2), STACK(1));
 			sp -= 1;
 			break;
 
-		case PCD_PLAYERNUMBER:
+		ACSOP(PLAYERNUMBER):
 			if (activator == NULL || activator->player == NULL)
 			{
 				PushToStack (-1);
@@ -9043,7 +10169,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_PLAYERINGAME:
+		ACSOP(PLAYERINGAME):
 			if (STACK(1) < 0 || STACK(1) >= MAXPLAYERS)
 			{
 				STACK(1) = false;
@@ -9052,9 +10178,9 @@ scriptwait:
 			{
 				STACK(1) = playeringame[STACK(1)];
 			}
-			break;
+			NEXTOP;
 
-		case PCD_PLAYERISBOT:
+		ACSOP(PLAYERISBOT):
 			if (STACK(1) < 0 || STACK(1) >= MAXPLAYERS || !playeringame[STACK(1)])
 			{
 				STACK(1) = false;
@@ -9063,9 +10189,9 @@ scriptwait:
 			{
 				STACK(1) = (players[STACK(1)].Bot != NULL);
 			}
-			break;
+			NEXTOP;
 
-		case PCD_ACTIVATORTID:
+		ACSOP(ACTIVATORTID):
 			if (activator == NULL)
 			{
 				PushToStack (0);
@@ -9074,17 +10200,17 @@ scriptwait:
 			{
 				PushToStack (activator->tid);
 			}
-			break;
+			NEXTOP;
 
-		case PCD_GETSCREENWIDTH:
+		ACSOP(GETSCREENWIDTH):
 			PushToStack (SCREENWIDTH);
-			break;
+			NEXTOP;
 
-		case PCD_GETSCREENHEIGHT:
+		ACSOP(GETSCREENHEIGHT):
 			PushToStack (SCREENHEIGHT);
-			break;
+			NEXTOP;
 
-		case PCD_THING_PROJECTILE2:
+		ACSOP(THING_PROJECTILE2):
 			// Like Thing_Projectile(Gravity) specials, but you can give the
 			// projectile a TID.
 			// Thing_Projectile2 (tid, type, angle, speed, vspeed, gravity, newtid);
@@ -9093,14 +10219,14 @@ scriptwait:
 			sp -= 7;
 			break;
 
-		case PCD_SPAWNPROJECTILE:
+		ACSOP(SPAWNPROJECTILE):
 			// Same, but takes an actor name instead of a spawn ID.
 			P_Thing_Projectile(STACK(7), activator, 0, FBehavior::StaticLookupString(STACK(6)), STACK(5) * (360. / 256.),
 				STACK(4) / 8., STACK(3) / 8., 0, NULL, STACK(2), STACK(1), false);
 			sp -= 7;
 			break;
 
-		case PCD_STRLEN:
+		ACSOP(STRLEN):
 			{
 				const char *str = FBehavior::StaticLookupString(STACK(1));
 				if (str != NULL)
@@ -9119,11 +10245,11 @@ scriptwait:
 			}
 			break;
 
-		case PCD_GETCVAR:
+		ACSOP(GETCVAR):
 			STACK(1) = DoGetCVar(GetCVar(activator, FBehavior::StaticLookupString(STACK(1))), false);
 			break;
 
-		case PCD_SETHUDSIZE:
+		ACSOP(SETHUDSIZE):
 			hudwidth = abs (STACK(3));
 			hudheight = abs (STACK(2));
 			if (STACK(1) != 0)
@@ -9131,9 +10257,9 @@ scriptwait:
 				hudheight = -hudheight;
 			}
 			sp -= 3;
-			break;
+			NEXTOP;
 
-		case PCD_GETLEVELINFO:
+		ACSOP(GETLEVELINFO):
 			switch (STACK(1))
 			{
 			case LEVELINFO_PAR_TIME:		STACK(1) = level.partime;			break;
@@ -9150,7 +10276,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_CHANGESKY:
+		ACSOP(CHANGESKY):
 			{
 				const char *sky1name, *sky2name;
 
@@ -9169,7 +10295,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_SETCAMERATOTEXTURE:
+		ACSOP(SETCAMERATOTEXTURE):
 			{
 				const char *picname = FBehavior::StaticLookupString (STACK(2));
 				AActor *camera;
@@ -9200,17 +10326,17 @@ scriptwait:
 			}
 			break;
 
-		case PCD_SETACTORANGLE:		// [GRB]
+		ACSOP(SETACTORANGLE):		// [GRB]
 			SetActorAngle(activator, STACK(2), STACK(1), false);
 			sp -= 2;
 			break;
 
-		case PCD_SETACTORPITCH:
+		ACSOP(SETACTORPITCH):
 			SetActorPitch(activator, STACK(2), STACK(1), false);
 			sp -= 2;
 			break;
 
-		case PCD_SETACTORSTATE:
+		ACSOP(SETACTORSTATE):
 			{
 				const char *statename = FBehavior::StaticLookupString (STACK(2));
 				FState *state;
@@ -9252,7 +10378,7 @@ scriptwait:
 			}
 			break;
 
-		case PCD_PLAYERCLASS:		// [GRB]
+		ACSOP(PLAYERCLASS):		// [GRB]
 			if (STACK(1) < 0 || STACK(1) >= MAXPLAYERS || !playeringame[STACK(1)])
 			{
 				STACK(1) = -1;
@@ -9261,9 +10387,9 @@ scriptwait:
 			{
 				STACK(1) = players[STACK(1)].CurrentPlayerClass;
 			}
-			break;
+			NEXTOP;
 
-		case PCD_GETPLAYERINFO:		// [GRB]
+		ACSOP(GETPLAYERINFO):		// [GRB]
 			if (STACK(2) < 0 || STACK(2) >= MAXPLAYERS || !playeringame[STACK(2)])
 			{
 				STACK(2) = -1;
@@ -9290,14 +10416,14 @@ scriptwait:
 			sp -= 1;
 			break;
 
-		case PCD_CHANGELEVEL:
+		ACSOP(CHANGELEVEL):
 			{
 				G_ChangeLevel(FBehavior::StaticLookupString(STACK(4)), STACK(3), STACK(2), STACK(1));
 				sp -= 4;
 			}
 			break;
 
-		case PCD_SECTORDAMAGE:
+		ACSOP(SECTORDAMAGE):
 			{
 				int tag = STACK(5);
 				int amount = STACK(4);
@@ -9311,22 +10437,22 @@ scriptwait:
 			}
 			break;
 
-		case PCD_THINGDAMAGE2:
+		ACSOP(THINGDAMAGE2):
 			STACK(3) = P_Thing_Damage (STACK(3), activator, STACK(2), FName(FBehavior::StaticLookupString(STACK(1))));
 			sp -= 2;
 			break;
 
-		case PCD_CHECKACTORCEILINGTEXTURE:
+		ACSOP(CHECKACTORCEILINGTEXTURE):
 			STACK(2) = DoCheckActorTexture(STACK(2), activator, STACK(1), false);
 			sp--;
 			break;
 
-		case PCD_CHECKACTORFLOORTEXTURE:
+		ACSOP(CHECKACTORFLOORTEXTURE):
 			STACK(2) = DoCheckActorTexture(STACK(2), activator, STACK(1), true);
 			sp--;
 			break;
 
-		case PCD_GETACTORLIGHTLEVEL:
+		ACSOP(GETACTORLIGHTLEVEL):
 		{
 			AActor *actor = SingleActorFromTID(STACK(1), activator);
 			if (actor != NULL)
@@ -9356,12 +10482,12 @@ scriptwait:
 			break;
 		}
 
-		case PCD_SETMUGSHOTSTATE:
+		ACSOP(SETMUGSHOTSTATE):
 			StatusBar->SetMugShotState(FBehavior::StaticLookupString(STACK(1)));
 			sp--;
 			break;
 
-		case PCD_CHECKPLAYERCAMERA:
+		ACSOP(CHECKPLAYERCAMERA):
 			{
 				int playernum = STACK(1);
 
@@ -9374,13 +10500,13 @@ scriptwait:
 					STACK(1) = players[playernum].camera->tid;
 				}
 			}
-			break;
+			NEXTOP;
 
-		case PCD_CLASSIFYACTOR:
+		ACSOP(CLASSIFYACTOR):
 			STACK(1) = DoClassifyActor(STACK(1));
 			break;
 
-		case PCD_MORPHACTOR:
+		ACSOP(MORPHACTOR):
 			{
 				int tag = STACK(7);
 				FName playerclass_name = FBehavior::StaticLookupString(STACK(6));
@@ -9430,7 +10556,7 @@ scriptwait:
 			}	
 			break;
 
-		case PCD_UNMORPHACTOR:
+		ACSOP(UNMORPHACTOR):
 			{
 				int tag = STACK(2);
 				bool force = !!STACK(1);
@@ -9490,7 +10616,7 @@ scriptwait:
 			}	
 			break;
 
-		case PCD_SAVESTRING:
+		ACSOP(SAVESTRING):
 			// Saves the string
 			{
 				const int str = GlobalACSStrings.AddString(work);
@@ -9499,10 +10625,10 @@ scriptwait:
 			}		
 			break;
 
-		case PCD_STRCPYTOSCRIPTCHRANGE:
-		case PCD_STRCPYTOMAPCHRANGE:
-		case PCD_STRCPYTOWORLDCHRANGE:
-		case PCD_STRCPYTOGLOBALCHRANGE:
+		ACSOP(STRCPYTOSCRIPTCHRANGE):
+		ACSOP(STRCPYTOMAPCHRANGE):
+		ACSOP(STRCPYTOWORLDCHRANGE):
+		ACSOP(STRCPYTOGLOBALCHRANGE):
 			// source: stringid(2); stringoffset(1)
 			// destination: capacity (3); stringoffset(4); arrayid (5); offset(6)
 
@@ -9595,8 +10721,8 @@ scriptwait:
 			}
 			break;
 
-		case PCD_CONSOLECOMMAND:
-		case PCD_CONSOLECOMMANDDIRECT:
+		ACSOP(CONSOLECOMMAND):
+		ACSOP(CONSOLECOMMANDDIRECT):
 			Printf (TEXTCOLOR_RED GAMENAME " doesn't support execution of console commands from scripts\n");
 			if (pcd == PCD_CONSOLECOMMAND)
 				sp -= 3;
@@ -9606,9 +10732,26 @@ scriptwait:
  		}
  	}
 
-	if (runaway != 0 && InModuleScriptNumber >= 0)
+	if (--ACSRunDepth == 0)
+	{
+		ACSTotalCycles.Unclock();
+	}
+	if (profiling)
+	{
+		VMProfileLeave();
+	}
+
+	if (runaway != 0)
+	{
+		ACSTotalProfile.AddRun(runaway);
+		if (InModuleScriptNumber >= 0)
+		{
+			activeBehavior->GetScriptPtr(InModuleScriptNumber)->ProfileData.AddRun(runaway);
+		}
+	}
+	if (comparevm)
 	{
-		activeBehavior->GetScriptPtr(InModuleScriptNumber)->ProfileData.AddRun(runaway);
+		EndVMCompare(vmtic, pc);
 	}
 
 	if (state == SCRIPT_DivideBy0)
@@ -9629,6 +10772,7 @@ scriptwait:
 			*running == this)
 		{
 			controller->RunningScripts.Remove(script);
+			controller->WakeScripts(DACSThinker::WAIT_Script, script);
 		}
 	}
 	else
@@ -9685,6 +10829,8 @@ DLevelScript::DLevelScript (AActor *who, line_t *where, int num, const ScriptPtr
 	ClipRectLeft = ClipRectTop = ClipRectWidth = ClipRectHeight = WrapWidth = 0;
 	HandleAspect = true;
 	state = SCRIPT_Running;
+	WaitQueue = -1;
+	NextWaiting = NULL;
 
 	// Hexen waited one second before executing any open scripts. I didn't realize
 	// this when I wrote my ACS implementation. Now that I know, it's still best to
@@ -9693,7 +10839,10 @@ DLevelScript::DLevelScript (AActor *who, line_t *where, int num, const ScriptPtr
 	// goes by while they're in their default state.
 
 	if (!(flags & ACS_ALWAYS))
+	{
 		DACSThinker::ActiveThinker->RunningScripts[num] = this;
+		DACSThinker::ActiveThinker->WakeScripts(DACSThinker::WAIT_Script, num);
+	}
 
 	Link();
 
@@ -9919,6 +11068,7 @@ void ACSProfileInfo::Reset()
 {
 	TotalInstr = 0;
 	NumRuns = 0;
+	VMRuns = 0;
 	MinInstrPerRun = UINT_MAX;
 	MaxInstrPerRun = 0;
 }
@@ -9937,6 +11087,19 @@ void ACSProfileInfo::AddRun(unsigned int num_instr)
 	}
 }
 
+// Functions that run on the VM are not counted in instructions, so their
+// runs only count as runs.
+void ACSProfileInfo::AddVMRun()
+{
+	NumRuns++;
+	VMRuns++;
+}
+
+unsigned int ACSProfileInfo::AvgInstrPerRun() const
+{
+	return NumRuns > VMRuns ? unsigned(TotalInstr / (NumRuns - VMRuns)) : 0;
+}
+
 void ArrangeScriptProfiles(TArray<ProfileCollector> &profiles)
 {
 	for (unsigned int mod_num = 0; mod_num < FBehavior::StaticModules.Size(); ++mod_num)
@@ -10012,8 +11175,8 @@ static int sort_by_avg(const void *a_, const void *b_)
 	const ProfileCollector *a = (const ProfileCollector *)a_;
 	const ProfileCollector *b = (const ProfileCollector *)b_;
 
-	int a_avg = a->ProfileData->NumRuns == 0 ? 0 : int(a->ProfileData->TotalInstr / a->ProfileData->NumRuns);
-	int b_avg = b->ProfileData->NumRuns == 0 ? 0 : int(b->ProfileData->TotalInstr / b->ProfileData->NumRuns);
+	int a_avg = int(a->ProfileData->AvgInstrPerRun());
+	int b_avg = int(b->ProfileData->AvgInstrPerRun());
 	return b_avg - a_avg;
 }
 
@@ -10052,8 +11215,8 @@ static void ShowProfileData(TArray<ProfileCollector> &profiles, long ilimit,
 		limit = UINT_MAX;
 	}
 
-	Printf(TEXTCOLOR_YELLOW "Module       %-20s      Total    Runs     Avg     Min     Max\n", typelabels[functions]);
-	Printf(TEXTCOLOR_YELLOW "------------ -------------------- ---------- ------- ------- ------- -------\n");
+	Printf(TEXTCOLOR_YELLOW "Module       %-20s      Total    Runs  VMRuns     Avg     Min     Max\n", typelabels[functions]);
+	Printf(TEXTCOLOR_YELLOW "------------ -------------------- ---------- ------- ------- ------- ------- -------\n");
 	for (unsigned int i = 0; i < limit && i < profiles.Size(); ++i)
 	{
 		ProfileCollector *prof = &profiles[i];
@@ -10084,12 +11247,13 @@ static void ShowProfileData(TArray<ProfileCollector> &profiles, long ilimit,
 			mysnprintf(scriptname, sizeof(scriptname), "%s",
 				ScriptPresentation(prof->Module->GetScriptPtr(prof->Index)->Number).GetChars() + 7);
 		}
-		Printf("%-12s %-20s%11llu%8u%8u%8u%8u\n",
+		Printf("%-12s %-20s%11llu%8u%8u%8u%8u%8u\n",
 			modname, scriptname,
 			prof->ProfileData->TotalInstr,
 			prof->ProfileData->NumRuns,
-			unsigned(prof->ProfileData->TotalInstr / prof->ProfileData->NumRuns),
-			prof->ProfileData->MinInstrPerRun,
+			prof->ProfileData->VMRuns,
+			prof->ProfileData->AvgInstrPerRun(),
+			prof->ProfileData->NumRuns > prof->ProfileData->VMRuns ? prof->ProfileData->MinInstrPerRun : 0,
 			prof->ProfileData->MaxInstrPerRun
 			);
 	}
@@ -10124,6 +11288,8 @@ CCMD(acsprofile)
 		{
 			ClearProfiles(ScriptProfiles);
 			ClearProfiles(FuncProfiles);
+			ACSTotalProfile.Reset();
+			ACSTotalCycles.Reset();
 			return;
 		}
 		for (int i = 1; i < argv.argc(); ++i)
@@ -10164,4 +11330,9 @@ CCMD(acsprofile)
 
 	ShowProfileData(ScriptProfiles, limit, sorter, false);
 	ShowProfileData(FuncProfiles, limit, sorter, true);
+
+	double ms = ACSTotalCycles.TimeMS();
+	Printf(TEXTCOLOR_ORANGE "Overall: " TEXTCOLOR_NORMAL "%llu instructions in %u runs, %.3f ms, %.1f instructions/us\n",
+		ACSTotalProfile.TotalInstr, ACSTotalProfile.NumRuns, ms,
+		ms > 0 ? ACSTotalProfile.TotalInstr / (ms * 1000) : 0.);
 }
@@ -45,6 +45,8 @@
 class FFont;
 class FileReader;
 struct line_t;
+struct sector_t;
+class VMScriptFunction;
 
 
 enum
@@ -98,29 +100,75 @@ public:
 	void ReadStrings(FSerializer &file, const char *key);
 	void WriteStrings(FSerializer &file, const char *key) const;
 
+	// Incremental collection, driven by P_StepACSStrings. A full collection
+	// marks everything; a minor one only sweeps strings created since the
+	// last collection and relies on WriteBarrier to learn about young
+	// strings stored in the arrays it does not look at.
+	enum EGCState { GCS_Idle, GCS_Mark, GCS_Sweep };
+
+	bool CollectionDue() const;
+	bool FullCollectionDue() const { return LiveCount >= FullThreshold; }
+	void BeginCollection(bool full);
+	void FinishMarking();
+	bool SweepStep(size_t &work, size_t budget);
+	void AbortMarking();
+	EGCState GetGCState() const { return State; }
+	bool IsFullCollection() const { return FullCollection; }
+	unsigned int GetLiveCount() const { return LiveCount; }
+	unsigned int GetYoungCount() const { return YoungList.Size(); }
+	unsigned int GetPoolSize() const { return Pool.Size(); }
+
+	void WriteBarrier(int strnum)
+	{
+		if ((strnum & LIBRARYID_MASK) == STRPOOL_LIBRARYID_OR)
+		{
+			Barrier(strnum & ~LIBRARYID_MASK);
+		}
+	}
+
 private:
 	int FindString(const char *str, size_t len, unsigned int h, unsigned int bucketnum);
 	int InsertString(FString &str, unsigned int h, unsigned int bucketnum);
 	void FindFirstFreeEntry(unsigned int base);
+	void FreeEntry(unsigned int index);
+	void UnlinkEntry(unsigned int index);
+	void Barrier(unsigned int index);
+	void NextEpoch();
 
-	enum { NUM_BUCKETS = 251 };
+	enum { NUM_BUCKETS = 4093 };		// Big enough that unlinking a single entry is cheap
 	enum { FREE_ENTRY = 0xFFFFFFFE };	// Stored in PoolEntry's Next field
 	enum { NO_ENTRY = 0xFFFFFFFF };
 	enum { MIN_GC_SIZE = 100 };			// Don't auto-collect until there are this many strings
+	enum { MINOR_GC_SIZE = 1024 };		// Young strings before a minor collection is started
 	struct PoolEntry
 	{
 		FString Str;
 		unsigned int Hash;
 		unsigned int Next;
 		unsigned int LockCount;
+		unsigned int Mark;				// Marked if equal to MarkEpoch
+		bool Young;						// Not yet survived a collection
 	};
 	TArray<PoolEntry> Pool;
 	unsigned int PoolBuckets[NUM_BUCKETS];
 	unsigned int FirstFreeEntry;
+
+	TArray<unsigned int> YoungList;		// Indices of young entries
+	TArray<unsigned int> SweepList;		// What a minor collection is sweeping
+	unsigned int MarkEpoch;
+	unsigned int LiveCount;
+	unsigned int FullThreshold;			// LiveCount that starts a full collection
+	unsigned int SweepPos;				// Bucket or SweepList index
+	EGCState State;
+	bool FullCollection;
 };
 extern ACSStringPool GlobalACSStrings;
 
 void P_CollectACSGlobalStrings();
+void P_StepACSStrings(size_t budget);
+void P_WakeACSTagWaiters(sector_t *sector);
+void P_WakeACSPolyWaiters(int polynum);
+
 void P_ReadACSVars(FSerializer &);
 void P_WriteACSVars(FSerializer &);
 void P_ClearACSVars(bool);
@@ -129,11 +177,14 @@ struct ACSProfileInfo
 {
 	unsigned long long TotalInstr;
 	unsigned int NumRuns;
+	unsigned int VMRuns;			// included in NumRuns, but not counted in instructions
 	unsigned int MinInstrPerRun;
 	unsigned int MaxInstrPerRun;
 
 	ACSProfileInfo();
 	void AddRun(unsigned int num_instr);
+	void AddVMRun();
+	unsigned int AvgInstrPerRun() const;
 	void Reset();
 };
 
@@ -283,6 +334,25 @@ enum
 
 enum ACSFormat { ACS_Old, ACS_Enhanced, ACS_LittleEnhanced, ACS_Unknown };
 
+// How a function or script translated to VM code finished
+enum
+{
+	ACSVM_Done,
+	ACSVM_Runaway,
+	ACSVM_DivideBy0,
+	ACSVM_ModulusBy0,
+	ACSVM_Delayed		// scripts only
+};
+
+// Whether a function has been translated to VM code yet
+enum
+{
+	VMSTATE_Untried,
+	VMSTATE_Failed,
+	VMSTATE_Compiled,
+	VMSTATE_CompiledPure		// and does not change any variables outside itself
+};
+
 class FBehavior
 {
 public:
@@ -295,9 +365,20 @@ public:
 	BYTE *NextChunk (BYTE *chunk) const;
 	const ScriptPtr *FindScript (int number) const;
 	void StartTypedScripts (WORD type, AActor *activator, bool always, int arg1, bool runNow);
-	DWORD PC2Ofs (int *pc) const { return (DWORD)((BYTE *)pc - Data); }
-	int *Ofs2PC (DWORD ofs) const {	return (int *)(Data + ofs); }
-	int *Jump2PC (DWORD jumpPoint) const { return Ofs2PC(JumpPoints[jumpPoint]); }
+	DWORD PC2Ofs (int *pc) const;
+	int *Ofs2PC (DWORD ofs) const;
+	int *Index2PC (int index) const { return const_cast<int *>(&Code[index]); }
+	int *Jump2PC (DWORD jumpPoint) const { return Index2PC(JumpPoints[jumpPoint]); }
+	int *GetFunctionAddress (const ScriptFunction *func) const { return Index2PC(FunctionCode[func - Functions]); }
+	int GetNumFunctions () const { return NumFunctions; }
+	int GetFunctionIndex (const ScriptFunction *func) const { return int(func - Functions); }
+	FString GetFunctionName (int index) const;
+	VMScriptFunction *GetCompiledFunction (const ScriptFunction *func, bool *pure = NULL);
+	int GetCompiledFunctionState (int index) const { return (unsigned)index < CompileState.Size() ? CompileState[index] : VMSTATE_Untried; }
+	VMScriptFunction *GetCompiledScript (int index, const int *pc);
+	int GetCompiledScriptState (int index) const { return (unsigned)index < ScriptCompileState.Size() ? ScriptCompileState[index] : VMSTATE_Untried; }
+	int GetNumScripts () const { return NumScripts; }
+	int PC2Index (const int *pc) const { return int(pc - &Code[0]); }
 	ACSFormat GetFormat() const { return Format; }
 	ScriptFunction *GetFunction (int funcnum, FBehavior *&module) const;
 	int GetArrayVal (int arraynum, int index) const;
@@ -308,7 +389,7 @@ public:
 	int FindMapVarName (const char *varname) const;
 	int FindMapArray (const char *arrayname) const;
 	int GetLibraryID () const { return LibraryID; }
-	int *GetScriptAddress (const ScriptPtr *ptr) const { return (int *)(ptr->Address + Data); }
+	int *GetScriptAddress (const ScriptPtr *ptr) const { return Ofs2PC(ptr->Address); }
 	int GetScriptIndex (const ScriptPtr *ptr) const { ptrdiff_t index = ptr - Scripts; return index >= NumScripts ? -1 : (int)index; }
 	ScriptPtr *GetScriptPtr(int index) const { return index >= 0 && index < NumScripts ? &Scripts[index] : NULL; }
 	int GetLumpNum() const { return LumpNum; }
@@ -326,7 +407,7 @@ public:
 	static bool StaticCheckAllGood ();
 	static FBehavior *StaticGetModule (int lib);
 	static void StaticSerializeModuleStates (FSerializer &arc);
-	static void StaticMarkLevelVarStrings();
+	static void StaticMarkLevelVarStrings(bool arrays = true);
 	static void StaticLockLevelVarStrings();
 	static void StaticUnlockLevelVarStrings();
 
@@ -335,6 +416,8 @@ public:
 	static void StaticStartTypedScripts (WORD type, AActor *activator, bool always, int arg1=0, bool runNow=false);
 	static void StaticStopMyScripts (AActor *actor);
 
+	const SDWORD *GetMapArray (int arraynum, unsigned int &size) const;
+
 private:
 	struct ArrayInfo;
 
@@ -358,11 +441,34 @@ private:
 	TArray<FBehavior *> Imports;
 	DWORD LibraryID;
 	char ModuleName[9];
-	TArray<int> JumpPoints;
+	TArray<int> JumpPoints;		// Indices into Code once the module is loaded
+
+	// The module's code, decoded once at load time into one int per opcode
+	// and operand, with jump operands turned into indices into this array.
+	// Code[0] is a PCD_TERMINATE that anything undecodable leads to.
+	// Offsets into the lump are only kept for savegames.
+	TArray<int> Code;
+	TMap<DWORD, int> CodeMap;			// lump offset -> index
+	TArray<int> InstrIndex;				// index of each decoded instruction
+	TArray<DWORD> InstrOffset;			// and the lump offset it came from
+	TArray<int> FunctionCode;			// entry index of each local function
+
+	// Functions translated to VM code the first time they are called
+	TArray<VMScriptFunction *> CompiledFunctions;
+	TArray<BYTE> CompileState;
+
+	// Scripts translated to VM code the first time they run, and the code
+	// indices they can be entered at: their start and the instruction after
+	// each delay, mapped to the script's index.
+	TArray<VMScriptFunction *> CompiledScripts;
+	TArray<BYTE> ScriptCompileState;
+	TMap<int, int> ResumePoints;
 
 	static TArray<FBehavior *> StaticModules;
 
 	void LoadScriptsDirectory ();
+	void DecodeCode ();
+	void FreeCompiledFunctions ();
 
 	static int SortScripts (const void *a, const void *b);
 	void UnencryptStrings ();
@@ -372,7 +478,7 @@ private:
 	void SerializeVars (FSerializer &arc);
 	void SerializeVarSet (FSerializer &arc, SDWORD *vars, int max);
 
-	void MarkMapVarStrings() const;
+	void MarkMapVarStrings(bool arrays) const;
 	void LockMapVarStrings() const;
 	void UnlockMapVarStrings() const;
 
@@ -380,6 +486,21 @@ private:
 	friend void ArrangeFunctionProfiles(TArray<ProfileCollector> &profiles);
 };
 
+int ACS_CallCompiledFunction (VMScriptFunction *func, const SDWORD *args, int &status);
+void ACS_ReportVMMismatch (FBehavior *module, const ScriptFunction *func, int vmresult, int result);
+FString ScriptPresentation (int script);
+
+// What a translated script did during one tic, kept by acs_vmcompare
+// until the interpreter has run the same tic.
+struct FACSVMTic
+{
+	int State;
+	int StateData;
+	int *PC;
+	TArray<int32_t> Locals;
+	TArray<SDWORD> Vars;
+};
+
 class DLevelScript : public DObject
 {
 	DECLARE_CLASS (DLevelScript, DObject)
@@ -389,391 +510,8 @@ public:
 	// P-codes for ACS scripts
 	enum
 	{
-/*  0*/	PCD_NOP,
-		PCD_TERMINATE,
-		PCD_SUSPEND,
-		PCD_PUSHNUMBER,
-		PCD_LSPEC1,
-		PCD_LSPEC2,
-		PCD_LSPEC3,
-		PCD_LSPEC4,
-		PCD_LSPEC5,
-		PCD_LSPEC1DIRECT,
-/* 10*/	PCD_LSPEC2DIRECT,
-		PCD_LSPEC3DIRECT,
-		PCD_LSPEC4DIRECT,
-		PCD_LSPEC5DIRECT,
-		PCD_ADD,
-		PCD_SUBTRACT,
-		PCD_MULTIPLY,
-		PCD_DIVIDE,
-		PCD_MODULUS,
-		PCD_EQ,
-/* 20*/ PCD_NE,
-		PCD_LT,
-		PCD_GT,
-		PCD_LE,
-		PCD_GE,
-		PCD_ASSIGNSCRIPTVAR,
-		PCD_ASSIGNMAPVAR,
-		PCD_ASSIGNWORLDVAR,
-		PCD_PUSHSCRIPTVAR,
-		PCD_PUSHMAPVAR,
-/* 30*/	PCD_PUSHWORLDVAR,
-		PCD_ADDSCRIPTVAR,
-		PCD_ADDMAPVAR,
-		PCD_ADDWORLDVAR,
-		PCD_SUBSCRIPTVAR,
-		PCD_SUBMAPVAR,
-		PCD_SUBWORLDVAR,
-		PCD_MULSCRIPTVAR,
-		PCD_MULMAPVAR,
-		PCD_MULWORLDVAR,
-/* 40*/	PCD_DIVSCRIPTVAR,
-		PCD_DIVMAPVAR,
-		PCD_DIVWORLDVAR,
-		PCD_MODSCRIPTVAR,
-		PCD_MODMAPVAR,
-		PCD_MODWORLDVAR,
-		PCD_INCSCRIPTVAR,
-		PCD_INCMAPVAR,
-		PCD_INCWORLDVAR,
-		PCD_DECSCRIPTVAR,
-/* 50*/	PCD_DECMAPVAR,
-		PCD_DECWORLDVAR,
-		PCD_GOTO,
-		PCD_IFGOTO,
-		PCD_DROP,
-		PCD_DELAY,
-		PCD_DELAYDIRECT,
-		PCD_RANDOM,
-		PCD_RANDOMDIRECT,
-		PCD_THINGCOUNT,
-/* 60*/	PCD_THINGCOUNTDIRECT,
-		PCD_TAGWAIT,
-		PCD_TAGWAITDIRECT,
-		PCD_POLYWAIT,
-		PCD_POLYWAITDIRECT,
-		PCD_CHANGEFLOOR,
-		PCD_CHANGEFLOORDIRECT,
-		PCD_CHANGECEILING,
-		PCD_CHANGECEILINGDIRECT,
-		PCD_RESTART,
-/* 70*/	PCD_ANDLOGICAL,
-		PCD_ORLOGICAL,
-		PCD_ANDBITWISE,
-		PCD_ORBITWISE,
-		PCD_EORBITWISE,
-		PCD_NEGATELOGICAL,
-		PCD_LSHIFT,
-		PCD_RSHIFT,
-		PCD_UNARYMINUS,
-		PCD_IFNOTGOTO,
-/* 80*/	PCD_LINESIDE,
-		PCD_SCRIPTWAIT,
-		PCD_SCRIPTWAITDIRECT,
-		PCD_CLEARLINESPECIAL,
-		PCD_CASEGOTO,
-		PCD_BEGINPRINT,
-		PCD_ENDPRINT,
-		PCD_PRINTSTRING,
-		PCD_PRINTNUMBER,
-		PCD_PRINTCHARACTER,
-/* 90*/	PCD_PLAYERCOUNT,
-		PCD_GAMETYPE,
-		PCD_GAMESKILL,
-		PCD_TIMER,
-		PCD_SECTORSOUND,
-		PCD_AMBIENTSOUND,
-		PCD_SOUNDSEQUENCE,
-		PCD_SETLINETEXTURE,
-		PCD_SETLINEBLOCKING,
-		PCD_SETLINESPECIAL,
-/*100*/	PCD_THINGSOUND,
-		PCD_ENDPRINTBOLD,		// [RH] End of Hexen p-codes
-		PCD_ACTIVATORSOUND,
-		PCD_LOCALAMBIENTSOUND,
-		PCD_SETLINEMONSTERBLOCKING,
-		PCD_PLAYERBLUESKULL,	// [BC] Start of new [Skull Tag] pcodes
-		PCD_PLAYERREDSKULL,
-		PCD_PLAYERYELLOWSKULL,
-		PCD_PLAYERMASTERSKULL,
-		PCD_PLAYERBLUECARD,
-/*110*/	PCD_PLAYERREDCARD,
-		PCD_PLAYERYELLOWCARD,
-		PCD_PLAYERMASTERCARD,
-		PCD_PLAYERBLACKSKULL,
-		PCD_PLAYERSILVERSKULL,
-		PCD_PLAYERGOLDSKULL,
-		PCD_PLAYERBLACKCARD,
-		PCD_PLAYERSILVERCARD,
-		PCD_ISNETWORKGAME,
-		PCD_PLAYERTEAM,
-/*120*/	PCD_PLAYERHEALTH,
-		PCD_PLAYERARMORPOINTS,
-		PCD_PLAYERFRAGS,
-		PCD_PLAYEREXPERT,
-		PCD_BLUETEAMCOUNT,
-		PCD_REDTEAMCOUNT,
-		PCD_BLUETEAMSCORE,
-		PCD_REDTEAMSCORE,
-		PCD_ISONEFLAGCTF,
-		PCD_LSPEC6,				// These are never used. They should probably
-/*130*/	PCD_LSPEC6DIRECT,		// be given names like PCD_DUMMY.
-		PCD_PRINTNAME,
-		PCD_MUSICCHANGE,
-		PCD_CONSOLECOMMANDDIRECT,
-		PCD_CONSOLECOMMAND,
-		PCD_SINGLEPLAYER,		// [RH] End of Skull Tag p-codes
-		PCD_FIXEDMUL,
-		PCD_FIXEDDIV,
-		PCD_SETGRAVITY,
-		PCD_SETGRAVITYDIRECT,
-/*140*/	PCD_SETAIRCONTROL,
-		PCD_SETAIRCONTROLDIRECT,
-		PCD_CLEARINVENTORY,
-		PCD_GIVEINVENTORY,
-		PCD_GIVEINVENTORYDIRECT,
-		PCD_TAKEINVENTORY,
-		PCD_TAKEINVENTORYDIRECT,
-		PCD_CHECKINVENTORY,
-		PCD_CHECKINVENTORYDIRECT,
-		PCD_SPAWN,
-/*150*/	PCD_SPAWNDIRECT,
-		PCD_SPAWNSPOT,
-		PCD_SPAWNSPOTDIRECT,
-		PCD_SETMUSIC,
-		PCD_SETMUSICDIRECT,
-		PCD_LOCALSETMUSIC,
-		PCD_LOCALSETMUSICDIRECT,
-		PCD_PRINTFIXED,
-		PCD_PRINTLOCALIZED,
-		PCD_MOREHUDMESSAGE,
-/*160*/	PCD_OPTHUDMESSAGE,
-		PCD_ENDHUDMESSAGE,
-		PCD_ENDHUDMESSAGEBOLD,
-		PCD_SETSTYLE,
-		PCD_SETSTYLEDIRECT,
-		PCD_SETFONT,
-		PCD_SETFONTDIRECT,
-		PCD_PUSHBYTE,
-		PCD_LSPEC1DIRECTB,
-		PCD_LSPEC2DIRECTB,
-/*170*/	PCD_LSPEC3DIRECTB,
-		PCD_LSPEC4DIRECTB,
-		PCD_LSPEC5DIRECTB,
-		PCD_DELAYDIRECTB,
-		PCD_RANDOMDIRECTB,
-		PCD_PUSHBYTES,
-		PCD_PUSH2BYTES,
-		PCD_PUSH3BYTES,
-		PCD_PUSH4BYTES,
-		PCD_PUSH5BYTES,
-/*180*/	PCD_SETTHINGSPECIAL,
-		PCD_ASSIGNGLOBALVAR,
-		PCD_PUSHGLOBALVAR,
-		PCD_ADDGLOBALVAR,
-		PCD_SUBGLOBALVAR,
-		PCD_MULGLOBALVAR,
-		PCD_DIVGLOBALVAR,
-		PCD_MODGLOBALVAR,
-		PCD_INCGLOBALVAR,
-		PCD_DECGLOBALVAR,
-/*190*/	PCD_FADETO,
-		PCD_FADERANGE,
-		PCD_CANCELFADE,
-		PCD_PLAYMOVIE,
-		PCD_SETFLOORTRIGGER,
-		PCD_SETCEILINGTRIGGER,
-		PCD_GETACTORX,
-		PCD_GETACTORY,
-		PCD_GETACTORZ,
-		PCD_STARTTRANSLATION,
-/*200*/	PCD_TRANSLATIONRANGE1,
-		PCD_TRANSLATIONRANGE2,
-		PCD_ENDTRANSLATION,
-		PCD_CALL,
-		PCD_CALLDISCARD,
-		PCD_RETURNVOID,
-		PCD_RETURNVAL,
-		PCD_PUSHMAPARRAY,
-		PCD_ASSIGNMAPARRAY,
-		PCD_ADDMAPARRAY,
-/*210*/	PCD_SUBMAPARRAY,
-		PCD_MULMAPARRAY,
-		PCD_DIVMAPARRAY,
-		PCD_MODMAPARRAY,
-		PCD_INCMAPARRAY,
-		PCD_DECMAPARRAY,
-		PCD_DUP,
-		PCD_SWAP,
-		PCD_WRITETOINI,
-		PCD_GETFROMINI,
-/*220*/ PCD_SIN,
-		PCD_COS,
-		PCD_VECTORANGLE,
-		PCD_CHECKWEAPON,
-		PCD_SETWEAPON,
-		PCD_TAGSTRING,
-		PCD_PUSHWORLDARRAY,
-		PCD_ASSIGNWORLDARRAY,
-		PCD_ADDWORLDARRAY,
-		PCD_SUBWORLDARRAY,
-/*230*/	PCD_MULWORLDARRAY,
-		PCD_DIVWORLDARRAY,
-		PCD_MODWORLDARRAY,
-		PCD_INCWORLDARRAY,
-		PCD_DECWORLDARRAY,
-		PCD_PUSHGLOBALARRAY,
-		PCD_ASSIGNGLOBALARRAY,
-		PCD_ADDGLOBALARRAY,
-		PCD_SUBGLOBALARRAY,
-		PCD_MULGLOBALARRAY,
-/*240*/	PCD_DIVGLOBALARRAY,
-		PCD_MODGLOBALARRAY,
-		PCD_INCGLOBALARRAY,
-		PCD_DECGLOBALARRAY,
-		PCD_SETMARINEWEAPON,
-		PCD_SETACTORPROPERTY,
-		PCD_GETACTORPROPERTY,
-		PCD_PLAYERNUMBER,
-		PCD_ACTIVATORTID,
-		PCD_SETMARINESPRITE,
-/*250*/	PCD_GETSCREENWIDTH,
-		PCD_GETSCREENHEIGHT,
-		PCD_THING_PROJECTILE2,
-		PCD_STRLEN,
-		PCD_SETHUDSIZE,
-		PCD_GETCVAR,
-		PCD_CASEGOTOSORTED,
-		PCD_SETRESULTVALUE,
-		PCD_GETLINEROWOFFSET,
-		PCD_GETACTORFLOORZ,
-/*260*/	PCD_GETACTORANGLE,
-		PCD_GETSECTORFLOORZ,
-		PCD_GETSECTORCEILINGZ,
-		PCD_LSPEC5RESULT,
-		PCD_GETSIGILPIECES,
-		PCD_GETLEVELINFO,
-		PCD_CHANGESKY,
-		PCD_PLAYERINGAME,
-		PCD_PLAYERISBOT,
-		PCD_SETCAMERATOTEXTURE,
-/*270*/	PCD_ENDLOG,
-		PCD_GETAMMOCAPACITY,
-		PCD_SETAMMOCAPACITY,
-		PCD_PRINTMAPCHARARRAY,		// [JB] start of new p-codes
-		PCD_PRINTWORLDCHARARRAY,
-		PCD_PRINTGLOBALCHARARRAY,	// [JB] end of new p-codes
-		PCD_SETACTORANGLE,			// [GRB]
-		PCD_GRABINPUT,				// Unused but acc defines them
-		PCD_SETMOUSEPOINTER,		// "
-		PCD_MOVEMOUSEPOINTER,		// "
-/*280*/	PCD_SPAWNPROJECTILE,
-		PCD_GETSECTORLIGHTLEVEL,
-		PCD_GETACTORCEILINGZ,
-		PCD_SETACTORPOSITION,
-		PCD_CLEARACTORINVENTORY,
-		PCD_GIVEACTORINVENTORY,
-		PCD_TAKEACTORINVENTORY,
-		PCD_CHECKACTORINVENTORY,
-		PCD_THINGCOUNTNAME,
-		PCD_SPAWNSPOTFACING,
-/*290*/	PCD_PLAYERCLASS,			// [GRB]
-		//[MW] start my p-codes
-		PCD_ANDSCRIPTVAR,
-		PCD_ANDMAPVAR, 
-		PCD_ANDWORLDVAR, 
-		PCD_ANDGLOBALVAR, 
-		PCD_ANDMAPARRAY, 
-		PCD_ANDWORLDARRAY, 
-		PCD_ANDGLOBALARRAY,
-		PCD_EORSCRIPTVAR, 
-		PCD_EORMAPVAR, 
-/*300*/	PCD_EORWORLDVAR, 
-		PCD_EORGLOBALVAR, 
-		PCD_EORMAPARRAY, 
-		PCD_EORWORLDARRAY, 
-		PCD_EORGLOBALARRAY,
-		PCD_ORSCRIPTVAR, 
-		PCD_ORMAPVAR, 
-		PCD_ORWORLDVAR, 
-		PCD_ORGLOBALVAR, 
-		PCD_ORMAPARRAY, 
-/*310*/	PCD_ORWORLDARRAY, 
-		PCD_ORGLOBALARRAY,
-		PCD_LSSCRIPTVAR, 
-		PCD_LSMAPVAR, 
-		PCD_LSWORLDVAR, 
-		PCD_LSGLOBALVAR, 
-		PCD_LSMAPARRAY, 
-		PCD_LSWORLDARRAY, 
-		PCD_LSGLOBALARRAY,
-		PCD_RSSCRIPTVAR, 
-/*320*/	PCD_RSMAPVAR, 
-		PCD_RSWORLDVAR, 
-		PCD_RSGLOBALVAR, 
-		PCD_RSMAPARRAY, 
-		PCD_RSWORLDARRAY, 
-		PCD_RSGLOBALARRAY, 
-		//[MW] end my p-codes
-		PCD_GETPLAYERINFO,			// [GRB]
-		PCD_CHANGELEVEL,
-		PCD_SECTORDAMAGE,
-		PCD_REPLACETEXTURES,
-/*330*/	PCD_NEGATEBINARY,
-		PCD_GETACTORPITCH,
-		PCD_SETACTORPITCH,
-		PCD_PRINTBIND,
-		PCD_SETACTORSTATE,
-		PCD_THINGDAMAGE2,
-		PCD_USEINVENTORY,
-		PCD_USEACTORINVENTORY,
-		PCD_CHECKACTORCEILINGTEXTURE,
-		PCD_CHECKACTORFLOORTEXTURE,
-/*340*/	PCD_GETACTORLIGHTLEVEL,
-		PCD_SETMUGSHOTSTATE,
-		PCD_THINGCOUNTSECTOR,
-		PCD_THINGCOUNTNAMESECTOR,
-		PCD_CHECKPLAYERCAMERA,		// [TN]
-		PCD_MORPHACTOR,				// [MH]
-		PCD_UNMORPHACTOR,			// [MH]
-		PCD_GETPLAYERINPUT,
-		PCD_CLASSIFYACTOR,
-		PCD_PRINTBINARY,
-/*350*/	PCD_PRINTHEX,
-		PCD_CALLFUNC,
-		PCD_SAVESTRING,			// [FDARI] create string (temporary)
-		PCD_PRINTMAPCHRANGE,	// [FDARI] output range (print part of array)
-		PCD_PRINTWORLDCHRANGE,
-		PCD_PRINTGLOBALCHRANGE,
-		PCD_STRCPYTOMAPCHRANGE,	// [FDARI] input range (copy string to all/part of array)
-		PCD_STRCPYTOWORLDCHRANGE,
-		PCD_STRCPYTOGLOBALCHRANGE,
-		PCD_PUSHFUNCTION,		// from Eternity
-/*360*/	PCD_CALLSTACK,			// from Eternity
-		PCD_SCRIPTWAITNAMED,
-		PCD_TRANSLATIONRANGE3,
-		PCD_GOTOSTACK,
-		PCD_ASSIGNSCRIPTARRAY,
-		PCD_PUSHSCRIPTARRAY,
-		PCD_ADDSCRIPTARRAY,
-		PCD_SUBSCRIPTARRAY,
-		PCD_MULSCRIPTARRAY,
-		PCD_DIVSCRIPTARRAY,
-/*370*/	PCD_MODSCRIPTARRAY,
-		PCD_INCSCRIPTARRAY,
-		PCD_DECSCRIPTARRAY,
-		PCD_ANDSCRIPTARRAY,
-		PCD_EORSCRIPTARRAY,
-		PCD_ORSCRIPTARRAY,
-		PCD_LSSCRIPTARRAY,
-		PCD_RSSCRIPTARRAY,
-		PCD_PRINTSCRIPTCHARARRAY,
-		PCD_PRINTSCRIPTCHRANGE,
-/*380*/	PCD_STRCPYTOSCRIPTCHRANGE,
-		PCD_LSPEC5EX,
-		PCD_LSPEC5EXRESULT,
+#define xx(op) PCD_##op,
+#include "p_acsops.h"
 
 /*381*/	PCODE_COMMAND_COUNT
 	};
@@ -862,8 +600,9 @@ public:
 
 	void Serialize(FSerializer &arc);
 	int RunScript ();
+	static const char *PCodeOperands (int pcd);
 
-	inline void SetState (EScriptState newstate) { state = newstate; }
+	inline void SetState (EScriptState newstate) { WakeUp(); state = newstate; }
 	inline EScriptState GetState () { return state; }
 
 	DLevelScript *GetNext() const { return next; }
@@ -899,6 +638,21 @@ protected:
 	FBehavior	    *activeBehavior;
 	int				InModuleScriptNumber;
 
+	// While waiting for a sector, polyobject or script, the script is
+	// skipped by DACSThinker::Tick until something wakes it. None of this
+	// is saved; loaded scripts start out awake and go back to sleep on
+	// their first check.
+	int				WaitQueue;			// -1 if awake
+	DLevelScript	*NextWaiting;
+
+	void Sleep (int queue);
+	void WakeUp ();
+
+	// p_acsvm.cpp
+	VMScriptFunction *GetCompiledScript (const int *pc) const;
+	void RunCompiledScript (VMScriptFunction *func, int *&pc);
+	void StartVMCompare (VMScriptFunction *func, int *pc, FACSVMTic &tic);
+	void EndVMCompare (const FACSVMTic &tic, int *pc);
 	void Link ();
 	void Unlink ();
 	void PutLast ();
@@ -954,10 +708,23 @@ public:
 	void DumpScriptStatus();
 	void StopScriptsFor (AActor *actor);
 
+	enum
+	{
+		WAIT_Tag,
+		WAIT_Poly,
+		WAIT_Script,
+		NUM_WAITQUEUES
+	};
+	void WakeScripts (int queue, int key);
+	bool HasSleepers (int queue) { return WaitQueues[queue].CountUsed() != 0; }
+
 private:
 	DLevelScript *LastScript;
 	DLevelScript *Scripts;				// List of all running scripts
 
+	// Sleeping scripts, chained through NextWaiting and keyed by what they wait for
+	TMap<int, DLevelScript *> WaitQueues[NUM_WAITQUEUES];
+
 	friend class DLevelScript;
 	friend class FBehavior;
 };
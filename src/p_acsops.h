@@ -0,0 +1,394 @@
+#ifndef xx
+#define xx(op) PCD_##op,
+#endif
+
+// The p-codes of ACS scripts, in the order of their numbers. p_acs.h makes
+// the PCD_ enum from them and RunScript its dispatch table.
+
+/*  0*/	xx(NOP)
+		xx(TERMINATE)
+		xx(SUSPEND)
+		xx(PUSHNUMBER)
+		xx(LSPEC1)
+		xx(LSPEC2)
+		xx(LSPEC3)
+		xx(LSPEC4)
+		xx(LSPEC5)
+		xx(LSPEC1DIRECT)
+/* 10*/	xx(LSPEC2DIRECT)
+		xx(LSPEC3DIRECT)
+		xx(LSPEC4DIRECT)
+		xx(LSPEC5DIRECT)
+		xx(ADD)
+		xx(SUBTRACT)
+		xx(MULTIPLY)
+		xx(DIVIDE)
+		xx(MODULUS)
+		xx(EQ)
+/* 20*/ xx(NE)
+		xx(LT)
+		xx(GT)
+		xx(LE)
+		xx(GE)
+		xx(ASSIGNSCRIPTVAR)
+		xx(ASSIGNMAPVAR)
+		xx(ASSIGNWORLDVAR)
+		xx(PUSHSCRIPTVAR)
+		xx(PUSHMAPVAR)
+/* 30*/	xx(PUSHWORLDVAR)
+		xx(ADDSCRIPTVAR)
+		xx(ADDMAPVAR)
+		xx(ADDWORLDVAR)
+		xx(SUBSCRIPTVAR)
+		xx(SUBMAPVAR)
+		xx(SUBWORLDVAR)
+		xx(MULSCRIPTVAR)
+		xx(MULMAPVAR)
+		xx(MULWORLDVAR)
+/* 40*/	xx(DIVSCRIPTVAR)
+		xx(DIVMAPVAR)
+		xx(DIVWORLDVAR)
+		xx(MODSCRIPTVAR)
+		xx(MODMAPVAR)
+		xx(MODWORLDVAR)
+		xx(INCSCRIPTVAR)
+		xx(INCMAPVAR)
+		xx(INCWORLDVAR)
+		xx(DECSCRIPTVAR)
+/* 50*/	xx(DECMAPVAR)
+		xx(DECWORLDVAR)
+		xx(GOTO)
+		xx(IFGOTO)
+		xx(DROP)
+		xx(DELAY)
+		xx(DELAYDIRECT)
+		xx(RANDOM)
+		xx(RANDOMDIRECT)
+		xx(THINGCOUNT)
+/* 60*/	xx(THINGCOUNTDIRECT)
+		xx(TAGWAIT)
+		xx(TAGWAITDIRECT)
+		xx(POLYWAIT)
+		xx(POLYWAITDIRECT)
+		xx(CHANGEFLOOR)
+		xx(CHANGEFLOORDIRECT)
+		xx(CHANGECEILING)
+		xx(CHANGECEILINGDIRECT)
+		xx(RESTART)
+/* 70*/	xx(ANDLOGICAL)
+		xx(ORLOGICAL)
+		xx(ANDBITWISE)
+		xx(ORBITWISE)
+		xx(EORBITWISE)
+		xx(NEGATELOGICAL)
+		xx(LSHIFT)
+		xx(RSHIFT)
+		xx(UNARYMINUS)
+		xx(IFNOTGOTO)
+/* 80*/	xx(LINESIDE)
+		xx(SCRIPTWAIT)
+		xx(SCRIPTWAITDIRECT)
+		xx(CLEARLINESPECIAL)
+		xx(CASEGOTO)
+		xx(BEGINPRINT)
+		xx(ENDPRINT)
+		xx(PRINTSTRING)
+		xx(PRINTNUMBER)
+		xx(PRINTCHARACTER)
+/* 90*/	xx(PLAYERCOUNT)
+		xx(GAMETYPE)
+		xx(GAMESKILL)
+		xx(TIMER)
+		xx(SECTORSOUND)
+		xx(AMBIENTSOUND)
+		xx(SOUNDSEQUENCE)
+		xx(SETLINETEXTURE)
+		xx(SETLINEBLOCKING)
+		xx(SETLINESPECIAL)
+/*100*/	xx(THINGSOUND)
+		xx(ENDPRINTBOLD)		// [RH] End of Hexen p-codes
+		xx(ACTIVATORSOUND)
+		xx(LOCALAMBIENTSOUND)
+		xx(SETLINEMONSTERBLOCKING)
+		xx(PLAYERBLUESKULL)	// [BC] Start of new [Skull Tag] pcodes
+		xx(PLAYERREDSKULL)
+		xx(PLAYERYELLOWSKULL)
+		xx(PLAYERMASTERSKULL)
+		xx(PLAYERBLUECARD)
+/*110*/	xx(PLAYERREDCARD)
+		xx(PLAYERYELLOWCARD)
+		xx(PLAYERMASTERCARD)
+		xx(PLAYERBLACKSKULL)
+		xx(PLAYERSILVERSKULL)
+		xx(PLAYERGOLDSKULL)
+		xx(PLAYERBLACKCARD)
+		xx(PLAYERSILVERCARD)
+		xx(ISNETWORKGAME)
+		xx(PLAYERTEAM)
+/*120*/	xx(PLAYERHEALTH)
+		xx(PLAYERARMORPOINTS)
+		xx(PLAYERFRAGS)
+		xx(PLAYEREXPERT)
+		xx(BLUETEAMCOUNT)
+		xx(REDTEAMCOUNT)
+		xx(BLUETEAMSCORE)
+		xx(REDTEAMSCORE)
+		xx(ISONEFLAGCTF)
+		xx(LSPEC6)				// These are never used. They should probably
+/*130*/	xx(LSPEC6DIRECT)		// be given names like PCD_DUMMY.
+		xx(PRINTNAME)
+		xx(MUSICCHANGE)
+		xx(CONSOLECOMMANDDIRECT)
+		xx(CONSOLECOMMAND)
+		xx(SINGLEPLAYER)		// [RH] End of Skull Tag p-codes
+		xx(FIXEDMUL)
+		xx(FIXEDDIV)
+		xx(SETGRAVITY)
+		xx(SETGRAVITYDIRECT)
+/*140*/	xx(SETAIRCONTROL)
+		xx(SETAIRCONTROLDIRECT)
+		xx(CLEARINVENTORY)
+		xx(GIVEINVENTORY)
+		xx(GIVEINVENTORYDIRECT)
+		xx(TAKEINVENTORY)
+		xx(TAKEINVENTORYDIRECT)
+		xx(CHECKINVENTORY)
+		xx(CHECKINVENTORYDIRECT)
+		xx(SPAWN)
+/*150*/	xx(SPAWNDIRECT)
+		xx(SPAWNSPOT)
+		xx(SPAWNSPOTDIRECT)
+		xx(SETMUSIC)
+		xx(SETMUSICDIRECT)
+		xx(LOCALSETMUSIC)
+		xx(LOCALSETMUSICDIRECT)
+		xx(PRINTFIXED)
+		xx(PRINTLOCALIZED)
+		xx(MOREHUDMESSAGE)
+/*160*/	xx(OPTHUDMESSAGE)
+		xx(ENDHUDMESSAGE)
+		xx(ENDHUDMESSAGEBOLD)
+		xx(SETSTYLE)
+		xx(SETSTYLEDIRECT)
+		xx(SETFONT)
+		xx(SETFONTDIRECT)
+		xx(PUSHBYTE)
+		xx(LSPEC1DIRECTB)
+		xx(LSPEC2DIRECTB)
+/*170*/	xx(LSPEC3DIRECTB)
+		xx(LSPEC4DIRECTB)
+		xx(LSPEC5DIRECTB)
+		xx(DELAYDIRECTB)
+		xx(RANDOMDIRECTB)
+		xx(PUSHBYTES)
+		xx(PUSH2BYTES)
+		xx(PUSH3BYTES)
+		xx(PUSH4BYTES)
+		xx(PUSH5BYTES)
+/*180*/	xx(SETTHINGSPECIAL)
+		xx(ASSIGNGLOBALVAR)
+		xx(PUSHGLOBALVAR)
+		xx(ADDGLOBALVAR)
+		xx(SUBGLOBALVAR)
+		xx(MULGLOBALVAR)
+		xx(DIVGLOBALVAR)
+		xx(MODGLOBALVAR)
+		xx(INCGLOBALVAR)
+		xx(DECGLOBALVAR)
+/*190*/	xx(FADETO)
+		xx(FADERANGE)
+		xx(CANCELFADE)
+		xx(PLAYMOVIE)
+		xx(SETFLOORTRIGGER)
+		xx(SETCEILINGTRIGGER)
+		xx(GETACTORX)
+		xx(GETACTORY)
+		xx(GETACTORZ)
+		xx(STARTTRANSLATION)
+/*200*/	xx(TRANSLATIONRANGE1)
+		xx(TRANSLATIONRANGE2)
+		xx(ENDTRANSLATION)
+		xx(CALL)
+		xx(CALLDISCARD)
+		xx(RETURNVOID)
+		xx(RETURNVAL)
+		xx(PUSHMAPARRAY)
+		xx(ASSIGNMAPARRAY)
+		xx(ADDMAPARRAY)
+/*210*/	xx(SUBMAPARRAY)
+		xx(MULMAPARRAY)
+		xx(DIVMAPARRAY)
+		xx(MODMAPARRAY)
+		xx(INCMAPARRAY)
+		xx(DECMAPARRAY)
+		xx(DUP)
+		xx(SWAP)
+		xx(WRITETOINI)
+		xx(GETFROMINI)
+/*220*/ xx(SIN)
+		xx(COS)
+		xx(VECTORANGLE)
+		xx(CHECKWEAPON)
+		xx(SETWEAPON)
+		xx(TAGSTRING)
+		xx(PUSHWORLDARRAY)
+		xx(ASSIGNWORLDARRAY)
+		xx(ADDWORLDARRAY)
+		xx(SUBWORLDARRAY)
+/*230*/	xx(MULWORLDARRAY)
+		xx(DIVWORLDARRAY)
+		xx(MODWORLDARRAY)
+		xx(INCWORLDARRAY)
+		xx(DECWORLDARRAY)
+		xx(PUSHGLOBALARRAY)
+		xx(ASSIGNGLOBALARRAY)
+		xx(ADDGLOBALARRAY)
+		xx(SUBGLOBALARRAY)
+		xx(MULGLOBALARRAY)
+/*240*/	xx(DIVGLOBALARRAY)
+		xx(MODGLOBALARRAY)
+		xx(INCGLOBALARRAY)
+		xx(DECGLOBALARRAY)
+		xx(SETMARINEWEAPON)
+		xx(SETACTORPROPERTY)
+		xx(GETACTORPROPERTY)
+		xx(PLAYERNUMBER)
+		xx(ACTIVATORTID)
+		xx(SETMARINESPRITE)
+/*250*/	xx(GETSCREENWIDTH)
+		xx(GETSCREENHEIGHT)
+		xx(THING_PROJECTILE2)
+		xx(STRLEN)
+		xx(SETHUDSIZE)
+		xx(GETCVAR)
+		xx(CASEGOTOSORTED)
+		xx(SETRESULTVALUE)
+		xx(GETLINEROWOFFSET)
+		xx(GETACTORFLOORZ)
+/*260*/	xx(GETACTORANGLE)
+		xx(GETSECTORFLOORZ)
+		xx(GETSECTORCEILINGZ)
+		xx(LSPEC5RESULT)
+		xx(GETSIGILPIECES)
+		xx(GETLEVELINFO)
+		xx(CHANGESKY)
+		xx(PLAYERINGAME)
+		xx(PLAYERISBOT)
+		xx(SETCAMERATOTEXTURE)
+/*270*/	xx(ENDLOG)
+		xx(GETAMMOCAPACITY)
+		xx(SETAMMOCAPACITY)
+		xx(PRINTMAPCHARARRAY)		// [JB] start of new p-codes
+		xx(PRINTWORLDCHARARRAY)
+		xx(PRINTGLOBALCHARARRAY)	// [JB] end of new p-codes
+		xx(SETACTORANGLE)			// [GRB]
+		xx(GRABINPUT)				// Unused but acc defines them
+		xx(SETMOUSEPOINTER)		// "
+		xx(MOVEMOUSEPOINTER)		// "
+/*280*/	xx(SPAWNPROJECTILE)
+		xx(GETSECTORLIGHTLEVEL)
+		xx(GETACTORCEILINGZ)
+		xx(SETACTORPOSITION)
+		xx(CLEARACTORINVENTORY)
+		xx(GIVEACTORINVENTORY)
+		xx(TAKEACTORINVENTORY)
+		xx(CHECKACTORINVENTORY)
+		xx(THINGCOUNTNAME)
+		xx(SPAWNSPOTFACING)
+/*290*/	xx(PLAYERCLASS)			// [GRB]
+		//[MW] start my p-codes
+		xx(ANDSCRIPTVAR)
+		xx(ANDMAPVAR) 
+		xx(ANDWORLDVAR) 
+		xx(ANDGLOBALVAR) 
+		xx(ANDMAPARRAY) 
+		xx(ANDWORLDARRAY) 
+		xx(ANDGLOBALARRAY)
+		xx(EORSCRIPTVAR) 
+		xx(EORMAPVAR) 
+/*300*/	xx(EORWORLDVAR) 
+		xx(EORGLOBALVAR) 
+		xx(EORMAPARRAY) 
+		xx(EORWORLDARRAY) 
+		xx(EORGLOBALARRAY)
+		xx(ORSCRIPTVAR) 
+		xx(ORMAPVAR) 
+		xx(ORWORLDVAR) 
+		xx(ORGLOBALVAR) 
+		xx(ORMAPARRAY) 
+/*310*/	xx(ORWORLDARRAY) 
+		xx(ORGLOBALARRAY)
+		xx(LSSCRIPTVAR) 
+		xx(LSMAPVAR) 
+		xx(LSWORLDVAR) 
+		xx(LSGLOBALVAR) 
+		xx(LSMAPARRAY) 
+		xx(LSWORLDARRAY) 
+		xx(LSGLOBALARRAY)
+		xx(RSSCRIPTVAR) 
+/*320*/	xx(RSMAPVAR) 
+		xx(RSWORLDVAR) 
+		xx(RSGLOBALVAR) 
+		xx(RSMAPARRAY) 
+		xx(RSWORLDARRAY) 
+		xx(RSGLOBALARRAY) 
+		//[MW] end my p-codes
+		xx(GETPLAYERINFO)			// [GRB]
+		xx(CHANGELEVEL)
+		xx(SECTORDAMAGE)
+		xx(REPLACETEXTURES)
+/*330*/	xx(NEGATEBINARY)
+		xx(GETACTORPITCH)
+		xx(SETACTORPITCH)
+		xx(PRINTBIND)
+		xx(SETACTORSTATE)
+		xx(THINGDAMAGE2)
+		xx(USEINVENTORY)
+		xx(USEACTORINVENTORY)
+		xx(CHECKACTORCEILINGTEXTURE)
+		xx(CHECKACTORFLOORTEXTURE)
+/*340*/	xx(GETACTORLIGHTLEVEL)
+		xx(SETMUGSHOTSTATE)
+		xx(THINGCOUNTSECTOR)
+		xx(THINGCOUNTNAMESECTOR)
+		xx(CHECKPLAYERCAMERA)		// [TN]
+		xx(MORPHACTOR)				// [MH]
+		xx(UNMORPHACTOR)			// [MH]
+		xx(GETPLAYERINPUT)
+		xx(CLASSIFYACTOR)
+		xx(PRINTBINARY)
+/*350*/	xx(PRINTHEX)
+		xx(CALLFUNC)
+		xx(SAVESTRING)			// [FDARI] create string (temporary)
+		xx(PRINTMAPCHRANGE)	// [FDARI] output range (print part of array)
+		xx(PRINTWORLDCHRANGE)
+		xx(PRINTGLOBALCHRANGE)
+		xx(STRCPYTOMAPCHRANGE)	// [FDARI] input range (copy string to all/part of array)
+		xx(STRCPYTOWORLDCHRANGE)
+		xx(STRCPYTOGLOBALCHRANGE)
+		xx(PUSHFUNCTION)		// from Eternity
+/*360*/	xx(CALLSTACK)			// from Eternity
+		xx(SCRIPTWAITNAMED)
+		xx(TRANSLATIONRANGE3)
+		xx(GOTOSTACK)
+		xx(ASSIGNSCRIPTARRAY)
+		xx(PUSHSCRIPTARRAY)
+		xx(ADDSCRIPTARRAY)
+		xx(SUBSCRIPTARRAY)
+		xx(MULSCRIPTARRAY)
+		xx(DIVSCRIPTARRAY)
+/*370*/	xx(MODSCRIPTARRAY)
+		xx(INCSCRIPTARRAY)
+		xx(DECSCRIPTARRAY)
+		xx(ANDSCRIPTARRAY)
+		xx(EORSCRIPTARRAY)
+		xx(ORSCRIPTARRAY)
+		xx(LSSCRIPTARRAY)
+		xx(RSSCRIPTARRAY)
+		xx(PRINTSCRIPTCHARARRAY)
+		xx(PRINTSCRIPTCHRANGE)
+/*380*/	xx(STRCPYTOSCRIPTCHRANGE)
+		xx(LSPEC5EX)
+		xx(LSPEC5EXRESULT)
+
+#undef xx
@@ -0,0 +1,1631 @@
+/*
+** p_acsvm.cpp
+** Translates ACS functions and scripts into VM code
+**
+*/
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <algorithm>
+
+#include "p_acs.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "gi.h"
+#include "m_swap.h"
+#include "templates.h"
+#include "v_text.h"
+#include "vm.h"
+#include "vmbuilder.h"
+
+// MACROS ------------------------------------------------------------------
+
+// A translated function may loop this many times before it is considered
+// a runaway. The interpreter counts instructions instead, but for the
+// simple code that gets translated the two limits are close enough.
+#define VM_RUNAWAY_LIMIT	2000000
+
+// Translated functions get their arguments passed in a VMValue array.
+#define VM_MAX_ARGS			32
+
+// Translated scripts are passed their local variables and where to resume.
+#define VM_SCRIPT_ARGS		2
+
+// TYPES -------------------------------------------------------------------
+
+enum EVarOp
+{
+	VAROP_Assign,
+	VAROP_Push,
+	VAROP_Add,
+	VAROP_Sub,
+	VAROP_Mul,
+	VAROP_Div,
+	VAROP_Mod,
+	VAROP_And,
+	VAROP_Eor,
+	VAROP_Or,
+	VAROP_LShift,
+	VAROP_RShift,
+	VAROP_Inc,
+	VAROP_Dec
+};
+
+enum EVarScope
+{
+	VARSCOPE_Local,
+	VARSCOPE_Map,
+	VARSCOPE_World,
+	VARSCOPE_Global
+};
+
+struct FVarPCode
+{
+	int PCode;
+	BYTE Op;
+	BYTE Scope;
+};
+
+//==========================================================================
+//
+// FACSVMTranslator
+//
+// Turns one ACS function or script from its module's decoded code into a
+// VMScriptFunction. The ACS stack never grows past what the compiler
+// statically knows at each instruction, so every stack slot and local
+// variable simply becomes an int register. Map, world and global
+// variables are accessed through their addresses.
+//
+// Only code that does nothing but arithmetic, variable access, flow
+// control, calls to other translated functions and delays is translated.
+// Anything that can call into the game or touch arrays is left to the
+// interpreter.
+//
+// A translated function returns the ACS return value and one of the
+// ACSVM_* codes to tell the caller if it stopped early.
+//
+// A translated script gets a pointer to the DLevelScript's local variables
+// and the code index to start at, which is either the script's entry or
+// the instruction after one of its delays. It loads the variables into
+// registers and writes them back when it delays, so everything it needs
+// to be resumed stays in the DLevelScript, just like with the interpreter,
+// and either of the two can pick up where the other stopped. It returns an
+// ACSVM_* code, the delay in tics and the index to resume at.
+//
+//==========================================================================
+
+class FACSVMTranslator
+{
+public:
+	FACSVMTranslator(FBehavior *module, const TArray<int> &code, int entry, int numargs, int numlocals, const ACSLocalArrays &arrays, bool script);
+	VMScriptFunction *Translate(FName name, const char *printablename);
+
+	bool Pure;
+	FString Failure;
+	TArray<int> ResumePoints;	// code indices after each delay
+
+private:
+	struct FInstr
+	{
+		int PCode;
+		int Size;		// in ints, including the p-code
+		int Pops;
+		int Pushes;
+		bool FallsThrough;
+		const FVarPCode *Var;
+	};
+	struct FFixup
+	{
+		size_t Address;
+		int Target;
+	};
+
+	bool Describe(int index, FInstr &instr);
+	bool Visit(int index, int depth, TArray<int> &work);
+	bool Analyze();
+	bool EmitInstr(int index, const FInstr &instr, int depth);
+	bool EmitVarOp(int index, const FVarPCode *var, int top);
+	bool EmitCall(const int *pc, int top, bool discard);
+	void EmitDelay(int resume, int tics);
+	void EmitJump(int from, int target);
+	void EmitCondJump(int from, int target, int opcode, int check, int b, int c);
+	void EmitRunawayCheck();
+	void EmitBool(int opcode, int check, int b, int c, int dest);
+	void EmitExit(int status, int statusreg);
+	void EmitScriptEntry();
+
+	FBehavior *Module;
+	const TArray<int> &Code;
+	int Entry;
+	int NumArgs;
+	int NumLocals;
+	const ACSLocalArrays &LocalArrays;
+	bool Script;
+	int DelayBonus;
+
+	TMap<int, int> Depths;		// code index -> stack depth before it runs
+	int MaxDepth;
+
+	VMFunctionBuilder Build;
+	TMap<int, size_t> Addresses;	// code index -> VM address
+	TArray<FFixup> Fixups;
+	TArray<size_t> RunawayExits, DivExits, ModExits, StatusExits, DelayExits;
+	int LocalBase;
+	int StackBase;
+	int Counter;
+	int Temp;
+	int Status;
+	int Resume;			// scripts only
+	int Locals;			// scripts only
+	int Pointer;
+	int Zero;
+};
+
+// EXTERNAL DATA DECLARATIONS ----------------------------------------------
+
+EXTERN_CVAR (Bool, acs_vm)
+EXTERN_CVAR (Bool, acs_vmcompare)
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static const FVarPCode VarPCodes[] =
+{
+	{ DLevelScript::PCD_ASSIGNSCRIPTVAR,	VAROP_Assign,	VARSCOPE_Local },
+	{ DLevelScript::PCD_ASSIGNMAPVAR,		VAROP_Assign,	VARSCOPE_Map },
+	{ DLevelScript::PCD_ASSIGNWORLDVAR,		VAROP_Assign,	VARSCOPE_World },
+	{ DLevelScript::PCD_ASSIGNGLOBALVAR,	VAROP_Assign,	VARSCOPE_Global },
+	{ DLevelScript::PCD_PUSHSCRIPTVAR,		VAROP_Push,		VARSCOPE_Local },
+	{ DLevelScript::PCD_PUSHMAPVAR,			VAROP_Push,		VARSCOPE_Map },
+	{ DLevelScript::PCD_PUSHWORLDVAR,		VAROP_Push,		VARSCOPE_World },
+	{ DLevelScript::PCD_PUSHGLOBALVAR,		VAROP_Push,		VARSCOPE_Global },
+	{ DLevelScript::PCD_ADDSCRIPTVAR,		VAROP_Add,		VARSCOPE_Local },
+	{ DLevelScript::PCD_ADDMAPVAR,			VAROP_Add,		VARSCOPE_Map },
+	{ DLevelScript::PCD_ADDWORLDVAR,		VAROP_Add,		VARSCOPE_World },
+	{ DLevelScript::PCD_ADDGLOBALVAR,		VAROP_Add,		VARSCOPE_Global },
+	{ DLevelScript::PCD_SUBSCRIPTVAR,		VAROP_Sub,		VARSCOPE_Local },
+	{ DLevelScript::PCD_SUBMAPVAR,			VAROP_Sub,		VARSCOPE_Map },
+	{ DLevelScript::PCD_SUBWORLDVAR,		VAROP_Sub,		VARSCOPE_World },
+	{ DLevelScript::PCD_SUBGLOBALVAR,		VAROP_Sub,		VARSCOPE_Global },
+	{ DLevelScript::PCD_MULSCRIPTVAR,		VAROP_Mul,		VARSCOPE_Local },
+	{ DLevelScript::PCD_MULMAPVAR,			VAROP_Mul,		VARSCOPE_Map },
+	{ DLevelScript::PCD_MULWORLDVAR,		VAROP_Mul,		VARSCOPE_World },
+	{ DLevelScript::PCD_MULGLOBALVAR,		VAROP_Mul,		VARSCOPE_Global },
+	{ DLevelScript::PCD_DIVSCRIPTVAR,		VAROP_Div,		VARSCOPE_Local },
+	{ DLevelScript::PCD_DIVMAPVAR,			VAROP_Div,		VARSCOPE_Map },
+	{ DLevelScript::PCD_DIVWORLDVAR,		VAROP_Div,		VARSCOPE_World },
+	{ DLevelScript::PCD_DIVGLOBALVAR,		VAROP_Div,		VARSCOPE_Global },
+	{ DLevelScript::PCD_MODSCRIPTVAR,		VAROP_Mod,		VARSCOPE_Local },
+	{ DLevelScript::PCD_MODMAPVAR,			VAROP_Mod,		VARSCOPE_Map },
+	{ DLevelScript::PCD_MODWORLDVAR,		VAROP_Mod,		VARSCOPE_World },
+	{ DLevelScript::PCD_MODGLOBALVAR,		VAROP_Mod,		VARSCOPE_Global },
+	{ DLevelScript::PCD_ANDSCRIPTVAR,		VAROP_And,		VARSCOPE_Local },
+	{ DLevelScript::PCD_ANDMAPVAR,			VAROP_And,		VARSCOPE_Map },
+	{ DLevelScript::PCD_ANDWORLDVAR,		VAROP_And,		VARSCOPE_World },
+	{ DLevelScript::PCD_ANDGLOBALVAR,		VAROP_And,		VARSCOPE_Global },
+	{ DLevelScript::PCD_EORSCRIPTVAR,		VAROP_Eor,		VARSCOPE_Local },
+	{ DLevelScript::PCD_EORMAPVAR,			VAROP_Eor,		VARSCOPE_Map },
+	{ DLevelScript::PCD_EORWORLDVAR,		VAROP_Eor,		VARSCOPE_World },
+	{ DLevelScript::PCD_EORGLOBALVAR,		VAROP_Eor,		VARSCOPE_Global },
+	{ DLevelScript::PCD_ORSCRIPTVAR,		VAROP_Or,		VARSCOPE_Local },
+	{ DLevelScript::PCD_ORMAPVAR,			VAROP_Or,		VARSCOPE_Map },
+	{ DLevelScript::PCD_ORWORLDVAR,			VAROP_Or,		VARSCOPE_World },
+	{ DLevelScript::PCD_ORGLOBALVAR,		VAROP_Or,		VARSCOPE_Global },
+	{ DLevelScript::PCD_LSSCRIPTVAR,		VAROP_LShift,	VARSCOPE_Local },
+	{ DLevelScript::PCD_LSMAPVAR,			VAROP_LShift,	VARSCOPE_Map },
+	{ DLevelScript::PCD_LSWORLDVAR,			VAROP_LShift,	VARSCOPE_World },
+	{ DLevelScript::PCD_LSGLOBALVAR,		VAROP_LShift,	VARSCOPE_Global },
+	{ DLevelScript::PCD_RSSCRIPTVAR,		VAROP_RShift,	VARSCOPE_Local },
+	{ DLevelScript::PCD_RSMAPVAR,			VAROP_RShift,	VARSCOPE_Map },
+	{ DLevelScript::PCD_RSWORLDVAR,			VAROP_RShift,	VARSCOPE_World },
+	{ DLevelScript::PCD_RSGLOBALVAR,		VAROP_RShift,	VARSCOPE_Global },
+	{ DLevelScript::PCD_INCSCRIPTVAR,		VAROP_Inc,		VARSCOPE_Local },
+	{ DLevelScript::PCD_INCMAPVAR,			VAROP_Inc,		VARSCOPE_Map },
+	{ DLevelScript::PCD_INCWORLDVAR,		VAROP_Inc,		VARSCOPE_World },
+	{ DLevelScript::PCD_INCGLOBALVAR,		VAROP_Inc,		VARSCOPE_Global },
+	{ DLevelScript::PCD_DECSCRIPTVAR,		VAROP_Dec,		VARSCOPE_Local },
+	{ DLevelScript::PCD_DECMAPVAR,			VAROP_Dec,		VARSCOPE_Map },
+	{ DLevelScript::PCD_DECWORLDVAR,		VAROP_Dec,		VARSCOPE_World },
+	{ DLevelScript::PCD_DECGLOBALVAR,		VAROP_Dec,		VARSCOPE_Global },
+};
+
+// VM opcodes for the binary operators, in EVarOp order from VAROP_Add.
+static const BYTE VarOpCodes[] =
+{
+	OP_ADD_RR, OP_SUB_RR, OP_MUL_RR, OP_DIV_RR, OP_MOD_RR,
+	OP_AND_RR, OP_XOR_RR, OP_OR_RR, OP_SLL_RR, OP_SRA_RR
+};
+
+static unsigned int VMCalls;
+static unsigned int VMMismatches;
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// FACSVMTranslator Constructor
+//
+//==========================================================================
+
+FACSVMTranslator::FACSVMTranslator(FBehavior *module, const TArray<int> &code, int entry, int numargs, int numlocals, const ACSLocalArrays &arrays, bool script)
+	: Pure(!script), Module(module), Code(code), Entry(entry), NumArgs(numargs), NumLocals(numlocals), LocalArrays(arrays), Script(script),
+	  MaxDepth(0), Build(0), LocalBase(0), Resume(-1), Locals(-1)
+{
+	// Hexen's delays were one tic longer.
+	DelayBonus = module->GetFormat() == ACS_Old && gameinfo.gametype == GAME_Hexen;
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: Describe
+//
+// Works out how big an instruction is and what it does to the stack.
+// Returns false for anything that cannot be translated.
+//
+//==========================================================================
+
+bool FACSVMTranslator::Describe(int index, FInstr &instr)
+{
+	int codesize = (int)Code.Size();
+	int pcd = Code[index];
+
+	instr.PCode = pcd;
+	instr.Size = 1;
+	instr.Pops = 0;
+	instr.Pushes = 0;
+	instr.FallsThrough = true;
+	instr.Var = NULL;
+
+	switch (pcd)
+	{
+	case DLevelScript::PCD_NOP:
+		break;
+
+	case DLevelScript::PCD_PUSHNUMBER:
+	case DLevelScript::PCD_PUSHBYTE:
+		instr.Size = 2;
+		instr.Pushes = 1;
+		break;
+
+	case DLevelScript::PCD_PUSH2BYTES:
+	case DLevelScript::PCD_PUSH3BYTES:
+	case DLevelScript::PCD_PUSH4BYTES:
+	case DLevelScript::PCD_PUSH5BYTES:
+		instr.Pushes = pcd - DLevelScript::PCD_PUSH2BYTES + 2;
+		instr.Size = 1 + instr.Pushes;
+		break;
+
+	case DLevelScript::PCD_PUSHBYTES:
+		if (index + 1 >= codesize)
+		{
+			return false;
+		}
+		instr.Pushes = Code[index + 1];
+		instr.Size = 2 + instr.Pushes;
+		break;
+
+	case DLevelScript::PCD_DUP:
+		instr.Pops = 1;
+		instr.Pushes = 2;
+		break;
+
+	case DLevelScript::PCD_SWAP:
+		instr.Pops = 2;
+		instr.Pushes = 2;
+		break;
+
+	case DLevelScript::PCD_DROP:
+		instr.Pops = 1;
+		break;
+
+	case DLevelScript::PCD_ADD:			case DLevelScript::PCD_SUBTRACT:
+	case DLevelScript::PCD_MULTIPLY:	case DLevelScript::PCD_DIVIDE:
+	case DLevelScript::PCD_MODULUS:
+	case DLevelScript::PCD_EQ:			case DLevelScript::PCD_NE:
+	case DLevelScript::PCD_LT:			case DLevelScript::PCD_GT:
+	case DLevelScript::PCD_LE:			case DLevelScript::PCD_GE:
+	case DLevelScript::PCD_ANDLOGICAL:	case DLevelScript::PCD_ORLOGICAL:
+	case DLevelScript::PCD_ANDBITWISE:	case DLevelScript::PCD_ORBITWISE:
+	case DLevelScript::PCD_EORBITWISE:
+	case DLevelScript::PCD_LSHIFT:		case DLevelScript::PCD_RSHIFT:
+		instr.Pops = 2;
+		instr.Pushes = 1;
+		break;
+
+	case DLevelScript::PCD_NEGATELOGICAL:
+	case DLevelScript::PCD_NEGATEBINARY:
+	case DLevelScript::PCD_UNARYMINUS:
+		instr.Pops = 1;
+		instr.Pushes = 1;
+		break;
+
+	case DLevelScript::PCD_GOTO:
+		instr.Size = 2;
+		instr.FallsThrough = false;
+		break;
+
+	case DLevelScript::PCD_IFGOTO:
+	case DLevelScript::PCD_IFNOTGOTO:
+		instr.Size = 2;
+		instr.Pops = 1;
+		break;
+
+	case DLevelScript::PCD_CASEGOTO:
+		// Only pops the value if the jump is taken.
+		instr.Size = 3;
+		instr.Pops = 1;
+		instr.Pushes = 1;
+		break;
+
+	case DLevelScript::PCD_CASEGOTOSORTED:
+		if (index + 1 >= codesize)
+		{
+			return false;
+		}
+		instr.Size = 2 + Code[index + 1] * 2;
+		instr.Pops = 1;
+		instr.Pushes = 1;
+		break;
+
+	case DLevelScript::PCD_RETURNVOID:
+	case DLevelScript::PCD_RETURNVAL:
+		if (Script)
+		{
+			Failure = "returns from a script";
+			return false;
+		}
+		instr.Pops = pcd == DLevelScript::PCD_RETURNVAL;
+		instr.FallsThrough = false;
+		break;
+
+	case DLevelScript::PCD_TERMINATE:
+		if (!Script)
+		{
+			Failure = "terminates its script";
+			return false;
+		}
+		instr.FallsThrough = false;
+		break;
+
+	case DLevelScript::PCD_DELAY:
+	case DLevelScript::PCD_DELAYDIRECT:
+	case DLevelScript::PCD_DELAYDIRECTB:
+		// The interpreter cannot keep a function's frame across tics either.
+		if (!Script)
+		{
+			Failure = "delays";
+			return false;
+		}
+		instr.Size = pcd == DLevelScript::PCD_DELAY ? 1 : 2;
+		instr.Pops = pcd == DLevelScript::PCD_DELAY;
+		break;
+
+	case DLevelScript::PCD_CALL:
+	case DLevelScript::PCD_CALLDISCARD:
+		{
+			if (index + 1 >= codesize)
+			{
+				return false;
+			}
+			FBehavior *module = Module;
+			const ScriptFunction *func = Module->GetFunction(Code[index + 1], module);
+			if (func == NULL)
+			{
+				Failure = "calls a function that does not exist";
+				return false;
+			}
+			instr.Size = 2;
+			instr.Pops = func->ArgCount;
+			instr.Pushes = pcd == DLevelScript::PCD_CALL;
+		}
+		break;
+
+	default:
+		for (size_t i = 0; i < countof(VarPCodes); ++i)
+		{
+			if (VarPCodes[i].PCode == pcd)
+			{
+				instr.Var = &VarPCodes[i];
+				instr.Size = 2;
+				instr.Pops = (instr.Var->Op == VAROP_Push || instr.Var->Op == VAROP_Inc || instr.Var->Op == VAROP_Dec) ? 0 : 1;
+				instr.Pushes = instr.Var->Op == VAROP_Push ? 1 : 0;
+				if (instr.Var->Scope != VARSCOPE_Local && instr.Var->Op != VAROP_Push)
+				{
+					Pure = false;
+				}
+				return index + 2 <= codesize;
+			}
+		}
+		Failure.Format("uses p-code %d", pcd);
+		return false;
+	}
+	return instr.Size > 0 && index + instr.Size <= codesize;
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: Visit
+//
+// Queues an instruction for analysis. Every path to an instruction must
+// arrive with the same stack depth for its slots to map to registers.
+//
+//==========================================================================
+
+bool FACSVMTranslator::Visit(int index, int depth, TArray<int> &work)
+{
+	if (index <= 0 || index >= (int)Code.Size())
+	{
+		Failure = "jumps outside its module";
+		return false;
+	}
+	int *known = Depths.CheckKey(index);
+	if (known != NULL)
+	{
+		if (*known != depth)
+		{
+			Failure = "does not keep its stack balanced";
+			return false;
+		}
+		return true;
+	}
+	Depths[index] = depth;
+	work.Push(index);
+	return true;
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: Analyze
+//
+// Follows every path through the function to find out which instructions
+// belong to it and how deep the stack is at each of them.
+//
+//==========================================================================
+
+bool FACSVMTranslator::Analyze()
+{
+	TArray<int> work;
+	int index;
+
+	if (!Visit(Entry, 0, work))
+	{
+		return false;
+	}
+	while (work.Pop(index))
+	{
+		FInstr instr;
+		int depth = Depths[index];
+
+		if (!Describe(index, instr))
+		{
+			if (Failure.IsEmpty())
+			{
+				Failure = "has malformed code";
+			}
+			return false;
+		}
+		if (depth < instr.Pops)
+		{
+			Failure = "pops more than it pushes";
+			return false;
+		}
+		depth += instr.Pushes - instr.Pops;
+		MaxDepth = MAX(MaxDepth, depth);
+
+		switch (instr.PCode)
+		{
+		case DLevelScript::PCD_DELAY:
+		case DLevelScript::PCD_DELAYDIRECT:
+		case DLevelScript::PCD_DELAYDIRECTB:
+			// Only the locals are kept while the script waits.
+			if (depth != 0)
+			{
+				Failure = "delays with values on the stack";
+				return false;
+			}
+			ResumePoints.Push(index + instr.Size);
+			break;
+
+		case DLevelScript::PCD_GOTO:
+			if (!Visit(Code[index + 1], depth, work)) return false;
+			break;
+
+		case DLevelScript::PCD_IFGOTO:
+		case DLevelScript::PCD_IFNOTGOTO:
+			if (!Visit(Code[index + 1], depth, work)) return false;
+			break;
+
+		case DLevelScript::PCD_CASEGOTO:
+			if (!Visit(Code[index + 2], depth - 1, work)) return false;
+			break;
+
+		case DLevelScript::PCD_CASEGOTOSORTED:
+			for (int i = 0; i < Code[index + 1]; ++i)
+			{
+				if (!Visit(Code[index + 3 + i*2], depth - 1, work)) return false;
+			}
+			break;
+		}
+		if (instr.FallsThrough && !Visit(index + instr.Size, depth, work))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: EmitRunawayCheck
+//
+// Counts down one loop iteration and leaves if there were too many.
+//
+//==========================================================================
+
+void FACSVMTranslator::EmitRunawayCheck()
+{
+	Build.Emit(OP_ADDI, Counter, Counter, uint8_t(-1));
+	Build.Emit(OP_EQ_K, CMP_CHECK, Counter, Zero);
+	RunawayExits.Push(Build.Emit(OP_JMP, 0));
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: EmitJump
+//
+//==========================================================================
+
+void FACSVMTranslator::EmitJump(int from, int target)
+{
+	if (target <= from)
+	{
+		EmitRunawayCheck();
+	}
+	FFixup fixup = { Build.Emit(OP_JMP, 0), target };
+	Fixups.Push(fixup);
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: EmitCondJump
+//
+// Jumps to target if (b <op> c) == check.
+//
+//==========================================================================
+
+void FACSVMTranslator::EmitCondJump(int from, int target, int opcode, int check, int b, int c)
+{
+	if (target <= from)
+	{
+		EmitRunawayCheck();
+	}
+	Build.Emit(opcode, check, b, c);
+	FFixup fixup = { Build.Emit(OP_JMP, 0), target };
+	Fixups.Push(fixup);
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: EmitBool
+//
+// Sets dest to 1 if (b <op> c) == check, and to 0 otherwise.
+//
+//==========================================================================
+
+void FACSVMTranslator::EmitBool(int opcode, int check, int b, int c, int dest)
+{
+	Build.Emit(opcode, check, b, c);
+	size_t truejump = Build.Emit(OP_JMP, 0);
+	Build.EmitLoadInt(dest, 0);
+	size_t endjump = Build.Emit(OP_JMP, 0);
+	Build.BackpatchToHere(truejump);
+	Build.EmitLoadInt(dest, 1);
+	Build.BackpatchToHere(endjump);
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: EmitVarOp
+//
+//==========================================================================
+
+bool FACSVMTranslator::EmitVarOp(int index, const FVarPCode *var, int top)
+{
+	int varnum = Code[index + 1];
+	int reg;
+	void *addr = NULL;
+
+	switch (var->Scope)
+	{
+	case VARSCOPE_Local:
+		if ((unsigned)varnum >= (unsigned)NumLocals)
+		{
+			Failure = "uses an undeclared local variable";
+			return false;
+		}
+		reg = LocalBase + varnum;
+		break;
+
+	case VARSCOPE_Map:
+		if ((unsigned)varnum >= NUM_MAPVARS || Module->MapVars[varnum] == NULL)
+		{
+			Failure = "uses an undefined map variable";
+			return false;
+		}
+		addr = Module->MapVars[varnum];
+		break;
+
+	case VARSCOPE_World:
+		if ((unsigned)varnum >= NUM_WORLDVARS)
+		{
+			Failure = "uses an undefined world variable";
+			return false;
+		}
+		addr = &ACS_WorldVars[varnum];
+		break;
+
+	case VARSCOPE_Global:
+	default:
+		if ((unsigned)varnum >= NUM_GLOBALVARS)
+		{
+			Failure = "uses an undefined global variable";
+			return false;
+		}
+		addr = &ACS_GlobalVars[varnum];
+		break;
+	}
+
+	if (addr != NULL)
+	{
+		Build.Emit(OP_LKP, Pointer, Build.GetConstantAddress(addr, ATAG_GENERIC));
+		if (var->Op == VAROP_Assign)
+		{
+			Build.Emit(OP_SW, Pointer, top, Zero);
+			return true;
+		}
+		if (var->Op == VAROP_Push)
+		{
+			Build.Emit(OP_LW, top + 1, Pointer, Zero);
+			return true;
+		}
+		Build.Emit(OP_LW, Temp, Pointer, Zero);
+		reg = Temp;
+	}
+
+	switch (var->Op)
+	{
+	case VAROP_Assign:
+		Build.Emit(OP_MOVE, reg, top);
+		break;
+
+	case VAROP_Push:
+		Build.Emit(OP_MOVE, top + 1, reg);
+		break;
+
+	case VAROP_Inc:
+		Build.Emit(OP_ADDI, reg, reg, 1);
+		break;
+
+	case VAROP_Dec:
+		Build.Emit(OP_ADDI, reg, reg, uint8_t(-1));
+		break;
+
+	case VAROP_Div:
+	case VAROP_Mod:
+		Build.Emit(OP_EQ_K, CMP_CHECK, top, Zero);
+		(var->Op == VAROP_Div ? DivExits : ModExits).Push(Build.Emit(OP_JMP, 0));
+		// fall through
+	default:
+		Build.Emit(VarOpCodes[var->Op - VAROP_Add], reg, reg, top);
+		break;
+	}
+
+	if (addr != NULL)
+	{
+		Build.Emit(OP_SW, Pointer, Temp, Zero);
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: EmitCall
+//
+// Calls the VM version of another ACS function. If that stops early, so
+// does the caller.
+//
+//==========================================================================
+
+bool FACSVMTranslator::EmitCall(const int *pc, int top, bool discard)
+{
+	FBehavior *module = Module;
+	const ScriptFunction *func = Module->GetFunction(pc[0], module);
+	bool pure;
+
+	// A function that is being translated right now has already been
+	// marked as failed, so recursion is left to the interpreter.
+	VMScriptFunction *callee = module->GetCompiledFunction(func, &pure);
+	if (callee == NULL)
+	{
+		Failure.Format("calls %s, which is interpreted", module->GetFunctionName(module->GetFunctionIndex(func)).GetChars());
+		return false;
+	}
+	Pure = Pure && pure;
+
+	int first = top - func->ArgCount + 1;
+	for (int i = 0; i < func->ArgCount; ++i)
+	{
+		Build.Emit(OP_PARAM, 0, REGT_INT, first + i);
+	}
+	Build.Emit(OP_CALL_K, Build.GetConstantAddress(callee, ATAG_OBJECT), func->ArgCount, 2);
+	Build.Emit(OP_RESULT, 0, REGT_INT, discard ? Temp : first);
+	Build.Emit(OP_RESULT, 0, REGT_INT, Status);
+	Build.Emit(OP_EQ_K, 0, Status, Zero);
+	StatusExits.Push(Build.Emit(OP_JMP, 0));
+	return true;
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: EmitDelay
+//
+// Leaves the script until the delay is over. If tics is negative, the
+// delay is already in Temp.
+//
+//==========================================================================
+
+void FACSVMTranslator::EmitDelay(int resume, int tics)
+{
+	if (tics >= 0)
+	{
+		Build.EmitLoadInt(Temp, tics);
+	}
+	Build.EmitLoadInt(Resume, resume);
+	DelayExits.Push(Build.Emit(OP_JMP, 0));
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: EmitExit
+//
+// Returns with the given ACSVM_* code, or with the one in statusreg if
+// that is not negative.
+//
+//==========================================================================
+
+void FACSVMTranslator::EmitExit(int status, int statusreg)
+{
+	if (Script)
+	{
+		if (statusreg >= 0)
+		{
+			Build.Emit(OP_RET, 0, REGT_INT, statusreg);
+		}
+		else
+		{
+			Build.EmitRetInt(0, false, status);
+		}
+		Build.EmitRetInt(1, false, 0);
+		Build.EmitRetInt(2, true, 0);
+	}
+	else
+	{
+		Build.EmitRetInt(0, false, 0);
+		if (statusreg >= 0)
+		{
+			Build.Emit(OP_RET, RET_FINAL | 1, REGT_INT, statusreg);
+		}
+		else
+		{
+			Build.EmitRetInt(1, true, status);
+		}
+	}
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: EmitScriptEntry
+//
+// Loads the script's local variables and goes to where it has to resume.
+//
+//==========================================================================
+
+void FACSVMTranslator::EmitScriptEntry()
+{
+	for (int i = 0; i < NumLocals; ++i)
+	{
+		Build.Emit(OP_LW, LocalBase + i, Locals, Build.GetConstantInt(i * sizeof(SDWORD)));
+	}
+	for (unsigned int i = 0; i < ResumePoints.Size(); ++i)
+	{
+		Build.Emit(OP_EQ_K, CMP_CHECK, Resume, Build.GetConstantInt(ResumePoints[i]));
+		FFixup fixup = { Build.Emit(OP_JMP, 0), ResumePoints[i] };
+		Fixups.Push(fixup);
+	}
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: EmitInstr
+//
+//==========================================================================
+
+bool FACSVMTranslator::EmitInstr(int index, const FInstr &instr, int depth)
+{
+	const int *pc = &Code[index + 1];
+	int top = StackBase + depth - 1;	// STACK(1)
+	int next = top - 1;					// STACK(2)
+	int i;
+
+	if (instr.Var != NULL)
+	{
+		return EmitVarOp(index, instr.Var, top);
+	}
+
+	switch (instr.PCode)
+	{
+	case DLevelScript::PCD_NOP:
+		break;
+
+	case DLevelScript::PCD_PUSHNUMBER:
+	case DLevelScript::PCD_PUSHBYTE:
+		Build.EmitLoadInt(top + 1, pc[0]);
+		break;
+
+	case DLevelScript::PCD_PUSH2BYTES:
+	case DLevelScript::PCD_PUSH3BYTES:
+	case DLevelScript::PCD_PUSH4BYTES:
+	case DLevelScript::PCD_PUSH5BYTES:
+		for (i = 0; i < instr.Pushes; ++i)
+		{
+			Build.EmitLoadInt(top + 1 + i, pc[i]);
+		}
+		break;
+
+	case DLevelScript::PCD_PUSHBYTES:
+		for (i = 0; i < instr.Pushes; ++i)
+		{
+			Build.EmitLoadInt(top + 1 + i, pc[1 + i]);
+		}
+		break;
+
+	case DLevelScript::PCD_DUP:
+		Build.Emit(OP_MOVE, top + 1, top);
+		break;
+
+	case DLevelScript::PCD_SWAP:
+		Build.Emit(OP_MOVE, Temp, top);
+		Build.Emit(OP_MOVE, top, next);
+		Build.Emit(OP_MOVE, next, Temp);
+		break;
+
+	case DLevelScript::PCD_DROP:
+		break;
+
+	case DLevelScript::PCD_ADD:			Build.Emit(OP_ADD_RR, next, next, top);		break;
+	case DLevelScript::PCD_SUBTRACT:	Build.Emit(OP_SUB_RR, next, next, top);		break;
+	case DLevelScript::PCD_MULTIPLY:	Build.Emit(OP_MUL_RR, next, next, top);		break;
+	case DLevelScript::PCD_ANDBITWISE:	Build.Emit(OP_AND_RR, next, next, top);		break;
+	case DLevelScript::PCD_ORBITWISE:	Build.Emit(OP_OR_RR, next, next, top);		break;
+	case DLevelScript::PCD_EORBITWISE:	Build.Emit(OP_XOR_RR, next, next, top);		break;
+	case DLevelScript::PCD_LSHIFT:		Build.Emit(OP_SLL_RR, next, next, top);		break;
+	case DLevelScript::PCD_RSHIFT:		Build.Emit(OP_SRA_RR, next, next, top);		break;
+
+	case DLevelScript::PCD_DIVIDE:
+	case DLevelScript::PCD_MODULUS:
+		Build.Emit(OP_EQ_K, CMP_CHECK, top, Zero);
+		(instr.PCode == DLevelScript::PCD_DIVIDE ? DivExits : ModExits).Push(Build.Emit(OP_JMP, 0));
+		Build.Emit(instr.PCode == DLevelScript::PCD_DIVIDE ? OP_DIV_RR : OP_MOD_RR, next, next, top);
+		break;
+
+	case DLevelScript::PCD_EQ:		EmitBool(OP_EQ_R, CMP_CHECK, next, top, next);	break;
+	case DLevelScript::PCD_NE:		EmitBool(OP_EQ_R, 0, next, top, next);			break;
+	case DLevelScript::PCD_LT:		EmitBool(OP_LT_RR, CMP_CHECK, next, top, next);	break;
+	case DLevelScript::PCD_GT:		EmitBool(OP_LT_RR, CMP_CHECK, top, next, next);	break;
+	case DLevelScript::PCD_LE:		EmitBool(OP_LE_RR, CMP_CHECK, next, top, next);	break;
+	case DLevelScript::PCD_GE:		EmitBool(OP_LE_RR, CMP_CHECK, top, next, next);	break;
+
+	case DLevelScript::PCD_ANDLOGICAL:
+	case DLevelScript::PCD_ORLOGICAL:
+		{
+			// ACS evaluates both sides, so this only needs to combine them.
+			int check = instr.PCode == DLevelScript::PCD_ANDLOGICAL ? CMP_CHECK : 0;
+			Build.Emit(OP_EQ_K, check, next, Zero);
+			size_t jump1 = Build.Emit(OP_JMP, 0);
+			Build.Emit(OP_EQ_K, check, top, Zero);
+			size_t jump2 = Build.Emit(OP_JMP, 0);
+			Build.EmitLoadInt(next, check);
+			size_t endjump = Build.Emit(OP_JMP, 0);
+			Build.BackpatchToHere(jump1);
+			Build.BackpatchToHere(jump2);
+			Build.EmitLoadInt(next, !check);
+			Build.BackpatchToHere(endjump);
+		}
+		break;
+
+	case DLevelScript::PCD_NEGATELOGICAL:
+		EmitBool(OP_EQ_K, CMP_CHECK, top, Zero, top);
+		break;
+
+	case DLevelScript::PCD_NEGATEBINARY:
+		Build.Emit(OP_NOT, top, top);
+		break;
+
+	case DLevelScript::PCD_UNARYMINUS:
+		Build.Emit(OP_NEG, top, top);
+		break;
+
+	case DLevelScript::PCD_GOTO:
+		EmitJump(index, pc[0]);
+		break;
+
+	case DLevelScript::PCD_IFGOTO:
+		EmitCondJump(index, pc[0], OP_EQ_K, 0, top, Zero);
+		break;
+
+	case DLevelScript::PCD_IFNOTGOTO:
+		EmitCondJump(index, pc[0], OP_EQ_K, CMP_CHECK, top, Zero);
+		break;
+
+	case DLevelScript::PCD_CASEGOTO:
+		EmitCondJump(index, pc[1], OP_EQ_K, CMP_CHECK, top, Build.GetConstantInt(pc[0]));
+		break;
+
+	case DLevelScript::PCD_CASEGOTOSORTED:
+		for (i = 0; i < pc[0]; ++i)
+		{
+			EmitCondJump(index, pc[2 + i*2], OP_EQ_K, CMP_CHECK, top, Build.GetConstantInt(pc[1 + i*2]));
+		}
+		break;
+
+	case DLevelScript::PCD_RETURNVOID:
+		Build.EmitRetInt(0, false, 0);
+		Build.EmitRetInt(1, true, ACSVM_Done);
+		break;
+
+	case DLevelScript::PCD_RETURNVAL:
+		Build.Emit(OP_RET, 0, REGT_INT, top);
+		Build.EmitRetInt(1, true, ACSVM_Done);
+		break;
+
+	case DLevelScript::PCD_TERMINATE:
+		EmitExit(ACSVM_Done, -1);
+		break;
+
+	case DLevelScript::PCD_CALL:
+	case DLevelScript::PCD_CALLDISCARD:
+		return EmitCall(pc, top, instr.PCode == DLevelScript::PCD_CALLDISCARD);
+
+	case DLevelScript::PCD_DELAY:
+		{
+			// Like the interpreter, go on right away unless the delay is positive.
+			if (DelayBonus != 0)
+			{
+				Build.Emit(OP_ADDI, top, top, DelayBonus);
+			}
+			Build.Emit(OP_LT_KR, 0, Zero, top);
+			size_t nodelay = Build.Emit(OP_JMP, 0);
+			Build.Emit(OP_MOVE, Temp, top);
+			EmitDelay(index + instr.Size, -1);
+			Build.BackpatchToHere(nodelay);
+		}
+		break;
+
+	case DLevelScript::PCD_DELAYDIRECT:
+	case DLevelScript::PCD_DELAYDIRECTB:
+		if (pc[0] + DelayBonus > 0)
+		{
+			EmitDelay(index + instr.Size, pc[0] + DelayBonus);
+		}
+		break;
+
+	default:
+		return false;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// FACSVMTranslator :: Translate
+//
+//==========================================================================
+
+VMScriptFunction *FACSVMTranslator::Translate(FName name, const char *printablename)
+{
+	TArray<int> order;
+	TMap<int, int>::Iterator it(Depths);
+	TMap<int, int>::Pair *pair;
+	unsigned int i;
+
+	if (!Script && NumArgs > VM_MAX_ARGS)
+	{
+		Failure = "has too many arguments";
+		return NULL;
+	}
+	if (LocalArrays.Count > 0)
+	{
+		Failure = "has local arrays";
+		return NULL;
+	}
+	if (!Analyze())
+	{
+		return NULL;
+	}
+	LocalBase = Script ? 1 : 0;
+	if (LocalBase + NumLocals + MaxDepth + 3 > 255)
+	{
+		Failure = "needs too many registers";
+		return NULL;
+	}
+
+	// Arguments come first so the VM puts them in the right place.
+	for (int j = LocalBase + NumLocals + MaxDepth + 3; j > 0; --j)
+	{
+		Build.Registers[REGT_INT].Get(1);
+	}
+	if (Script)
+	{
+		Resume = 0;
+		Locals = Build.Registers[REGT_POINTER].Get(1);
+	}
+	StackBase = LocalBase + NumLocals;
+	Counter = StackBase + MaxDepth;
+	Temp = Counter + 1;
+	Status = Counter + 2;
+	Pointer = Build.Registers[REGT_POINTER].Get(1);
+	Zero = Build.GetConstantInt(0);
+
+	Build.EmitLoadInt(Counter, VM_RUNAWAY_LIMIT);
+	if (Script)
+	{
+		EmitScriptEntry();
+	}
+	else
+	{
+		for (int j = NumArgs; j < NumLocals; ++j)
+		{
+			Build.EmitLoadInt(j, 0);
+		}
+	}
+
+	// Lay the instructions out in the order the ACS compiler did.
+	while (it.NextPair(pair))
+	{
+		order.Push(pair->Key);
+	}
+	std::sort(&order[0], &order[0] + order.Size());
+
+	for (i = 0; i < order.Size(); ++i)
+	{
+		int index = order[i];
+		FInstr instr;
+
+		Describe(index, instr);
+		Addresses[index] = Build.GetAddress();
+		if (!EmitInstr(index, instr, Depths[index]))
+		{
+			return NULL;
+		}
+		if (instr.FallsThrough && (i + 1 == order.Size() || order[i + 1] != index + instr.Size))
+		{
+			EmitJump(index, index + instr.Size);
+		}
+	}
+
+	for (i = 0; i < Fixups.Size(); ++i)
+	{
+		Build.Backpatch(Fixups[i].Address, *Addresses.CheckKey(Fixups[i].Target));
+	}
+
+	static const int exitcodes[4] = { ACSVM_Runaway, ACSVM_DivideBy0, ACSVM_ModulusBy0, ACSVM_Done };
+	TArray<size_t> *exits[4] = { &RunawayExits, &DivExits, &ModExits, &StatusExits };
+	for (int j = 0; j < 4; ++j)
+	{
+		if (exits[j]->Size() > 0)
+		{
+			Build.BackpatchListToHere(*exits[j]);
+			EmitExit(exitcodes[j], exits[j] == &StatusExits ? Status : -1);
+		}
+	}
+	if (DelayExits.Size() > 0)
+	{
+		Build.BackpatchListToHere(DelayExits);
+		for (int j = 0; j < NumLocals; ++j)
+		{
+			Build.Emit(OP_SW, Locals, LocalBase + j, Build.GetConstantInt(j * sizeof(SDWORD)));
+		}
+		Build.EmitRetInt(0, false, ACSVM_Delayed);
+		Build.Emit(OP_RET, 1, REGT_INT, Temp);
+		Build.Emit(OP_RET, RET_FINAL | 2, REGT_INT, Resume);
+	}
+
+	VMScriptFunction *sfunc = new VMScriptFunction(name);
+	Build.MakeFunction(sfunc);
+	sfunc->NumArgs = Script ? VM_SCRIPT_ARGS : NumArgs;
+	sfunc->PrintableName = printablename;
+	sfunc->ObjectFlags |= OF_Fixed;
+	return sfunc;
+}
+
+//==========================================================================
+//
+// FBehavior :: GetFunctionName
+//
+//==========================================================================
+
+FString FBehavior::GetFunctionName (int index) const
+{
+	DWORD *fnames = (DWORD *)FindChunk(MAKE_ID('F','N','A','M'));
+	FString name;
+
+	if (fnames != NULL && index >= 0 && index < (int)LittleLong(fnames[2]))
+	{
+		name = (char *)(fnames + 2) + LittleLong(fnames[3+index]);
+	}
+	else
+	{
+		name.Format("Function %d", index);
+	}
+	return name;
+}
+
+//==========================================================================
+//
+// FBehavior :: GetCompiledFunction
+//
+// Returns the VM version of an ACS function, translating it the first
+// time it is asked for. Returns NULL if it needs the interpreter.
+//
+//==========================================================================
+
+VMScriptFunction *FBehavior::GetCompiledFunction (const ScriptFunction *func, bool *pure)
+{
+	int index = int(func - Functions);
+
+	if ((unsigned)index >= (unsigned)NumFunctions)
+	{
+		return NULL;
+	}
+	if (CompileState.Size() != (unsigned)NumFunctions)
+	{
+		CompileState.Resize(NumFunctions);
+		CompiledFunctions.Resize(NumFunctions);
+		for (int i = 0; i < NumFunctions; ++i)
+		{
+			CompileState[i] = VMSTATE_Untried;
+			CompiledFunctions[i] = NULL;
+		}
+	}
+	if (CompileState[index] == VMSTATE_Untried)
+	{
+		CompileState[index] = VMSTATE_Failed;
+		if (func->ImportNum == 0 && FunctionCode[index] > 0)
+		{
+			FString name = GetFunctionName(index);
+			FString printable;
+			printable.Format("ACS function %s in %s", name.GetChars(), ModuleName);
+
+			FACSVMTranslator translator(this, Code, FunctionCode[index], func->ArgCount, func->ArgCount + func->LocalCount, func->LocalArrays, false);
+			CompiledFunctions[index] = translator.Translate(name.GetChars(), printable);
+			if (CompiledFunctions[index] != NULL)
+			{
+				CompileState[index] = translator.Pure ? VMSTATE_CompiledPure : VMSTATE_Compiled;
+			}
+			else
+			{
+				DPrintf (DMSG_NOTIFY, "%s is interpreted: it %s\n", printable.GetChars(), translator.Failure.GetChars());
+			}
+		}
+	}
+	if (pure != NULL)
+	{
+		*pure = CompileState[index] == VMSTATE_CompiledPure;
+	}
+	return CompiledFunctions[index];
+}
+
+//==========================================================================
+//
+// FBehavior :: GetCompiledScript
+//
+// Returns the VM version of a script if it can be entered at pc,
+// translating it the first time it is asked for.
+//
+//==========================================================================
+
+VMScriptFunction *FBehavior::GetCompiledScript (int index, const int *pc)
+{
+	if ((unsigned)index >= (unsigned)NumScripts)
+	{
+		return NULL;
+	}
+	if (ScriptCompileState.Size() != (unsigned)NumScripts)
+	{
+		ScriptCompileState.Resize(NumScripts);
+		CompiledScripts.Resize(NumScripts);
+		for (int i = 0; i < NumScripts; ++i)
+		{
+			ScriptCompileState[i] = VMSTATE_Untried;
+			CompiledScripts[i] = NULL;
+		}
+	}
+	if (ScriptCompileState[index] == VMSTATE_Untried)
+	{
+		const ScriptPtr *ptr = &Scripts[index];
+		int entry = PC2Index(GetScriptAddress(ptr));
+		FString name = ScriptPresentation(ptr->Number);
+		FString printable;
+		printable.Format("ACS %s in %s", name.GetChars(), ModuleName);
+
+		ScriptCompileState[index] = VMSTATE_Failed;
+		FACSVMTranslator translator(this, Code, entry, ptr->ArgCount, ptr->VarCount, ptr->LocalArrays, true);
+		CompiledScripts[index] = translator.Translate(name.GetChars(), printable);
+		if (CompiledScripts[index] != NULL)
+		{
+			ScriptCompileState[index] = VMSTATE_Compiled;
+			ResumePoints[entry] = index;
+			for (unsigned int i = 0; i < translator.ResumePoints.Size(); ++i)
+			{
+				ResumePoints[translator.ResumePoints[i]] = index;
+			}
+		}
+		else
+		{
+			DPrintf (DMSG_NOTIFY, "%s is interpreted: it %s\n", printable.GetChars(), translator.Failure.GetChars());
+		}
+	}
+
+	// A script that was running when the game was saved or acs_vm was
+	// turned on may be waiting somewhere the VM code cannot resume.
+	int *point = ResumePoints.CheckKey(PC2Index(pc));
+	return point != NULL && *point == index ? CompiledScripts[index] : NULL;
+}
+
+//==========================================================================
+//
+// FBehavior :: FreeCompiledFunctions
+//
+//==========================================================================
+
+void FBehavior::FreeCompiledFunctions ()
+{
+	for (unsigned int i = 0; i < CompiledFunctions.Size(); ++i)
+	{
+		if (CompiledFunctions[i] != NULL)
+		{
+			CompiledFunctions[i]->Destroy();
+		}
+	}
+	for (unsigned int i = 0; i < CompiledScripts.Size(); ++i)
+	{
+		if (CompiledScripts[i] != NULL)
+		{
+			CompiledScripts[i]->Destroy();
+		}
+	}
+	CompiledFunctions.Clear();
+	CompileState.Clear();
+	CompiledScripts.Clear();
+	ScriptCompileState.Clear();
+	ResumePoints.Clear();
+}
+
+//==========================================================================
+//
+// ACS_CallCompiledFunction
+//
+// Runs a translated function with the given arguments and returns its
+// result. status is set to one of the ACSVM_* codes.
+//
+//==========================================================================
+
+int ACS_CallCompiledFunction (VMScriptFunction *func, const SDWORD *args, int &status)
+{
+	VMValue params[VM_MAX_ARGS];
+	VMReturn rets[2];
+	int result = 0;
+
+	for (int i = 0; i < func->NumArgs; ++i)
+	{
+		params[i] = args[i];
+	}
+	status = ACSVM_Done;
+	rets[0].IntAt(&result);
+	rets[1].IntAt(&status);
+	GlobalVMStack.Call(func, params, func->NumArgs, rets, 2);
+	VMCalls++;
+	return result;
+}
+
+//==========================================================================
+//
+// DLevelScript :: GetCompiledScript
+//
+// Returns the VM version of this script if it can continue at pc.
+//
+//==========================================================================
+
+VMScriptFunction *DLevelScript::GetCompiledScript (const int *pc) const
+{
+	return InModuleScriptNumber >= 0 ? activeBehavior->GetCompiledScript(InModuleScriptNumber, pc) : NULL;
+}
+
+//==========================================================================
+//
+// DLevelScript :: RunCompiledScript
+//
+// Runs this tic of a translated script and leaves the script in the state
+// the interpreter would have left it in.
+//
+//==========================================================================
+
+void DLevelScript::RunCompiledScript (VMScriptFunction *func, int *&pc)
+{
+	VMValue params[VM_SCRIPT_ARGS] = { Localvars.Size() > 0 ? &Localvars[0] : NULL, activeBehavior->PC2Index(pc) };
+	VMReturn rets[3];
+	int status = ACSVM_Done, data = 0, resume = 0;
+
+	rets[0].IntAt(&status);
+	rets[1].IntAt(&data);
+	rets[2].IntAt(&resume);
+	GlobalVMStack.Call(func, params, VM_SCRIPT_ARGS, rets, 3);
+	VMCalls++;
+	activeBehavior->GetScriptPtr(InModuleScriptNumber)->ProfileData.AddVMRun();
+
+	switch (status)
+	{
+	case ACSVM_Delayed:
+		state = SCRIPT_Delayed;
+		statedata = data;
+		pc = activeBehavior->Index2PC(resume);
+		break;
+
+	case ACSVM_Runaway:
+		Printf ("Runaway %s terminated\n", ScriptPresentation(script).GetChars());
+		state = SCRIPT_PleaseRemove;
+		break;
+
+	case ACSVM_DivideBy0:
+		state = SCRIPT_DivideBy0;
+		break;
+
+	case ACSVM_ModulusBy0:
+		state = SCRIPT_ModulusBy0;
+		break;
+
+	default:
+		DPrintf (DMSG_NOTIFY, "%s finished\n", ScriptPresentation(script).GetChars());
+		state = SCRIPT_PleaseRemove;
+		break;
+	}
+}
+
+//==========================================================================
+//
+// SaveVars / RestoreVars
+//
+// Copies every variable a translated script can change outside itself.
+//
+//==========================================================================
+
+static void SaveVars (TArray<SDWORD> &vars)
+{
+	vars.Clear();
+	for (int i = 0; ; ++i)
+	{
+		FBehavior *module = FBehavior::StaticGetModule(i);
+		if (module == NULL)
+		{
+			break;
+		}
+		for (int j = 0; j < NUM_MAPVARS; ++j)
+		{
+			vars.Push(module->MapVars[j] != NULL ? *module->MapVars[j] : 0);
+		}
+	}
+	for (int j = 0; j < NUM_WORLDVARS; ++j)
+	{
+		vars.Push(ACS_WorldVars[j]);
+	}
+	for (int j = 0; j < NUM_GLOBALVARS; ++j)
+	{
+		vars.Push(ACS_GlobalVars[j]);
+	}
+}
+
+static void RestoreVars (const TArray<SDWORD> &vars)
+{
+	unsigned int k = 0;
+
+	for (int i = 0; ; ++i)
+	{
+		FBehavior *module = FBehavior::StaticGetModule(i);
+		if (module == NULL)
+		{
+			break;
+		}
+		for (int j = 0; j < NUM_MAPVARS; ++j, ++k)
+		{
+			if (module->MapVars[j] != NULL)
+			{
+				*module->MapVars[j] = vars[k];
+			}
+		}
+	}
+	for (int j = 0; j < NUM_WORLDVARS; ++j)
+	{
+		ACS_WorldVars[j] = vars[k++];
+	}
+	for (int j = 0; j < NUM_GLOBALVARS; ++j)
+	{
+		ACS_GlobalVars[j] = vars[k++];
+	}
+}
+
+//==========================================================================
+//
+// DLevelScript :: StartVMCompare
+//
+// For acs_vmcompare: runs this tic of a translated script on the VM, notes
+// what it did and undoes it again, so the interpreter can run the same tic
+// from the same state. EndVMCompare then checks that both did the same.
+//
+//==========================================================================
+
+void DLevelScript::StartVMCompare (VMScriptFunction *func, int *pc, FACSVMTic &tic)
+{
+	TArray<int32_t> locals = Localvars;
+	TArray<SDWORD> vars;
+	int oldstatedata = statedata;
+	int *vmpc = pc;
+
+	SaveVars(vars);
+	RunCompiledScript(func, vmpc);
+	tic.State = state;
+	tic.StateData = statedata;
+	tic.PC = vmpc;
+	tic.Locals = Localvars;
+	SaveVars(tic.Vars);
+
+	Localvars = locals;
+	RestoreVars(vars);
+	state = SCRIPT_Running;
+	statedata = oldstatedata;
+}
+
+//==========================================================================
+//
+// DLevelScript :: EndVMCompare
+//
+//==========================================================================
+
+void DLevelScript::EndVMCompare (const FACSVMTic &tic, int *pc)
+{
+	TArray<SDWORD> vars;
+	FString diffs;
+
+	if (tic.State != state)
+	{
+		diffs.AppendFormat(" state %d instead of %d,", tic.State, state);
+	}
+	else if (state == SCRIPT_Delayed)
+	{
+		if (tic.StateData != statedata)
+		{
+			diffs.AppendFormat(" delay %d instead of %d,", tic.StateData, statedata);
+		}
+		if (tic.PC != pc)
+		{
+			diffs.AppendFormat(" resumes at %u instead of %u,", activeBehavior->PC2Ofs(tic.PC), activeBehavior->PC2Ofs(pc));
+		}
+		for (unsigned int i = 0; i < Localvars.Size(); ++i)
+		{
+			if (tic.Locals[i] != Localvars[i])
+			{
+				diffs.AppendFormat(" local %u is %d instead of %d,", i, tic.Locals[i], Localvars[i]);
+			}
+		}
+	}
+	SaveVars(vars);
+	for (unsigned int i = 0; i < vars.Size() && i < tic.Vars.Size(); ++i)
+	{
+		if (tic.Vars[i] != vars[i])
+		{
+			diffs.AppendFormat(" a map, world or global variable is %d instead of %d,", tic.Vars[i], vars[i]);
+			break;
+		}
+	}
+	if (diffs.IsNotEmpty())
+	{
+		VMMismatches++;
+		diffs.Truncate(diffs.Len() - 1);
+		Printf (TEXTCOLOR_RED "%s ran differently on the VM:%s\n", ScriptPresentation(script).GetChars(), diffs.GetChars());
+	}
+}
+
+//==========================================================================
+//
+// ACS_ReportVMMismatch
+//
+// Called by acs_vmcompare when the interpreter and the VM returned
+// different values from the same call.
+//
+//==========================================================================
+
+void ACS_ReportVMMismatch (FBehavior *module, const ScriptFunction *func, int vmresult, int result)
+{
+	VMMismatches++;
+	Printf (TEXTCOLOR_RED "ACS function %s in %s returned %d from the VM, but %d from the interpreter\n",
+		module->GetFunctionName(module->GetFunctionIndex(func)).GetChars(), module->GetModuleName(), vmresult, result);
+}
+
+//==========================================================================
+//
+// CCMD acsvm
+//
+// Lists which functions and scripts of the loaded modules run as VM code
+// and which ones still use the interpreter. Only the ones that have been
+// called or started at least once have been looked at.
+//
+//==========================================================================
+
+CCMD (acsvm)
+{
+	int compiled = 0, interpreted = 0;
+	int compiledscripts = 0, interpretedscripts = 0;
+	bool all = argv.argc() > 1 && !stricmp(argv[1], "all");
+
+	for (int i = 0; ; ++i)
+	{
+		FBehavior *module = FBehavior::StaticGetModule(i);
+		if (module == NULL)
+		{
+			break;
+		}
+		for (int j = 0; j < (int)module->GetNumFunctions(); ++j)
+		{
+			int state = module->GetCompiledFunctionState(j);
+			if (state == VMSTATE_Untried)
+			{
+				continue;
+			}
+			if (state == VMSTATE_Failed)
+			{
+				interpreted++;
+			}
+			else
+			{
+				compiled++;
+			}
+			if (all)
+			{
+				Printf ("%-8s %-24s %s\n", module->GetModuleName(), module->GetFunctionName(j).GetChars(),
+					state == VMSTATE_Failed ? "interpreted" : state == VMSTATE_CompiledPure ? "VM (pure)" : "VM");
+			}
+		}
+		for (int j = 0; j < module->GetNumScripts(); ++j)
+		{
+			int state = module->GetCompiledScriptState(j);
+			if (state == VMSTATE_Untried)
+			{
+				continue;
+			}
+			if (state == VMSTATE_Failed)
+			{
+				interpretedscripts++;
+			}
+			else
+			{
+				compiledscripts++;
+			}
+			if (all)
+			{
+				Printf ("%-8s %-24s %s\n", module->GetModuleName(), ScriptPresentation(module->GetScriptPtr(j)->Number).GetChars(),
+					state == VMSTATE_Failed ? "interpreted" : "VM");
+			}
+		}
+	}
+	Printf ("ACS functions: %d run on the VM, %d interpreted%s\n", compiled, interpreted, acs_vm ? "" : " (acs_vm is off)");
+	Printf ("ACS scripts: %d run on the VM, %d interpreted\n", compiledscripts, interpretedscripts);
+	Printf ("%u VM calls, %u mismatches%s\n", VMCalls, VMMismatches, acs_vmcompare ? "" : " (acs_vmcompare is off)");
+}
@@ -210,6 +210,25 @@ int FTagManager::GetFirstSectorTag(const sector_t *sect) const
 	return SectorHasTags(i) ? allTags[startForSector[i]].tag : 0;
 }
 
+//-----------------------------------------------------------------------------
+//
+// Untagged sectors get an empty list
+//
+//-----------------------------------------------------------------------------
+
+void FTagManager::GetSectorTags(const sector_t *sect, TArray<int> &tags) const
+{
+	int i = sectindex(sect);
+	tags.Clear();
+	if (SectorHasTags(i))
+	{
+		for (int ndx = startForSector[i]; ndx < (int)allTags.Size() && allTags[ndx].target == i; ndx++)
+		{
+			tags.Push(allTags[ndx].tag);
+		}
+	}
+}
+
 //-----------------------------------------------------------------------------
 //
 //
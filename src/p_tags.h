@@ -54,6 +54,7 @@ public:
 
 	bool SectorHasTags(const sector_t *sector) const;
 	int GetFirstSectorTag(const sector_t *sect) const;
+	void GetSectorTags(const sector_t *sect, TArray<int> &tags) const;
 	bool SectorHasTag(int sector, int tag) const;
 	bool SectorHasTag(const sector_t *sector, int tag) const;
 
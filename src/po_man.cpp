@@ -30,6 +30,7 @@
 #include "serializer.h"
 #include "p_blockmap.h"
 #include "p_maputl.h"
+#include "p_acs.h"
 #include "r_utility.h"
 #include "p_blockmap.h"
 
@@ -206,6 +207,7 @@ void DPolyAction::Destroy()
 	if (poly->specialdata == this)
 	{
 		poly->specialdata = NULL;
+		P_WakeACSPolyWaiters(m_PolyObj);
 	}
 
 	StopInterpolation();
@@ -108,6 +108,10 @@ CVAR (Int, vid_displaybits, 32, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 
 CVAR (Bool, vid_forcesurface, false, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 
+// Filter the picture when the renderer stretches it to the window.
+// Takes effect the next time the renderer is set up.
+CVAR (Bool, vid_linearscale, false, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+
 CUSTOM_CVAR (Float, rgamma, 1.f, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 {
 	if (screen != NULL)
@@ -497,7 +501,7 @@ void SDLFB::Update ()
 
 	if (NotPaletted)
 	{
-		GPfx.Convert (MemBuffer, Pitch,
+		GPfx.ConvertThreaded (MemBuffer, Pitch,
 			pixels, pitch, Width, Height,
 			FRACUNIT, FRACUNIT, 0, 0);
 	}
@@ -683,6 +687,7 @@ void SDLFB::ResetSDLRenderer ()
 			case 16: fmt = SDL_PIXELFORMAT_RGB565; break;
 			case 15: fmt = SDL_PIXELFORMAT_ARGB1555; break;
 		}
+		SDL_SetHint (SDL_HINT_RENDER_SCALE_QUALITY, vid_linearscale ? "linear" : "nearest");
 		Texture = SDL_CreateTexture (Renderer, fmt, SDL_TEXTUREACCESS_STREAMING, Width, Height);
 
 		{
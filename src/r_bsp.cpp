@@ -51,6 +51,7 @@
 #include "r_sky.h"
 #include "po_man.h"
 #include "r_data/colormaps.h"
+#include "r_profile.h"
 
 CVAR (Bool, r_drawflat, false, 0)		// [RH] Don't texture segs?
 EXTERN_CVAR(Bool, r_fullbrightignoresectorcolor);
@@ -1379,6 +1380,7 @@ void R_RenderBSPNode (void *node)
 	while (!((size_t)node & 1))  // Keep going until found a subsector
 	{
 		node_t *bsp = (node_t *)node;
+		RenderCounts.Nodes++;
 
 		// Decide which side the view point is on.
 		int side = R_PointOnSide (ViewPos, bsp);
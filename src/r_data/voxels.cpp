@@ -34,6 +34,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <algorithm>
 
 #include "templates.h"
@@ -173,6 +174,148 @@ static void RemapVoxelSlabs(kvxslab_t *dest, int size, const BYTE *remap)
 	}
 }
 
+//==========================================================================
+//
+// MakeVoxelMip
+//
+// Makes a mip level at half the size of another one, for voxels that do
+// not bring all of theirs. Each voxel gets the color of the first voxel in
+// the 2x2x2 block it covers. Only the surface of a model is stored in the
+// slabs, so the result is a surface, too, if maybe a thicker one, and only
+// the voxels of it with an exposed face are kept.
+//
+//==========================================================================
+
+static bool MakeVoxelMip(FVoxelMipLevel *dest, const FVoxelMipLevel *src)
+{
+	const int sizex = (src->SizeX + 1) >> 1;
+	const int sizey = (src->SizeY + 1) >> 1;
+	const int sizez = (src->SizeZ + 1) >> 1;
+	int x, y, z;
+
+	if (src->SlabData == NULL || sizex <= 0 || sizey <= 0 || sizez <= 0)
+	{
+		return false;
+	}
+
+	// Collect the voxels into a volume of the new size, with -1 for empty.
+	// Each column of voxels is stored in one piece.
+	TArray<short> volume;
+	volume.Resize(sizex * sizey * sizez);
+	for (unsigned i = 0; i < volume.Size(); ++i)
+	{
+		volume[i] = -1;
+	}
+	for (x = 0; x < src->SizeX; ++x)
+	{
+		const BYTE *slabxoffs = &src->SlabData[src->OffsetX[x]];
+		const short *xyoffs = &src->OffsetXY[x * (src->SizeY + 1)];
+		for (y = 0; y < src->SizeY; ++y)
+		{
+			const kvxslab_t *slab = (const kvxslab_t *)(slabxoffs + xyoffs[y]);
+			const kvxslab_t *end = (const kvxslab_t *)(slabxoffs + xyoffs[y + 1]);
+			short *column = &volume[((x >> 1) * sizey + (y >> 1)) * sizez];
+			for (; slab < end; slab = (const kvxslab_t *)((const BYTE *)slab + slab->zleng + 3))
+			{
+				for (z = 0; z < slab->zleng; ++z)
+				{
+					int zz = (slab->ztop + z) >> 1;
+					if (zz < sizez && column[zz] < 0)
+					{
+						column[zz] = slab->col[z];
+					}
+				}
+			}
+		}
+	}
+
+	auto solid = [&](int x, int y, int z)
+	{
+		return x >= 0 && x < sizex && y >= 0 && y < sizey && z >= 0 && z < sizez &&
+			volume[(x * sizey + y) * sizez + z] >= 0;
+	};
+	// Bits 0-3 of backfacecull are the -x, +x, -y and +y faces.
+	auto sides = [&](int x, int y, int z)
+	{
+		return (solid(x - 1, y, z) ? 0 : 1) | (solid(x + 1, y, z) ? 0 : 2) |
+			(solid(x, y - 1, z) ? 0 : 4) | (solid(x, y + 1, z) ? 0 : 8);
+	};
+	auto exposed = [&](int x, int y, int z)
+	{
+		return solid(x, y, z) && (sides(x, y, z) != 0 || !solid(x, y, z - 1) || !solid(x, y, z + 1));
+	};
+
+	// Turn each run of exposed voxels into a slab. Bits 4 and 5 of
+	// backfacecull are the top and bottom face of the whole slab.
+	TArray<BYTE> slabs;
+	TArray<int> offsetx;
+	TArray<short> offsetxy;
+	offsetx.Resize(sizex + 1);
+	offsetxy.Resize(sizex * (sizey + 1));
+	for (x = 0; x < sizex; ++x)
+	{
+		offsetx[x] = slabs.Size();
+		for (y = 0; y <= sizey; ++y)
+		{
+			int xyoff = slabs.Size() - offsetx[x];
+			if (xyoff > SHRT_MAX)
+			{
+				return false;
+			}
+			offsetxy[x * (sizey + 1) + y] = (short)xyoff;
+			if (y == sizey)
+			{
+				break;
+			}
+
+			const short *column = &volume[(x * sizey + y) * sizez];
+			for (z = 0; z < sizez; )
+			{
+				if (!exposed(x, y, z))
+				{
+					++z;
+					continue;
+				}
+				int ztop = z;
+				int cull = 0;
+				for (; z < sizez && z - ztop < 255 && exposed(x, y, z); ++z)
+				{
+					cull |= sides(x, y, z);
+				}
+				if (!solid(x, y, ztop - 1)) cull |= 16;
+				if (!solid(x, y, z)) cull |= 32;
+
+				slabs.Push(ztop);
+				slabs.Push(z - ztop);
+				slabs.Push(cull);
+				for (int i = ztop; i < z; ++i)
+				{
+					slabs.Push((BYTE)column[i]);
+				}
+			}
+		}
+	}
+	offsetx[sizex] = slabs.Size();
+	if (slabs.Size() == 0)
+	{
+		return false;
+	}
+
+	// Same layout as the mip levels loaded from the file
+	int offsetsize = (sizex + 1) * 4 + sizex * (sizey + 1) * 2;
+	dest->SizeX = sizex;
+	dest->SizeY = sizey;
+	dest->SizeZ = sizez;
+	dest->Pivot = src->Pivot / 2;
+	dest->OffsetX = new int[(offsetsize + slabs.Size() + 3) / 4];
+	dest->OffsetXY = (short *)(dest->OffsetX + sizex + 1);
+	dest->SlabData = (BYTE *)(dest->OffsetXY + sizex * (sizey + 1));
+	memcpy(dest->OffsetX, &offsetx[0], (sizex + 1) * sizeof(int));
+	memcpy(dest->OffsetXY, &offsetxy[0], sizex * (sizey + 1) * sizeof(short));
+	memcpy(dest->SlabData, &slabs[0], slabs.Size());
+	return true;
+}
+
 //==========================================================================
 //
 // R_LoadKVX
@@ -312,6 +455,19 @@ FVoxel *R_LoadKVX(int lumpnum)
 		}
 	}
 
+	// Most voxels come with only one mip level, so make the rest, down to
+	// a single voxel, for drawing them far away.
+	for (; mip < MAXVOXMIPS; ++mip)
+	{
+		const FVoxelMipLevel *prev = &voxel->Mips[mip - 1];
+		if ((prev->SizeX <= 1 && prev->SizeY <= 1 && prev->SizeZ <= 1) ||
+			!MakeVoxelMip(&voxel->Mips[mip], prev))
+		{
+			break;
+		}
+	}
+	voxel->NumMips = mip;
+
 	voxel->LumpNum = lumpnum;
 	voxel->Palette = new BYTE[768];
 	memcpy(voxel->Palette, rawvoxel + voxelsize - 768, 768);
@@ -51,6 +51,10 @@
 #include "r_draw.h"
 #include "r_draw_pal.h"
 #include "r_thread.h"
+#include "r_profile.h"
+
+CVAR(Bool, r_mipmap, false, CVAR_ARCHIVE | CVAR_GLOBALCONFIG)
+CVAR(Bool, r_spanbatch, true, 0)
 
 namespace swrenderer
 {
@@ -495,6 +499,23 @@ namespace swrenderer
 		return tex->GetColumn(col, nullptr);
 	}
 
+	// Picks the mip level for a texture drawn with this many texels per screen pixel.
+	// Level 0 is the texture itself.
+	int R_MipLevel(FTexture *tex, double texelsperpixel)
+	{
+		if (!r_mipmap || texelsperpixel < 2.0)
+			return 0;
+
+		int levels = tex->GetMipLevels();
+		int level = 0;
+		while (level < levels && texelsperpixel >= 2.0)
+		{
+			texelsperpixel *= 0.5;
+			level++;
+		}
+		return level;
+	}
+
 	bool R_GetTransMaskDrawers(void(**drawCol1)(), void(**drawCol4)())
 	{
 		if (colfunc == R_DrawAddColumn)
@@ -802,27 +823,51 @@ namespace swrenderer
 		DrawerCommandQueue::QueueCommand<DrawColumnHorizPalCommand>();
 	}
 
+	// Adds the pixels a drawer is about to write to the render counts
+	static inline void CountColumns(int columns)
+	{
+		using namespace drawerargs;
+		if (RenderCountPixels && dc_count > 0)
+			R_CountPixels(dc_dest, columns, dc_count);
+	}
+
+	static inline void CountRtColumns(int sx, int columns, int yl, int yh)
+	{
+		if (RenderCountPixels && yh >= yl)
+			R_CountPixels(sx, yl, columns, yh - yl + 1);
+	}
+
+	static inline void CountSpan(int y, int x1, int x2)
+	{
+		if (RenderCountPixels && x2 >= x1)
+			R_CountPixels(x1, y, x2 - x1 + 1, 1);
+	}
+
 	// Copies one span at hx to the screen at sx.
 	void rt_copy1col(int hx, int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 1, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt1CopyPalCommand>(hx, sx, yl, yh);
 	}
 
 	// Copies all four spans to the screen starting at sx.
 	void rt_copy4cols(int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 4, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt4CopyPalCommand>(0, sx, yl, yh);
 	}
 
 	// Maps one span at hx to the screen at sx.
 	void rt_map1col(int hx, int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 1, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt1PalCommand>(hx, sx, yl, yh);
 	}
 
 	// Maps all four spans to the screen starting at sx.
 	void rt_map4cols(int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 4, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt4PalCommand>(0, sx, yl, yh);
 	}
 
@@ -843,12 +888,14 @@ namespace swrenderer
 	// Adds one span at hx to the screen at sx without clamping.
 	void rt_add1col(int hx, int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 1, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt1AddPalCommand>(hx, sx, yl, yh);
 	}
 
 	// Adds all four spans to the screen starting at sx without clamping.
 	void rt_add4cols(int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 4, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt4AddPalCommand>(0, sx, yl, yh);
 	}
 
@@ -869,24 +916,28 @@ namespace swrenderer
 	// Shades one span at hx to the screen at sx.
 	void rt_shaded1col(int hx, int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 1, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt1ShadedPalCommand>(hx, sx, yl, yh);
 	}
 
 	// Shades all four spans to the screen starting at sx.
 	void rt_shaded4cols(int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 4, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt4ShadedPalCommand>(0, sx, yl, yh);
 	}
 
 	// Adds one span at hx to the screen at sx with clamping.
 	void rt_addclamp1col(int hx, int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 1, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt1AddClampPalCommand>(hx, sx, yl, yh);
 	}
 
 	// Adds all four spans to the screen starting at sx with clamping.
 	void rt_addclamp4cols(int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 4, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt4AddClampPalCommand>(0, sx, yl, yh);
 	}
 
@@ -907,12 +958,14 @@ namespace swrenderer
 	// Subtracts one span at hx to the screen at sx with clamping.
 	void rt_subclamp1col(int hx, int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 1, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt1SubClampPalCommand>(hx, sx, yl, yh);
 	}
 
 	// Subtracts all four spans to the screen starting at sx with clamping.
 	void rt_subclamp4cols(int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 4, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt4SubClampPalCommand>(0, sx, yl, yh);
 	}
 
@@ -933,12 +986,14 @@ namespace swrenderer
 	// Subtracts one span at hx from the screen at sx with clamping.
 	void rt_revsubclamp1col(int hx, int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 1, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt1RevSubClampPalCommand>(hx, sx, yl, yh);
 	}
 
 	// Subtracts all four spans from the screen starting at sx with clamping.
 	void rt_revsubclamp4cols(int sx, int yl, int yh)
 	{
+		CountRtColumns(sx, 4, yl, yh);
 		DrawerCommandQueue::QueueCommand<DrawColumnRt4RevSubClampPalCommand>(0, sx, yl, yh);
 	}
 
@@ -958,111 +1013,133 @@ namespace swrenderer
 
 	void R_DrawWallCol1()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawWall1PalCommand>();
 	}
 
 	void R_DrawWallCol4()
 	{
+		CountColumns(4);
 		DrawerCommandQueue::QueueCommand<DrawWall4PalCommand>();
 	}
 
 	void R_DrawWallMaskedCol1()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawWallMasked1PalCommand>();
 	}
 
 	void R_DrawWallMaskedCol4()
 	{
+		CountColumns(4);
 		DrawerCommandQueue::QueueCommand<DrawWallMasked4PalCommand>();
 	}
 
 	void R_DrawWallAddCol1()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawWallAdd1PalCommand>();
 	}
 
 	void R_DrawWallAddCol4()
 	{
+		CountColumns(4);
 		DrawerCommandQueue::QueueCommand<DrawWallAdd4PalCommand>();
 	}
 
 	void R_DrawWallAddClampCol1()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawWallAddClamp1PalCommand>();
 	}
 
 	void R_DrawWallAddClampCol4()
 	{
+		CountColumns(4);
 		DrawerCommandQueue::QueueCommand<DrawWallAddClamp4PalCommand>();
 	}
 
 	void R_DrawWallSubClampCol1()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawWallSubClamp1PalCommand>();
 	}
 
 	void R_DrawWallSubClampCol4()
 	{
+		CountColumns(4);
 		DrawerCommandQueue::QueueCommand<DrawWallSubClamp4PalCommand>();
 	}
 
 	void R_DrawWallRevSubClampCol1()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawWallRevSubClamp1PalCommand>();
 	}
 
 	void R_DrawWallRevSubClampCol4()
 	{
+		CountColumns(4);
 		DrawerCommandQueue::QueueCommand<DrawWallRevSubClamp4PalCommand>();
 	}
 
 	void R_DrawSingleSkyCol1(uint32_t solid_top, uint32_t solid_bottom)
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawSingleSky1PalCommand>(solid_top, solid_bottom);
 	}
 
 	void R_DrawSingleSkyCol4(uint32_t solid_top, uint32_t solid_bottom)
 	{
+		CountColumns(4);
 		DrawerCommandQueue::QueueCommand<DrawSingleSky4PalCommand>(solid_top, solid_bottom);
 	}
 
 	void R_DrawDoubleSkyCol1(uint32_t solid_top, uint32_t solid_bottom)
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawDoubleSky1PalCommand>(solid_top, solid_bottom);
 	}
 
 	void R_DrawDoubleSkyCol4(uint32_t solid_top, uint32_t solid_bottom)
 	{
+		CountColumns(4);
 		DrawerCommandQueue::QueueCommand<DrawDoubleSky4PalCommand>(solid_top, solid_bottom);
 	}
 
 	void R_DrawColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawColumnPalCommand>();
 	}
 
 	void R_FillColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<FillColumnPalCommand>();
 	}
 
 	void R_FillAddColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<FillColumnAddPalCommand>();
 	}
 
 	void R_FillAddClampColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<FillColumnAddClampPalCommand>();
 	}
 
 	void R_FillSubClampColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<FillColumnSubClampPalCommand>();
 	}
 
 	void R_FillRevSubClampColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<FillColumnRevSubClampPalCommand>();
 	}
 
@@ -1070,6 +1147,7 @@ namespace swrenderer
 	{
 		using namespace drawerargs;
 
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawFuzzColumnPalCommand>();
 
 		dc_yl = MAX(dc_yl, 1);
@@ -1080,112 +1158,259 @@ namespace swrenderer
 
 	void R_DrawAddColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawColumnAddPalCommand>();
 	}
 
 	void R_DrawTranslatedColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawColumnTranslatedPalCommand>();
 	}
 
 	void R_DrawTlatedAddColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawColumnTlatedAddPalCommand>();
 	}
 
 	void R_DrawShadedColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawColumnShadedPalCommand>();
 	}
 
 	void R_DrawAddClampColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawColumnAddClampPalCommand>();
 	}
 
 	void R_DrawAddClampTranslatedColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawColumnAddClampTranslatedPalCommand>();
 	}
 
 	void R_DrawSubClampColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawColumnSubClampPalCommand>();
 	}
 
 	void R_DrawSubClampTranslatedColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawColumnSubClampTranslatedPalCommand>();
 	}
 
 	void R_DrawRevSubClampColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawColumnRevSubClampPalCommand>();
 	}
 
 	void R_DrawRevSubClampTranslatedColumn()
 	{
+		CountColumns(1);
 		DrawerCommandQueue::QueueCommand<DrawColumnRevSubClampTranslatedPalCommand>();
 	}
 
+	// Opaque spans collected between R_BeginSpanBatch and R_EndSpanBatch
+	static bool SpanBatching;
+	static int SpanBatchCount;
+	static PalSpan SpanBatch[DrawSpanBatchPalCommand::MaxSpans];
+
+	static void R_FlushSpanBatch()
+	{
+		if (SpanBatchCount > 0)
+		{
+			DrawerCommandQueue::QueueCommand<DrawSpanBatchPalCommand>(SpanBatch, SpanBatchCount);
+			SpanBatchCount = 0;
+		}
+	}
+
+	void R_BeginSpanBatch()
+	{
+		SpanBatching = r_spanbatch;
+		SpanBatchCount = 0;
+	}
+
+	void R_EndSpanBatch()
+	{
+		R_FlushSpanBatch();
+		SpanBatching = false;
+	}
+
 	void R_DrawSpan()
 	{
-		DrawerCommandQueue::QueueCommand<DrawSpanPalCommand>();
+		using namespace drawerargs;
+
+		CountSpan(ds_y, ds_x1, ds_x2);
+		if (SpanBatching)
+		{
+			PalSpan &span = SpanBatch[SpanBatchCount];
+			span.source = ds_source;
+			span.colormap = ds_colormap;
+			span.xfrac = ds_xfrac;
+			span.yfrac = ds_yfrac;
+			span.xstep = ds_xstep;
+			span.ystep = ds_ystep;
+			span.y = ds_y;
+			span.x1 = ds_x1;
+			span.x2 = ds_x2;
+			span.xbits = ds_xbits;
+			span.ybits = ds_ybits;
+			if (++SpanBatchCount == DrawSpanBatchPalCommand::MaxSpans)
+			{
+				R_FlushSpanBatch();
+			}
+		}
+		else
+		{
+			DrawerCommandQueue::QueueCommand<DrawSpanPalCommand>();
+		}
 	}
 
 	void R_DrawSpanMasked()
 	{
+		CountSpan(drawerargs::ds_y, drawerargs::ds_x1, drawerargs::ds_x2);
 		DrawerCommandQueue::QueueCommand<DrawSpanMaskedPalCommand>();
 	}
 
 	void R_DrawSpanTranslucent()
 	{
+		CountSpan(drawerargs::ds_y, drawerargs::ds_x1, drawerargs::ds_x2);
 		DrawerCommandQueue::QueueCommand<DrawSpanTranslucentPalCommand>();
 	}
 
 	void R_DrawSpanMaskedTranslucent()
 	{
+		CountSpan(drawerargs::ds_y, drawerargs::ds_x1, drawerargs::ds_x2);
 		DrawerCommandQueue::QueueCommand<DrawSpanMaskedTranslucentPalCommand>();
 	}
 
 	void R_DrawSpanAddClamp()
 	{
+		CountSpan(drawerargs::ds_y, drawerargs::ds_x1, drawerargs::ds_x2);
 		DrawerCommandQueue::QueueCommand<DrawSpanAddClampPalCommand>();
 	}
 
 	void R_DrawSpanMaskedAddClamp()
 	{
+		CountSpan(drawerargs::ds_y, drawerargs::ds_x1, drawerargs::ds_x2);
 		DrawerCommandQueue::QueueCommand<DrawSpanMaskedAddClampPalCommand>();
 	}
 
 	void R_FillSpan()
 	{
+		CountSpan(drawerargs::ds_y, drawerargs::ds_x1, drawerargs::ds_x2);
 		DrawerCommandQueue::QueueCommand<FillSpanPalCommand>();
 	}
 
 	void R_DrawTiltedSpan(int y, int x1, int x2, const FVector3 &plane_sz, const FVector3 &plane_su, const FVector3 &plane_sv, bool plane_shade, int planeshade, float planelightfloat, fixed_t pviewx, fixed_t pviewy)
 	{
+		CountSpan(y, x1, x2);
 		DrawerCommandQueue::QueueCommand<DrawTiltedSpanPalCommand>(y, x1, x2, plane_sz, plane_su, plane_sv, plane_shade, planeshade, planelightfloat, pviewx, pviewy);
 	}
 
 	void R_DrawColoredSpan(int y, int x1, int x2)
 	{
+		CountSpan(y, x1, x2);
 		DrawerCommandQueue::QueueCommand<DrawColoredSpanPalCommand>(y, x1, x2);
 	}
 
+	// Stretches a view drawn at a lower resolution over the view window
+	void R_DrawScaledView(const uint8_t *src, int srcwidth, int srcheight, int srcpitch, int width, int height)
+	{
+		DrawerCommandQueue::QueueCommand<DrawScaledViewPalCommand>(src, srcwidth, srcheight, srcpitch, width, height);
+	}
+
+	// Shows the render counts of each pixel with the colors of the ramp
+	void R_DrawCostMap(const uint16_t *counts, int width, int height, const uint8_t *ramp, int rampsize)
+	{
+		DrawerCommandQueue::QueueCommand<DrawCostMapPalCommand>(counts, width, height, ramp, rampsize);
+	}
+
+	void R_DrawPortalWindow(int x1, int x2, const short *top, const short *bottom, uint8_t color, bool outline)
+	{
+		for (int x = x1; x < x2; x += DrawPortalPalCommand::MaxColumns)
+		{
+			int count = MIN<int>(x2 - x, DrawPortalPalCommand::MaxColumns);
+			const short *coltop = top + (x - x1);
+			const short *colbottom = bottom + (x - x1);
+			if (RenderCountPixels && !outline)
+			{
+				for (int i = 0; i < count; i++)
+				{
+					if (colbottom[i] >= coltop[i])
+						R_CountPixels(x + i, coltop[i], 1, colbottom[i] - coltop[i] + 1);
+				}
+			}
+			DrawerCommandQueue::QueueCommand<DrawPortalPalCommand>(x, count, coltop, colbottom, color, outline, x == x1, x + count == x2);
+		}
+	}
+
 	namespace
 	{
 		const uint8_t *slab_colormap;
 	}
 
+	// Slabs collected between R_BeginSlabBatch and R_EndSlabBatch
+	static bool SlabBatching;
+	static int SlabBatchCount;
+	static PalSlab SlabBatch[DrawSlabBatchPalCommand::MaxSlabs];
+
+	static void R_FlushSlabBatch()
+	{
+		if (SlabBatchCount > 0)
+		{
+			DrawerCommandQueue::QueueCommand<DrawSlabBatchPalCommand>(SlabBatch, SlabBatchCount, slab_colormap);
+			SlabBatchCount = 0;
+		}
+	}
+
 	void R_SetupDrawSlab(uint8_t *colormap)
 	{
+		R_FlushSlabBatch();
 		slab_colormap = colormap;
 	}
 
+	void R_BeginSlabBatch()
+	{
+		SlabBatching = true;
+		SlabBatchCount = 0;
+	}
+
+	void R_EndSlabBatch()
+	{
+		R_FlushSlabBatch();
+		SlabBatching = false;
+	}
+
 	void R_DrawSlab(int dx, fixed_t v, int dy, fixed_t vi, const uint8_t *vptr, uint8_t *p)
 	{
-		DrawerCommandQueue::QueueCommand<DrawSlabPalCommand>(dx, v, dy, vi, vptr, p, slab_colormap);
+		if (RenderCountPixels)
+			R_CountPixels(p, dx, dy);
+		if (SlabBatching)
+		{
+			PalSlab &slab = SlabBatch[SlabBatchCount];
+			slab.source = vptr;
+			slab.dest = p;
+			slab.frac = v;
+			slab.step = vi;
+			slab.width = dx;
+			slab.count = dy;
+			slab.start_y = static_cast<int>((p - drawerargs::dc_destorg) / drawerargs::dc_pitch);
+			if (++SlabBatchCount == DrawSlabBatchPalCommand::MaxSlabs)
+			{
+				R_FlushSlabBatch();
+			}
+		}
+		else
+		{
+			DrawerCommandQueue::QueueCommand<DrawSlabPalCommand>(dx, v, dy, vi, vptr, p, slab_colormap);
+		}
 	}
 
 	void R_DrawFogBoundarySection(int y, int y2, int x1)
@@ -1193,6 +1418,7 @@ namespace swrenderer
 		for (; y < y2; ++y)
 		{
 			int x2 = spanend[y];
+			CountSpan(y, x1, x2);
 			DrawerCommandQueue::QueueCommand<DrawFogBoundaryLinePalCommand>(y, x1, x2);
 		}
 	}
@@ -1255,12 +1481,14 @@ namespace swrenderer
 					while (t2 < stop)
 					{
 						int y = t2++;
+						CountSpan(y, xr, spanend[y]);
 						DrawerCommandQueue::QueueCommand<DrawFogBoundaryLinePalCommand>(y, xr, spanend[y]);
 					}
 					stop = MAX(b1, t2);
 					while (b2 > stop)
 					{
 						int y = --b2;
+						CountSpan(y, xr, spanend[y]);
 						DrawerCommandQueue::QueueCommand<DrawFogBoundaryLinePalCommand>(y, xr, spanend[y]);
 					}
 				}
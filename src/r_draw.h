@@ -8,6 +8,7 @@ EXTERN_CVAR(Int, r_drawfuzz);
 EXTERN_CVAR(Bool, r_drawtrans);
 EXTERN_CVAR(Float, transsouls);
 EXTERN_CVAR(Int, r_columnmethod);
+EXTERN_CVAR(Bool, r_mipmap);
 
 namespace swrenderer
 {
@@ -101,6 +102,7 @@ namespace swrenderer
 	bool R_GetTransMaskDrawers(void(**drawCol1)(), void(**drawCol4)());
 
 	const uint8_t *R_GetColumn(FTexture *tex, int col);
+	int R_MipLevel(FTexture *tex, double texelsperpixel);
 	
 	void rt_initcols(uint8_t *buffer = nullptr);
 	void rt_span_coverage(int x, int start, int stop);
@@ -149,6 +151,9 @@ namespace swrenderer
 	void R_DrawRevSubClampColumn();
 	void R_DrawRevSubClampTranslatedColumn();
 	void R_DrawSpan();
+	// While batching, R_DrawSpan queues its spans in groups instead of one by one
+	void R_BeginSpanBatch();
+	void R_EndSpanBatch();
 	void R_DrawSpanMasked();
 	void R_DrawSpanTranslucent();
 	void R_DrawSpanMaskedTranslucent();
@@ -157,8 +162,15 @@ namespace swrenderer
 	void R_FillSpan();
 	void R_DrawTiltedSpan(int y, int x1, int x2, const FVector3 &plane_sz, const FVector3 &plane_su, const FVector3 &plane_sv, bool plane_shade, int planeshade, float planelightfloat, fixed_t pviewx, fixed_t pviewy);
 	void R_DrawColoredSpan(int y, int x1, int x2);
+	void R_DrawScaledView(const uint8_t *src, int srcwidth, int srcheight, int srcpitch, int width, int height);
+	void R_DrawCostMap(const uint16_t *counts, int width, int height, const uint8_t *ramp, int rampsize);
+	// Fills the clip window of a portal with a color, or draws its outline
+	void R_DrawPortalWindow(int x1, int x2, const short *top, const short *bottom, uint8_t color, bool outline);
 	void R_SetupDrawSlab(uint8_t *colormap);
 	void R_DrawSlab(int dx, fixed_t v, int dy, fixed_t vi, const uint8_t *vptr, uint8_t *p);
+	// While batching, R_DrawSlab queues its slabs in groups instead of one by one
+	void R_BeginSlabBatch();
+	void R_EndSlabBatch();
 	void R_DrawFogBoundary(int x1, int x2, short *uclip, short *dclip);
 	void R_FillColumnHoriz();
 	void R_FillSpan();
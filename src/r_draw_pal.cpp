@@ -1863,32 +1863,12 @@ namespace swrenderer
 		_color = ds_color;
 	}
 
-	void DrawSpanPalCommand::Execute(DrawerThread *thread)
+	static inline void DrawSpanLine(uint8_t *dest, int count, const uint8_t *source, const uint8_t *colormap,
+		dsfixed_t xfrac, dsfixed_t yfrac, dsfixed_t xstep, dsfixed_t ystep, int xbits, int ybits)
 	{
-		if (thread->line_skipped_by_thread(_y))
-			return;
-
-		dsfixed_t xfrac;
-		dsfixed_t yfrac;
-		dsfixed_t xstep;
-		dsfixed_t ystep;
-		uint8_t *dest;
-		const uint8_t *source = _source;
-		const uint8_t *colormap = _colormap;
-		int count;
 		int spot;
 
-		xfrac = _xfrac;
-		yfrac = _yfrac;
-
-		dest = ylookup[_y] + _x1 + _destorg;
-
-		count = _x2 - _x1 + 1;
-
-		xstep = _xstep;
-		ystep = _ystep;
-
-		if (_xbits == 6 && _ybits == 6)
+		if (xbits == 6 && ybits == 6)
 		{
 			// 64x64 is the most common case by far, so special case it.
 			do
@@ -1907,9 +1887,9 @@ namespace swrenderer
 		}
 		else
 		{
-			uint8_t yshift = 32 - _ybits;
-			uint8_t xshift = yshift - _xbits;
-			int xmask = ((1 << _xbits) - 1) << _ybits;
+			uint8_t yshift = 32 - ybits;
+			uint8_t xshift = yshift - xbits;
+			int xmask = ((1 << xbits) - 1) << ybits;
 
 			do
 			{
@@ -1927,6 +1907,35 @@ namespace swrenderer
 		}
 	}
 
+	void DrawSpanPalCommand::Execute(DrawerThread *thread)
+	{
+		if (thread->line_skipped_by_thread(_y))
+			return;
+
+		DrawSpanLine(ylookup[_y] + _x1 + _destorg, _x2 - _x1 + 1, _source, _colormap,
+			_xfrac, _yfrac, _xstep, _ystep, _xbits, _ybits);
+	}
+
+	DrawSpanBatchPalCommand::DrawSpanBatchPalCommand(const PalSpan *spans, int count)
+	{
+		_destorg = drawerargs::dc_destorg;
+		_count = count;
+		memcpy(_spans, spans, count * sizeof(PalSpan));
+	}
+
+	void DrawSpanBatchPalCommand::Execute(DrawerThread *thread)
+	{
+		for (int i = 0; i < _count; i++)
+		{
+			const PalSpan &span = _spans[i];
+			if (thread->line_skipped_by_thread(span.y))
+				continue;
+
+			DrawSpanLine(ylookup[span.y] + span.x1 + _destorg, span.x2 - span.x1 + 1, span.source, span.colormap,
+				span.xfrac, span.yfrac, span.xstep, span.ystep, span.xbits, span.ybits);
+		}
+	}
+
 	void DrawSpanMaskedPalCommand::Execute(DrawerThread *thread)
 	{
 		if (thread->line_skipped_by_thread(_y))
@@ -2559,6 +2568,121 @@ namespace swrenderer
 
 	/////////////////////////////////////////////////////////////////////////
 
+	DrawScaledViewPalCommand::DrawScaledViewPalCommand(const uint8_t *src, int srcwidth, int srcheight, int srcpitch, int width, int height)
+		: _src(src), _srcheight(srcheight), _srcpitch(srcpitch), _width(width), _height(height)
+	{
+		using namespace drawerargs;
+		_xstep = (uint32_t)(((uint64_t)srcwidth << 16) / width);
+		_destorg = dc_destorg;
+		_pitch = dc_pitch;
+	}
+
+	void DrawScaledViewPalCommand::Execute(DrawerThread *thread)
+	{
+		for (int y = 0; y < _height; y++)
+		{
+			if (thread->line_skipped_by_thread(y))
+				continue;
+
+			const uint8_t *src = _src + (int)((int64_t)y * _srcheight / _height) * _srcpitch;
+			uint8_t *dest = _destorg + y * _pitch;
+			uint32_t xfrac = 0;
+			for (int x = 0; x < _width; x++)
+			{
+				dest[x] = src[xfrac >> 16];
+				xfrac += _xstep;
+			}
+		}
+	}
+
+	/////////////////////////////////////////////////////////////////////////
+
+	DrawCostMapPalCommand::DrawCostMapPalCommand(const uint16_t *counts, int width, int height, const uint8_t *ramp, int rampsize)
+		: _counts(counts), _width(width), _height(height), _ramp(ramp), _rampsize(rampsize)
+	{
+		using namespace drawerargs;
+		_destorg = dc_destorg;
+		_pitch = dc_pitch;
+	}
+
+	void DrawCostMapPalCommand::Execute(DrawerThread *thread)
+	{
+		for (int y = 0; y < _height; y++)
+		{
+			if (thread->line_skipped_by_thread(y))
+				continue;
+
+			const uint16_t *counts = _counts + y * _width;
+			uint8_t *dest = _destorg + y * _pitch;
+			for (int x = 0; x < _width; x++)
+			{
+				dest[x] = _ramp[MIN<int>(counts[x], _rampsize - 1)];
+			}
+		}
+	}
+
+	/////////////////////////////////////////////////////////////////////////
+
+	DrawPortalPalCommand::DrawPortalPalCommand(int x, int count, const short *top, const short *bottom, uint8_t color, bool outline, bool firstedge, bool lastedge)
+		: _x(x), _count(count), _color(color), _outline(outline), _firstedge(firstedge), _lastedge(lastedge)
+	{
+		using namespace drawerargs;
+		_destorg = dc_destorg;
+		_pitch = dc_pitch;
+		_viewwidth = viewwidth;
+		_viewheight = viewheight;
+
+		_top[0] = firstedge ? top[0] : top[-1];
+		_bottom[0] = firstedge ? bottom[0] : bottom[-1];
+		memcpy(_top + 1, top, count * sizeof(short));
+		memcpy(_bottom + 1, bottom, count * sizeof(short));
+	}
+
+	void DrawPortalPalCommand::DrawRun(DrawerThread *thread, int x, int y1, int y2)
+	{
+		y1 = MAX(y1, 0);
+		y2 = MIN(y2, _viewheight - 1);
+		for (int y = y1; y <= y2; y++)
+		{
+			if (!thread->line_skipped_by_thread(y))
+			{
+				_destorg[y * _pitch + x] = _color;
+			}
+		}
+	}
+
+	void DrawPortalPalCommand::Execute(DrawerThread *thread)
+	{
+		for (int i = 1; i <= _count; i++)
+		{
+			int x = _x + i - 1;
+			if (x < 0 || x >= _viewwidth)
+				continue;
+
+			int top = _top[i];
+			int bottom = _bottom[i];
+			if (!_outline || (i == 1 && _firstedge) || (i == _count && _lastedge))
+			{
+				DrawRun(thread, x, top, bottom);
+				continue;
+			}
+
+			// Join each edge to the one of the column to the left.
+			int prevtop = _top[i - 1];
+			int prevbottom = _bottom[i - 1];
+			if (abs(top - prevtop) > 1)
+				DrawRun(thread, x, MIN(top, prevtop), MAX(top, prevtop));
+			else
+				DrawRun(thread, x, top, top);
+			if (abs(bottom - prevbottom) > 1)
+				DrawRun(thread, x, MIN(bottom, prevbottom), MAX(bottom, prevbottom));
+			else
+				DrawRun(thread, x, bottom, bottom);
+		}
+	}
+
+	/////////////////////////////////////////////////////////////////////////
+
 	DrawSlabPalCommand::DrawSlabPalCommand(int dx, fixed_t v, int dy, fixed_t vi, const uint8_t *vptr, uint8_t *p, const uint8_t *colormap)
 		: _dx(dx), _v(v), _dy(dy), _vi(vi), _vvptr(vptr), _p(p), _colormap(colormap)
 	{
@@ -2567,33 +2691,56 @@ namespace swrenderer
 		_start_y = static_cast<int>((p - dc_destorg) / dc_pitch);
 	}
 
-	void DrawSlabPalCommand::Execute(DrawerThread *thread)
+	static inline void DrawSlab(DrawerThread *thread, int width, int count, int start_y, fixed_t fracpos, fixed_t iscale,
+		const uint8_t *source, uint8_t *dest, int pitch, const uint8_t *colormap)
 	{
-		int count = _dy;
-		uint8_t *dest = _p;
-		int pitch = _pitch;
-		int width = _dx;
-		const uint8_t *colormap = _colormap;
-		const uint8_t *source = _vvptr;
-		fixed_t fracpos = _v;
-		fixed_t iscale = _vi;
-
-		count = thread->count_for_thread(_start_y, count);
-		dest = thread->dest_for_thread(_start_y, pitch, dest);
-		fracpos += iscale * thread->skipped_by_thread(_start_y);
+		count = thread->count_for_thread(start_y, count);
+		dest = thread->dest_for_thread(start_y, pitch, dest);
+		fracpos += iscale * thread->skipped_by_thread(start_y);
 		iscale *= thread->num_cores;
 		pitch *= thread->num_cores;
 
-		while (count > 0)
+		if (width == 1)
+		{
+			while (count > 0)
+			{
+				*dest = colormap[source[fracpos >> FRACBITS]];
+				dest += pitch;
+				fracpos += iscale;
+				count--;
+			}
+		}
+		else
 		{
-			uint8_t color = colormap[source[fracpos >> FRACBITS]];
+			// Every row is one color, which memset writes several pixels at a time.
+			while (count > 0)
+			{
+				memset(dest, colormap[source[fracpos >> FRACBITS]], width);
+				dest += pitch;
+				fracpos += iscale;
+				count--;
+			}
+		}
+	}
 
-			for (int x = 0; x < width; x++)
-				dest[x] = color;
+	void DrawSlabPalCommand::Execute(DrawerThread *thread)
+	{
+		DrawSlab(thread, _dx, _dy, _start_y, _v, _vi, _vvptr, _p, _pitch, _colormap);
+	}
 
-			dest += pitch;
-			fracpos += iscale;
-			count--;
+	DrawSlabBatchPalCommand::DrawSlabBatchPalCommand(const PalSlab *slabs, int count, const uint8_t *colormap)
+		: _colormap(colormap), _count(count)
+	{
+		_pitch = drawerargs::dc_pitch;
+		memcpy(_slabs, slabs, count * sizeof(PalSlab));
+	}
+
+	void DrawSlabBatchPalCommand::Execute(DrawerThread *thread)
+	{
+		for (int i = 0; i < _count; i++)
+		{
+			const PalSlab &slab = _slabs[i];
+			DrawSlab(thread, slab.width, slab.count, slab.start_y, slab.frac, slab.step, slab.source, slab.dest, _pitch, _colormap);
 		}
 	}
 
@@ -170,6 +170,38 @@ namespace swrenderer
 	class DrawSpanMaskedAddClampPalCommand : public PalSpanCommand { public: void Execute(DrawerThread *thread) override; };
 	class FillSpanPalCommand : public PalSpanCommand { public: void Execute(DrawerThread *thread) override; };
 
+	// One opaque span of a plane, as collected by R_DrawSpan while batching
+	struct PalSpan
+	{
+		const uint8_t *source;
+		const uint8_t *colormap;
+		dsfixed_t xfrac;
+		dsfixed_t yfrac;
+		dsfixed_t xstep;
+		dsfixed_t ystep;
+		int y;
+		int x1;
+		int x2;
+		int xbits;
+		int ybits;
+	};
+
+	// Draws up to MaxSpans spans of a plane with one command
+	class DrawSpanBatchPalCommand : public DrawerCommand
+	{
+	public:
+		enum { MaxSpans = 32 };
+
+		DrawSpanBatchPalCommand(const PalSpan *spans, int count);
+		void Execute(DrawerThread *thread) override;
+		FString DebugInfo() override { return "DrawSpanBatchPalCommand"; }
+
+	private:
+		uint8_t *_destorg;
+		int _count;
+		PalSpan _spans[MaxSpans];
+	};
+
 	class DrawTiltedSpanPalCommand : public DrawerCommand
 	{
 	public:
@@ -233,6 +265,35 @@ namespace swrenderer
 		int _start_y;
 	};
 
+	// One slab of a voxel, as collected by R_DrawSlab while batching
+	struct PalSlab
+	{
+		const uint8_t *source;
+		uint8_t *dest;
+		fixed_t frac;
+		fixed_t step;
+		int width;
+		int count;
+		int start_y;
+	};
+
+	// Draws up to MaxSlabs slabs of a voxel with one command
+	class DrawSlabBatchPalCommand : public DrawerCommand
+	{
+	public:
+		enum { MaxSlabs = 32 };
+
+		DrawSlabBatchPalCommand(const PalSlab *slabs, int count, const uint8_t *colormap);
+		void Execute(DrawerThread *thread) override;
+		FString DebugInfo() override { return "DrawSlabBatchPalCommand"; }
+
+	private:
+		const uint8_t *_colormap;
+		int _pitch;
+		int _count;
+		PalSlab _slabs[MaxSlabs];
+	};
+
 	class DrawFogBoundaryLinePalCommand : public PalSpanCommand
 	{
 	public:
@@ -245,6 +306,68 @@ namespace swrenderer
 		uint8_t *_destorg;
 	};
 
+	class DrawScaledViewPalCommand : public DrawerCommand
+	{
+	public:
+		DrawScaledViewPalCommand(const uint8_t *src, int srcwidth, int srcheight, int srcpitch, int width, int height);
+		void Execute(DrawerThread *thread) override;
+		FString DebugInfo() override { return "DrawScaledViewPalCommand"; }
+
+	private:
+		const uint8_t *_src;
+		int _srcheight;
+		int _srcpitch;
+		int _width;
+		int _height;
+		uint32_t _xstep;
+		uint8_t *_destorg;
+		int _pitch;
+	};
+
+	class DrawCostMapPalCommand : public DrawerCommand
+	{
+	public:
+		DrawCostMapPalCommand(const uint16_t *counts, int width, int height, const uint8_t *ramp, int rampsize);
+		void Execute(DrawerThread *thread) override;
+		FString DebugInfo() override { return "DrawCostMapPalCommand"; }
+
+	private:
+		const uint16_t *_counts;
+		int _width;
+		int _height;
+		const uint8_t *_ramp;
+		int _rampsize;
+		uint8_t *_destorg;
+		int _pitch;
+	};
+
+	// Fills or outlines up to MaxColumns columns of a portal's clip window
+	class DrawPortalPalCommand : public DrawerCommand
+	{
+	public:
+		enum { MaxColumns = 64 };
+
+		DrawPortalPalCommand(int x, int count, const short *top, const short *bottom, uint8_t color, bool outline, bool firstedge, bool lastedge);
+		void Execute(DrawerThread *thread) override;
+		FString DebugInfo() override { return "DrawPortalPalCommand"; }
+
+	private:
+		void DrawRun(DrawerThread *thread, int x, int y1, int y2);
+
+		uint8_t *_destorg;
+		int _pitch;
+		int _viewwidth;
+		int _viewheight;
+		int _x;
+		int _count;
+		uint8_t _color;
+		bool _outline;
+		bool _firstedge;
+		bool _lastedge;
+		short _top[MaxColumns + 1];		// [0] is the column left of _x
+		short _bottom[MaxColumns + 1];
+	};
+
 	class RtInitColsPalCommand : public DrawerCommand
 	{
 	public:
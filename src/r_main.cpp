@@ -59,6 +59,10 @@
 #include "r_data/colormaps.h"
 #include "p_maputl.h"
 #include "r_thread.h"
+#include "r_renderer.h"
+#include "d_player.h"
+#include "d_main.h"
+#include "r_data/sprites.h"
 
 CVAR (String, r_viewsize, "", CVAR_NOSET)
 CVAR (Bool, r_shadercolormaps, true, CVAR_ARCHIVE)
@@ -76,9 +80,12 @@ CUSTOM_CVAR (Int, r_columnmethod, 1, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 }
 
 CVAR(Int, r_portal_recursions, 4, CVAR_ARCHIVE)
+CVAR(Float, r_dynres_target, 0.f, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)	// ms per frame, 0 = off
+CVAR(Float, r_dynres_minscale, 0.5f, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
 CVAR(Bool, r_highlight_portals, false, CVAR_ARCHIVE)
 
 EXTERN_CVAR(Bool, r_fullbrightignoresectorcolor)
+EXTERN_CVAR(Bool, r_voxellod)
 
 extern cycle_t WallCycles, PlaneCycles, MaskedCycles, WallScanCycles;
 extern cycle_t FrameCycles;
@@ -129,6 +136,11 @@ static double MaxVisForWall;
 static double MaxVisForFloor;
 bool r_dontmaplines;
 
+static DSimpleCanvas *DynResCanvas;	// the view when drawn at a lower resolution
+static double DynResScale = 1.;
+static double DynResMS;
+static int DynResViewX, DynResViewY;
+
 // PUBLIC DATA DEFINITIONS -------------------------------------------------
 
 double			r_BaseVisibility;
@@ -150,6 +162,7 @@ double			WallTMapScale2;
 
 
 bool			bRenderingToCanvas;	// [RH] True if rendering to a special canvas
+bool			bDynamicResolution;	// True while the view is drawn at a lower resolution
 double			globaluclip, globaldclip;
 double			CenterX, CenterY;
 double			YaspectMul;
@@ -422,6 +435,11 @@ void R_InitRenderer()
 
 static void R_ShutdownRenderer()
 {
+	if (DynResCanvas != NULL)
+	{
+		delete DynResCanvas;
+		DynResCanvas = NULL;
+	}
 	R_DeinitSprites();
 	R_DeinitPlanes();
 	// Free openings
@@ -578,41 +596,13 @@ void R_SetupFreelook()
 //
 //==========================================================================
 
+// Both go through the drawer queue, so that they land on top of what was
+// drawn so far even when the drawers run on other threads.
+
 void R_HighlightPortal (PortalDrawseg* pds)
 {
-	// [ZZ] NO OVERFLOW CHECKS HERE
-	//      I believe it won't break. if it does, blame me. :(
-
 	BYTE color = (BYTE)BestColor((DWORD *)GPalette.BaseColors, 255, 0, 0, 0, 255);
-
-	BYTE* pixels = RenderTarget->GetBuffer();
-	// top edge
-	for (int x = pds->x1; x < pds->x2; x++)
-	{
-		if (x < 0 || x >= RenderTarget->GetWidth())
-			continue;
-
-		int p = x - pds->x1;
-		int Ytop = pds->ceilingclip[p];
-		int Ybottom = pds->floorclip[p];
-
-		if (x == pds->x1 || x == pds->x2-1)
-		{
-			RenderTarget->DrawLine(x, Ytop, x, Ybottom+1, color, 0);
-			continue;
-		}
-
-		int YtopPrev = pds->ceilingclip[p-1];
-		int YbottomPrev = pds->floorclip[p-1];
-
-		if (abs(Ytop-YtopPrev) > 1)
-			RenderTarget->DrawLine(x, YtopPrev, x, Ytop, color, 0);
-		else *(pixels + Ytop * RenderTarget->GetPitch() + x) = color;
-
-		if (abs(Ybottom-YbottomPrev) > 1)
-			RenderTarget->DrawLine(x, YbottomPrev, x, Ybottom, color, 0);
-		else *(pixels + Ybottom * RenderTarget->GetPitch() + x) = color;
-	}
+	R_DrawPortalWindow(pds->x1, pds->x2, &pds->ceilingclip[0], &pds->floorclip[0], color, true);
 }
 
 void R_EnterPortal (PortalDrawseg* pds, int depth)
@@ -621,23 +611,7 @@ void R_EnterPortal (PortalDrawseg* pds, int depth)
 	if (depth >= r_portal_recursions)
 	{
 		BYTE color = (BYTE)BestColor((DWORD *)GPalette.BaseColors, 0, 0, 0, 0, 255);
-		int spacing = RenderTarget->GetPitch();
-		for (int x = pds->x1; x < pds->x2; x++)
-		{
-			if (x < 0 || x >= RenderTarget->GetWidth())
-				continue;
-
-			int Ytop = pds->ceilingclip[x-pds->x1];
-			int Ybottom = pds->floorclip[x-pds->x1];
-
-			BYTE *dest = RenderTarget->GetBuffer() + x + Ytop * spacing;
-
-			for (int y = Ytop; y <= Ybottom; y++)
-			{
-				*dest = color;
-				dest += spacing;
-			}
-		}
+		R_DrawPortalWindow(pds->x1, pds->x2, &pds->ceilingclip[0], &pds->floorclip[0], color, false);
 
 		if (r_highlight_portals)
 			R_HighlightPortal(pds);
@@ -746,6 +720,11 @@ void R_EnterPortal (PortalDrawseg* pds, int depth)
 	memcpy (ceilingclip + pds->x1, &pds->ceilingclip[0], pds->len*sizeof(*ceilingclip));
 	memcpy (floorclip + pds->x1, &pds->floorclip[0], pds->len*sizeof(*floorclip));
 
+	if (r_parallelportals)
+	{
+		R_HandoffDrawerCommands();
+	}
+
 	InSubsector = NULL;
 	R_RenderBSPNode (nodes + numnodes - 1);
 	R_3D_ResetClip(); // reset clips (floor/ceiling)
@@ -821,6 +800,107 @@ void R_SetupBuffer ()
 	}
 }
 
+//==========================================================================
+//
+// R_BeginDynamicResolution
+//
+// With r_dynres_target set, the view is drawn into a smaller canvas when
+// frames take longer than that. The canvas stands in for a screen that
+// much smaller, so the view keeps its shape, field of view and weapon
+// placement. Returns true if the view is being drawn at a lower resolution.
+//
+//==========================================================================
+
+bool R_BeginDynamicResolution ()
+{
+	if (r_dynres_target <= 0 || bRenderingToCanvas)
+	{
+		DynResScale = 1.;
+		return false;
+	}
+	if (DynResScale >= 1.)
+	{
+		return false;
+	}
+
+	int fullwidth = MAX(int(SCREENWIDTH * DynResScale) & ~3, 64);
+	int fullheight = MAX(int(SCREENHEIGHT * DynResScale), 48);
+	int stheight = MIN(int(ST_Y * DynResScale), fullheight);
+
+	DynResViewX = viewwindowx;
+	DynResViewY = viewwindowy;
+	bRenderingToCanvas = true;
+	bDynamicResolution = true;
+	R_SetWindow (setblocks, fullwidth, fullheight, stheight);
+	viewwindowx = (fullwidth - viewwidth) >> 1;
+	viewwindowy = (viewwidth == fullwidth) ? 0 : (stheight - viewheight) >> 1;
+
+	if (DynResCanvas == NULL || DynResCanvas->GetWidth() != fullwidth || DynResCanvas->GetHeight() != fullheight)
+	{
+		delete DynResCanvas;
+		DynResCanvas = new DSimpleCanvas (fullwidth, fullheight);
+	}
+	DynResCanvas->Lock (true);
+	RenderTarget = DynResCanvas;
+	return true;
+}
+
+//==========================================================================
+//
+// R_EndDynamicResolution
+//
+// Goes back to the screen and queues the view to be stretched over it.
+//
+//==========================================================================
+
+void R_EndDynamicResolution ()
+{
+	// Each row of the stretched view comes from rows drawn by other threads.
+	DrawerCommandQueue::WaitForWorkers();
+
+	int srcwidth = viewwidth, srcheight = viewheight;
+	int srcpitch = DynResCanvas->GetPitch();
+	const BYTE *src = DynResCanvas->GetBuffer() + viewwindowy * srcpitch + viewwindowx;
+	DynResCanvas->Unlock ();
+	RenderTarget = screen;
+	R_SetWindow (setblocks, SCREENWIDTH, SCREENHEIGHT, ST_Y);
+	viewwindowx = DynResViewX;
+	viewwindowy = DynResViewY;
+	bRenderingToCanvas = false;
+	bDynamicResolution = false;
+
+	R_SetupBuffer ();
+	R_DrawScaledView (src, srcwidth, srcheight, srcpitch, viewwidth, viewheight);
+}
+
+//==========================================================================
+//
+// R_UpdateDynamicResolution
+//
+// Called with the time the last view took. The time to draw it is mostly
+// spent per pixel, so the scale moves with the square root of how far off
+// it is. It is lowered quickly and raised slowly to avoid flip-flopping.
+//
+//==========================================================================
+
+void R_UpdateDynamicResolution (double ms)
+{
+	if (r_dynres_target <= 0)
+	{
+		DynResScale = 1.;
+		DynResMS = 0;
+		return;
+	}
+	DynResMS = DynResMS == 0 ? ms : DynResMS * 0.75 + ms * 0.25;
+
+	double target = r_dynres_target;
+	if (DynResMS > target * 1.05 || DynResMS < target * 0.85)
+	{
+		DynResScale *= clamp(sqrt(target / MAX(DynResMS, 0.1)), 0.9, 1.03);
+	}
+	DynResScale = clamp(DynResScale, clamp<double>(r_dynres_minscale, 0.25, 1.), 1.);
+}
+
 //==========================================================================
 //
 // R_RenderActorView
@@ -1053,6 +1133,181 @@ CCMD (clearwallcycles)
 	bestwallcycles = HUGE_VAL;
 }
 
+//==========================================================================
+//
+// STAT dynres
+//
+// Shows the resolution the view is drawn at with r_dynres_target
+//
+//==========================================================================
+
+ADD_STAT (dynres)
+{
+	FString out;
+	if (r_dynres_target <= 0)
+	{
+		out = "r_dynres_target is off";
+	}
+	else
+	{
+		out.Format ("scale %.2f, %dx%d, %.2f ms (target %.2f ms)", DynResScale,
+			int(viewwidth * DynResScale), int(viewheight * DynResScale), DynResMS, (double)r_dynres_target);
+	}
+	return out;
+}
+
+//==========================================================================
+//
+// CCMD mipbench
+//
+// Renders the current view a number of times, first with full size
+// textures and then with r_mipmap on, and prints the time a frame took
+// on average. Most useful on maps with large textures, where walls and
+// flats in the distance are drawn much smaller than they are.
+//
+//==========================================================================
+
+CCMD (mipbench)
+{
+	if (gamestate != GS_LEVEL || players[consoleplayer].mo == NULL)
+	{
+		Printf ("mipbench needs a running level\n");
+		return;
+	}
+
+	int frames = argv.argc() > 1 ? clamp(atoi(argv[1]), 1, 10000) : 100;
+	bool oldmipmap = r_mipmap;
+	cycle_t times[2];
+
+	D_FinishPendingFrame ();
+	screen->Lock (true);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		r_mipmap = (pass == 1);
+		// The first frame makes the mip levels for everything in view.
+		Renderer->RenderView (&players[consoleplayer]);
+		times[pass].Reset();
+		times[pass].Clock();
+		for (int i = 0; i < frames; i++)
+		{
+			Renderer->RenderView (&players[consoleplayer]);
+		}
+		times[pass].Unclock();
+	}
+	screen->Unlock ();
+	r_mipmap = oldmipmap;
+
+	Printf ("%d frames at %dx%d\n", frames, viewwidth, viewheight);
+	Printf ("  full size  %8.3f ms/frame\n", times[0].TimeMS() / frames);
+	Printf ("  mipmapped  %8.3f ms/frame\n", times[1].TimeMS() / frames);
+}
+
+//==========================================================================
+//
+// CCMD voxelbench
+//
+// voxelbench [count] [frames]
+//
+// Puts a grid of things that are drawn as voxels in front of the player
+// and renders the view a number of times, first with all voxels at full
+// detail and then with r_voxellod on, and prints the time a frame took on
+// average. The things are of all the actor classes whose spawn frame has
+// a voxel, in turn, and are removed again afterwards.
+//
+//==========================================================================
+
+static void R_FindVoxelClasses (TArray<PClassActor *> &classes)
+{
+	for (unsigned i = 0; i < PClassActor::AllActorClasses.Size(); i++)
+	{
+		PClassActor *cls = PClassActor::AllActorClasses[i];
+		if (cls->Defaults == NULL || cls->IsDescendantOf(RUNTIME_CLASS(APlayerPawn)))
+			continue;
+
+		FState *state = GetDefaultByType(cls)->SpawnState;
+		if (state == NULL || (unsigned)state->sprite >= sprites.Size() || state->Frame >= sprites[state->sprite].numframes)
+			continue;
+
+		if (SpriteFrames[sprites[state->sprite].spriteframes + state->Frame].Voxel != NULL)
+			classes.Push(cls);
+	}
+}
+
+CCMD (voxelbench)
+{
+	if (gamestate != GS_LEVEL || players[consoleplayer].mo == NULL)
+	{
+		Printf ("voxelbench needs a running level\n");
+		return;
+	}
+	if (netgame || demorecording || demoplayback)
+	{
+		Printf ("voxelbench cannot be used in netgames or demos\n");
+		return;
+	}
+
+	TArray<PClassActor *> classes;
+	R_FindVoxelClasses (classes);
+	if (classes.Size() == 0)
+	{
+		Printf ("Nothing is drawn as a voxel\n");
+		return;
+	}
+
+	int count = argv.argc() > 1 ? clamp(atoi(argv[1]), 1, 4096) : 256;
+	int frames = argv.argc() > 2 ? clamp(atoi(argv[2]), 1, 10000) : 100;
+
+	// Rows of things 48 units apart, starting a bit in front of the player
+	AActor *mo = players[consoleplayer].mo;
+	DVector2 forward = mo->Angles.Yaw.ToVector();
+	DVector2 right(forward.Y, -forward.X);
+	int columns = MAX(1, (int)sqrt((double)count));
+	TArray<AActor *> things;
+
+	for (int i = 0; i < count; i++)
+	{
+		double ahead = 96. + (i / columns) * 48.;
+		double side = ((i % columns) - (columns - 1) / 2.) * 48.;
+		DVector2 pos = mo->Pos().XY() + forward * ahead + right * side;
+		AActor *thing = Spawn (classes[i % classes.Size()], DVector3(pos, mo->floorz), NO_REPLACE);
+		if (thing != NULL)
+		{
+			things.Push(thing);
+		}
+	}
+
+	bool oldlod = r_voxellod;
+	cycle_t times[2];
+
+	D_FinishPendingFrame ();
+	screen->Lock (true);
+	for (int pass = 0; pass < 2; pass++)
+	{
+		r_voxellod = (pass == 1);
+		Renderer->RenderView (&players[consoleplayer]);
+		times[pass].Reset();
+		times[pass].Clock();
+		for (int i = 0; i < frames; i++)
+		{
+			Renderer->RenderView (&players[consoleplayer]);
+		}
+		times[pass].Unclock();
+	}
+	screen->Unlock ();
+	r_voxellod = oldlod;
+
+	for (unsigned i = 0; i < things.Size(); i++)
+	{
+		things[i]->ClearCounters();
+		things[i]->Destroy();
+	}
+
+	Printf ("%u things of %u voxel classes, %d frames at %dx%d\n", things.Size(),
+		MIN(classes.Size(), things.Size()), frames, viewwidth, viewheight);
+	Printf ("  full detail  %8.3f ms/frame\n", times[0].TimeMS() / frames);
+	Printf ("  voxel LOD    %8.3f ms/frame\n", times[1].TimeMS() / frames);
+}
+
 #if 0
 // The replacement code for Build's wallscan doesn't have any timing calls so this does not work anymore.
 static double bestscancycles = HUGE_VAL;
@@ -42,6 +42,7 @@ namespace swrenderer
 // POV related.
 //
 extern bool				bRenderingToCanvas;
+extern bool				bDynamicResolution;
 extern fixed_t			viewingrangerecip;
 extern double			FocalLengthX, FocalLengthY;
 extern double			InvZtoScale;
@@ -135,6 +136,11 @@ void R_InitTextureMapping ();
 void R_RenderActorView (AActor *actor, bool dontmaplines = false);
 void R_SetupBuffer ();
 
+// Draws the view at a lower resolution when it takes longer than r_dynres_target
+bool R_BeginDynamicResolution ();
+void R_EndDynamicResolution ();
+void R_UpdateDynamicResolution (double ms);
+
 void R_RenderViewToCanvas (AActor *actor, DCanvas *canvas, int x, int y, int width, int height, bool dontmaplines = false);
 
 // [RH] Initialize multires stuff for renderer
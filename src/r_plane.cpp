@@ -58,6 +58,8 @@
 #include "r_3dfloors.h"
 #include "v_palette.h"
 #include "r_data/colormaps.h"
+#include "r_profile.h"
+#include "r_thread.h"
 
 #ifdef _MSC_VER
 #pragma warning(disable:4244)
@@ -65,6 +67,7 @@
 
 CVAR(Bool, tilt, false, 0);
 CVAR(Bool, r_skyboxes, true, 0)
+CVAR(Bool, r_mergeplanes, true, 0)
 
 EXTERN_CVAR(Int, r_skymode)
 
@@ -75,12 +78,16 @@ namespace swrenderer
 extern subsector_t *InSubsector;
 
 static void R_DrawSkyStriped (visplane_t *pl);
+static void R_FreeVisplanes ();
 
 planefunction_t 		floorfunc;
 planefunction_t 		ceilingfunc;
 
 // Here comes the obnoxious "visplane".
-#define MAXVISPLANES 128    /* must be a power of 2 */
+#define MAXVISPLANES 512    /* must be a power of 2 */
+
+// Visplanes are allocated this many at a time
+#define VISPLANE_BLOCK 16
 
 // Avoid infinite recursion with stacked sectors by limiting them.
 #define MAX_SKYBOX_PLANES 1000
@@ -89,15 +96,45 @@ planefunction_t 		ceilingfunc;
 static visplane_t		*visplanes[MAXVISPLANES+1];	// killough
 static visplane_t		*freetail;					// killough
 static visplane_t		**freehead = &freetail;		// killough
+static TArray<void *>	visplaneblocks;
 
 visplane_t 				*floorplane;
 visplane_t 				*ceilingplane;
 
 // killough -- hash function for visplanes
-// Empirically verified to be fairly uniform:
+// [RH] Everything R_FindPlane compares goes into it, so that planes that
+// only differ in their colormap, offsets or the portal they are in do not
+// end up in one long chain. FTransform compares some fields as sums, so
+// they are hashed that way, too.
+
+static inline unsigned visplane_hash_step(unsigned hash, unsigned val)
+{
+	return (hash ^ val) * 0x01000193;
+}
 
-#define visplane_hash(picnum,lightlevel,height) \
-  ((unsigned)((picnum)*3+(lightlevel)+(FLOAT2FIXED((height).fD()))*7) & (MAXVISPLANES-1))
+static unsigned visplane_hash(const secplane_t &height, FTextureID picnum, int lightlevel,
+	FDynamicColormap *colormap, const FTransform &xform, int sky, int portaluniq, int skybox)
+{
+	const DVector3 &normal = height.Normal();
+	unsigned hash = 0x811c9dc5;
+
+	hash = visplane_hash_step(hash, picnum.GetIndex());
+	hash = visplane_hash_step(hash, lightlevel);
+	hash = visplane_hash_step(hash, FLOAT2FIXED(height.fD()));
+	hash = visplane_hash_step(hash, FLOAT2FIXED(normal.X));
+	hash = visplane_hash_step(hash, FLOAT2FIXED(normal.Y));
+	hash = visplane_hash_step(hash, FLOAT2FIXED(normal.Z));
+	hash = visplane_hash_step(hash, (unsigned)((uintptr_t)colormap >> 4));
+	hash = visplane_hash_step(hash, FLOAT2FIXED(xform.xOffs));
+	hash = visplane_hash_step(hash, FLOAT2FIXED(xform.yOffs + xform.baseyOffs));
+	hash = visplane_hash_step(hash, FLOAT2FIXED(xform.xScale));
+	hash = visplane_hash_step(hash, FLOAT2FIXED(xform.yScale));
+	hash = visplane_hash_step(hash, (xform.Angle + xform.baseAngle).BAMs());
+	hash = visplane_hash_step(hash, sky);
+	hash = visplane_hash_step(hash, portaluniq);
+	hash = visplane_hash_step(hash, skybox);
+	return (hash ^ (hash >> 16)) & (MAXVISPLANES-1);
+}
 
 // These are copies of the main parameters used when drawing stacked sectors.
 // When you change the main parameters, you should copy them here too *unless*
@@ -148,6 +185,7 @@ float 					yslope[MAXHEIGHT];
 static fixed_t			xscale, yscale;
 static double			xstepscale, ystepscale;
 static double			basexfrac, baseyfrac;
+static FTexture			*planemiptex;	// flat being drawn, if it has mip levels
 
 void					R_DrawSinglePlane (visplane_t *, fixed_t alpha, bool additive, bool masked);
 void R_DrawSkySegment(visplane_t *vis, short *uwal, short *dwal, float *swal, fixed_t *lwal, double yrepeat, const uint8_t *(*getcol)(FTexture *tex, int col));
@@ -175,19 +213,31 @@ void R_DeinitPlanes ()
 	fakeActive = 0;
 
 	// do not use R_ClearPlanes because at this point the screen pointer is no longer valid.
-	for (int i = 0; i <= MAXVISPLANES; i++)	// new code -- killough
+	R_FreeVisplanes ();
+}
+
+//==========================================================================
+//
+// R_FreeVisplanes
+//
+// Frees the blocks all visplanes were allocated in.
+//
+//==========================================================================
+
+static void R_FreeVisplanes ()
+{
+	for (int i = 0; i <= MAXVISPLANES; i++)
 	{
-		for (*freehead = visplanes[i], visplanes[i] = NULL; *freehead; )
-		{
-			freehead = &(*freehead)->next;
-		}
+		visplanes[i] = NULL;
 	}
-	for (visplane_t *pl = freetail; pl != NULL; )
+	freetail = NULL;
+	freehead = &freetail;
+
+	for (unsigned i = 0; i < visplaneblocks.Size(); i++)
 	{
-		visplane_t *next = pl->next;
-		free (pl);
-		pl = next;
+		M_Free (visplaneblocks[i]);
 	}
+	visplaneblocks.Clear();
 }
 
 //==========================================================================
@@ -247,7 +297,29 @@ void R_MapPlane (int y, int x1)
 	ds_x1 = x1;
 	ds_x2 = x2;
 
-	spanfunc ();
+	int miplevel = 0;
+	if (planemiptex != NULL)
+	{
+		miplevel = R_MipLevel(planemiptex, distance * sqrt(xstepscale * xstepscale + ystepscale * ystepscale));
+	}
+	if (miplevel > 0)
+	{
+		// The fractions address the same spot at every level, so only
+		// the number of bits they are cut down to changes.
+		int xbits = ds_xbits, ybits = ds_ybits;
+		const uint8_t *source = ds_source;
+		ds_xbits -= miplevel;
+		ds_ybits -= miplevel;
+		ds_source = planemiptex->GetMipPixels(miplevel);
+		spanfunc ();
+		ds_xbits = xbits;
+		ds_ybits = ybits;
+		ds_source = source;
+	}
+	else
+	{
+		spanfunc ();
+	}
 }
 
 //==========================================================================
@@ -333,6 +405,9 @@ void R_ClearPlanes (bool fullclear)
 //
 // New function, by Lee Killough
 // [RH] top and bottom buffers get allocated immediately after the visplane.
+// When the free list runs dry, a block of VISPLANE_BLOCK planes is allocated
+// in one go and all but the first one are put on it. Once allocated, planes
+// are only ever recycled until the renderer shuts down or the level changes.
 //
 //==========================================================================
 
@@ -340,11 +415,28 @@ static visplane_t *new_visplane (unsigned hash)
 {
 	visplane_t *check = freetail;
 
+	RenderCounts.PlanesCreated++;
 	if (check == NULL)
 	{
-		check = (visplane_t *)M_Malloc (sizeof(*check) + 3 + sizeof(*check->top)*(MAXWIDTH*2));
-		memset(check, 0, sizeof(*check) + 3 + sizeof(*check->top)*(MAXWIDTH*2));
-		check->bottom = check->top + MAXWIDTH+2;
+		const size_t size = (sizeof(*check) + 3 + sizeof(*check->top)*(MAXWIDTH*2) + 15) & ~(size_t)15;
+		BYTE *block = (BYTE *)M_Malloc (size * VISPLANE_BLOCK);
+		memset(block, 0, size * VISPLANE_BLOCK);
+		visplaneblocks.Push(block);
+
+		for (int i = VISPLANE_BLOCK - 1; i >= 0; i--)
+		{
+			visplane_t *pl = (visplane_t *)(block + i * size);
+			pl->bottom = pl->top + MAXWIDTH+2;
+			if (i > 0)
+			{
+				*freehead = pl;
+				freehead = &pl->next;
+			}
+			else
+			{
+				check = pl;
+			}
+		}
 	}
 	else if (NULL == (freetail = freetail->next))
 	{
@@ -412,7 +504,7 @@ visplane_t *R_FindPlane (const secplane_t &height, FTextureID picnum, int lightl
 	}
 
 	// New visplane algorithm uses hash table -- killough
-	hash = isskybox ? MAXVISPLANES : visplane_hash (picnum.GetIndex(), lightlevel, height);
+	hash = isskybox ? MAXVISPLANES : visplane_hash (plane, picnum, lightlevel, basecolormap, *xform, sky, CurrentPortalUniq, CurrentSkybox);
 
 	for (check = visplanes[hash]; check; check = check->next)	// killough
 	{
@@ -542,6 +634,7 @@ visplane_t *R_CheckPlane (visplane_t *pl, int start, int stop)
 		// use the same visplane
 		pl->left = unionl;
 		pl->right = unionh;
+		RenderCounts.PlanesMerged++;
 	}
 	else
 	{
@@ -554,7 +647,7 @@ visplane_t *R_CheckPlane (visplane_t *pl, int start, int stop)
 		}
 		else
 		{
-			hash = visplane_hash (pl->picnum.GetIndex(), pl->lightlevel, pl->height);
+			hash = visplane_hash (pl->height, pl->picnum, pl->lightlevel, pl->colormap, pl->xform, pl->sky, pl->CurrentPortalUniq, pl->CurrentSkybox);
 		}
 		visplane_t *new_pl = new_visplane (hash);
 
@@ -936,6 +1029,78 @@ static void R_DrawSkyStriped (visplane_t *pl)
 	}
 }
 
+//==========================================================================
+//
+// R_MergeVisplanes
+//
+// R_FindPlane picks the first plane in a hash chain that matches, and that
+// is the newest one. So once R_CheckPlane had to split a plane, all later
+// wall ranges go to the copy, and when that fills up a third one is made,
+// although the older ones may still have room. Before the planes of a view
+// are drawn, each one is folded into an older plane with the same key if
+// no column is used by both, so they are mapped as one plane and their
+// spans join up.
+//
+//==========================================================================
+
+static bool R_SameVisplane (const visplane_t *a, const visplane_t *b)
+{
+	return a->height == b->height &&
+		a->picnum == b->picnum &&
+		a->lightlevel == b->lightlevel &&
+		a->colormap == b->colormap &&
+		a->xform == b->xform &&
+		a->sky == b->sky &&
+		a->portal == b->portal &&
+		a->CurrentPortalUniq == b->CurrentPortalUniq &&
+		a->MirrorFlags == b->MirrorFlags &&
+		a->CurrentSkybox == b->CurrentSkybox &&
+		a->viewpos == b->viewpos;
+}
+
+static void R_MergeVisplanes ()
+{
+	for (int i = 0; i < MAXVISPLANES; i++)
+	{
+		for (visplane_t *pl = visplanes[i]; pl; pl = pl->next)
+		{
+			// Only opaque planes of this view. Fake planes are drawn with
+			// the masked stuff, and portals are handled on their own.
+			if (pl->left >= pl->right || pl->sky < 0 || pl->portal != NULL ||
+				pl->CurrentPortalUniq != CurrentPortalUniq || pl->CurrentSkybox != CurrentSkybox)
+				continue;
+
+			for (visplane_t *into = pl->next; into; into = into->next)
+			{
+				if (into->left >= into->right || !R_SameVisplane (pl, into))
+					continue;
+
+				int x = MAX(pl->left, into->left);
+				int stop = MIN(pl->right, into->right);
+				while (x < stop && (pl->top[x] == 0x7fff || into->top[x] == 0x7fff))
+					x++;
+				if (x < stop)
+					continue;
+
+				for (x = pl->left; x < pl->right; x++)
+				{
+					if (pl->top[x] != 0x7fff)
+					{
+						into->top[x] = pl->top[x];
+						into->bottom[x] = pl->bottom[x];
+					}
+				}
+				into->left = MIN(into->left, pl->left);
+				into->right = MAX(into->right, pl->right);
+				pl->left = viewwidth;
+				pl->right = 0;
+				RenderCounts.PlanesJoined++;
+				break;
+			}
+		}
+	}
+}
+
 //==========================================================================
 //
 // R_DrawPlanes
@@ -952,6 +1117,11 @@ int R_DrawPlanes ()
 
 	ds_color = 3;
 
+	if (r_mergeplanes)
+	{
+		R_MergeVisplanes ();
+	}
+
 	for (i = 0; i < MAXVISPLANES; i++)
 	{
 		for (pl = visplanes[i]; pl; pl = pl->next)
@@ -1049,7 +1219,9 @@ void R_DrawSinglePlane (visplane_t *pl, fixed_t alpha, bool additive, bool maske
 
 		if (r_drawflat || (!pl->height.isSlope() && !tilt))
 		{
+			planemiptex = (r_mipmap && !r_drawflat && tex->GetMipLevels() > 0) ? tex : NULL;
 			R_DrawNormalPlane(pl, xscale, yscale, alpha, additive, masked);
+			planemiptex = NULL;
 		}
 		else
 		{
@@ -1227,6 +1399,11 @@ void R_DrawPortals ()
 		viewposStack.Push(ViewPos);
 		visplaneStack.Push (pl);
 
+		if (r_parallelportals)
+		{
+			R_HandoffDrawerCommands();
+		}
+
 		InSubsector = NULL;
 		R_RenderBSPNode (nodes + numnodes - 1);
 		R_3D_ResetClip(); // reset clips (floor/ceiling)
@@ -1547,7 +1724,9 @@ void R_DrawNormalPlane (visplane_t *pl, double _xscale, double _yscale, fixed_t
 			}
 		}
 	}
+	R_BeginSpanBatch ();
 	R_MapVisPlane (pl, R_MapPlane);
+	R_EndSpanBatch ();
 }
 
 //==========================================================================
@@ -1754,33 +1933,8 @@ void R_MapVisPlane (visplane_t *pl, void (*mapfunc)(int y, int x1))
 
 bool R_PlaneInitData ()
 {
-	int i;
-	visplane_t *pl;
-
 	// Free all visplanes and let them be re-allocated as needed.
-	pl = freetail;
-
-	while (pl)
-	{
-		visplane_t *next = pl->next;
-		M_Free (pl);
-		pl = next;
-	}
-	freetail = NULL;
-	freehead = &freetail;
-
-	for (i = 0; i < MAXVISPLANES; i++)
-	{
-		pl = visplanes[i];
-		visplanes[i] = NULL;
-		while (pl)
-		{
-			visplane_t *next = pl->next;
-			M_Free (pl);
-			pl = next;
-		}
-	}
-
+	R_FreeVisplanes ();
 	return true;
 }
 
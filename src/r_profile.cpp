@@ -0,0 +1,298 @@
+/*
+** r_profile.cpp
+** Per-frame counters for the software renderer
+**
+** The frontend counts the BSP nodes, wall ranges and visplanes it goes
+** through. With r_costmap on or a rendertrace running it also counts the
+** drawer commands it queues, by type, and which pixels of the view they
+** write to. The cost map shows the latter over the view, so that the
+** geometry that makes a frame expensive stands out, and rendertrace
+** writes all of it to a CSV file, one line per frame.
+**
+*/
+
+#include <stdio.h>
+
+#include "templates.h"
+#include "doomdef.h"
+#include "doomstat.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "stats.h"
+#include "v_palette.h"
+#include "colormatcher.h"
+#include "v_video.h"
+#include "r_local.h"
+#include "r_profile.h"
+
+extern cycle_t WallCycles, PlaneCycles, MaskedCycles;
+
+// Draws how often each pixel of the view was written to instead of the view
+CVAR(Bool, r_costmap, false, 0)
+
+namespace swrenderer
+{
+
+// MACROS ------------------------------------------------------------------
+
+#define COSTMAP_COLORS		9
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+FRenderCounts RenderCounts;
+bool RenderProfiling;
+bool RenderCountPixels;
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static TArray<FString> CommandTypeNames;
+static TArray<int> CommandTypeCounts;
+
+static TArray<uint16_t> CostMap;
+static int CostMapWidth, CostMapHeight;
+static uint8_t CostMapRamp[COSTMAP_COLORS];
+static bool CostMapRampDone;
+
+// What stat rendercounts shows, from the last finished frame
+static FRenderCounts LastCounts;
+static double LastViewPixels;
+static double LastWallMS, LastPlaneMS, LastMaskedMS;
+
+static FILE *TraceFile;
+static int TraceFrame;
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// R_RegisterDrawerCommandType
+//
+// Each type of drawer command gets a counter slot the first time one is
+// queued while profiling. Types that share a name share the counter.
+//
+//==========================================================================
+
+int R_RegisterDrawerCommandType(const char *name)
+{
+	for (unsigned i = 0; i < CommandTypeNames.Size(); i++)
+	{
+		if (CommandTypeNames[i].Compare(name) == 0)
+		{
+			return i;
+		}
+	}
+	CommandTypeNames.Push(name);
+	return CommandTypeCounts.Push(0);
+}
+
+void R_CountDrawerCommand(int type)
+{
+	CommandTypeCounts[type]++;
+	RenderCounts.Commands++;
+}
+
+//==========================================================================
+//
+// R_CountPixels
+//
+//==========================================================================
+
+void R_CountPixels(int x, int y, int width, int height)
+{
+	RenderCounts.Pixels += width * height;
+
+	int x2 = MIN(x + width, CostMapWidth);
+	int y2 = MIN(y + height, CostMapHeight);
+	x = MAX(x, 0);
+	y = MAX(y, 0);
+	for (; y < y2; y++)
+	{
+		uint16_t *line = &CostMap[y * CostMapWidth];
+		for (int i = x; i < x2; i++)
+		{
+			if (line[i] < 0xffff) line[i]++;
+		}
+	}
+}
+
+void R_CountPixels(const uint8_t *dest, int width, int height)
+{
+	using namespace drawerargs;
+
+	// Drawers that write to other buffers than the view are counted,
+	// but they stay out of the cost map.
+	ptrdiff_t offset = dest - dc_destorg;
+	if (offset < 0 || dc_pitch <= 0)
+	{
+		RenderCounts.Pixels += width * height;
+		return;
+	}
+	R_CountPixels(int(offset % dc_pitch), int(offset / dc_pitch), width, height);
+}
+
+//==========================================================================
+//
+// InitCostMapRamp
+//
+// Black for pixels that were not written, then from blue over green and
+// yellow to red for the ones written over many times.
+//
+//==========================================================================
+
+static void InitCostMapRamp()
+{
+	static const BYTE colors[COSTMAP_COLORS][3] =
+	{
+		{   0,   0,   0 }, {   0,   0, 160 }, {   0, 128, 255 },
+		{   0, 200,   0 }, { 160, 255,   0 }, { 255, 255,   0 },
+		{ 255, 160,   0 }, { 255,   0,   0 }, { 255, 255, 255 }
+	};
+	for (int i = 0; i < COSTMAP_COLORS; i++)
+	{
+		CostMapRamp[i] = ColorMatcher.Pick(colors[i][0], colors[i][1], colors[i][2]);
+	}
+	CostMapRampDone = true;
+}
+
+//==========================================================================
+//
+// R_BeginRenderCounts
+//
+// Called before the view is rendered.
+//
+//==========================================================================
+
+void R_BeginRenderCounts()
+{
+	memset(&RenderCounts, 0, sizeof(RenderCounts));
+	for (unsigned i = 0; i < CommandTypeCounts.Size(); i++)
+	{
+		CommandTypeCounts[i] = 0;
+	}
+
+	RenderProfiling = r_costmap || TraceFile != NULL;
+	RenderCountPixels = RenderProfiling && viewwidth > 0 && viewheight > 0;
+	if (RenderCountPixels)
+	{
+		CostMapWidth = viewwidth;
+		CostMapHeight = viewheight;
+		CostMap.Resize(CostMapWidth * CostMapHeight);
+		memset(&CostMap[0], 0, CostMap.Size() * sizeof(uint16_t));
+	}
+}
+
+//==========================================================================
+//
+// R_EndViewRenderCounts
+//
+// Called after the view itself was set up, but before camera textures are
+// rendered. Those only add to the counts, not to the cost map, which
+// replaces the view if r_costmap is on.
+//
+//==========================================================================
+
+void R_EndViewRenderCounts()
+{
+	LastWallMS = WallCycles.TimeMS();
+	LastPlaneMS = PlaneCycles.TimeMS();
+	LastMaskedMS = MaskedCycles.TimeMS();
+
+	if (!RenderCountPixels)
+	{
+		return;
+	}
+	RenderCountPixels = false;
+	if (r_costmap)
+	{
+		if (!CostMapRampDone)
+		{
+			InitCostMapRamp();
+		}
+		R_DrawCostMap(&CostMap[0], MIN(CostMapWidth, viewwidth), MIN(CostMapHeight, viewheight), CostMapRamp, COSTMAP_COLORS);
+	}
+}
+
+//==========================================================================
+//
+// R_EndRenderCounts
+//
+// Called when the view is done, with the time it took.
+//
+//==========================================================================
+
+void R_EndRenderCounts(double ms)
+{
+	RenderProfiling = false;
+	RenderCountPixels = false;
+	LastCounts = RenderCounts;
+	LastViewPixels = double(CostMapWidth) * CostMapHeight;
+
+	if (TraceFile != NULL)
+	{
+		fprintf(TraceFile, "%d,%.3f,%.3f,%.3f,%.3f,%d,%d,%d,%d,%d,%d,%lld,%.3f,",
+			TraceFrame++, ms, LastWallMS, LastPlaneMS, LastMaskedMS,
+			RenderCounts.Nodes, RenderCounts.Segs, RenderCounts.PlanesCreated, RenderCounts.PlanesMerged,
+			RenderCounts.PlanesJoined, RenderCounts.Commands, (long long)RenderCounts.Pixels,
+			LastViewPixels > 0 ? RenderCounts.Pixels / LastViewPixels : 0.);
+		for (unsigned i = 0; i < CommandTypeCounts.Size(); i++)
+		{
+			if (CommandTypeCounts[i] > 0)
+			{
+				fprintf(TraceFile, "%s=%d ", CommandTypeNames[i].GetChars(), CommandTypeCounts[i]);
+			}
+		}
+		fputc('\n', TraceFile);
+	}
+}
+
+//==========================================================================
+//
+// CCMD rendertrace
+//
+// rendertrace <file>	starts writing the counts of each frame to file
+// rendertrace			stops
+//
+//==========================================================================
+
+CCMD(rendertrace)
+{
+	if (TraceFile != NULL)
+	{
+		fclose(TraceFile);
+		TraceFile = NULL;
+		Printf("Wrote %d frames\n", TraceFrame);
+	}
+	if (argv.argc() < 2)
+	{
+		return;
+	}
+	TraceFile = fopen(argv[1], "w");
+	if (TraceFile == NULL)
+	{
+		Printf("Could not open %s for writing\n", argv[1]);
+		return;
+	}
+	TraceFrame = 0;
+	fprintf(TraceFile, "frame,ms,walls_ms,planes_ms,masked_ms,nodes,segs,planes_created,planes_merged,planes_joined,commands,pixels,overdraw,command_types\n");
+}
+
+//==========================================================================
+//
+// STAT rendercounts
+//
+//==========================================================================
+
+ADD_STAT(rendercounts)
+{
+	FString out;
+	out.Format("nodes=%d segs=%d planes=%d merged=%d joined=%d", LastCounts.Nodes, LastCounts.Segs,
+		LastCounts.PlanesCreated, LastCounts.PlanesMerged, LastCounts.PlanesJoined);
+	if (LastCounts.Commands > 0)
+	{
+		out.AppendFormat(" commands=%d pixels=%lld overdraw=%.2f", LastCounts.Commands,
+			(long long)LastCounts.Pixels, LastViewPixels > 0 ? LastCounts.Pixels / LastViewPixels : 0.);
+	}
+	return out;
+}
+
+}
@@ -0,0 +1,44 @@
+#ifndef __R_PROFILE_H
+#define __R_PROFILE_H
+
+#include <stdint.h>
+
+// Per-frame counters for the software renderer. They are shown by
+// stat rendercounts, drawn over the view by r_costmap and written to a
+// CSV file by rendertrace.
+
+namespace swrenderer
+{
+	struct FRenderCounts
+	{
+		int Nodes;			// BSP nodes visited
+		int Segs;			// wall ranges stored
+		int PlanesCreated;	// visplanes allocated
+		int PlanesMerged;	// wall ranges added to an existing visplane
+		int PlanesJoined;	// visplanes folded into another before drawing
+		int Commands;		// drawer commands queued
+		int64_t Pixels;		// pixels written to the view
+	};
+
+	extern FRenderCounts RenderCounts;
+
+	// True while drawer commands are counted by type
+	extern bool RenderProfiling;
+
+	// True while the pixels written to the view are counted
+	extern bool RenderCountPixels;
+
+	int R_RegisterDrawerCommandType(const char *name);
+	void R_CountDrawerCommand(int type);
+
+	// Counts a rectangle of pixels in view coordinates, or starting at a
+	// pointer into the view buffer.
+	void R_CountPixels(int x, int y, int width, int height);
+	void R_CountPixels(const uint8_t *dest, int width, int height);
+
+	void R_BeginRenderCounts();
+	void R_EndViewRenderCounts();
+	void R_EndRenderCounts(double ms);
+}
+
+#endif
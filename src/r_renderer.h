@@ -34,6 +34,11 @@ struct FRenderer
 	// render 3D view
 	virtual void RenderView(player_t *player) = 0;
 
+	// render 3D view, but allow it to be finished in the background while the game
+	// goes on. Returns true if FinishView must be called before the screen is used.
+	virtual bool StartView(player_t *player) { RenderView(player); return false; }
+	virtual void FinishView() {}
+
 	// Remap voxel palette
 	virtual void RemapVoxels() {}
 
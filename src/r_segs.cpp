@@ -47,6 +47,7 @@
 #include "r_draw.h"
 #include "v_palette.h"
 #include "r_data/colormaps.h"
+#include "r_profile.h"
 
 #define WALLYREPEAT 8
 
@@ -1627,6 +1628,8 @@ void R_StoreWallRange (int start, int stop)
 	int i;
 	bool maskedtexture = false;
 
+	RenderCounts.Segs++;
+
 #ifdef RANGECHECK
 	if (start >= viewwidth || start >= stop)
 		I_FatalError ("Bad R_StoreWallRange: %i to %i", start , stop);
@@ -43,6 +43,8 @@
 #include "textures/textures.h"
 #include "r_data/voxels.h"
 #include "r_thread.h"
+#include "r_profile.h"
+#include "stats.h"
 
 namespace swrenderer
 {
@@ -153,6 +155,10 @@ void FSoftwareRenderer::Precache(BYTE *texhitlist, TMap<PClassActor*, bool> &act
 	}
 }
 
+// Time the view took to draw, for r_dynres_target. With r_pipelined it is
+// added up over StartView and FinishView.
+static cycle_t ViewTime;
+
 //===========================================================================
 //
 // Render the view 
@@ -161,11 +167,61 @@ void FSoftwareRenderer::Precache(BYTE *texhitlist, TMap<PClassActor*, bool> &act
 
 void FSoftwareRenderer::RenderView(player_t *player)
 {
+	ViewTime.Reset();
+	ViewTime.Clock();
+
 	R_BeginDrawerCommands();
+	bool scaled = R_BeginDynamicResolution();
+	R_BeginRenderCounts();
 	R_RenderActorView (player->mo);
+	R_EndViewRenderCounts();
+	if (scaled) R_EndDynamicResolution();
 	// [RH] Let cameras draw onto textures that were visible this frame.
 	FCanvasTextureInfo::UpdateAll ();
 	R_EndDrawerCommands();
+
+	ViewTime.Unclock();
+	R_UpdateDynamicResolution(ViewTime.TimeMS());
+	R_EndRenderCounts(ViewTime.TimeMS());
+}
+
+//===========================================================================
+//
+// Render the view, but leave the drawers working on it in the background
+//
+//===========================================================================
+
+bool FSoftwareRenderer::StartView(player_t *player)
+{
+	ViewTime.Reset();
+	ViewTime.Clock();
+
+	R_BeginDrawerCommands();
+	bool scaled = R_BeginDynamicResolution();
+	R_BeginRenderCounts();
+	R_RenderActorView (player->mo);
+	R_EndViewRenderCounts();
+	if (scaled) R_EndDynamicResolution();
+	FCanvasTextureInfo::UpdateAll ();
+	bool pending = R_DetachDrawerCommands();
+
+	ViewTime.Unclock();
+	if (!pending)
+	{
+		R_UpdateDynamicResolution(ViewTime.TimeMS());
+		R_EndRenderCounts(ViewTime.TimeMS());
+	}
+	return pending;
+}
+
+void FSoftwareRenderer::FinishView()
+{
+	// The time the game spent in between does not count against the view.
+	ViewTime.Clock();
+	R_EndDrawerCommands();
+	ViewTime.Unclock();
+	R_UpdateDynamicResolution(ViewTime.TimeMS());
+	R_EndRenderCounts(ViewTime.TimeMS());
 }
 
 //==========================================================================
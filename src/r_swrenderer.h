@@ -14,6 +14,8 @@ struct FSoftwareRenderer : public FRenderer
 
 	// render 3D view
 	virtual void RenderView(player_t *player) override;
+	virtual bool StartView(player_t *player) override;
+	virtual void FinishView() override;
 
 	// Remap voxel palette
 	virtual void RemapVoxels() override;
@@ -65,6 +65,7 @@
 #include "p_local.h"
 #include "p_maputl.h"
 #include "r_thread.h"
+#include "stats.h"
 
 EXTERN_CVAR(Bool, st_scale)
 EXTERN_CVAR(Bool, r_shadercolormaps)
@@ -74,6 +75,8 @@ EXTERN_CVAR(Bool, r_drawplayersprites)
 EXTERN_CVAR(Bool, r_drawvoxels)
 
 CVAR(Bool, r_fullbrightignoresectorcolor, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);
+// Draw voxels that are small on screen from their smaller mip levels
+CVAR(Bool, r_voxellod, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);
 //CVAR(Bool, r_splitsprites, true, CVAR_ARCHIVE)
 
 namespace swrenderer
@@ -165,6 +168,24 @@ static vissprite_t **spritesorter;
 static int spritesortersize = 0;
 static int vsprcount;
 
+// Sprites with at least this many in view are sorted with a radix sort
+#define RADIXSORT_MIN		64
+
+static TArray<uint64_t> SpriteSortKeys, SpriteSortKeys2;
+static TArray<vissprite_t *> SpriteSortTemp;
+
+// Drawsegs that can clip sprites, listed by the columns they cover
+#define DSINDEX_BITS		5
+#define DSINDEX_BUCKETS		((MAXWIDTH >> DSINDEX_BITS) + 1)
+
+static TArray<unsigned> DrawSegBuckets[DSINDEX_BUCKETS];
+static TArray<unsigned> DrawSegsIndexed;
+static TArray<unsigned> DrawSegCandidates;
+static int NumDrawSegBuckets;
+
+// For stat sprites
+static int SpriteStatSprites, SpriteStatDrawSegs, SpriteStatClipTests;
+
 static void R_ProjectWallSprite(AActor *thing, const DVector3 &pos, FTextureID picnum, const DVector2 &scale, INTBOOL flip);
 
 
@@ -211,6 +232,7 @@ void R_ClearSprites (void)
 {
 	vissprite_p = firstvissprite;
 	DrewAVoxel = false;
+	SpriteStatSprites = SpriteStatDrawSegs = SpriteStatClipTests = 0;
 }
 
 
@@ -1365,14 +1387,14 @@ void R_DrawPSprite(DPSprite *pspr, AActor *owner, float bobx, float boby, double
 
 	vis->texturemid = (BASEYCENTER - sy) * tex->Scale.Y + tex->TopOffset;
 
-	if (camera->player && (RenderTarget != screen ||
+	if (camera->player && ((RenderTarget != screen && !bDynamicResolution) ||
 		viewheight == RenderTarget->GetHeight() ||
 		(RenderTarget->GetWidth() > (BASEXCENTER * 2) && !st_scale)))
 	{	// Adjust PSprite for fullscreen views
 		AWeapon *weapon = dyn_cast<AWeapon>(pspr->GetCaller());
 		if (weapon != nullptr && weapon->YAdjust != 0)
 		{
-			if (RenderTarget != screen || viewheight == RenderTarget->GetHeight())
+			if ((RenderTarget != screen && !bDynamicResolution) || viewheight == RenderTarget->GetHeight())
 			{
 				vis->texturemid -= weapon->YAdjust;
 			}
@@ -1897,6 +1919,92 @@ static void swap(vissprite_t *&a, vissprite_t *&b)
 }
 #endif
 
+//==========================================================================
+//
+// SortKey
+//
+// Maps floating point numbers to integers that sort in the same order.
+//
+//==========================================================================
+
+static inline uint32_t SortKey (float f)
+{
+	uint32_t bits;
+	memcpy (&bits, &f, sizeof(bits));
+	return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+static inline uint64_t SortKey (double f)
+{
+	uint64_t bits;
+	memcpy (&bits, &f, sizeof(bits));
+	return (bits & 0x8000000000000000ull) ? ~bits : bits | 0x8000000000000000ull;
+}
+
+//==========================================================================
+//
+// R_RadixSortVisSprites
+//
+// Sorts spritesorter the same way std::stable_sort would with sv_compare
+// or sv_compare2d. Passes in which all keys have the same byte are
+// skipped, so the 32-bit depth keys take at most four.
+//
+//==========================================================================
+
+static void R_RadixSortVisSprites (bool by2d)
+{
+	SpriteSortKeys.Resize (vsprcount);
+	SpriteSortKeys2.Resize (vsprcount);
+	SpriteSortTemp.Resize (vsprcount);
+
+	uint64_t *keys = &SpriteSortKeys[0], *keys2 = &SpriteSortKeys2[0];
+	vissprite_t **sprites = spritesorter, **sprites2 = &SpriteSortTemp[0];
+	int i;
+
+	for (i = 0; i < vsprcount; i++)
+	{
+		if (by2d)
+		{ // nearest last
+			keys[i] = SortKey (DVector2(sprites[i]->deltax, sprites[i]->deltay).LengthSquared());
+		}
+		else
+		{ // farthest first
+			keys[i] = uint32_t(~SortKey (sprites[i]->idepth));
+		}
+	}
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		unsigned counts[256] = { 0 };
+		for (i = 0; i < vsprcount; i++)
+		{
+			counts[(keys[i] >> shift) & 255]++;
+		}
+		if (counts[(keys[0] >> shift) & 255] == (unsigned)vsprcount)
+		{
+			continue;
+		}
+		for (unsigned pos = 0, j = 0; j < 256; j++)
+		{
+			unsigned count = counts[j];
+			counts[j] = pos;
+			pos += count;
+		}
+		for (i = 0; i < vsprcount; i++)
+		{
+			unsigned to = counts[(keys[i] >> shift) & 255]++;
+			keys2[to] = keys[i];
+			sprites2[to] = sprites[i];
+		}
+		std::swap (keys, keys2);
+		std::swap (sprites, sprites2);
+	}
+	if (sprites != spritesorter)
+	{
+		memcpy (spritesorter, sprites, vsprcount * sizeof(vissprite_t *));
+	}
+}
+
 void R_SortVisSprites (bool (*compare)(vissprite_t *, vissprite_t *), size_t first)
 {
 	int i;
@@ -1933,7 +2041,105 @@ void R_SortVisSprites (bool (*compare)(vissprite_t *, vissprite_t *), size_t fir
 		}
 	}
 
-	std::stable_sort(&spritesorter[0], &spritesorter[vsprcount], compare);
+	if (vsprcount >= RADIXSORT_MIN && (compare == sv_compare || compare == sv_compare2d))
+	{
+		R_RadixSortVisSprites (compare == sv_compare2d);
+	}
+	else
+	{
+		std::stable_sort(&spritesorter[0], &spritesorter[vsprcount], compare);
+	}
+}
+
+//==========================================================================
+//
+// R_IndexDrawSegs
+//
+// Lists the drawsegs that can clip sprites or have something to draw over
+// them by the groups of columns they cover. R_DrawSprite then only looks
+// at the drawsegs under the sprite instead of all of them.
+//
+//==========================================================================
+
+static void R_IndexDrawSegs ()
+{
+	for (int i = 0; i < NumDrawSegBuckets; i++)
+	{
+		DrawSegBuckets[i].Clear();
+	}
+	DrawSegsIndexed.Clear();
+	NumDrawSegBuckets = MIN((viewwidth >> DSINDEX_BITS) + 1, DSINDEX_BUCKETS);
+
+	unsigned count = unsigned(ds_p - firstdrawseg);
+	for (unsigned i = 0; i < count; i++)
+	{
+		drawseg_t *ds = firstdrawseg + i;
+
+		if (ds->fake || (!(ds->silhouette & SIL_BOTH) && ds->maskedtexturecol == -1 && !ds->bFogBoundary))
+		{
+			continue;
+		}
+		int b1 = MAX(ds->x1 >> DSINDEX_BITS, 0);
+		int b2 = MIN(ds->x2 >> DSINDEX_BITS, NumDrawSegBuckets - 1);
+		for (int b = b1; b <= b2; b++)
+		{
+			DrawSegBuckets[b].Push(i);
+		}
+		DrawSegsIndexed.Push(i);
+	}
+	SpriteStatDrawSegs += count;
+}
+
+//==========================================================================
+//
+// R_DrawSegsUnder
+//
+// Returns the drawsegs that may cover columns x1 to x2, in the order they
+// were created. Sprites covering many columns take the list of all of
+// them rather than merging a lot of buckets.
+//
+//==========================================================================
+
+static unsigned R_DrawSegsUnder (int x1, int x2, const unsigned *&list)
+{
+	int b1 = MAX(x1 >> DSINDEX_BITS, 0);
+	int b2 = MIN(x2 >> DSINDEX_BITS, NumDrawSegBuckets - 1);
+
+	if (b1 >= b2)
+	{
+		TArray<unsigned> &bucket = DrawSegBuckets[MIN(b1, NumDrawSegBuckets - 1)];
+		list = bucket.Size() > 0 ? &bucket[0] : NULL;
+		return bucket.Size();
+	}
+
+	unsigned total = 0;
+	for (int b = b1; b <= b2; b++)
+	{
+		total += DrawSegBuckets[b].Size();
+	}
+	if (total >= DrawSegsIndexed.Size())
+	{
+		list = DrawSegsIndexed.Size() > 0 ? &DrawSegsIndexed[0] : NULL;
+		return DrawSegsIndexed.Size();
+	}
+
+	DrawSegCandidates.Clear();
+	for (int b = b1; b <= b2; b++)
+	{
+		for (unsigned i = 0; i < DrawSegBuckets[b].Size(); i++)
+		{
+			DrawSegCandidates.Push(DrawSegBuckets[b][i]);
+		}
+	}
+	if (total == 0)
+	{
+		list = NULL;
+		return 0;
+	}
+	unsigned *start = &DrawSegCandidates[0];
+	std::sort (start, start + total);
+	list = start;
+	return unsigned(std::unique (start, start + total) - start);
 }
 
 //
@@ -2226,8 +2432,17 @@ void R_DrawSprite (vissprite_t *spr)
 
 	//		for (ds=ds_p-1 ; ds >= drawsegs ; ds--)    old buggy code
 
-	for (ds = ds_p; ds-- > firstdrawseg; )  // new -- killough
+	// Only the drawsegs indexed under the sprite's columns need to be checked.
+	const unsigned *dslist;
+	unsigned dsindex = R_DrawSegsUnder (x1, x2, dslist);
+
+	SpriteStatSprites++;
+	SpriteStatClipTests += dsindex;
+
+	while (dsindex-- > 0)
 	{
+		ds = firstdrawseg + dslist[dsindex];
+
 		// [ZZ] portal handling here
 		//if (ds->CurrentPortalUniq != spr->CurrentPortalUniq)
 		//	continue;
@@ -2406,6 +2621,7 @@ void R_DrawHeightPlanes(double height); // kg3D - fake planes
 void R_DrawMasked (void)
 {
 	R_CollectPortals();
+	R_IndexDrawSegs();
 	R_SortVisSprites (DrewAVoxel ? sv_compare2d : sv_compare, firstvissprite - vissprites);
 
 	if (height_top == NULL)
@@ -2460,6 +2676,22 @@ void R_DrawMasked (void)
 }
 
 
+//==========================================================================
+//
+// STAT sprites
+//
+// Shows how many drawsegs the sprites were checked against this frame
+//
+//==========================================================================
+
+ADD_STAT (sprites)
+{
+	FString out;
+	out.Format ("%d sprites, %d drawsegs, %d clip tests",
+		SpriteStatSprites, SpriteStatDrawSegs, SpriteStatClipTests);
+	return out;
+}
+
 void R_ProjectParticle (particle_t *particle, const sector_t *sector, int shade, int fakeside)
 {
 	double 				tr_x, tr_y;
@@ -2764,11 +2996,12 @@ void R_DrawVoxel(const FVector3 &globalpos, FAngle viewangle,
 
 	R_SetupDrawSlab(colormap);
 
-	// Select mip level
+	// Select mip level: each one further down is used once a voxel of the
+	// one above would be less than a pixel wide.
 	i = abs(DMulScale6(dasprx - globalposx, cosang, daspry - globalposy, sinang));
 	i = DivScale6(i, MIN(daxscale, dayscale));
 	j = xs_Fix<13>::ToFix(FocalLengthX);
-	for (k = 0; i >= j && k < voxobj->NumMips; ++k)
+	for (k = 0; r_voxellod && i >= j && k < voxobj->NumMips; ++k)
 	{
 		i >>= 1;
 	}
@@ -2826,6 +3059,7 @@ void R_DrawVoxel(const FVector3 &globalpos, FAngle viewangle,
 	syoff = DivScale21(globalposz - dasprz, FixedMul(dazscale, 0xE800)) + (piv_z << 7);
 	yoff = (abs(gxinc) + abs(gyinc)) >> 1;
 
+	R_BeginSlabBatch();
 	for (cnt = 0; cnt < 8; cnt++)
 	{
 		switch (cnt)
@@ -3046,6 +3280,7 @@ void R_DrawVoxel(const FVector3 &globalpos, FAngle viewangle,
 			}
 		}
 	}
+	R_EndSlabBatch();
 }
 
 //==========================================================================
@@ -34,6 +34,8 @@
 #include "r_thread.h"
 
 CVAR(Bool, r_multithreaded, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);
+CVAR(Int, r_drawerbatch, 512, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);
+CVAR(Bool, r_parallelportals, true, CVAR_ARCHIVE | CVAR_GLOBALCONFIG);
 
 void R_BeginDrawerCommands()
 {
@@ -45,6 +47,16 @@ void R_EndDrawerCommands()
 	DrawerCommandQueue::End();
 }
 
+bool R_DetachDrawerCommands()
+{
+	return DrawerCommandQueue::Detach();
+}
+
+void R_HandoffDrawerCommands()
+{
+	DrawerCommandQueue::Handoff();
+}
+
 /////////////////////////////////////////////////////////////////////////////
 
 DrawerCommandQueue *DrawerCommandQueue::Instance()
@@ -91,43 +103,146 @@ void DrawerCommandQueue::End()
 		queue->threaded_render--;
 }
 
+bool DrawerCommandQueue::Detach()
+{
+	auto queue = Instance();
+	if (queue->threaded_render > 0)
+		queue->threaded_render--;
+	if (queue->threaded_render > 0)
+	{
+		queue->Finish();
+		return false;
+	}
+	queue->Submit();
+	if (!queue->commands.empty())
+		queue->Finish();
+	return queue->run_active;
+}
+
 void DrawerCommandQueue::WaitForWorkers()
 {
 	Instance()->Finish();
 }
 
+// Called when the frontend starts on a portal or skybox view, so that what
+// it has queued up to there is drawn while it walks the new view, instead
+// of waiting for r_drawerbatch commands to come together.
+void DrawerCommandQueue::Handoff()
+{
+	auto queue = Instance();
+	if (queue->threaded_render > 0 && r_multithreaded && queue->commands.size() >= min_handoff)
+		queue->Submit();
+}
+
+// Hands the commands queued so far to the worker threads without waiting
+// for them. The frontend keeps producing commands in the meantime, so the
+// time spent walking the scene and drawing it overlaps. In such a run the
+// main thread does not draw any rows itself, as it would otherwise have to
+// catch up with all of them at the end.
+void DrawerCommandQueue::Submit()
+{
+	if (commands.empty() || num_batches + 1 >= max_batches)
+		return;
+
+	StartThreads();
+	if (threads.empty())
+		return;
+
+	std::unique_lock<std::mutex> start_lock(start_mutex);
+	batches[num_batches].swap(commands);
+	num_batches++;
+	if (!run_active)
+	{
+		run_active = true;
+		run_complete = false;
+		run_streaming = true;
+		run_id++;
+	}
+	start_lock.unlock();
+	start_condition.notify_all();
+}
+
 void DrawerCommandQueue::Finish()
 {
 	auto queue = Instance();
-	if (queue->commands.empty())
+	if (queue->commands.empty() && !queue->run_active)
 		return;
 
 	// Give worker threads something to do:
 
+	queue->StartThreads();
+
 	std::unique_lock<std::mutex> start_lock(queue->start_mutex);
-	queue->active_commands.swap(queue->commands);
-	queue->run_id++;
+	if (!queue->commands.empty())
+	{
+		queue->batches[queue->num_batches].swap(queue->commands);
+		queue->num_batches++;
+	}
+	if (!queue->run_active)
+	{
+		queue->run_active = true;
+		queue->run_streaming = false;
+		queue->run_id++;
+	}
+	queue->run_complete = true;
 	start_lock.unlock();
-
-	queue->StartThreads();
 	queue->start_condition.notify_all();
 
-	// Do one thread ourselves:
+	// Do one thread ourselves, unless the workers already got all the rows:
+
+	if (!queue->run_streaming)
+	{
+		DrawerThread thread;
+		thread.core = 0;
+		thread.num_cores = (int)(queue->threads.size() + 1);
+		queue->RunBatches(&thread, 0, queue->num_batches);
+	}
+
+	// Wait for everyone to finish:
+
+	std::unique_lock<std::mutex> end_lock(queue->end_mutex);
+	queue->end_condition.wait(end_lock, [&]() { return queue->finished_threads == queue->threads.size(); });
+
+	if (!queue->thread_error.IsEmpty())
+	{
+		static bool first = true;
+		if (queue->thread_error_fatal)
+			I_FatalError("%s", queue->thread_error.GetChars());
+		else if (first)
+			Printf("%s\n", queue->thread_error.GetChars());
+		first = false;
+	}
 
-	DrawerThread thread;
-	thread.core = 0;
-	thread.num_cores = (int)(queue->threads.size() + 1);
+	// Clean up batch:
 
+	for (size_t i = 0; i < queue->num_batches; i++)
+	{
+		for (auto &command : queue->batches[i])
+			command->~DrawerCommand();
+		queue->batches[i].clear();
+	}
+	queue->num_batches = 0;
+	queue->run_active = false;
+	queue->run_complete = false;
+	queue->memorypool_pos = 0;
+	queue->finished_threads = 0;
+}
+
+void DrawerCommandQueue::RunBatches(DrawerThread *thread, size_t first, size_t last)
+{
 	struct TryCatchData
 	{
 		DrawerCommandQueue *queue;
 		DrawerThread *thread;
-		size_t command_index;
+		size_t first, last;
+		DrawerCommand *command;
 	} data;
 
-	data.queue = queue;
-	data.thread = &thread;
-	data.command_index = 0;
+	data.queue = this;
+	data.thread = thread;
+	data.first = first;
+	data.last = last;
+	data.command = nullptr;
 	VectoredTryCatch(&data,
 	[](void *data)
 	{
@@ -140,42 +255,21 @@ void DrawerCommandQueue::Finish()
 			if (pass + 1 == d->queue->num_passes)
 				d->thread->pass_end_y = MAX(d->thread->pass_end_y, MAXHEIGHT);
 
-			size_t size = d->queue->active_commands.size();
-			for (d->command_index = 0; d->command_index < size; d->command_index++)
+			for (size_t i = d->first; i < d->last; i++)
 			{
-				auto &command = d->queue->active_commands[d->command_index];
-				command->Execute(d->thread);
+				for (auto command : d->queue->batches[i])
+				{
+					d->command = command;
+					command->Execute(d->thread);
+				}
 			}
 		}
 	},
 	[](void *data, const char *reason, bool fatal)
 	{
 		TryCatchData *d = (TryCatchData*)data;
-		ReportDrawerError(d->queue->active_commands[d->command_index], true, reason, fatal);
+		ReportDrawerError(d->command, true, reason, fatal);
 	});
-
-	// Wait for everyone to finish:
-
-	std::unique_lock<std::mutex> end_lock(queue->end_mutex);
-	queue->end_condition.wait(end_lock, [&]() { return queue->finished_threads == queue->threads.size(); });
-
-	if (!queue->thread_error.IsEmpty())
-	{
-		static bool first = true;
-		if (queue->thread_error_fatal)
-			I_FatalError("%s", queue->thread_error.GetChars());
-		else if (first)
-			Printf("%s\n", queue->thread_error.GetChars());
-		first = false;
-	}
-
-	// Clean up batch:
-
-	for (auto &command : queue->active_commands)
-		command->~DrawerCommand();
-	queue->active_commands.clear();
-	queue->memorypool_pos = 0;
-	queue->finished_threads = 0;
 }
 
 void DrawerCommandQueue::StartThreads()
@@ -193,8 +287,6 @@ void DrawerCommandQueue::StartThreads()
 	{
 		DrawerCommandQueue *queue = this;
 		DrawerThread *thread = &threads[i];
-		thread->core = i + 1;
-		thread->num_cores = num_threads;
 		thread->thread = std::thread([=]()
 		{
 			int run_id = 0;
@@ -206,45 +298,28 @@ void DrawerCommandQueue::StartThreads()
 				if (queue->shutdown_flag)
 					break;
 				run_id = queue->run_id;
-				start_lock.unlock();
 
-				// Do the work:
+				// Without the main thread drawing, the workers split all rows between them
+				thread->core = queue->run_streaming ? i : i + 1;
+				thread->num_cores = (int)queue->threads.size() + (queue->run_streaming ? 0 : 1);
 
-				struct TryCatchData
-				{
-					DrawerCommandQueue *queue;
-					DrawerThread *thread;
-					size_t command_index;
-				} data;
-
-				data.queue = queue;
-				data.thread = thread;
-				data.command_index = 0;
-				VectoredTryCatch(&data,
-				[](void *data)
-				{
-					TryCatchData *d = (TryCatchData*)data;
-
-					for (int pass = 0; pass < d->queue->num_passes; pass++)
-					{
-						d->thread->pass_start_y = pass * d->queue->rows_in_pass;
-						d->thread->pass_end_y = (pass + 1) * d->queue->rows_in_pass;
-						if (pass + 1 == d->queue->num_passes)
-							d->thread->pass_end_y = MAX(d->thread->pass_end_y, MAXHEIGHT);
-
-						size_t size = d->queue->active_commands.size();
-						for (d->command_index = 0; d->command_index < size; d->command_index++)
-						{
-							auto &command = d->queue->active_commands[d->command_index];
-							command->Execute(d->thread);
-						}
-					}
-				},
-				[](void *data, const char *reason, bool fatal)
+				// Do the work as it comes in, until the main thread says this was all:
+
+				size_t done = 0;
+				while (true)
 				{
-					TryCatchData *d = (TryCatchData*)data;
-					ReportDrawerError(d->queue->active_commands[d->command_index], true, reason, fatal);
-				});
+					queue->start_condition.wait(start_lock, [&]() { return queue->num_batches != done || queue->run_complete || queue->shutdown_flag; });
+					size_t last = queue->num_batches;
+					if (last == done || queue->shutdown_flag)
+						break;
+					start_lock.unlock();
+
+					queue->RunBatches(thread, done, last);
+					done = last;
+
+					start_lock.lock();
+				}
+				start_lock.unlock();
 
 				// Notify main thread that we finished:
 				std::unique_lock<std::mutex> end_lock(queue->end_mutex);
@@ -23,6 +23,7 @@
 #pragma once
 
 #include "r_draw.h"
+#include "r_profile.h"
 #include <vector>
 #include <memory>
 #include <thread>
@@ -32,12 +33,25 @@
 // Use multiple threads when drawing
 EXTERN_CVAR(Bool, r_multithreaded)
 
+// Number of queued commands handed to the worker threads while the frame is still being set up
+EXTERN_CVAR(Int, r_drawerbatch)
+
+// Hand the queued commands to the worker threads whenever a portal or skybox view starts
+EXTERN_CVAR(Bool, r_parallelportals)
+
 // Redirect drawer commands to worker threads
 void R_BeginDrawerCommands();
 
 // Wait until all drawers finished executing
 void R_EndDrawerCommands();
 
+// End redirection, but leave the queued drawers running on the worker threads.
+// Returns true if they have to be waited for with R_EndDrawerCommands.
+bool R_DetachDrawerCommands();
+
+// Let the worker threads start on what was queued so far, without waiting for them
+void R_HandoffDrawerCommands();
+
 // Worker data for each thread executing drawer commands
 class DrawerThread
 {
@@ -159,13 +173,25 @@ class DrawerCommandQueue
 	char memorypool[memorypool_size];
 	size_t memorypool_pos = 0;
 
+	enum { max_batches = 256 };
+
+	// Fewer commands are not worth a batch of their own
+	enum { min_handoff = 64 };
+
 	std::vector<DrawerCommand *> commands;
 
 	std::vector<DrawerThread> threads;
 
+	// Commands handed to the worker threads. Batches below num_batches are
+	// never touched by the main thread until the run has finished.
+	std::vector<DrawerCommand *> batches[max_batches];
+	size_t num_batches = 0;
+	bool run_active = false;
+	bool run_complete = false;
+	bool run_streaming = false;
+
 	std::mutex start_mutex;
 	std::condition_variable start_condition;
-	std::vector<DrawerCommand *> active_commands;
 	bool shutdown_flag = false;
 	int run_id = 0;
 
@@ -182,9 +208,20 @@ class DrawerCommandQueue
 
 	void StartThreads();
 	void StopThreads();
+	void Submit();
 	void Finish();
+	void RunBatches(DrawerThread *thread, size_t first, size_t last);
 
 	static DrawerCommandQueue *Instance();
+
+	// Counts queued commands by type for the render counts
+	template<typename T>
+	static void CountCommand(T *command)
+	{
+		static int type = swrenderer::R_RegisterDrawerCommandType(command->DebugInfo().GetChars());
+		swrenderer::R_CountDrawerCommand(type);
+	}
+
 	static void ReportDrawerError(DrawerCommand *command, bool worker_thread, const char *reason, bool fatal);
 
 	DrawerCommandQueue();
@@ -202,6 +239,8 @@ public:
 		if (queue->threaded_render == 0 || !r_multithreaded)
 		{
 			T command(std::forward<Types>(args)...);
+			if (swrenderer::RenderProfiling)
+				CountCommand(&command);
 			VectoredTryCatch(&command,
 			[](void *data)
 			{
@@ -225,7 +264,11 @@ public:
 					return;
 			}
 			T *command = new (ptr)T(std::forward<Types>(args)...);
+			if (swrenderer::RenderProfiling)
+				CountCommand(command);
 			queue->commands.push_back(command);
+			if (r_drawerbatch > 0 && queue->commands.size() >= (size_t)r_drawerbatch)
+				queue->Submit();
 		}
 	}
 
@@ -236,6 +279,12 @@ public:
 	// End redirection and wait until all worker threads finished executing
 	static void End();
 
+	// End redirection without waiting. Returns true if the workers are still busy.
+	static bool Detach();
+
 	// Waits until all worker threads finished executing
 	static void WaitForWorkers();
+
+	// Hands the queued commands to the worker threads, if there are enough of them
+	static void Handoff();
 };
@@ -53,7 +53,7 @@ namespace swrenderer
 struct WallSampler
 {
 	WallSampler() { }
-	WallSampler(int y1, float swal, double yrepeat, fixed_t xoffset, FTexture *texture, const BYTE*(*getcol)(FTexture *texture, int x));
+	WallSampler(int y1, float swal, double yrepeat, fixed_t xoffset, FTexture *texture, const BYTE*(*getcol)(FTexture *texture, int x), int miplevel = 0);
 
 	uint32_t uv_pos;
 	uint32_t uv_step;
@@ -61,13 +61,19 @@ struct WallSampler
 
 	const BYTE *source;
 	uint32_t height;
+	int fracbits;
 };
 
-WallSampler::WallSampler(int y1, float swal, double yrepeat, fixed_t xoffset, FTexture *texture, const BYTE*(*getcol)(FTexture *texture, int x))
+WallSampler::WallSampler(int y1, float swal, double yrepeat, fixed_t xoffset, FTexture *texture, const BYTE*(*getcol)(FTexture *texture, int x), int miplevel)
 {
 	height = texture->GetHeight();
 
 	int uv_fracbits = 32 - texture->HeightBits;
+
+	// Mip levels only exist for power of two heights, for which uv covers the whole
+	// 32 bit range no matter the level. Only the shift to a texel changes, here
+	// and for the column GetMipColumn picks.
+	fracbits = uv_fracbits != 32 ? uv_fracbits + miplevel : 0;
 	if (uv_fracbits != 32)
 	{
 		uv_max = height << uv_fracbits;
@@ -92,7 +98,19 @@ WallSampler::WallSampler(int y1, float swal, double yrepeat, fixed_t xoffset, FT
 		uv_max = 1;
 	}
 
-	source = getcol(texture, xoffset >> FRACBITS);
+	if (miplevel > 0)
+		source = texture->GetMipColumn(miplevel, xoffset >> FRACBITS);
+	else
+		source = getcol(texture, xoffset >> FRACBITS);
+}
+
+// Picks the mip level for a column from the texels one pixel covers across and down the wall
+static int WallMipLevel(int x, int x1, int x2, float *swal, fixed_t *lwal, double yrepeat)
+{
+	double v = fabs(swal[x] * yrepeat);
+	int next = x + 1 < x2 ? x + 1 : x - 1;
+	double u = next >= x1 ? fabs((double)(lwal[next] - lwal[x])) / FRACUNIT : 0.0;
+	return R_MipLevel(rw_pic, MAX(u, v));
 }
 
 // Draw a column with support for non-power-of-two ranges
@@ -105,6 +123,7 @@ static void Draw1Column(int x, int y1, int y2, WallSampler &sampler, void(*draw1
 		dc_source = sampler.source;
 		dc_dest = (ylookup[y1] + x) + dc_destorg;
 		dc_count = count;
+		dc_wall_fracbits = sampler.fracbits;
 		dc_iscale = sampler.uv_step;
 		dc_texturefrac = sampler.uv_pos;
 		draw1column();
@@ -129,6 +148,7 @@ static void Draw1Column(int x, int y1, int y2, WallSampler &sampler, void(*draw1
 			dc_source = sampler.source;
 			dc_dest = (ylookup[y1] + x) + dc_destorg;
 			dc_count = count;
+			dc_wall_fracbits = sampler.fracbits;
 			dc_iscale = sampler.uv_step;
 			dc_texturefrac = uv_pos;
 			draw1column();
@@ -146,6 +166,7 @@ static void Draw1Column(int x, int y1, int y2, WallSampler &sampler, void(*draw1
 // Draw four columns with support for non-power-of-two ranges
 static void Draw4Columns(int x, int y1, int y2, WallSampler *sampler, void(*draw4columns)())
 {
+	dc_wall_fracbits = sampler[0].fracbits;
 	if (sampler[0].uv_max == 0 || sampler[0].uv_step == 0) // power of two, no wrap handling needed
 	{
 		int count = y2 - y1;
@@ -228,6 +249,9 @@ static void ProcessWallWorker(
 
 	dc_wall_fracbits = fracbits;
 
+	// Skies fetch their columns differently, so they are never mipmapped.
+	bool mipmapped = r_mipmap && getcol == R_GetColumn && rw_pic->GetMipLevels() > 0;
+
 	bool fixed = (fixedcolormap != NULL || fixedlightlev >= 0);
 	if (fixed)
 	{
@@ -259,7 +283,8 @@ static void ProcessWallWorker(
 		if (!fixed)
 			dc_colormap = basecolormap->Maps + (GETPALOOKUP(light, wallshade) << COLORMAPSHIFT);
 
-		WallSampler sampler(y1, swal[x], yrepeat, lwal[x] + xoffset, rw_pic, getcol);
+		int miplevel = mipmapped ? WallMipLevel(x, x1, x2, swal, lwal, yrepeat) : 0;
+		WallSampler sampler(y1, swal[x], yrepeat, lwal[x] + xoffset, rw_pic, getcol, miplevel);
 		Draw1Column(x, y1, y2, sampler, draw1column);
 	}
 
@@ -277,9 +302,18 @@ static void ProcessWallWorker(
 			light += rw_lightstep;
 		}
 
+		// All four columns are drawn from the same mip level
+		int miplevel = 0;
+		if (mipmapped)
+		{
+			miplevel = WallMipLevel(x, x1, x2, swal, lwal, yrepeat);
+			for (int i = 1; i < 4; i++)
+				miplevel = MIN(miplevel, WallMipLevel(x + i, x1, x2, swal, lwal, yrepeat));
+		}
+
 		WallSampler sampler[4];
 		for (int i = 0; i < 4; i++)
-			sampler[i] = WallSampler(y1[i], swal[x + i], yrepeat, lwal[x + i] + xoffset, rw_pic, getcol);
+			sampler[i] = WallSampler(y1[i], swal[x + i], yrepeat, lwal[x + i] + xoffset, rw_pic, getcol, miplevel);
 
 		// Figure out where we vertically can start and stop drawing 4 columns in one go
 		int middle_y1 = y1[0];
@@ -354,7 +388,8 @@ static void ProcessWallWorker(
 		if (!fixed)
 			dc_colormap = basecolormap->Maps + (GETPALOOKUP(light, wallshade) << COLORMAPSHIFT);
 
-		WallSampler sampler(y1, swal[x], yrepeat, lwal[x] + xoffset, rw_pic, getcol);
+		int miplevel = mipmapped ? WallMipLevel(x, x1, x2, swal, lwal, yrepeat) : 0;
+		WallSampler sampler(y1, swal[x], yrepeat, lwal[x] + xoffset, rw_pic, getcol, miplevel);
 		Draw1Column(x, y1, y2, sampler, draw1column);
 	}
 
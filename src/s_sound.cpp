@@ -53,6 +53,7 @@
 #include "serializer.h"
 #include "d_player.h"
 #include "r_state.h"
+#include "stats.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -102,6 +103,9 @@ extern float S_GetMusicVolume (const char *music);
 static void S_LoadSound3D(sfxinfo_t *sfx);
 static bool S_CheckSoundLimit(sfxinfo_t *sfx, const FVector3 &pos, int near_limit, float limit_range, AActor *actor, int channel);
 static bool S_IsChannelUsed(AActor *actor, int channel, int *seen);
+static void S_IndexChannel(FSoundChan *chan);
+static void S_UnindexChannel(FSoundChan *chan);
+static void S_ClearChannelIndex();
 static void S_ActivatePlayList(bool goBack);
 static void CalcPosVel(FSoundChan *chan, FVector3 *pos, FVector3 *vel);
 static void CalcPosVel(int type, const AActor *actor, const sector_t *sector, const FPolyObj *poly,
@@ -351,6 +355,7 @@ void S_Shutdown ()
 		delete chan;
 	}
 	FreeChannels = NULL;
+	S_ClearChannelIndex();
 
 	if (S_SoundCurve != NULL)
 	{
@@ -595,6 +600,7 @@ FISoundChannel *S_GetChannel(void *syschan)
 
 void S_ReturnChannel(FSoundChan *chan)
 {
+	S_UnindexChannel(chan);
 	S_UnlinkChannel(chan);
 	memset(chan, 0, sizeof(*chan));
 	S_LinkChannel(chan, &FreeChannels);
@@ -632,6 +638,302 @@ void S_LinkChannel(FSoundChan *chan, FSoundChan **head)
 	chan->PrevChan = head;
 }
 
+//==========================================================================
+//
+// Channel lookup
+//
+// Every playing channel is also linked into a chain for its sound ID and,
+// if it belongs to an actor, into a chain for that actor's hash bucket.
+// These let S_CheckSoundLimit and the per-actor queries look only at the
+// channels that can possibly match instead of walking the entire Channels
+// list for every sound that starts.
+//
+// Sounds with many copies playing at once additionally get a coarse grid
+// of their channels' positions, rebuilt at most once per tic, so that a
+// limit check only measures the channels in the neighboring cells.
+//
+//==========================================================================
+
+enum
+{
+	ACTORCHAN_HASHSIZE = 256,
+	SOUNDGRID_BUCKETS = 256,
+	SOUNDGRID_MINCHANS = 16,		// Don't bother with a grid for fewer channels than this.
+	SOUNDGRID_MAXCELL = 4096,		// Limits wider than this aren't worth gridding.
+	SOUNDGRID_SLOP = 64,			// Extra cell size to cover movement since the grid was built.
+};
+
+struct FSoundGridEntry
+{
+	FSoundChan *Chan;
+	DWORD Serial;
+	int CellX, CellZ;
+	int Next;
+};
+
+struct FSoundGrid
+{
+	int BuildTic;
+	float CellSize;
+	unsigned int Stale;
+	int Buckets[SOUNDGRID_BUCKETS];
+	TArray<FSoundGridEntry> Entries;
+};
+
+struct FSoundChanIndex
+{
+	FSoundChan *Head;
+	int Count;
+	FSoundGrid *Grid;
+};
+
+static TArray<FSoundChanIndex> SoundChanIndex;
+static FSoundChan *ActorChans[ACTORCHAN_HASHSIZE];
+static DWORD ChanIndexSerial;
+
+struct FSoundLimitStats
+{
+	unsigned int Checks;
+	unsigned int Suppressed;
+	unsigned int Tested;
+	unsigned int GridRebuilds;
+};
+
+static FSoundLimitStats LimitStats, LastLimitStats;
+static unsigned int TotalSuppressed;
+static int LimitStatsTic;
+
+static inline unsigned int ActorChanHash(const AActor *actor)
+{
+	return (unsigned int)(((size_t)actor >> 4) ^ ((size_t)actor >> 12)) & (ACTORCHAN_HASHSIZE - 1);
+}
+
+static inline unsigned int SoundGridHash(int cx, int cz)
+{
+	return ((unsigned int)cx * 73856093u ^ (unsigned int)cz * 19349663u) & (SOUNDGRID_BUCKETS - 1);
+}
+
+static inline void SoundGridCell(const FVector3 &pos, float cellsize, int &cx, int &cz)
+{
+	// Sound positions are stored as (x, height, y).
+	cx = (int)floorf(pos.X / cellsize);
+	cz = (int)floorf(pos.Z / cellsize);
+}
+
+//==========================================================================
+//
+// S_GridInsert
+//
+//==========================================================================
+
+static void S_GridInsert(FSoundGrid *grid, FSoundChan *chan)
+{
+	FVector3 pos;
+	FSoundGridEntry entry;
+
+	CalcPosVel(chan, &pos, NULL);
+	SoundGridCell(pos, grid->CellSize, entry.CellX, entry.CellZ);
+	entry.Chan = chan;
+	entry.Serial = chan->IndexSerial;
+
+	unsigned int bucket = SoundGridHash(entry.CellX, entry.CellZ);
+	entry.Next = grid->Buckets[bucket];
+	grid->Buckets[bucket] = grid->Entries.Push(entry);
+}
+
+//==========================================================================
+//
+// S_RebuildSoundGrid
+//
+//==========================================================================
+
+static void S_RebuildSoundGrid(FSoundChanIndex &index, float cellsize)
+{
+	FSoundGrid *grid = index.Grid;
+
+	if (grid == NULL)
+	{
+		grid = index.Grid = new FSoundGrid;
+	}
+	grid->BuildTic = gametic;
+	grid->CellSize = cellsize;
+	grid->Stale = 0;
+	grid->Entries.Clear();
+	for (int i = 0; i < SOUNDGRID_BUCKETS; ++i)
+	{
+		grid->Buckets[i] = -1;
+	}
+	for (FSoundChan *chan = index.Head; chan != NULL; chan = chan->NextSameSound)
+	{
+		if (!(chan->ChanFlags & CHAN_EVICTED))
+		{
+			S_GridInsert(grid, chan);
+		}
+	}
+	LimitStats.GridRebuilds++;
+}
+
+//==========================================================================
+//
+// S_UnindexChannel
+//
+// Removes a channel from the lookup chains. Entries for it in its sound's
+// grid are left behind; they are recognized as stale by their serial.
+//
+//==========================================================================
+
+static void S_UnindexChannel(FSoundChan *chan)
+{
+	if (chan->IndexSerial == 0)
+	{
+		return;
+	}
+
+	FSoundChanIndex &index = SoundChanIndex[chan->SoundID];
+	if (chan->PrevSameSound != NULL)
+	{
+		chan->PrevSameSound->NextSameSound = chan->NextSameSound;
+	}
+	else
+	{
+		index.Head = chan->NextSameSound;
+	}
+	if (chan->NextSameSound != NULL)
+	{
+		chan->NextSameSound->PrevSameSound = chan->PrevSameSound;
+	}
+	index.Count--;
+	if (index.Grid != NULL)
+	{
+		index.Grid->Stale++;
+	}
+
+	if (chan->IndexedActor != NULL)
+	{
+		if (chan->PrevActorChan != NULL)
+		{
+			chan->PrevActorChan->NextActorChan = chan->NextActorChan;
+		}
+		else
+		{
+			ActorChans[ActorChanHash(chan->IndexedActor)] = chan->NextActorChan;
+		}
+		if (chan->NextActorChan != NULL)
+		{
+			chan->NextActorChan->PrevActorChan = chan->PrevActorChan;
+		}
+	}
+
+	chan->NextSameSound = chan->PrevSameSound = NULL;
+	chan->NextActorChan = chan->PrevActorChan = NULL;
+	chan->IndexedActor = NULL;
+	chan->IndexSerial = 0;
+}
+
+//==========================================================================
+//
+// S_IndexChannel
+//
+// (Re)links a channel into the lookup chains. Must be called whenever a
+// channel's sound or source actor changes.
+//
+//==========================================================================
+
+static void S_IndexChannel(FSoundChan *chan)
+{
+	S_UnindexChannel(chan);
+
+	int id = chan->SoundID;
+	if (id <= 0)
+	{
+		return;
+	}
+	if ((unsigned)id >= SoundChanIndex.Size())
+	{
+		unsigned int oldsize = SoundChanIndex.Size();
+		SoundChanIndex.Resize(id + 1);
+		memset(&SoundChanIndex[oldsize], 0, (id + 1 - oldsize) * sizeof(FSoundChanIndex));
+	}
+
+	if (++ChanIndexSerial == 0)
+	{
+		ChanIndexSerial = 1;
+	}
+	chan->IndexSerial = ChanIndexSerial;
+
+	FSoundChanIndex &index = SoundChanIndex[id];
+	chan->PrevSameSound = NULL;
+	chan->NextSameSound = index.Head;
+	if (index.Head != NULL)
+	{
+		index.Head->PrevSameSound = chan;
+	}
+	index.Head = chan;
+	index.Count++;
+
+	// Keep an up-to-date grid current instead of rebuilding it.
+	if (index.Grid != NULL && index.Grid->BuildTic == gametic && !(chan->ChanFlags & CHAN_EVICTED))
+	{
+		S_GridInsert(index.Grid, chan);
+	}
+
+	if (chan->SourceType == SOURCE_Actor && chan->Actor != NULL)
+	{
+		FSoundChan **head = &ActorChans[ActorChanHash(chan->Actor)];
+		chan->IndexedActor = chan->Actor;
+		chan->PrevActorChan = NULL;
+		chan->NextActorChan = *head;
+		if (*head != NULL)
+		{
+			(*head)->PrevActorChan = chan;
+		}
+		*head = chan;
+	}
+}
+
+//==========================================================================
+//
+// S_ClearChannelIndex
+//
+//==========================================================================
+
+static void S_ClearChannelIndex()
+{
+	for (unsigned int i = 0; i < SoundChanIndex.Size(); ++i)
+	{
+		if (SoundChanIndex[i].Grid != NULL)
+		{
+			delete SoundChanIndex[i].Grid;
+			SoundChanIndex[i].Grid = NULL;
+		}
+	}
+}
+
+//==========================================================================
+//
+// S_RollLimitStats
+//
+//==========================================================================
+
+static void S_RollLimitStats()
+{
+	if (LimitStatsTic != gametic)
+	{
+		LimitStatsTic = gametic;
+		LastLimitStats = LimitStats;
+		memset(&LimitStats, 0, sizeof(LimitStats));
+	}
+}
+
+ADD_STAT(soundlimit)
+{
+	FString out;
+	out.Format("Limit checks=%u, suppressed=%u (total %u), tested=%u, grid rebuilds=%u",
+		LastLimitStats.Checks, LastLimitStats.Suppressed, TotalSuppressed,
+		LastLimitStats.Tested, LastLimitStats.GridRebuilds);
+	return out;
+}
+
 // [RH] Split S_StartSoundAtVolume into multiple parts so that sounds can
 //		be specified both by id and by name. Also borrowed some stuff from
 //		Hexen and parameters from Quake.
@@ -1149,6 +1451,7 @@ static FSoundChan *S_StartSound(AActor *actor, const sector_t *sec, const FPolyO
 		case SOURCE_Unattached:	chan->Point[0] = pt->X; chan->Point[1] = pt->Y; chan->Point[2] = pt->Z;	break;
 		default:										break;
 		}
+		S_IndexChannel(chan);
 	}
 	return chan;
 }
@@ -1513,28 +1816,94 @@ bool S_CheckSoundLimit(sfxinfo_t *sfx, const FVector3 &pos, int near_limit, floa
 	AActor *actor, int channel)
 {
 	FSoundChan *chan;
-	int count;
-	
-	for (chan = Channels, count = 0; chan != NULL && count < near_limit; chan = chan->NextChan)
+	int count = 0;
+	int id = int(sfx - &S_sfx[0]);
+
+	S_RollLimitStats();
+	LimitStats.Checks++;
+
+	if ((unsigned)id >= SoundChanIndex.Size() || SoundChanIndex[id].Head == NULL)
 	{
-		if (!(chan->ChanFlags & CHAN_EVICTED) && &S_sfx[chan->SoundID] == sfx)
-		{
-			FVector3 chanorigin;
+		return false;
+	}
+	FSoundChanIndex &index = SoundChanIndex[id];
 
-			if (actor != NULL && chan->EntChannel == channel &&
-				chan->SourceType == SOURCE_Actor && chan->Actor == actor)
+	if (actor != NULL)
+	{
+		for (chan = ActorChans[ActorChanHash(actor)]; chan != NULL; chan = chan->NextActorChan)
+		{
+			if (chan->IndexedActor == actor && chan->SoundID == id &&
+				chan->EntChannel == channel && !(chan->ChanFlags & CHAN_EVICTED))
 			{ // We are restarting a playing sound. Always let it play.
 				return false;
 			}
+		}
+	}
 
-			CalcPosVel(chan, &chanorigin, NULL);
-			if ((chanorigin - pos).LengthSquared() <= limit_range)
+	float range = sqrtf(limit_range);
+	if (index.Count < SOUNDGRID_MINCHANS || range > SOUNDGRID_MAXCELL)
+	{
+		for (chan = index.Head; chan != NULL && count < near_limit; chan = chan->NextSameSound)
+		{
+			if (!(chan->ChanFlags & CHAN_EVICTED))
 			{
-				count++;
+				FVector3 chanorigin;
+
+				LimitStats.Tested++;
+				CalcPosVel(chan, &chanorigin, NULL);
+				if ((chanorigin - pos).LengthSquared() <= limit_range)
+				{
+					count++;
+				}
 			}
 		}
 	}
-	return count >= near_limit;
+	else
+	{
+		float cellsize = range + SOUNDGRID_SLOP;
+		FSoundGrid *grid = index.Grid;
+		int cx, cz;
+
+		if (grid == NULL || grid->BuildTic != gametic || grid->CellSize != cellsize ||
+			grid->Stale > grid->Entries.Size() / 2)
+		{
+			S_RebuildSoundGrid(index, cellsize);
+			grid = index.Grid;
+		}
+		SoundGridCell(pos, cellsize, cx, cz);
+		for (int x = cx - 1; x <= cx + 1 && count < near_limit; ++x)
+		{
+			for (int z = cz - 1; z <= cz + 1 && count < near_limit; ++z)
+			{
+				for (int i = grid->Buckets[SoundGridHash(x, z)]; i >= 0 && count < near_limit; i = grid->Entries[i].Next)
+				{
+					FSoundGridEntry &entry = grid->Entries[i];
+					if (entry.CellX != x || entry.CellZ != z ||
+						entry.Serial != entry.Chan->IndexSerial ||
+						(entry.Chan->ChanFlags & CHAN_EVICTED))
+					{
+						continue;
+					}
+
+					FVector3 chanorigin;
+
+					LimitStats.Tested++;
+					CalcPosVel(entry.Chan, &chanorigin, NULL);
+					if ((chanorigin - pos).LengthSquared() <= limit_range)
+					{
+						count++;
+					}
+				}
+			}
+		}
+	}
+	if (count >= near_limit)
+	{
+		LimitStats.Suppressed++;
+		TotalSuppressed++;
+		return true;
+	}
+	return false;
 }
 
 //==========================================================================
@@ -1570,12 +1939,11 @@ void S_StopSound (int channel)
 
 void S_StopSound (AActor *actor, int channel)
 {
-	FSoundChan *chan = Channels;
+	FSoundChan *chan = ActorChans[ActorChanHash(actor)];
 	while (chan != NULL)
 	{
-		FSoundChan *next = chan->NextChan;
-		if (chan->SourceType == SOURCE_Actor &&
-			chan->Actor == actor &&
+		FSoundChan *next = chan->NextActorChan;
+		if (chan->IndexedActor == actor &&
 			(chan->EntChannel == channel || (i_compatflags & COMPATF_MAGICSILENCE)))
 		{
 			S_StopChannel(chan);
@@ -1665,15 +2033,16 @@ void S_RelinkSound (AActor *from, AActor *to)
 	if (from == NULL)
 		return;
 
-	FSoundChan *chan = Channels;
+	FSoundChan *chan = ActorChans[ActorChanHash(from)];
 	while (chan != NULL)
 	{
-		FSoundChan *next = chan->NextChan;
-		if (chan->SourceType == SOURCE_Actor && chan->Actor == from)
+		FSoundChan *next = chan->NextActorChan;
+		if (chan->IndexedActor == from)
 		{
 			if (to != NULL)
 			{
 				chan->Actor = to;
+				S_IndexChannel(chan);
 			}
 			else if (!(chan->ChanFlags & CHAN_LOOP) && !(compatflags2 & COMPATF2_SOUNDCUTOFF))
 			{
@@ -1683,6 +2052,7 @@ void S_RelinkSound (AActor *from, AActor *to)
 				chan->Point[0] = p.X;
 				chan->Point[1] = p.Y;
 				chan->Point[2] = p.Z;
+				S_IndexChannel(chan);
 			}
 			else
 			{
@@ -1790,9 +2160,9 @@ static bool S_IsChannelUsed(AActor *actor, int channel, int *seen)
 	{
 		return true;
 	}
-	for (FSoundChan *chan = Channels; chan != NULL; chan = chan->NextChan)
+	for (FSoundChan *chan = ActorChans[ActorChanHash(actor)]; chan != NULL; chan = chan->NextActorChan)
 	{
-		if (chan->SourceType == SOURCE_Actor && chan->Actor == actor)
+		if (chan->IndexedActor == actor)
 		{
 			*seen |= 1 << chan->EntChannel;
 			if (chan->EntChannel == channel)
@@ -1817,9 +2187,9 @@ bool S_IsActorPlayingSomething (AActor *actor, int channel, int sound_id)
 		channel = 0;
 	}
 
-	for (FSoundChan *chan = Channels; chan != NULL; chan = chan->NextChan)
+	for (FSoundChan *chan = ActorChans[ActorChanHash(actor)]; chan != NULL; chan = chan->NextActorChan)
 	{
-		if (chan->SourceType == SOURCE_Actor && chan->Actor == actor)
+		if (chan->IndexedActor == actor)
 		{
 			if (channel == 0 || chan->EntChannel == channel)
 			{
@@ -2234,6 +2604,7 @@ void S_StopChannel(FSoundChan *chan)
 			if (chan->SourceType == SOURCE_Actor)
 			{
 				chan->Actor = NULL;
+				S_IndexChannel(chan);
 			}
 		}
 		GSnd->StopChannel(chan);
@@ -2340,6 +2711,7 @@ void S_SerializeSounds(FSerializer &arc)
 				arc(nullptr, *chan);
 				// Sounds always start out evicted when restored from a save.
 				chan->ChanFlags |= CHAN_EVICTED | CHAN_ABSTIME;
+				S_IndexChannel(chan);
 			}
 			arc.EndArray();
 		}
@@ -204,6 +204,14 @@ struct FSoundChan : public FISoundChannel
 		const FPolyObj	*Poly;		// Polyobject sound source.
 		float			 Point[3];	// Sound is not attached to any source.
 	};
+
+	// Lookup links maintained by S_IndexChannel. Not serialized.
+	FSoundChan	*NextSameSound;	// Next channel playing the same sound.
+	FSoundChan	*PrevSameSound;
+	FSoundChan	*NextActorChan;	// Next channel in this actor's hash bucket.
+	FSoundChan	*PrevActorChan;
+	DWORD		IndexSerial;	// Nonzero while linked into the lookup chains.
+	AActor		*IndexedActor;	// Actor this channel is hashed under, if any.
 };
 extern FSoundChan *Channels;
 
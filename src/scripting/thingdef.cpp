@@ -364,21 +364,47 @@ static void CheckStates(PClassActor *obj)
 void ParseScripts();
 void ParseAllDecorate();
 
+extern cycle_t ZScriptCompileTime;
+
+//==========================================================================
+//
+// LoadActors
+//
+// Compiles all ZScript and DECORATE. The time each phase takes is logged
+// with the total.
+//
+//==========================================================================
+
 void LoadActors()
 {
-	cycle_t timer;
+	cycle_t timer, inittime, zscripttime, decoratetime, codegentime, checktime;
 
 	timer.Reset(); timer.Clock();
+	inittime.Reset();
+	zscripttime.Reset();
+	decoratetime.Reset();
+	codegentime.Reset();
+	checktime.Reset();
+	ZScriptCompileTime.Reset();
 	FScriptPosition::ResetErrorCounter();
 
+	inittime.Clock();
 	InitThingdef();
+	inittime.Unclock();
+
+	zscripttime.Clock();
 	FScriptPosition::StrictErrors = true;
 	ParseScripts();
+	zscripttime.Unclock();
 
+	decoratetime.Clock();
 	FScriptPosition::StrictErrors = false;
 	ParseAllDecorate();
+	decoratetime.Unclock();
 
+	codegentime.Clock();
 	FunctionBuildList.Build();
+	codegentime.Unclock();
 
 	if (FScriptPosition::ErrorCounter > 0)
 	{
@@ -386,6 +412,7 @@ void LoadActors()
 	}
 	FScriptPosition::ResetErrorCounter();
 
+	checktime.Clock();
 	for (int i = PClassActor::AllActorClasses.Size() - 1; i >= 0; i--)
 	{
 		auto ti = PClassActor::AllActorClasses[i];
@@ -430,9 +457,20 @@ void LoadActors()
 	{
 		I_Error("%d errors during actor postprocessing", FScriptPosition::ErrorCounter);
 	}
+	checktime.Unclock();
 
 	timer.Unclock();
-	if (!batchrun) Printf("script parsing took %.2f ms\n", timer.TimeMS());
+	if (!batchrun)
+	{
+		Printf("script parsing took %.2f ms\n", timer.TimeMS());
+		Printf("  setup %.2f, zscript %.2f (parse %.2f, compile %.2f), decorate %.2f, code generation %.2f (resolve %.2f, emit %.2f, optimize %.2f), checks %.2f ms\n",
+			inittime.TimeMS(), zscripttime.TimeMS(), zscripttime.TimeMS() - ZScriptCompileTime.TimeMS(), ZScriptCompileTime.TimeMS(),
+			decoratetime.TimeMS(), codegentime.TimeMS(), FunctionBuildList.ResolveTime.TimeMS(), FunctionBuildList.EmitTime.TimeMS(),
+			FunctionBuildList.OptimizeTime.TimeMS(), checktime.TimeMS());
+		DPrintf(DMSG_NOTIFY, "  %d functions, %d bytes of code (%d instructions optimized away, %d calls inlined), %u actor classes\n",
+			FunctionBuildList.NumBuilt, FunctionBuildList.BuiltCodeSize, FunctionBuildList.NumRemovedOps, FunctionBuildList.NumInlinedCalls,
+			PClassActor::AllActorClasses.Size());
+	}
 
 	// Since these are defined in DECORATE now the table has to be initialized here.
 	for (int i = 0; i < 31; i++)
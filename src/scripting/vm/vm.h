@@ -6,6 +6,7 @@
 #include "vectors.h"
 #include "cmdlib.h"
 #include "doomerrors.h"
+#include <atomic>
 
 #define MAX_RETURNS		8	// Maximum number of results a function called by script code can return
 #define MAX_TRY_DEPTH	8	// Maximum number of nested TRYs in a single function
@@ -847,6 +848,11 @@ public:
 	FVoidObj *KonstA;
 	int ExtraSpace;
 	int CodeSize;			// Size of code in instructions (not bytes)
+	int EmittedOps;			// Instructions the code generator produced
+	int RemovedOps;			// Instructions the builder's optimizer took out
+	int InlinedCalls;		// Calls replaced by a copy of the function called
+	int FoldedOps;			// Instructions rewritten to use known constant values
+	int CoalescedMoves;		// Moves saved by writing straight to their destination
 	unsigned LineInfoCount;
 	VM_UBYTE NumRegD;
 	VM_UBYTE NumRegF;
@@ -860,12 +866,28 @@ public:
 	VM_UBYTE NumArgs;		// Number of arguments this function takes
 	TArray<FTypeAndOffset> SpecialInits;	// list of all contents on the extra stack which require construction and destruction
 
+	// For functions that do nothing but pass their arguments and some constants
+	// on to a native function, see FindDirectCall.
+	struct DirectArg
+	{
+		VMValue Konst;			// passed as is if RegType is REGT_NIL
+		VM_UBYTE RegType;		// otherwise the argument that would be in this register is passed
+		VM_UBYTE RegNum;
+	};
+	VMFunction *DirectNative;
+	TArray<DirectArg> DirectArgs;
+	bool DirectTail;		// the native function's results are this function's results
+
 	void InitExtra(void *addr);
 	void DestroyExtra(void *addr);
 	int AllocExtraStack(PType *type);
 	int PCToLine(const VMOP *pc);
+	void FindDirectCall();
+	bool CallDirect(VMValue *params, int numparams, VMReturn *ret, int numret, int &numresults);
 };
 
+extern bool VMDirectCalls;
+
 class VMFrameStack
 {
 public:
@@ -962,7 +984,8 @@ enum EVMEngine
 {
 	VMEngine_Default,
 	VMEngine_Unchecked,
-	VMEngine_Checked
+	VMEngine_Checked,
+	VMEngine_Profiled
 };
 
 extern thread_local VMFrameStack GlobalVMStack;
@@ -972,6 +995,27 @@ void VMSelectEngine(EVMEngine engine);
 extern int (*VMExec)(VMFrameStack *stack, const VMOP *pc, VMReturn *ret, int numret);
 void VMFillParams(VMValue *params, VMFrame *callee, int numparam);
 
+// Sampling profiler for script code, see vmprofile.cpp. While it is on,
+// VMEngine_Profiled keeps a VMProfileFrame for every running function, and
+// script interpreters outside the VM bracket their runs with VMProfileEnter
+// and VMProfileLeave. VMProfilePending counts sampling intervals that have
+// passed, and whoever is running script code at the time takes the sample.
+struct VMProfileFrame
+{
+	VMProfileFrame(VMScriptFunction *func, const VMOP *const *pc);
+	~VMProfileFrame();
+
+	VMScriptFunction *Func;
+	const VMOP *const *PC;
+	unsigned Ops;
+};
+
+extern bool VMProfiling;
+extern std::atomic<int> VMProfilePending;
+void VMProfileEnter();
+void VMProfileLeave();
+void VMProfileSample(const void *id = NULL, const char *name = NULL, const char *line = NULL);
+
 void VMDumpConstants(FILE *out, const VMScriptFunction *func);
 void VMDisasm(FILE *out, const VMOP *code, int codesize, const VMScriptFunction *func);
 
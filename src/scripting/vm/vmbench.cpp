@@ -0,0 +1,275 @@
+/*
+** vmbench.cpp
+** Times the different ways script code can end up in a native function
+**
+*/
+
+#include "dobject.h"
+#include "actor.h"
+#include "c_dispatch.h"
+#include "d_player.h"
+#include "doomstat.h"
+#include "s_sound.h"
+#include "stats.h"
+#include "vm.h"
+#include "vmbuilder.h"
+
+//==========================================================================
+//
+// AddBenchParam
+//
+// Pushes one explicit argument given on the command line, converted to
+// what the function's prototype expects.
+//
+//==========================================================================
+
+static bool AddBenchParam(VMFunctionBuilder &build, PType *type, const char *arg, AActor *self)
+{
+	if (type == TypeState)
+	{
+		return false;
+	}
+	switch (type->GetRegType())
+	{
+	case REGT_INT:
+		if (type == TypeName)
+		{
+			build.Emit(OP_PARAM, 0, REGT_INT | REGT_KONST, build.GetConstantInt(FName(arg).GetIndex()));
+		}
+		else if (type == TypeSound)
+		{
+			build.Emit(OP_PARAM, 0, REGT_INT | REGT_KONST, build.GetConstantInt(FSoundID(arg)));
+		}
+		else
+		{
+			build.Emit(OP_PARAM, 0, REGT_INT | REGT_KONST, build.GetConstantInt((int)strtol(arg, NULL, 0)));
+		}
+		return true;
+
+	case REGT_FLOAT:
+		if (type->GetRegCount() != 1)
+		{
+			return false;
+		}
+		build.Emit(OP_PARAM, 0, REGT_FLOAT | REGT_KONST, build.GetConstantFloat(atof(arg)));
+		return true;
+
+	case REGT_STRING:
+		build.Emit(OP_PARAM, 0, REGT_STRING | REGT_KONST, build.GetConstantString(arg));
+		return true;
+
+	case REGT_POINTER:
+		if (!stricmp(arg, "self"))
+		{
+			build.Emit(OP_PARAM, 0, REGT_POINTER, 0);
+		}
+		else if (!stricmp(arg, "target"))
+		{
+			build.Emit(OP_PARAM, 0, REGT_POINTER | REGT_KONST, build.GetConstantAddress(self->target, ATAG_OBJECT));
+		}
+		else if (!stricmp(arg, "null"))
+		{
+			build.Emit(OP_PARAM, 0, REGT_POINTER | REGT_KONST, build.GetConstantAddress(NULL, ATAG_OBJECT));
+		}
+		else
+		{
+			return false;
+		}
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+//==========================================================================
+//
+// MakeBenchCall
+//
+// Creates the function DECORATE would make for a state that calls <func>
+// with these arguments: pass on self (and stateowner and stateinfo for
+// action functions), push the constants and tail call the function.
+// When <loop> is set, <callee> is called <count> times instead, with the
+// constants only if it is the native function itself.
+//
+//==========================================================================
+
+static VMScriptFunction *MakeBenchCall(PFunction *func, VMFunction *callee, FCommandLine &argv, AActor *self, bool loop, int count)
+{
+	int imp = func->GetImplicitArgs();
+	VMFunctionBuilder build(imp);
+	build.Registers[REGT_POINTER].Get(imp);
+
+	size_t loopstart = 0;
+	ExpEmit counter;
+	if (loop)
+	{
+		counter = ExpEmit(&build, REGT_INT);
+		build.EmitLoadInt(counter.RegNum, count);
+		loopstart = build.GetAddress();
+	}
+	for (int i = 0; i < imp; i++)
+	{
+		build.Emit(OP_PARAM, 0, REGT_POINTER, i);
+	}
+	// The DECORATE style function has the arguments built in.
+	int numargs = imp;
+	for (int i = 3; callee->Native && i < argv.argc(); i++, numargs++)
+	{
+		if (!AddBenchParam(build, func->Variants[0].Proto->ArgumentTypes[imp + i - 3], argv[i], self))
+		{
+			Printf("Cannot pass '%s' as argument %d\n", argv[i], i - 2);
+			return NULL;
+		}
+	}
+	int funcaddr = build.GetConstantAddress(callee, ATAG_OBJECT);
+	if (loop)
+	{
+		build.Emit(OP_CALL_K, funcaddr, numargs, 0);
+		build.Emit(OP_ADDI, counter.RegNum, counter.RegNum, -1);
+		build.Emit(OP_EQ_K, 0, counter.RegNum, build.GetConstantInt(0));
+		build.Backpatch(build.Emit(OP_JMP, 0), loopstart);
+		build.Emit(OP_RET, RET_FINAL, REGT_NIL, 0);
+	}
+	else
+	{
+		build.Emit(OP_TAIL_K, funcaddr, numargs, 0);
+	}
+
+	VMScriptFunction *sfunc = new VMScriptFunction(NAME_None);
+	sfunc->PrintableName = "vmcallbench";
+	build.MakeFunction(sfunc);
+	sfunc->NumArgs = imp;
+	sfunc->ImplicitArgs = imp;
+	return sfunc;
+}
+
+//==========================================================================
+//
+// CCMD vmcallbench
+//
+// Calls a native function on a freshly spawned actor of the given class,
+// repeatedly, in several ways:
+//
+// - from a script loop through a DECORATE style function, with and without
+//   the direct call lane that skips over such functions
+// - from a script loop straight to the native function
+// - from C++ the way states call their action function, again with and
+//   without the direct call lane
+//
+// Extra arguments are passed to the function as constants. Objects can be
+// given as self, target or null. Be aware that anything the function does
+// to the actor is done many times over.
+//
+//==========================================================================
+
+CCMD(vmcallbench)
+{
+	if (argv.argc() < 3)
+	{
+		Printf("Usage: vmcallbench <class> <function> [arguments...]\n");
+		return;
+	}
+	if (gamestate != GS_LEVEL || players[consoleplayer].mo == NULL)
+	{
+		Printf("vmcallbench needs a running level\n");
+		return;
+	}
+	PClassActor *cls = dyn_cast<PClassActor>(PClass::FindClass(argv[1]));
+	if (cls == NULL)
+	{
+		Printf("Unknown actor class '%s'\n", argv[1]);
+		return;
+	}
+	PFunction *func = dyn_cast<PFunction>(cls->Symbols.FindSymbol(FName(argv[2], true), true));
+	if (func == NULL || func->Variants[0].Implementation == NULL || !func->Variants[0].Implementation->Native)
+	{
+		Printf("'%s' has no native function '%s'\n", argv[1], argv[2]);
+		return;
+	}
+	if (!(func->Variants[0].Flags & VARF_Method))
+	{
+		Printf("%s.%s is not a method\n", argv[1], argv[2]);
+		return;
+	}
+
+	auto &variant = func->Variants[0];
+	int imp = func->GetImplicitArgs();
+	unsigned given = imp + argv.argc() - 3;
+	if (given > variant.Proto->ArgumentTypes.Size())
+	{
+		Printf("Too many arguments for %s.%s\n", argv[1], argv[2]);
+		return;
+	}
+	if (given < variant.ArgFlags.Size() && !(variant.ArgFlags[given] & VARF_Optional))
+	{
+		Printf("%s.%s needs more arguments\n", argv[1], argv[2]);
+		return;
+	}
+
+	const int count = 100000;
+	AActor *self = Spawn(cls, players[consoleplayer].mo->Pos(), NO_REPLACE);
+	self->target = players[consoleplayer].mo;
+
+	VMFunction *native = variant.Implementation;
+	VMScriptFunction *wrapper = MakeBenchCall(func, native, argv, self, false, 0);
+	VMScriptFunction *loop = wrapper == NULL ? NULL : MakeBenchCall(func, wrapper, argv, self, true, count);
+	VMScriptFunction *nativeloop = wrapper == NULL ? NULL : MakeBenchCall(func, native, argv, self, true, count);
+	if (wrapper == NULL)
+	{
+		self->Destroy();
+		return;
+	}
+
+	VMValue params[3] = { self, self, VMValue(NULL, ATAG_GENERIC) };
+	cycle_t times[5];
+	bool olddirect = VMDirectCalls;
+
+	try
+	{
+		for (int pass = 0; pass < 5; pass++)
+		{
+			VMDirectCalls = (pass == 1 || pass == 4);
+			times[pass].Reset();
+			times[pass].Clock();
+			if (pass < 2)
+			{
+				GlobalVMStack.Call(loop, params, imp, NULL, 0, NULL);
+			}
+			else if (pass == 2)
+			{
+				GlobalVMStack.Call(nativeloop, params, imp, NULL, 0, NULL);
+			}
+			else
+			{
+				for (int i = 0; i < count; i++)
+				{
+					GlobalVMStack.Call(wrapper, params, imp, NULL, 0, NULL);
+				}
+			}
+			times[pass].Unclock();
+		}
+	}
+	catch (CVMAbortException &err)
+	{
+		VMDirectCalls = olddirect;
+		self->Destroy();
+		err.MaybePrintMessage();
+		Printf("%s", err.stacktrace.GetChars());
+		err.stacktrace = "";
+		return;
+	}
+	VMDirectCalls = olddirect;
+	self->Destroy();
+
+	static const char *const names[5] =
+	{
+		"script, full call", "script, direct lane", "script, native",
+		"state, full call", "state, direct lane"
+	};
+	Printf("%s.%s, %d calls%s\n", argv[1], argv[2], count, wrapper->DirectNative == NULL ? " (no direct lane for this call)" : "");
+	for (int pass = 0; pass < 5; pass++)
+	{
+		Printf("  %-20s %8.2f ms  %6.1f ns/call\n", names[pass], times[pass].TimeMS(), times[pass].TimeMS() * 1e6 / count);
+	}
+}
@@ -31,12 +31,17 @@
 **
 */
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include "vmbuilder.h"
 #include "codegeneration/codegen.h"
 #include "info.h"
 #include "m_argv.h"
 #include "thingdef.h"
 #include "doomerrors.h"
+#include "templates.h"
 
 struct VMRemap
 {
@@ -109,6 +114,13 @@ void VMFunctionBuilder::EndStatement()
 
 void VMFunctionBuilder::MakeFunction(VMScriptFunction *func)
 {
+	NumEmitted = Code.Size();
+	if (!Optimized && !Args->CheckParm("-noscriptopt"))
+	{
+		OptimizeCalls();
+		OptimizeCode();
+	}
+
 	func->Alloc(Code.Size(), IntConstantList.Size(), FloatConstantList.Size(), StringConstantList.Size(), AddressConstantList.Size(), LineNumbers.Size());
 
 	// Copy code block.
@@ -139,6 +151,12 @@ void VMFunctionBuilder::MakeFunction(VMScriptFunction *func)
 	func->NumRegA = Registers[REGT_POINTER].MostUsed;
 	func->NumRegS = Registers[REGT_STRING].MostUsed;
 	func->MaxParam = MaxParam;
+	func->EmittedOps = NumEmitted;
+	func->RemovedOps = NumRemoved;
+	func->InlinedCalls = NumInlined;
+	func->FoldedOps = NumFolded;
+	func->CoalescedMoves = NumCoalesced;
+	func->FindDirectCall();
 
 	// Technically, there's no reason why we can't end the function with
 	// entries on the parameter stack, but it means the caller probably
@@ -840,105 +858,302 @@ VMFunction *FFunctionBuildList::AddFunction(PFunction *functype, FxExpression *c
 }
 
 
-void FFunctionBuildList::Build()
+//==========================================================================
+//
+// FFunctionBuildList :: EmitItem
+//
+// Resolves and emits one function. The builder is kept until FinishItem,
+// so that the code can be copied into other functions first.
+//
+//==========================================================================
+
+void FFunctionBuildList::EmitItem(Item &item)
 {
-	int errorcount = 0;
-	int codesize = 0;
-	FILE *dump = nullptr;
+	assert(item.Code != NULL);
 
-	if (Args->CheckParm("-dumpdisasm")) dump = fopen("disasm.txt", "w");
+	// We don't know the return type in advance for anonymous functions.
+	FCompileContext ctx(item.Func, item.Func->SymbolName == NAME_None ? nullptr : item.Func->Variants[0].Proto, item.FromDecorate, item.StateIndex, item.StateCount, item.Lump);
 
-	for (auto &item : mItems)
+	// Allocate registers for the function's arguments and create local variable nodes before starting to resolve it.
+	VMFunctionBuilder *buildit = new VMFunctionBuilder(item.Func->GetImplicitArgs());
+	for(unsigned i=0;i<item.Func->Variants[0].Proto->ArgumentTypes.Size();i++)
 	{
-		assert(item.Code != NULL);
+		auto type = item.Func->Variants[0].Proto->ArgumentTypes[i];
+		auto name = item.Func->Variants[0].ArgNames[i];
+		auto flags = item.Func->Variants[0].ArgFlags[i];
+		// this won't get resolved and won't get emitted. It is only needed so that the code generator can retrieve the necessary info about this argument to do its work.
+		auto local = new FxLocalVariableDeclaration(type, name, nullptr, flags, FScriptPosition());	
+		local->RegNum = buildit->Registers[type->GetRegType()].Get(type->GetRegCount());
+		ctx.FunctionArgs.Push(local);
+	}
+
+	FScriptPosition::StrictErrors = !item.FromDecorate;
+	ResolveTime.Clock();
+	item.Code = item.Code->Resolve(ctx);
+	ResolveTime.Unclock();
+	// If we need extra space, load the frame pointer into a register so that we do not have to call the wasteful LFP instruction more than once.
+	if (item.Function->ExtraSpace > 0)
+	{
+		buildit->FramePointer = ExpEmit(buildit, REGT_POINTER);
+		buildit->FramePointer.Fixed = true;
+		buildit->Emit(OP_LFP, buildit->FramePointer.RegNum);
+	}
 
-		// We don't know the return type in advance for anonymous functions.
-		FCompileContext ctx(item.Func, item.Func->SymbolName == NAME_None ? nullptr : item.Func->Variants[0].Proto, item.FromDecorate, item.StateIndex, item.StateCount, item.Lump);
+	// Make sure resolving it didn't obliterate it.
+	if (item.Code != nullptr)
+	{
+		if (!item.Code->CheckReturn())
+		{
+			auto newcmpd = new FxCompoundStatement(item.Code->ScriptPosition);
+			newcmpd->Add(item.Code);
+			newcmpd->Add(new FxReturnStatement(nullptr, item.Code->ScriptPosition));
+			item.Code = newcmpd->Resolve(ctx);
+		}
 
-		// Allocate registers for the function's arguments and create local variable nodes before starting to resolve it.
-		VMFunctionBuilder buildit(item.Func->GetImplicitArgs());
-		for(unsigned i=0;i<item.Func->Variants[0].Proto->ArgumentTypes.Size();i++)
+		item.Proto = ctx.ReturnProto;
+		if (item.Proto == nullptr)
 		{
-			auto type = item.Func->Variants[0].Proto->ArgumentTypes[i];
-			auto name = item.Func->Variants[0].ArgNames[i];
-			auto flags = item.Func->Variants[0].ArgFlags[i];
-			// this won't get resolved and won't get emitted. It is only needed so that the code generator can retrieve the necessary info about this argument to do its work.
-			auto local = new FxLocalVariableDeclaration(type, name, nullptr, flags, FScriptPosition());	
-			local->RegNum = buildit.Registers[type->GetRegType()].Get(type->GetRegCount());
-			ctx.FunctionArgs.Push(local);
+			item.Code->ScriptPosition.Message(MSG_ERROR, "Function %s without prototype", item.PrintableName.GetChars());
+			delete buildit;
+			return;
 		}
 
-		FScriptPosition::StrictErrors = !item.FromDecorate;
-		item.Code = item.Code->Resolve(ctx);
-		// If we need extra space, load the frame pointer into a register so that we do not have to call the wasteful LFP instruction more than once.
-		if (item.Function->ExtraSpace > 0)
+		// Generate prototype for anonymous functions.
+		VMScriptFunction *sfunc = item.Function;
+		// create a new prototype from the now known return type and the argument list of the function's template prototype.
+		if (sfunc->Proto == nullptr)
 		{
-			buildit.FramePointer = ExpEmit(&buildit, REGT_POINTER);
-			buildit.FramePointer.Fixed = true;
-			buildit.Emit(OP_LFP, buildit.FramePointer.RegNum);
+			sfunc->Proto = NewPrototype(item.Proto->ReturnTypes, item.Func->Variants[0].Proto->ArgumentTypes);
 		}
 
-		// Make sure resolving it didn't obliterate it.
-		if (item.Code != nullptr)
+		// Emit code
+		EmitTime.Clock();
+		try
 		{
-			if (!item.Code->CheckReturn())
+			sfunc->SourceFileName = item.Code->ScriptPosition.FileName;	// remember the file name for printing error messages if something goes wrong in the VM.
+			buildit->BeginStatement(item.Code);
+			item.Code->Emit(buildit);
+			buildit->EndStatement();
+			sfunc->NumArgs = 0;
+			// NumArgs for the VMFunction must be the amount of stack elements, which can differ from the amount of logical function arguments if vectors are in the list.
+			// For the VM a vector is 2 or 3 args, depending on size.
+			for (auto s : item.Func->Variants[0].Proto->ArgumentTypes)
 			{
-				auto newcmpd = new FxCompoundStatement(item.Code->ScriptPosition);
-				newcmpd->Add(item.Code);
-				newcmpd->Add(new FxReturnStatement(nullptr, item.Code->ScriptPosition));
-				item.Code = newcmpd->Resolve(ctx);
+				sfunc->NumArgs += s->GetRegCount();
 			}
+			sfunc->Unsafe = ctx.Unsafe;
+			item.Position = item.Code->ScriptPosition;
+			item.Builder = buildit;
+			buildit = nullptr;
+		}
+		catch (CRecoverableError &err)
+		{
+			// catch errors from the code generator and pring something meaningful.
+			item.Code->ScriptPosition.Message(MSG_ERROR, "%s in %s", err.GetMessage(), item.PrintableName.GetChars());
+		}
+		EmitTime.Unclock();
+	}
+	delete buildit;
+	delete item.Code;
+}
+
+//==========================================================================
+//
+// FFunctionBuildList :: AddInlineSource
+//
+// Lets calls to this function be replaced with its code, if it is small
+// and simple enough.
+//
+//==========================================================================
 
-			item.Proto = ctx.ReturnProto;
-			if (item.Proto == nullptr)
+void FFunctionBuildList::AddInlineSource(Item &item)
+{
+	int argregs[4] = { 0, 0, 0, 0 };
+	FInlineSource src;
+
+	for (auto type : item.Func->Variants[0].Proto->ArgumentTypes)
+	{
+		argregs[type->GetRegType()] += type->GetRegCount();
+	}
+	if (item.Builder->MakeInlineSource(src, argregs))
+	{
+		InlineSources[item.Function] = std::move(src);
+	}
+}
+
+//==========================================================================
+//
+// FFunctionBuildList :: OptimizeItems
+//
+// Optimizes every emitted function, on as many threads as there are
+// cores. A worker takes the next function in the list and only touches
+// that function's builder. Errors go into a list per worker and are only
+// put into their items once all workers are done, so that FinishItem can
+// report them in list order no matter which thread got to which function.
+//
+//==========================================================================
+
+void FFunctionBuildList::OptimizeItems()
+{
+	struct FWorker
+	{
+		std::thread Thread;
+		TArray<unsigned> ErrorItems;
+		TArray<FString> Errors;
+	};
+	std::atomic<unsigned> next(0);
+
+	auto work = [&](FWorker &worker)
+	{
+		unsigned i;
+		while ((i = next++) < mItems.Size())
+		{
+			if (mItems[i].Builder == nullptr)
 			{
-				item.Code->ScriptPosition.Message(MSG_ERROR, "Function %s without prototype", item.PrintableName.GetChars());
 				continue;
 			}
-
-			// Generate prototype for anonymous functions.
-			VMScriptFunction *sfunc = item.Function;
-			// create a new prototype from the now known return type and the argument list of the function's template prototype.
-			if (sfunc->Proto == nullptr)
+			try
 			{
-				sfunc->Proto = NewPrototype(item.Proto->ReturnTypes, item.Func->Variants[0].Proto->ArgumentTypes);
+				mItems[i].Builder->OptimizeCode();
 			}
-
-			// Emit code
-			try
+			catch (CDoomError &err)
 			{
-				sfunc->SourceFileName = item.Code->ScriptPosition.FileName;	// remember the file name for printing error messages if something goes wrong in the VM.
-				buildit.BeginStatement(item.Code);
-				item.Code->Emit(&buildit);
-				buildit.EndStatement();
-				buildit.MakeFunction(sfunc);
-				sfunc->NumArgs = 0;
-				// NumArgs for the VMFunction must be the amount of stack elements, which can differ from the amount of logical function arguments if vectors are in the list.
-				// For the VM a vector is 2 or 3 args, depending on size.
-				for (auto s : item.Func->Variants[0].Proto->ArgumentTypes)
-				{
-					sfunc->NumArgs += s->GetRegCount();
-				}
+				worker.ErrorItems.Push(i);
+				worker.Errors.Push(*err.GetMessage() ? err.GetMessage() : "Unknown error");
+			}
+		}
+	};
 
-				if (dump != nullptr)
-				{
-					DumpFunction(dump, sfunc, item.PrintableName.GetChars(), (int)item.PrintableName.Len());
-					codesize += sfunc->CodeSize;
-				}
-				sfunc->Unsafe = ctx.Unsafe;
+	int numthreads = std::thread::hardware_concurrency();
+	if (numthreads == 0)
+	{
+		numthreads = 4;
+	}
+	// Don't bother starting threads for the handful of functions DECORATE makes on its own.
+	numthreads = clamp<int>(mItems.Size() / 64, 1, numthreads);
+
+	// The main thread is the first worker.
+	std::vector<FWorker> workers(numthreads);
+	for (int i = 1; i < numthreads; i++)
+	{
+		FWorker *worker = &workers[i];
+		worker->Thread = std::thread([=]() { work(*worker); });
+	}
+	work(workers[0]);
+	for (int i = 1; i < numthreads; i++)
+	{
+		workers[i].Thread.join();
+	}
+	for (auto &worker : workers)
+	{
+		for (unsigned i = 0; i < worker.ErrorItems.Size(); i++)
+		{
+			mItems[worker.ErrorItems[i]].Error = worker.Errors[i];
+		}
+	}
+}
+
+//==========================================================================
+//
+// FFunctionBuildList :: FinishItem
+//
+// Copies the optimized code into the function.
+//
+//==========================================================================
+
+void FFunctionBuildList::FinishItem(Item &item, FILE *dump, int &codesize)
+{
+	VMScriptFunction *sfunc = item.Function;
+
+	if (item.Error.IsNotEmpty())
+	{
+		item.Position.Message(MSG_ERROR, "%s in %s", item.Error.GetChars(), item.PrintableName.GetChars());
+		delete item.Builder;
+		item.Builder = nullptr;
+		return;
+	}
+	EmitTime.Clock();
+	item.Builder->MakeFunction(sfunc);
+	EmitTime.Unclock();
+	delete item.Builder;
+	item.Builder = nullptr;
+
+	if (dump != nullptr)
+	{
+		DumpFunction(dump, sfunc, item.PrintableName.GetChars(), (int)item.PrintableName.Len());
+		codesize += sfunc->CodeSize;
+		fflush(dump);
+	}
+	NumBuilt++;
+	BuiltCodeSize += sfunc->CodeSize * 4;
+	NumRemovedOps += sfunc->RemovedOps;
+	NumInlinedCalls += sfunc->InlinedCalls;
+}
+
+//==========================================================================
+//
+// FFunctionBuildList :: Build
+//
+// Compiles every function that has been added. Each one is resolved and
+// emitted on its own, with nothing but its item and a builder of its own.
+// What they still share is global: the type and symbol tables, names,
+// string data and error reporting, which are not thread safe, so
+// resolving and emitting runs them one after another. All functions are
+// emitted before any is optimized, so that small ones can be inlined into
+// their callers no matter in which order they were declared. Inlining
+// copies string constants and also stays on this thread, the rest of the
+// optimizer runs on all cores, and the results are copied into the
+// functions in list order again.
+//
+//==========================================================================
+
+void FFunctionBuildList::Build()
+{
+	int codesize = 0;
+	FILE *dump = nullptr;
+
+	if (Args->CheckParm("-dumpdisasm")) dump = fopen("disasm.txt", "w");
+
+	NumBuilt = 0;
+	BuiltCodeSize = 0;
+	NumRemovedOps = 0;
+	NumInlinedCalls = 0;
+	ResolveTime.Reset();
+	EmitTime.Reset();
+	OptimizeTime.Reset();
+	for (auto &item : mItems)
+	{
+		EmitItem(item);
+	}
+	if (!Args->CheckParm("-noscriptopt"))
+	{
+		OptimizeTime.Clock();
+		for (auto &item : mItems)
+		{
+			if (item.Builder != nullptr)
+			{
+				AddInlineSource(item);
 			}
-			catch (CRecoverableError &err)
+		}
+		for (auto &item : mItems)
+		{
+			if (item.Builder != nullptr)
 			{
-				// catch errors from the code generator and pring something meaningful.
-				item.Code->ScriptPosition.Message(MSG_ERROR, "%s in %s", err.GetMessage(), item.PrintableName.GetChars());
+				item.Builder->InlineSources = &InlineSources;
+				item.Builder->OptimizeCalls();
 			}
 		}
-		delete item.Code;
-		if (dump != nullptr)
+		OptimizeItems();
+		OptimizeTime.Unclock();
+	}
+	for (auto &item : mItems)
+	{
+		if (item.Builder != nullptr)
 		{
-			fflush(dump);
+			FinishItem(item, dump, codesize);
 		}
 	}
+	InlineSources.Clear();
 	if (dump != nullptr)
 	{
 		fprintf(dump, "\n*************************************************************************\n%i code bytes\n", codesize * 4);
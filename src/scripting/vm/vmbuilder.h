@@ -2,6 +2,8 @@
 #define VMUTIL_H
 
 #include "dobject.h"
+#include "stats.h"
+#include "sc_man.h"
 
 class VMFunctionBuilder;
 class FxExpression;
@@ -20,6 +22,23 @@ struct ExpEmit
 	bool Konst, Fixed, Final, Target;
 };
 
+// The emitted code of a function small enough to be copied into the
+// functions that call it. See VMFunctionBuilder::MakeInlineSource.
+struct FInlineSource
+{
+	TArray<VMOP> Code;
+	TArray<int> IntConstants;
+	TArray<double> FloatConstants;
+	TArray<FString> StringConstants;
+	TArray<void *> AddressConstants;
+	TArray<VM_ATAG> AddressTags;
+	int NumRegs[4];
+	int NumArgs;
+};
+
+struct FRegSet;
+struct FKonstReg;
+
 class VMFunctionBuilder
 {
 public:
@@ -46,6 +65,11 @@ public:
 	void BeginStatement(FxExpression *stmt);
 	void EndStatement();
 	void MakeFunction(VMScriptFunction *func);
+	bool MakeInlineSource(FInlineSource &src, const int argregs[4]);
+
+	// MakeFunction does these if they have not been done yet.
+	void OptimizeCalls();
+	void OptimizeCode();
 
 	// Returns the constant register holding the value.
 	unsigned GetConstantInt(int val);
@@ -93,6 +117,9 @@ public:
 	// keep the frame pointer, if needed, in a register because the LFP opcode is hideously inefficient, requiring more than 20 instructions on x64.
 	ExpEmit FramePointer;
 
+	// Functions whose calls the optimizer may replace with their code.
+	TMap<VMFunction *, FInlineSource> *InlineSources = nullptr;
+
 private:
 	struct AddrKonst
 	{
@@ -117,6 +144,30 @@ private:
 	int MaxParam;
 	int ActiveParam;
 
+	// What the optimizer did, for the disassembly.
+	int NumEmitted = 0;
+	int NumRemoved = 0;
+	int NumInlined = 0;
+	int NumFolded = 0;
+	int NumCoalesced = 0;
+	bool Optimized = false;
+
+	int InlineCalls();
+	bool InlineCall(unsigned call, const FInlineSource &src);
+	bool RemapOp(VMOP &op, const int base[4], const FInlineSource &src);
+	bool CopyKonst(int mode, int index, const FInlineSource &src, unsigned limit, unsigned &newindex);
+	bool FindKonstInt(int val, unsigned limit, unsigned &index);
+	bool FindKonstFloat(double val, unsigned limit, unsigned &index);
+	bool KonstInt(int mode, int field, const FKonstReg *state, const FRegSet &pinned, int &val) const;
+	bool KonstFloat(int mode, int field, const FKonstReg *state, const FRegSet &pinned, double &val) const;
+	bool EvalKonst(const VMOP &op, const FKonstReg *state, const FRegSet &pinned, FKonstReg &val) const;
+	bool EvalSkip(const VMOP &op, const FKonstReg *state, const FRegSet &pinned, bool &skip) const;
+	void StepKonst(const VMOP &op, FKonstReg *state, const FRegSet &pinned) const;
+	bool RewriteKonst(VMOP &op, const FKonstReg *state, const FRegSet &pinned);
+	int PropagateConstants(const FRegSet &pinned);
+	int CoalesceMoves(const FRegSet &pinned);
+	void RemoveDeadCode(const FRegSet &pinned);
+
 	TArray<VMOP> Code;
 
 };
@@ -139,7 +190,10 @@ class FFunctionBuildList
 		FxExpression *Code = nullptr;
 		PPrototype *Proto = nullptr;
 		VMScriptFunction *Function = nullptr;
+		VMFunctionBuilder *Builder = nullptr;
+		FScriptPosition Position;
 		FString PrintableName;
+		FString Error;
 		int StateIndex;
 		int StateCount;
 		int Lump;
@@ -147,10 +201,25 @@ class FFunctionBuildList
 	};
 
 	TArray<Item> mItems;
+	TMap<VMFunction *, FInlineSource> InlineSources;
+
+	void EmitItem(Item &item);
+	void AddInlineSource(Item &item);
+	void OptimizeItems();
+	void FinishItem(Item &item, FILE *dump, int &codesize);
 
 public:
 	VMFunction *AddFunction(PFunction *func, FxExpression *code, const FString &name, bool fromdecorate, int currentstate, int statecnt, int lumpnum);
 	void Build();
+
+	// What the last Build produced, for the startup log.
+	int NumBuilt = 0;
+	int BuiltCodeSize = 0;
+	int NumRemovedOps = 0;
+	int NumInlinedCalls = 0;
+	cycle_t ResolveTime;
+	cycle_t EmitTime;
+	cycle_t OptimizeTime;
 };
 
 extern FFunctionBuildList FunctionBuildList;
@@ -34,6 +34,7 @@
 #include "dobject.h"
 #include "c_console.h"
 #include "templates.h"
+#include "c_dispatch.h"
 
 #define NOP		MODE_AUNUSED | MODE_BUNUSED | MODE_CUNUSED
 
@@ -642,11 +643,111 @@ static int print_reg(FILE *out, int col, int arg, int mode, int immshift, const
 void DumpFunction(FILE *dump, VMScriptFunction *sfunc, const char *label, int labellen)
 {
 	const char *marks = "=======================================================";
-	fprintf(dump, "\n%.*s %s %.*s", MAX(3, 38 - labellen / 2), marks, label, MAX(3, 38 - labellen / 2), marks);
-	fprintf(dump, "\nInteger regs: %-3d  Float regs: %-3d  Address regs: %-3d  String regs: %-3d\nStack size: %d\n",
+	printf_wrapper(dump, "\n%.*s %s %.*s", MAX(3, 38 - labellen / 2), marks, label, MAX(3, 38 - labellen / 2), marks);
+	printf_wrapper(dump, "\nInteger regs: %-3d  Float regs: %-3d  Address regs: %-3d  String regs: %-3d\nStack size: %d\n",
 		sfunc->NumRegD, sfunc->NumRegF, sfunc->NumRegA, sfunc->NumRegS, sfunc->MaxParam);
+	printf_wrapper(dump, "Code size: %d instructions (%d bytes), %d emitted\n",
+		sfunc->CodeSize, sfunc->CodeSize * (int)sizeof(VMOP), sfunc->EmittedOps);
+	printf_wrapper(dump, "Optimizer: %d calls inlined, %d instructions folded, %d moves coalesced, %d instructions removed\n",
+		sfunc->InlinedCalls, sfunc->FoldedOps, sfunc->CoalescedMoves, sfunc->RemovedOps);
 	VMDumpConstants(dump, sfunc);
-	fprintf(dump, "\nDisassembly @ %p:\n", sfunc->Code);
+	printf_wrapper(dump, "\nDisassembly @ %p:\n", sfunc->Code);
 	VMDisasm(dump, sfunc->Code, sfunc->CodeSize, sfunc);
 }
 
+//==========================================================================
+//
+// ListFunctionSizes
+//
+// Prints how large each of a class's script functions is, before and
+// after optimization.
+//
+//==========================================================================
+
+static int FuncNameCmp(const void *a, const void *b)
+{
+	return stricmp((*(PFunction **)a)->SymbolName.GetChars(), (*(PFunction **)b)->SymbolName.GetChars());
+}
+
+static void ListFunctionSizes(PClass *cls)
+{
+	TArray<PFunction *> funcs;
+	PSymbolTable::MapType::Iterator it = cls->Symbols.GetIterator();
+	PSymbolTable::MapType::Pair *pair;
+	int total = 0, emitted = 0;
+
+	while (it.NextPair(pair))
+	{
+		PFunction *func = dyn_cast<PFunction>(pair->Value);
+		if (func != NULL)
+		{
+			funcs.Push(func);
+		}
+	}
+	if (funcs.Size() > 1)
+	{
+		qsort(&funcs[0], funcs.Size(), sizeof(funcs[0]), FuncNameCmp);
+	}
+	Printf("%-32s %8s %8s %8s %8s\n", "Function", "Size", "Emitted", "Inlined", "Folded");
+	for (auto func : funcs)
+	{
+		for (auto &variant : func->Variants)
+		{
+			if (variant.Implementation == NULL || variant.Implementation->Native)
+			{
+				continue;
+			}
+			auto sfunc = static_cast<VMScriptFunction *>(variant.Implementation);
+			Printf("%-32s %8d %8d %8d %8d\n", func->SymbolName.GetChars(), sfunc->CodeSize,
+				sfunc->EmittedOps, sfunc->InlinedCalls, sfunc->FoldedOps);
+			total += sfunc->CodeSize;
+			emitted += sfunc->EmittedOps;
+		}
+	}
+	Printf("%d instructions (%d bytes) in %s, %d emitted\n", total, total * (int)sizeof(VMOP), cls->TypeName.GetChars(), emitted);
+}
+
+//==========================================================================
+//
+// CCMD vmdisasm
+//
+// Prints a script function's disassembly and code size to the console, or
+// the size of every script function of a class.
+//
+//==========================================================================
+
+CCMD(vmdisasm)
+{
+	if (argv.argc() < 2)
+	{
+		Printf("Usage: vmdisasm <class> [function]\n");
+		return;
+	}
+	PClass *cls = PClass::FindClass(argv[1]);
+	if (cls == NULL)
+	{
+		Printf("Unknown class '%s'\n", argv[1]);
+		return;
+	}
+	if (argv.argc() < 3)
+	{
+		ListFunctionSizes(cls);
+		return;
+	}
+	PFunction *func = dyn_cast<PFunction>(cls->Symbols.FindSymbol(FName(argv[2], true), true));
+	if (func == NULL)
+	{
+		Printf("'%s' has no function '%s'\n", argv[1], argv[2]);
+		return;
+	}
+	for (auto &variant : func->Variants)
+	{
+		if (variant.Implementation == NULL || variant.Implementation->Native)
+		{
+			Printf("%s.%s is native\n", argv[1], argv[2]);
+			continue;
+		}
+		FString label = variant.Implementation->PrintableName;
+		DumpFunction(NULL, static_cast<VMScriptFunction *>(variant.Implementation), label.GetChars(), (int)label.Len());
+	}
+}
@@ -53,12 +53,15 @@ void ThrowVMException(VMException *x);
 
 #if COMPGOTO
 #define OP(x)	x
-#define NEXTOP	do { pc++; unsigned op = pc->op; a = pc->a; goto *ops[op]; } while(0)
+#define NEXTOP	do { pc++; PROFILEOP; unsigned op = pc->op; a = pc->a; goto *ops[op]; } while(0)
 #else
 #define OP(x)	case OP_##x
 #define NEXTOP	pc++; break
 #endif
 
+// Only the profiled engine does anything for every instruction.
+#define PROFILEOP		((void)0)
+
 #define luai_nummod(a,b)        ((a) - floor((a)/(b))*(b))
 
 #define A				(pc[0].a)
@@ -135,6 +138,18 @@ struct VMExec_Unchecked
 {
 #include "vmexec.h"
 };
+
+#undef PROFILEOP
+#define PROFILEOP		(profile.Ops++, VMProfilePending.load(std::memory_order_relaxed) > 0 ? VMProfileSample() : (void)0)
+#define VM_PROFILE 1
+struct VMExec_Profiled
+{
+#include "vmexec.h"
+};
+#undef VM_PROFILE
+#undef PROFILEOP
+#define PROFILEOP		((void)0)
+
 #if !WAS_NDEBUG
 #undef NDEBUG
 #endif
@@ -181,6 +196,9 @@ void VMSelectEngine(EVMEngine engine)
 	case VMEngine_Checked:
 		VMExec = VMExec_Checked::Exec;
 		break;
+	case VMEngine_Profiled:
+		VMExec = VMExec_Profiled::Exec;
+		break;
 	}
 }
 
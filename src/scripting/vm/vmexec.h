@@ -40,6 +40,9 @@ static int Exec(VMFrameStack *stack, const VMOP *pc, VMReturn *ret, int numret)
 		konsta = NULL;
 		konstatag = NULL;
 	}
+#ifdef VM_PROFILE
+	VMProfileFrame profile(sfunc, &pc);
+#endif
 
 	void *ptr;
 	double fb, fc;
@@ -51,7 +54,7 @@ begin:
 	{
 #if !COMPGOTO
 	VM_UBYTE op;
-	for(;;) switch(op = pc->op, a = pc->a, op)
+	for(;;) switch(PROFILEOP, op = pc->op, a = pc->a, op)
 #else
 	pc--;
 	NEXTOP;
@@ -622,18 +625,21 @@ begin:
 			else
 			{
 				VMScriptFunction *script = static_cast<VMScriptFunction *>(call);
-				VMFrame *newf = stack->AllocFrame(script);
-				VMFillParams(reg.param + f->NumParam - B, newf, B);
-				try
-				{
-					numret = Exec(stack, script->Code, returns, C);
-				}
-				catch(...)
+				if (script->DirectNative == NULL || !VMDirectCalls || !script->CallDirect(reg.param + f->NumParam - B, B, returns, C, numret))
 				{
+					VMFrame *newf = stack->AllocFrame(script);
+					VMFillParams(reg.param + f->NumParam - B, newf, B);
+					try
+					{
+						numret = Exec(stack, script->Code, returns, C);
+					}
+					catch(...)
+					{
+						stack->PopFrame();
+						throw;
+					}
 					stack->PopFrame();
-					throw;
 				}
-				stack->PopFrame();
 			}
 			assert(numret == C && "Number of parameters returned differs from what was expected by the caller");
 			for (b = B; b != 0; --b)
@@ -676,6 +682,11 @@ begin:
 			else
 			{ // FIXME: Not a true tail call
 				VMScriptFunction *script = static_cast<VMScriptFunction *>(call);
+				int directret;
+				if (script->DirectNative != NULL && VMDirectCalls && script->CallDirect(reg.param + f->NumParam - B, B, ret, numret, directret))
+				{
+					return directret;
+				}
 				VMFrame *newf = stack->AllocFrame(script);
 				VMFillParams(reg.param + f->NumParam - B, newf, B);
 				try
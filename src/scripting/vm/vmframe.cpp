@@ -59,6 +59,13 @@ VMScriptFunction::VMScriptFunction(FName name)
 	LineInfoCount = 0;
 	ExtraSpace = 0;
 	CodeSize = 0;
+	EmittedOps = 0;
+	RemovedOps = 0;
+	InlinedCalls = 0;
+	FoldedOps = 0;
+	CoalescedMoves = 0;
+	DirectNative = NULL;
+	DirectTail = false;
 	NumRegD = 0;
 	NumRegF = 0;
 	NumRegS = 0;
@@ -221,6 +228,191 @@ int VMScriptFunction::PCToLine(const VMOP *pc)
 	return -1;
 }
 
+//===========================================================================
+//
+// VMScriptFunction :: FindDirectCall
+//
+// DECORATE creates a function like this for every action function call
+// with parameters: push self, stateowner and stateinfo, push some
+// constants, and tail call the native function. When the code is nothing
+// more than that, the parameter list is recorded here, so that CallDirect
+// can call the native function without setting up a frame and running
+// the code.
+//
+//===========================================================================
+
+#define MAX_DIRECT_ARGS 16
+
+bool VMDirectCalls = true;
+
+void VMScriptFunction::FindDirectCall()
+{
+	DirectNative = NULL;
+	DirectArgs.Clear();
+
+	if (CodeSize < 1 || CodeSize > MAX_DIRECT_ARGS + 2)
+	{
+		return;
+	}
+
+	int last = CodeSize - 1;
+	if (Code[last].op == OP_TAIL_K)
+	{
+		DirectTail = true;
+	}
+	else if (last > 0 && Code[last - 1].op == OP_CALL_K && Code[last - 1].c == 0 &&
+		Code[last].op == OP_RET && Code[last].a == RET_FINAL && Code[last].b == REGT_NIL)
+	{
+		DirectTail = false;
+		last--;
+	}
+	else
+	{
+		return;
+	}
+
+	// Every instruction before the call pushes one argument.
+	if (last > MAX_DIRECT_ARGS)
+	{
+		return;
+	}
+
+	const VMOP &call = Code[last];
+	if (KonstATags()[call.a] != ATAG_OBJECT || call.b != last)
+	{
+		return;
+	}
+	VMFunction *native = static_cast<VMFunction *>(KonstA[call.a].o);
+	if (native == NULL || !native->Native)
+	{
+		return;
+	}
+
+	DirectArgs.Resize(last);
+	for (int i = 0; i < last; i++)
+	{
+		const VMOP &op = Code[i];
+		DirectArg &arg = DirectArgs[i];
+
+		arg.RegType = REGT_NIL;
+		arg.RegNum = 0;
+		if (op.op == OP_PARAMI)
+		{
+			arg.Konst = op.i24;
+			continue;
+		}
+		if (op.op != OP_PARAM)
+		{
+			DirectArgs.Clear();
+			return;
+		}
+		switch (op.b)
+		{
+		case REGT_NIL:
+			arg.Konst = VMValue();
+			break;
+
+		case REGT_INT | REGT_KONST:
+			arg.Konst = KonstD[op.c];
+			break;
+
+		case REGT_FLOAT | REGT_KONST:
+			arg.Konst = KonstF[op.c];
+			break;
+
+		case REGT_STRING | REGT_KONST:
+			arg.Konst = KonstS[op.c];
+			break;
+
+		case REGT_POINTER | REGT_KONST:
+			arg.Konst = VMValue(KonstA[op.c].v, KonstATags()[op.c]);
+			break;
+
+		case REGT_INT:
+		case REGT_FLOAT:
+		case REGT_STRING:
+		case REGT_POINTER:
+			arg.RegType = op.b;
+			arg.RegNum = op.c;
+			break;
+
+		default:
+			// Vectors and addresses of registers.
+			DirectArgs.Clear();
+			return;
+		}
+	}
+	DirectNative = native;
+}
+
+//===========================================================================
+//
+// VMScriptFunction :: CallDirect
+//
+// Calls the native function found by FindDirectCall with this function's
+// arguments. Returns false if that cannot be done for this call, in which
+// case the function has to be run normally.
+//
+//===========================================================================
+
+bool VMScriptFunction::CallDirect(VMValue *params, int numparams, VMReturn *ret, int numret, int &numresults)
+{
+	VMValue args[MAX_DIRECT_ARGS];
+	unsigned count = DirectArgs.Size();
+
+	assert(count <= MAX_DIRECT_ARGS);
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		const DirectArg &arg = DirectArgs[i];
+		if (arg.RegType == REGT_NIL)
+		{
+			args[i] = arg.Konst;
+			continue;
+		}
+		// Find the argument VMFillParams would have put into this register.
+		int reg = 0, j;
+		for (j = 0; j < NumArgs; j++)
+		{
+			if (j >= numparams && j >= (int)DefaultArgs.Size())
+			{
+				return false;
+			}
+			const VMValue &p = j < numparams ? params[j] : DefaultArgs[j];
+			if (p.Type == arg.RegType && reg++ == arg.RegNum)
+			{
+				args[i] = p;
+				break;
+			}
+		}
+		if (j == NumArgs)
+		{
+			return false;
+		}
+	}
+
+	VMNativeFunction *native = static_cast<VMNativeFunction *>(DirectNative);
+	try
+	{
+		if (DirectTail)
+		{
+			numresults = native->NativeCall(args, native->DefaultArgs, count, ret, numret);
+		}
+		else
+		{
+			native->NativeCall(args, native->DefaultArgs, count, NULL, 0);
+			numresults = 0;
+		}
+	}
+	catch (CVMAbortException &err)
+	{
+		err.MaybePrintMessage();
+		err.stacktrace.AppendFormat("Called from %s\n", native->PrintableName.GetChars());
+		throw;
+	}
+	return true;
+}
+
 //===========================================================================
 //
 // VMFrame :: InitRegS
@@ -463,10 +655,16 @@ int VMFrameStack::Call(VMFunction *func, VMValue *params, int numparams, VMRetur
 		}
 		else
 		{
-			AllocFrame(static_cast<VMScriptFunction *>(func));
+			VMScriptFunction *script = static_cast<VMScriptFunction *>(func);
+			int numret;
+			if (script->DirectNative != NULL && VMDirectCalls && script->CallDirect(params, numparams, results, numresults, numret))
+			{
+				return numret;
+			}
+			AllocFrame(script);
 			allocated = true;
 			VMFillParams(params, TopFrame(), numparams);
-			int numret = VMExec(this, static_cast<VMScriptFunction *>(func)->Code, results, numresults);
+			numret = VMExec(this, script->Code, results, numresults);
 			PopFrame();
 			return numret;
 		}
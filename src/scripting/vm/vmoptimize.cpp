@@ -0,0 +1,1913 @@
+/*
+** vmoptimize.cpp
+** Improves the code the script compiler emits before it is copied into
+** the function
+**
+** Calls to small functions are replaced with a copy of their code,
+** registers that are known to hold a constant have their uses rewritten
+** to the constant, results that are only moved somewhere else are written
+** there directly, and code that can never run or whose results are never
+** used is removed. Register use is worked out per instruction, and values
+** are tracked from one basic block to the next.
+**
+*/
+
+#include <limits.h>
+#include <math.h>
+
+#include "templates.h"
+#include "vmbuilder.h"
+
+// Functions with more instructions than this are not copied into their callers.
+#define MAX_INLINE_SIZE		16
+
+// Stops a function made of nothing but small calls from growing too much.
+#define MAX_INLINE_CALLS	32
+
+//==========================================================================
+//
+// Constant forms
+//
+// For every instruction that reads two registers, the instruction that
+// reads a constant in place of B or C instead, as listed in vmops.h.
+//
+//==========================================================================
+
+#define xx(op, name, mode, alt, kreg, ktype) OP_##alt
+static const BYTE RegisterForm[NUM_OPS] =
+{
+#include "vmops.h"
+};
+
+static bool IsNumKonstMode(int mode)
+{
+	return mode == MODE_KI || mode == MODE_KF;
+}
+
+static struct FKonstForms
+{
+	BYTE B[NUM_OPS];
+	BYTE C[NUM_OPS];
+
+	FKonstForms()
+	{
+		memset(B, 0, sizeof(B));
+		memset(C, 0, sizeof(C));
+		for (int op = 0; op < NUM_OPS; op++)
+		{
+			int rop = RegisterForm[op];
+			if (rop == OP_NOP || rop == op)
+			{
+				continue;
+			}
+			// The kreg column is not reliable, so compare the operand modes.
+			int diff = OpInfo[op].Mode ^ OpInfo[rop].Mode;
+			if (diff != 0 && (diff & ~MODE_BTYPE) == 0 && IsNumKonstMode((OpInfo[op].Mode & MODE_BTYPE) >> MODE_BSHIFT))
+			{
+				B[rop] = op;
+			}
+			else if (diff != 0 && (diff & ~MODE_CTYPE) == 0 && IsNumKonstMode((OpInfo[op].Mode & MODE_CTYPE) >> MODE_CSHIFT))
+			{
+				C[rop] = op;
+			}
+		}
+	}
+} KonstForms;
+
+//==========================================================================
+//
+// Instruction properties
+//
+//==========================================================================
+
+// True for instructions that may skip the one following them.
+static bool IsSkipOp(const VMOP &op)
+{
+	return (OpInfo[op.op].Mode & MODE_ATYPE) == MODE_ACMP ||
+		op.op == OP_CMPS || op.op == OP_TEST || op.op == OP_TESTN || op.op == OP_CATCH;
+}
+
+// True for instructions that take their jump offset from the JMP that
+// follows them, so that JMP has to stay where and what it is.
+static bool IsCompareOp(const VMOP &op)
+{
+	return (OpInfo[op.op].Mode & MODE_ATYPE) == MODE_ACMP || op.op == OP_CMPS;
+}
+
+static bool IsFinalRet(const VMOP &op)
+{
+	return (op.op == OP_RET || op.op == OP_RETI) && (op.a & RET_FINAL);
+}
+
+// True for instructions after which the function does not go on.
+static bool IsEndOp(const VMOP &op)
+{
+	return IsFinalRet(op) || (op.op == OP_RET && op.b == REGT_NIL) ||
+		op.op == OP_TAIL || op.op == OP_TAIL_K || op.op == OP_THROW;
+}
+
+static bool IsNoOp(const VMOP &op)
+{
+	switch (op.op)
+	{
+	case OP_NOP:
+		return true;
+
+	case OP_JMP:
+		return op.i24 == 0;
+
+	case OP_MOVE:
+	case OP_MOVEF:
+	case OP_MOVES:
+	case OP_MOVEA:
+	case OP_MOVEV2:
+	case OP_MOVEV3:
+		return op.a == op.b;
+
+	default:
+		return false;
+	}
+}
+
+// True for instructions that do nothing but write their result register,
+// so they can go if nothing reads it. Loads from memory are not among them
+// because they throw on null pointers, nor is division because it throws
+// on zero.
+static bool IsPureOp(int op)
+{
+	switch (op)
+	{
+	case OP_LI:		case OP_LK:		case OP_LKF:	case OP_LKS:	case OP_LKP:
+	case OP_LK_R:	case OP_LKF_R:	case OP_LKS_R:	case OP_LKP_R:	case OP_LFP:
+	case OP_MOVE:	case OP_MOVEF:	case OP_MOVES:	case OP_MOVEA:	case OP_MOVEV2:	case OP_MOVEV3:
+	case OP_CAST:	case OP_CASTB:	case OP_CONCAT:	case OP_LENS:
+	case OP_SLL_RR:	case OP_SLL_RI:	case OP_SLL_KR:
+	case OP_SRL_RR:	case OP_SRL_RI:	case OP_SRL_KR:
+	case OP_SRA_RR:	case OP_SRA_RI:	case OP_SRA_KR:
+	case OP_ADD_RR:	case OP_ADD_RK:	case OP_ADDI:
+	case OP_SUB_RR:	case OP_SUB_RK:	case OP_SUB_KR:
+	case OP_MUL_RR:	case OP_MUL_RK:
+	case OP_AND_RR:	case OP_AND_RK:	case OP_OR_RR:	case OP_OR_RK:	case OP_XOR_RR:	case OP_XOR_RK:
+	case OP_MIN_RR:	case OP_MIN_RK:	case OP_MAX_RR:	case OP_MAX_RK:
+	case OP_ABS:	case OP_NEG:	case OP_NOT:	case OP_SEXT:
+	case OP_ZAP_R:	case OP_ZAP_I:	case OP_ZAPNOT_R:	case OP_ZAPNOT_I:
+	case OP_ADDF_RR:	case OP_ADDF_RK:
+	case OP_SUBF_RR:	case OP_SUBF_RK:	case OP_SUBF_KR:
+	case OP_MULF_RR:	case OP_MULF_RK:
+	case OP_POWF_RR:	case OP_POWF_RK:	case OP_POWF_KR:
+	case OP_MINF_RR:	case OP_MINF_RK:	case OP_MAXF_RR:	case OP_MAXF_RK:
+	case OP_ATAN2:	case OP_FLOP:
+	case OP_NEGV2:	case OP_ADDV2_RR:	case OP_SUBV2_RR:	case OP_DOTV2_RR:
+	case OP_MULVF2_RR:	case OP_MULVF2_RK:	case OP_LENV2:
+	case OP_NEGV3:	case OP_ADDV3_RR:	case OP_SUBV3_RR:	case OP_DOTV3_RR:	case OP_CROSSV_RR:
+	case OP_MULVF3_RR:	case OP_MULVF3_RK:	case OP_LENV3:
+	case OP_ADDA_RR:	case OP_ADDA_RK:	case OP_SUBA:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// Operations whose two operands may be swapped.
+static bool IsCommutative(int op)
+{
+	switch (op)
+	{
+	case OP_ADD_RR:	case OP_MUL_RR:	case OP_AND_RR:	case OP_OR_RR:	case OP_XOR_RR:
+	case OP_MIN_RR:	case OP_MAX_RR:	case OP_ADDF_RR:	case OP_MULF_RR:
+	case OP_EQ_R:	case OP_EQF_R:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+// Pointer instructions that set the tag of the register they write. The
+// others leave it alone, so MOVEA's copy of the tag cannot be skipped.
+static bool WritesAtag(int op)
+{
+	switch (op)
+	{
+	case OP_LKP:	case OP_LKP_R:	case OP_LFP:	case OP_META:
+	case OP_LO:		case OP_LO_R:	case OP_LP:		case OP_LP_R:
+	case OP_MOVEA:	case OP_DYNCAST_R:	case OP_DYNCAST_K:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static VMOP MakeOp(int opcode, int a, int b, int c)
+{
+	VMOP op;
+	op.op = opcode;
+	op.a = a;
+	op.b = b;
+	op.c = c;
+	return op;
+}
+
+static VMOP MakeOpBC(int opcode, int a, int bc)
+{
+	VMOP op;
+	op.op = opcode;
+	op.a = a;
+	op.i16u = bc;
+	return op;
+}
+
+static VMOP MakeJump(int offset)
+{
+	VMOP op;
+	op.op = OP_JMP;
+	op.i24 = offset;
+	return op;
+}
+
+static int RegCount(int regtype)
+{
+	return (regtype & REGT_MULTIREG3) ? 3 : (regtype & REGT_MULTIREG2) ? 2 : 1;
+}
+
+//==========================================================================
+//
+// FOpRegs
+//
+// The registers one instruction reads and writes. A range is a register
+// type, the first register and how many registers it covers.
+//
+//==========================================================================
+
+struct FRegRange
+{
+	int Type, Num, Count;
+};
+
+struct FOpRegs
+{
+	FRegRange Def;			// Count is 0 if nothing is written
+	FRegRange Uses[3];
+	int NumUses;
+	bool Known;				// false if the operands could not be worked out
+};
+
+static bool ModeRegType(int mode, int &type)
+{
+	switch (mode)
+	{
+	case MODE_I:	type = REGT_INT;		return true;
+	case MODE_F:
+	case MODE_V:	type = REGT_FLOAT;		return true;
+	case MODE_S:	type = REGT_STRING;		return true;
+	case MODE_P:	type = REGT_POINTER;	return true;
+	default:		return false;
+	}
+}
+
+static int VectorSize(int op)
+{
+	switch (op)
+	{
+	case OP_LV2:	case OP_LV2_R:	case OP_SV2:	case OP_SV2_R:	case OP_MOVEV2:
+	case OP_NEGV2:	case OP_ADDV2_RR:	case OP_SUBV2_RR:	case OP_DOTV2_RR:
+	case OP_MULVF2_RR:	case OP_MULVF2_RK:	case OP_DIVVF2_RR:	case OP_DIVVF2_RK:
+	case OP_LENV2:	case OP_EQV2_R:	case OP_EQV2_K:
+		return 2;
+
+	default:
+		return 3;
+	}
+}
+
+// The register types a CAST converts between.
+static bool CastTypes(int cast, int &to, int &from, int &fromcount)
+{
+	fromcount = 1;
+	switch (cast)
+	{
+	case CAST_I2F: case CAST_U2F:
+		to = REGT_FLOAT; from = REGT_INT; return true;
+	case CAST_F2I: case CAST_F2U:
+		to = REGT_INT; from = REGT_FLOAT; return true;
+	case CAST_I2S: case CAST_U2S: case CAST_N2S: case CAST_Co2S: case CAST_So2S: case CAST_SID2S: case CAST_TID2S:
+		to = REGT_STRING; from = REGT_INT; return true;
+	case CAST_F2S:
+		to = REGT_STRING; from = REGT_FLOAT; return true;
+	case CAST_V22S:
+		to = REGT_STRING; from = REGT_FLOAT; fromcount = 2; return true;
+	case CAST_V32S:
+		to = REGT_STRING; from = REGT_FLOAT; fromcount = 3; return true;
+	case CAST_P2S:
+		to = REGT_STRING; from = REGT_POINTER; return true;
+	case CAST_S2I: case CAST_S2N: case CAST_S2Co: case CAST_S2So:
+		to = REGT_INT; from = REGT_STRING; return true;
+	case CAST_S2F:
+		to = REGT_FLOAT; from = REGT_STRING; return true;
+	default:
+		return false;
+	}
+}
+
+static bool CastBTypes(int cast, int &to, int &from, int &fromcount)
+{
+	to = REGT_INT;
+	fromcount = 1;
+	from = cast == CASTB_I ? REGT_INT : cast == CASTB_F ? REGT_FLOAT : cast == CASTB_A ? REGT_POINTER : REGT_STRING;
+	return true;
+}
+
+static void AddUse(FOpRegs &regs, int type, int num, int count)
+{
+	FRegRange &use = regs.Uses[regs.NumUses++];
+	use.Type = type;
+	use.Num = num;
+	use.Count = count;
+}
+
+static void SetDef(FOpRegs &regs, int type, int num, int count)
+{
+	regs.Def.Type = type;
+	regs.Def.Num = num;
+	regs.Def.Count = count;
+}
+
+static void GetOpRegs(const VMOP &code, FOpRegs &regs)
+{
+	int op = code.op;
+	int mode = OpInfo[op].Mode;
+	int amode = (mode & MODE_ATYPE) >> MODE_ASHIFT;
+	int bmode = (mode & MODE_BTYPE) >> MODE_BSHIFT;
+	int cmode = (mode & MODE_CTYPE) >> MODE_CSHIFT;
+	int type, to, from, count;
+
+	regs.Def.Count = 0;
+	regs.NumUses = 0;
+	regs.Known = true;
+
+	switch (op)
+	{
+	case OP_CAST:
+	case OP_CASTB:
+		if (!(op == OP_CAST ? CastTypes(code.c, to, from, count) : CastBTypes(code.c, to, from, count)))
+		{
+			regs.Known = false;
+			return;
+		}
+		SetDef(regs, to, code.a, 1);
+		AddUse(regs, from, code.b, count);
+		return;
+
+	case OP_CMPS:
+		if (!(code.a & CMP_BK)) AddUse(regs, REGT_STRING, code.b, 1);
+		if (!(code.a & CMP_CK)) AddUse(regs, REGT_STRING, code.c, 1);
+		return;
+
+	case OP_PARAM:
+	case OP_RET:
+		if (code.b != REGT_NIL && !(code.b & REGT_KONST))
+		{
+			AddUse(regs, code.b & REGT_TYPE, code.c, RegCount(code.b));
+		}
+		return;
+
+	case OP_RESULT:
+		SetDef(regs, code.b & REGT_TYPE, code.c, RegCount(code.b));
+		return;
+
+	case OP_RETI:
+		// Its mode does not mark B and C as one field.
+		return;
+
+	case OP_IJMP:
+	case OP_TRY:
+	case OP_UNTRY:
+	case OP_THROW:
+	case OP_CATCH:
+		regs.Known = false;
+		return;
+	}
+
+	if (amode == MODE_X || bmode == MODE_X || cmode == MODE_X)
+	{
+		regs.Known = false;
+		return;
+	}
+	if (ModeRegType(amode, type))
+	{
+		count = amode == MODE_V ? VectorSize(op) : 1;
+		if ((op >= OP_SB && op <= OP_SBIT) || op == OP_TEST || op == OP_TESTN || op == OP_CALL || op == OP_TAIL ||
+			op == OP_BOUND || op == OP_BOUND_K || op == OP_BOUND_R)
+		{
+			AddUse(regs, type, code.a, count);
+		}
+		else
+		{
+			// The dot products are listed as vectors but write a single float.
+			SetDef(regs, type, code.a, (op == OP_DOTV2_RR || op == OP_DOTV3_RR) ? 1 : count);
+		}
+	}
+	if (ModeRegType(bmode, type))
+	{
+		AddUse(regs, type, code.b, bmode == MODE_V ? VectorSize(op) : 1);
+	}
+	if (ModeRegType(cmode, type))
+	{
+		AddUse(regs, type, code.c, cmode == MODE_V ? VectorSize(op) : 1);
+	}
+	if (op == OP_MOVEV2 || op == OP_MOVEV3)
+	{
+		regs.Def.Count = regs.Uses[0].Count = VectorSize(op);
+	}
+}
+
+static bool UsesReg(const FOpRegs &regs, int type, int reg)
+{
+	for (int i = 0; i < regs.NumUses; i++)
+	{
+		const FRegRange &use = regs.Uses[i];
+		if (use.Type == type && reg >= use.Num && reg < use.Num + use.Count)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool DefinesReg(const FOpRegs &regs, int type, int reg)
+{
+	return regs.Def.Type == type && reg >= regs.Def.Num && reg < regs.Def.Num + regs.Def.Count;
+}
+
+//==========================================================================
+//
+// FRegSet
+//
+// One bit for every register of every type.
+//
+//==========================================================================
+
+struct FRegSet
+{
+	VM_UWORD Bits[4 * 256 / 32];
+
+	void Clear()
+	{
+		memset(Bits, 0, sizeof(Bits));
+	}
+	void Fill()
+	{
+		memset(Bits, 0xFF, sizeof(Bits));
+	}
+	bool Test(int type, int reg) const
+	{
+		int bit = type * 256 + reg;
+		return reg < 256 && !!(Bits[bit >> 5] & (1u << (bit & 31)));
+	}
+	void Set(int type, int reg)
+	{
+		int bit = type * 256 + reg;
+		if (reg < 256) Bits[bit >> 5] |= 1u << (bit & 31);
+	}
+	void Reset(int type, int reg)
+	{
+		int bit = type * 256 + reg;
+		if (reg < 256) Bits[bit >> 5] &= ~(1u << (bit & 31));
+	}
+	bool TestRange(const FRegRange &range) const
+	{
+		for (int i = 0; i < range.Count; i++)
+		{
+			if (Test(range.Type, range.Num + i)) return true;
+		}
+		return false;
+	}
+	void SetRange(const FRegRange &range)
+	{
+		for (int i = 0; i < range.Count; i++) Set(range.Type, range.Num + i);
+	}
+	void ResetRange(const FRegRange &range)
+	{
+		for (int i = 0; i < range.Count; i++) Reset(range.Type, range.Num + i);
+	}
+	void Merge(const FRegSet &other)
+	{
+		for (int i = 0; i < 4 * 256 / 32; i++) Bits[i] |= other.Bits[i];
+	}
+	bool operator==(const FRegSet &other) const
+	{
+		return memcmp(Bits, other.Bits, sizeof(Bits)) == 0;
+	}
+};
+
+//==========================================================================
+//
+// Control flow
+//
+//==========================================================================
+
+// Returns how many instructions may run after this one, which may point
+// past the end of the code for broken functions.
+static int GetSuccessors(const TArray<VMOP> &code, unsigned i, unsigned succ[2])
+{
+	const VMOP &op = code[i];
+	if (op.op == OP_JMP)
+	{
+		succ[0] = i + 1 + op.i24;
+		return 1;
+	}
+	if (IsEndOp(op))
+	{
+		return 0;
+	}
+	succ[0] = i + 1;
+	if (IsSkipOp(op))
+	{
+		succ[1] = i + 2;
+		return 2;
+	}
+	return 1;
+}
+
+// Marks the first instruction of each basic block, and the end of the code.
+static void FindLeaders(const TArray<VMOP> &code, TArray<bool> &leader)
+{
+	unsigned count = code.Size();
+	unsigned succ[2];
+
+	leader.Resize(count + 1);
+	for (unsigned i = 0; i <= count; i++)
+	{
+		leader[i] = i == 0 || i == count;
+	}
+	for (unsigned i = 0; i < count; i++)
+	{
+		int num = GetSuccessors(code, i, succ);
+		if (code[i].op == OP_JMP || num != 1)
+		{
+			leader[i + 1] = true;
+			for (int s = 0; s < num; s++)
+			{
+				if (succ[s] <= count) leader[succ[s]] = true;
+			}
+		}
+	}
+}
+
+// Works out which registers may still be read after each instruction.
+// Pinned registers are always live.
+static void ComputeLiveness(const TArray<VMOP> &code, const FRegSet &pinned, TArray<FRegSet> &livein, TArray<FRegSet> &liveout)
+{
+	unsigned count = code.Size();
+	unsigned succ[2];
+	FOpRegs regs;
+	FRegSet in, out;
+	bool changed = true;
+
+	livein.Resize(count);
+	liveout.Resize(count);
+	for (unsigned i = 0; i < count; i++)
+	{
+		livein[i].Clear();
+		liveout[i].Clear();
+	}
+	while (changed)
+	{
+		changed = false;
+		for (unsigned i = count; i-- > 0; )
+		{
+			out = pinned;
+			int num = GetSuccessors(code, i, succ);
+			for (int s = 0; s < num; s++)
+			{
+				if (succ[s] < count) out.Merge(livein[succ[s]]);
+			}
+			in = out;
+			GetOpRegs(code[i], regs);
+			if (!regs.Known)
+			{
+				in.Fill();
+			}
+			else
+			{
+				if (regs.Def.Count > 0) in.ResetRange(regs.Def);
+				for (int u = 0; u < regs.NumUses; u++) in.SetRange(regs.Uses[u]);
+			}
+			liveout[i] = out;
+			if (!(in == livein[i]))
+			{
+				livein[i] = in;
+				changed = true;
+			}
+		}
+	}
+}
+
+// Registers whose address is passed to a function can change behind the
+// optimizer's back. Returns false if some instruction's registers cannot
+// be worked out, which turns off everything that needs them.
+static bool FindPinnedRegisters(const TArray<VMOP> &code, FRegSet &pinned)
+{
+	FOpRegs regs;
+
+	pinned.Clear();
+	for (auto &op : code)
+	{
+		GetOpRegs(op, regs);
+		if (!regs.Known)
+		{
+			return false;
+		}
+		if (op.op == OP_PARAM && op.b != REGT_NIL && (op.b & REGT_ADDROF))
+		{
+			FRegRange range = { op.b & REGT_TYPE, op.c, RegCount(op.b) };
+			pinned.SetRange(range);
+		}
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: MakeInlineSource
+//
+// Keeps a copy of the emitted code if this function can be copied into
+// its callers: it has to be short, must not call anything or need a frame
+// of its own, and must return at most one value. It also may not read a
+// register other than its arguments before writing it, because a call
+// would start it with fresh registers. argregs is how many registers of
+// each type the arguments take.
+//
+//==========================================================================
+
+bool VMFunctionBuilder::MakeInlineSource(FInlineSource &src, const int argregs[4])
+{
+	TArray<FRegSet> livein, liveout;
+	FRegSet none;
+	FOpRegs regs;
+
+	if (Code.Size() == 0 || Code.Size() > MAX_INLINE_SIZE)
+	{
+		return false;
+	}
+	for (auto &op : Code)
+	{
+		switch (op.op)
+		{
+		case OP_PARAM:	case OP_PARAMI:	case OP_CALL:	case OP_CALL_K:	case OP_TAIL:	case OP_TAIL_K:
+		case OP_RESULT:	case OP_LFP:	case OP_LK_R:	case OP_LKF_R:	case OP_LKS_R:	case OP_LKP_R:
+			return false;
+
+		case OP_RET:
+		case OP_RETI:
+			if (op.a != RET_FINAL)
+			{
+				return false;
+			}
+			break;
+		}
+		GetOpRegs(op, regs);
+		if (!regs.Known)
+		{
+			return false;
+		}
+	}
+
+	none.Clear();
+	ComputeLiveness(Code, none, livein, liveout);
+	for (int type = 0; type < 4; type++)
+	{
+		for (int reg = argregs[type]; reg < 256; reg++)
+		{
+			if (livein[0].Test(type, reg)) return false;
+		}
+	}
+
+	src.Code = Code;
+	src.IntConstants = IntConstantList;
+	src.FloatConstants = FloatConstantList;
+	src.AddressConstants = AddressConstantList;
+	src.AddressTags = AtagConstantList;
+	src.StringConstants.Clear();
+	for (auto &str : StringConstantList)
+	{
+		src.StringConstants.Push(FString(str.GetChars(), str.Len()));
+	}
+	src.NumArgs = 0;
+	for (int type = 0; type < 4; type++)
+	{
+		src.NumRegs[type] = Registers[type].MostUsed;
+		src.NumArgs += argregs[type];
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: CopyKonst
+//
+// Gets a constant of the inlined function into this one. Fails if its
+// index would not fit in the field it goes in.
+//
+//==========================================================================
+
+bool VMFunctionBuilder::CopyKonst(int mode, int index, const FInlineSource &src, unsigned limit, unsigned &newindex)
+{
+	switch (mode)
+	{
+	case MODE_KI:
+		newindex = GetConstantInt(src.IntConstants[index]);
+		break;
+
+	case MODE_KF:
+		newindex = GetConstantFloat(src.FloatConstants[index]);
+		break;
+
+	case MODE_KS:
+		newindex = GetConstantString(src.StringConstants[index]);
+		break;
+
+	case MODE_KP:
+	{
+		void *ptr = src.AddressConstants[index];
+		VM_ATAG tag = ptr == NULL ? VM_ATAG(ATAG_GENERIC) : src.AddressTags[index];
+		AddrKonst *locp = AddressConstantMap.CheckKey(ptr);
+		if (locp != NULL && locp->Tag != tag)
+		{
+			return false;
+		}
+		newindex = GetConstantAddress(ptr, tag);
+		break;
+	}
+
+	default:
+		return false;
+	}
+	return newindex <= limit;
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: RemapOp
+//
+// Moves an instruction of the inlined function into the registers set
+// aside for it and points it at this function's constants.
+//
+//==========================================================================
+
+bool VMFunctionBuilder::RemapOp(VMOP &op, const int base[4], const FInlineSource &src)
+{
+	int mode = OpInfo[op.op].Mode;
+	int fields[3] = { (mode & MODE_ATYPE) >> MODE_ASHIFT, (mode & MODE_BTYPE) >> MODE_BSHIFT, (mode & MODE_CTYPE) >> MODE_CSHIFT };
+	int bcmode = (mode & MODE_BCTYPE) >> MODE_BCSHIFT;
+	int types[3] = { -1, -1, -1 };
+	int to, from, count, type;
+	unsigned k;
+
+	if (op.op == OP_CAST || op.op == OP_CASTB)
+	{
+		if (!(op.op == OP_CAST ? CastTypes(op.c, to, from, count) : CastBTypes(op.c, to, from, count)))
+		{
+			return false;
+		}
+		types[0] = to;
+		types[1] = from;
+		fields[2] = MODE_IMMZ;
+	}
+	else if (op.op == OP_CMPS)
+	{
+		fields[1] = (op.a & CMP_BK) ? MODE_KS : MODE_S;
+		fields[2] = (op.a & CMP_CK) ? MODE_KS : MODE_S;
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		int value = i == 0 ? op.a : i == 1 ? op.b : op.c;
+		if (types[i] >= 0 || ModeRegType(fields[i], type))
+		{
+			if (types[i] >= 0) type = types[i];
+			value += base[type];
+			if (value > 255) return false;
+		}
+		else if (fields[i] >= MODE_KI && fields[i] <= MODE_KV)
+		{
+			if (!CopyKonst(fields[i], value, src, 255, k)) return false;
+			value = k;
+		}
+		else
+		{
+			continue;
+		}
+		if (i == 0) op.a = value;
+		else if (i == 1) op.b = value;
+		else op.c = value;
+	}
+	if (bcmode >= MODE_KI && bcmode <= MODE_KV)
+	{
+		if (!CopyKonst(bcmode, op.i16u, src, 65535, k)) return false;
+		op.i16u = k;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: InlineCall
+//
+// Replaces the CALL_K at index call with a copy of the function it calls.
+// Each PARAM becomes a move into the register the argument would have
+// been in, using registers above all the ones this function has, and each
+// return becomes a move into the register of the RESULT and a jump past
+// the copy.
+//
+//==========================================================================
+
+bool VMFunctionBuilder::InlineCall(unsigned call, const FInlineSource &src)
+{
+	static const BYTE moveops[4] = { OP_MOVE, OP_MOVEF, OP_MOVES, OP_MOVEA };
+	static const BYTE loadops[4] = { OP_LK, OP_LKF, OP_LKS, OP_LKP };
+	static const BYTE konstmodes[4] = { MODE_KI, MODE_KF, MODE_KS, MODE_KP };
+	VMOP callop = Code[call];
+	int numret = callop.c;
+	unsigned count = Code.Size();
+	TArray<unsigned> params;
+	TArray<VMOP> moves, body, code;
+	TArray<unsigned> bodyindex, jumps, exits;
+	VMOP result;
+	int base[4], next[4] = { 0, 0, 0, 0 };
+	unsigned k;
+
+	if (callop.b != src.NumArgs || numret > 1 || call + numret >= count)
+	{
+		return false;
+	}
+	if (numret == 1)
+	{
+		result = Code[call + 1];
+		if (result.op != OP_RESULT || result.b == REGT_NIL) return false;
+	}
+	for (int type = 0; type < 4; type++)
+	{
+		base[type] = Registers[type].MostUsed;
+		if (base[type] + src.NumRegs[type] > 255) return false;
+	}
+
+	// Find the PARAMs that belong to this call, going backwards. Calls made
+	// to work out an argument take their own PARAMs off the stack first.
+	int want = callop.b, nested = 0;
+	unsigned first = call;
+	while (want > 0)
+	{
+		if (first == 0) return false;
+		const VMOP &op = Code[--first];
+		if (op.op == OP_CALL || op.op == OP_CALL_K)
+		{
+			nested += op.b;
+		}
+		else if (op.op == OP_PARAM || op.op == OP_PARAMI)
+		{
+			int entries = op.op == OP_PARAM && op.b != REGT_NIL ? RegCount(op.b) : 1;
+			if (nested > 0)
+			{
+				nested -= entries;
+			}
+			else
+			{
+				want -= entries;
+				params.Push(first);
+			}
+		}
+		else if (op.op == OP_JMP || IsSkipOp(op) || IsEndOp(op))
+		{
+			return false;
+		}
+	}
+	if (want != 0 || nested != 0 || (first > 0 && IsSkipOp(Code[first - 1])))
+	{
+		return false;
+	}
+	// Nothing may jump into the middle of the arguments.
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (Code[i].op == OP_JMP)
+		{
+			unsigned target = i + 1 + Code[i].i24;
+			if (target > first && target <= call + numret) return false;
+		}
+	}
+
+	// Turn the PARAMs into moves, in argument order.
+	for (unsigned p = params.Size(); p-- > 0; )
+	{
+		VMOP op = Code[params[p]];
+		if (op.op == OP_PARAMI)
+		{
+			int reg = base[REGT_INT] + next[REGT_INT]++;
+			if (op.i24 >= -32768 && op.i24 <= 32767)
+			{
+				moves.Push(MakeOpBC(OP_LI, reg, 0));
+				moves.Last().i16 = op.i24;
+			}
+			else
+			{
+				moves.Push(MakeOpBC(OP_LK, reg, GetConstantInt(op.i24)));
+			}
+			continue;
+		}
+		if (op.b == REGT_NIL || (op.b & REGT_ADDROF))
+		{
+			return false;
+		}
+		int type = op.b & REGT_TYPE;
+		int regs = RegCount(op.b);
+		int reg = base[type] + next[type];
+		next[type] += regs;
+		if (op.b & REGT_KONST)
+		{
+			if (regs > 1) return false;
+			moves.Push(MakeOpBC(loadops[type], reg, op.c));
+		}
+		else if (regs > 1)
+		{
+			moves.Push(MakeOp(regs == 2 ? OP_MOVEV2 : OP_MOVEV3, reg, op.c, 0));
+		}
+		else
+		{
+			moves.Push(MakeOp(moveops[type], reg, op.c, 0));
+		}
+	}
+	for (int type = 0; type < 4; type++)
+	{
+		if (next[type] > src.NumRegs[type]) return false;
+	}
+
+	// Copy the body.
+	unsigned srccount = src.Code.Size();
+	for (unsigned i = 0; i < srccount; i++)
+	{
+		VMOP op = src.Code[i];
+		bodyindex.Push(body.Size());
+		if (op.op == OP_RET || op.op == OP_RETI)
+		{
+			if (numret == 1)
+			{
+				int dest = result.c;
+				if (op.op == OP_RETI)
+				{
+					if (result.b != REGT_INT) return false;
+					body.Push(MakeOpBC(OP_LI, dest, 0));
+					body.Last().i16 = op.i16;
+				}
+				else if (op.b == REGT_NIL || (op.b & ~REGT_KONST) != result.b)
+				{
+					return false;
+				}
+				else if (op.b & REGT_KONST)
+				{
+					int type = op.b & REGT_TYPE;
+					if ((op.b & REGT_MULTIREG) || !CopyKonst(konstmodes[type], op.c, src, 65535, k)) return false;
+					body.Push(MakeOpBC(loadops[type], dest, k));
+				}
+				else
+				{
+					int type = op.b & REGT_TYPE;
+					int regs = RegCount(op.b);
+					body.Push(MakeOp(regs == 3 ? int(OP_MOVEV3) : regs == 2 ? int(OP_MOVEV2) : int(moveops[type]), dest, op.c + base[type], 0));
+				}
+			}
+			if (i < srccount - 1)
+			{
+				exits.Push(body.Size());
+				body.Push(MakeJump(0));
+			}
+			continue;
+		}
+		if (op.op == OP_JMP)
+		{
+			// Fixed below, once the body's layout is known.
+			jumps.Push(body.Size());
+			jumps.Push(i + 1 + op.i24);
+			body.Push(op);
+			continue;
+		}
+		if (!RemapOp(op, base, src))
+		{
+			return false;
+		}
+		body.Push(op);
+	}
+	bodyindex.Push(body.Size());
+	for (unsigned i = 0; i < jumps.Size(); i += 2)
+	{
+		if (jumps[i + 1] > srccount) return false;
+		body[jumps[i]].i24 = int(bodyindex[jumps[i + 1]] - jumps[i] - 1);
+	}
+	for (auto exit : exits)
+	{
+		body[exit].i24 = int(body.Size() - exit - 1);
+	}
+
+	int delta = int(body.Size()) - 1 - numret;
+	if (count + delta >= 65535)
+	{
+		return false;
+	}
+
+	// Put it all together. Jumps and line numbers past the call move along.
+	auto newindex = [=](unsigned i) { return i <= call ? i : i + delta; };
+	for (unsigned p = 0; p < params.Size(); p++)
+	{
+		Code[params[p]] = moves[params.Size() - 1 - p];
+	}
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (i == call)
+		{
+			for (auto &op : body) code.Push(op);
+			i += numret;
+			continue;
+		}
+		VMOP op = Code[i];
+		if (op.op == OP_JMP)
+		{
+			op.i24 = int(newindex(i + 1 + op.i24) - newindex(i) - 1);
+		}
+		code.Push(op);
+	}
+	Code = std::move(code);
+	for (auto &line : LineNumbers)
+	{
+		line.InstructionIndex = (uint16_t)newindex(line.InstructionIndex);
+	}
+	for (int type = 0; type < 4; type++)
+	{
+		Registers[type].MostUsed = base[type] + src.NumRegs[type];
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: InlineCalls
+//
+// Returns the number of calls that were replaced.
+//
+//==========================================================================
+
+int VMFunctionBuilder::InlineCalls()
+{
+	int inlined = 0;
+
+	if (InlineSources == nullptr || InlineSources->CountUsed() == 0)
+	{
+		return 0;
+	}
+	for (unsigned i = 0; i < Code.Size() && inlined < MAX_INLINE_CALLS; i++)
+	{
+		if (Code[i].op != OP_CALL_K)
+		{
+			continue;
+		}
+		FInlineSource *src = InlineSources->CheckKey((VMFunction *)AddressConstantList[Code[i].a]);
+		if (src != nullptr && InlineCall(i, *src))
+		{
+			inlined++;
+		}
+	}
+	return inlined;
+}
+
+//==========================================================================
+//
+// Constant propagation
+//
+// Each integer and float register is either known to hold one value, or
+// it is not. Blocks start out with what all the blocks that lead to them
+// agree on.
+//
+//==========================================================================
+
+enum
+{
+	KONST_Unknown,		// nothing has reached this point yet
+	KONST_Known,
+	KONST_Varying
+};
+
+struct FKonstReg
+{
+	int State;
+	int Int;
+	double Float;
+};
+
+static bool SameKonst(const FKonstReg &a, const FKonstReg &b)
+{
+	return a.Int == b.Int && memcmp(&a.Float, &b.Float, sizeof(double)) == 0;
+}
+
+// Returns true if dest changed.
+static bool MergeKonst(FKonstReg *dest, const FKonstReg *src, unsigned width)
+{
+	bool changed = false;
+	for (unsigned i = 0; i < width; i++)
+	{
+		if (src[i].State == KONST_Unknown || dest[i].State == KONST_Varying)
+		{
+			continue;
+		}
+		if (dest[i].State == KONST_Unknown)
+		{
+			dest[i] = src[i];
+			changed = true;
+		}
+		else if (src[i].State == KONST_Varying || !SameKonst(dest[i], src[i]))
+		{
+			dest[i].State = KONST_Varying;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+// Does the same math as the VM. Returns false where the VM would throw or
+// the result is not defined.
+static bool FoldInt(int op, int b, int c, int &result)
+{
+	switch (op)
+	{
+	case OP_ADD_RR:	case OP_ADD_RK:	case OP_ADDI:
+		result = int(unsigned(b) + unsigned(c));
+		return true;
+	case OP_SUB_RR:	case OP_SUB_RK:	case OP_SUB_KR:
+		result = int(unsigned(b) - unsigned(c));
+		return true;
+	case OP_MUL_RR:	case OP_MUL_RK:
+		result = int(unsigned(b) * unsigned(c));
+		return true;
+	case OP_DIV_RR:	case OP_DIV_RK:	case OP_DIV_KR:
+		if (c == 0 || (b == INT_MIN && c == -1)) return false;
+		result = b / c;
+		return true;
+	case OP_DIVU_RR:	case OP_DIVU_RK:	case OP_DIVU_KR:
+		if (c == 0) return false;
+		result = int(unsigned(b) / unsigned(c));
+		return true;
+	case OP_MOD_RR:	case OP_MOD_RK:	case OP_MOD_KR:
+		if (c == 0 || (b == INT_MIN && c == -1)) return false;
+		result = b % c;
+		return true;
+	case OP_MODU_RR:	case OP_MODU_RK:	case OP_MODU_KR:
+		if (c == 0) return false;
+		result = int(unsigned(b) % unsigned(c));
+		return true;
+	case OP_AND_RR:	case OP_AND_RK:
+		result = b & c;
+		return true;
+	case OP_OR_RR:	case OP_OR_RK:
+		result = b | c;
+		return true;
+	case OP_XOR_RR:	case OP_XOR_RK:
+		result = b ^ c;
+		return true;
+	case OP_MIN_RR:	case OP_MIN_RK:
+		result = b < c ? b : c;
+		return true;
+	case OP_MAX_RR:	case OP_MAX_RK:
+		result = b > c ? b : c;
+		return true;
+	case OP_SLL_RR:	case OP_SLL_RI:	case OP_SLL_KR:
+		if (c < 0 || c > 31) return false;
+		result = int(unsigned(b) << c);
+		return true;
+	case OP_SRL_RR:	case OP_SRL_RI:	case OP_SRL_KR:
+		if (c < 0 || c > 31) return false;
+		result = int(unsigned(b) >> c);
+		return true;
+	case OP_SRA_RR:	case OP_SRA_RI:	case OP_SRA_KR:
+		if (c < 0 || c > 31) return false;
+		result = b >> c;
+		return true;
+	case OP_ABS:
+		if (b == INT_MIN) return false;
+		result = abs(b);
+		return true;
+	case OP_NEG:
+		result = int(0u - unsigned(b));
+		return true;
+	case OP_NOT:
+		result = ~b;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool FoldFloat(int op, double b, double c, double &result)
+{
+	switch (op)
+	{
+	case OP_ADDF_RR:	case OP_ADDF_RK:
+		result = b + c;
+		return true;
+	case OP_SUBF_RR:	case OP_SUBF_RK:	case OP_SUBF_KR:
+		result = b - c;
+		return true;
+	case OP_MULF_RR:	case OP_MULF_RK:
+		result = b * c;
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool VMFunctionBuilder::KonstInt(int mode, int field, const FKonstReg *state, const FRegSet &pinned, int &val) const
+{
+	if (mode == MODE_KI)
+	{
+		val = IntConstantList[field];
+		return true;
+	}
+	if (mode != MODE_I || field >= Registers[REGT_INT].MostUsed || pinned.Test(REGT_INT, field) || state[field].State != KONST_Known)
+	{
+		return false;
+	}
+	val = state[field].Int;
+	return true;
+}
+
+bool VMFunctionBuilder::KonstFloat(int mode, int field, const FKonstReg *state, const FRegSet &pinned, double &val) const
+{
+	if (mode == MODE_KF)
+	{
+		val = FloatConstantList[field];
+		return true;
+	}
+	const FKonstReg *reg = &state[Registers[REGT_INT].MostUsed + field];
+	if (mode != MODE_F || field >= Registers[REGT_FLOAT].MostUsed || pinned.Test(REGT_FLOAT, field) || reg->State != KONST_Known)
+	{
+		return false;
+	}
+	val = reg->Float;
+	return true;
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: EvalKonst
+//
+// Works out the value an instruction writes, if it can be known.
+//
+//==========================================================================
+
+bool VMFunctionBuilder::EvalKonst(const VMOP &op, const FKonstReg *state, const FRegSet &pinned, FKonstReg &val) const
+{
+	int mode = OpInfo[op.op].Mode;
+	int bmode = (mode & MODE_BTYPE) >> MODE_BSHIFT;
+	int cmode = (mode & MODE_CTYPE) >> MODE_CSHIFT;
+	int b, c;
+	double fb, fc;
+
+	val.State = KONST_Known;
+	val.Int = 0;
+	val.Float = 0;
+	switch (op.op)
+	{
+	case OP_LI:
+		val.Int = op.i16;
+		return true;
+
+	case OP_LK:
+		return KonstInt(MODE_KI, op.i16u, state, pinned, val.Int);
+
+	case OP_LKF:
+		return KonstFloat(MODE_KF, op.i16u, state, pinned, val.Float);
+
+	case OP_MOVE:
+		return KonstInt(MODE_I, op.b, state, pinned, val.Int);
+
+	case OP_MOVEF:
+		return KonstFloat(MODE_F, op.b, state, pinned, val.Float);
+
+	case OP_ABS:
+	case OP_NEG:
+	case OP_NOT:
+		return KonstInt(MODE_I, op.b, state, pinned, b) && FoldInt(op.op, b, 0, val.Int);
+
+	case OP_ADDI:
+		return KonstInt(MODE_I, op.b, state, pinned, b) && FoldInt(op.op, b, op.cs, val.Int);
+
+	case OP_SLL_RI:
+	case OP_SRL_RI:
+	case OP_SRA_RI:
+		return KonstInt(MODE_I, op.b, state, pinned, b) && FoldInt(op.op, b, op.c, val.Int);
+
+	case OP_ADDF_RR:	case OP_ADDF_RK:
+	case OP_SUBF_RR:	case OP_SUBF_RK:	case OP_SUBF_KR:
+	case OP_MULF_RR:	case OP_MULF_RK:
+		return KonstFloat(bmode, op.b, state, pinned, fb) && KonstFloat(cmode, op.c, state, pinned, fc) &&
+			FoldFloat(op.op, fb, fc, val.Float);
+
+	default:
+		return KonstInt(bmode, op.b, state, pinned, b) && KonstInt(cmode, op.c, state, pinned, c) &&
+			FoldInt(op.op, b, c, val.Int);
+	}
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: EvalSkip
+//
+// Works out whether a compare or test skips the next instruction, if its
+// operands are known.
+//
+//==========================================================================
+
+bool VMFunctionBuilder::EvalSkip(const VMOP &op, const FKonstReg *state, const FRegSet &pinned, bool &skip) const
+{
+	int mode = OpInfo[op.op].Mode;
+	int bmode = (mode & MODE_BTYPE) >> MODE_BSHIFT;
+	int cmode = (mode & MODE_CTYPE) >> MODE_CSHIFT;
+	int b, c;
+	double fb, fc;
+	bool test;
+
+	switch (op.op)
+	{
+	case OP_TEST:
+		if (!KonstInt(MODE_I, op.a, state, pinned, b)) return false;
+		skip = b != op.i16u;
+		return true;
+
+	case OP_TESTN:
+		if (!KonstInt(MODE_I, op.a, state, pinned, b)) return false;
+		skip = int(0u - unsigned(b)) != op.i16u;
+		return true;
+
+	case OP_EQ_R:	case OP_EQ_K:
+	case OP_LT_RR:	case OP_LT_RK:	case OP_LT_KR:
+	case OP_LE_RR:	case OP_LE_RK:	case OP_LE_KR:
+	case OP_LTU_RR:	case OP_LTU_RK:	case OP_LTU_KR:
+	case OP_LEU_RR:	case OP_LEU_RK:	case OP_LEU_KR:
+		if (!KonstInt(bmode, op.b, state, pinned, b) || !KonstInt(cmode, op.c, state, pinned, c)) return false;
+		switch (op.op)
+		{
+		case OP_EQ_R:	case OP_EQ_K:						test = b == c; break;
+		case OP_LT_RR:	case OP_LT_RK:	case OP_LT_KR:		test = b < c; break;
+		case OP_LE_RR:	case OP_LE_RK:	case OP_LE_KR:		test = b <= c; break;
+		case OP_LTU_RR:	case OP_LTU_RK:	case OP_LTU_KR:		test = unsigned(b) < unsigned(c); break;
+		default:											test = unsigned(b) <= unsigned(c); break;
+		}
+		break;
+
+	case OP_EQF_R:	case OP_EQF_K:
+	case OP_LTF_RR:	case OP_LTF_RK:	case OP_LTF_KR:
+	case OP_LEF_RR:	case OP_LEF_RK:	case OP_LEF_KR:
+		if (!KonstFloat(bmode, op.b, state, pinned, fb) || !KonstFloat(cmode, op.c, state, pinned, fc)) return false;
+		switch (op.op)
+		{
+		case OP_EQF_R:	case OP_EQF_K:
+			test = (op.a & CMP_APPROX) ? fabs(fc - fb) < VM_EPSILON : fc == fb;
+			break;
+		case OP_LTF_RR:	case OP_LTF_RK:	case OP_LTF_KR:
+			test = (op.a & CMP_APPROX) ? (fb - fc) < -VM_EPSILON : fb < fc;
+			break;
+		default:
+			test = (op.a & CMP_APPROX) ? (fb - fc) <= -VM_EPSILON : fb <= fc;
+			break;
+		}
+		break;
+
+	default:
+		return false;
+	}
+	// The jump after a compare is taken if the test matches the check bit.
+	skip = int(test) != (op.a & CMP_CHECK);
+	return true;
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: StepKonst
+//
+// Updates what is known about the registers after one instruction.
+//
+//==========================================================================
+
+void VMFunctionBuilder::StepKonst(const VMOP &op, FKonstReg *state, const FRegSet &pinned) const
+{
+	int numd = Registers[REGT_INT].MostUsed;
+	int numf = Registers[REGT_FLOAT].MostUsed;
+	FOpRegs regs;
+	FKonstReg val;
+
+	GetOpRegs(op, regs);
+	if (regs.Def.Count == 0)
+	{
+		return;
+	}
+	bool known = regs.Def.Count == 1 && EvalKonst(op, state, pinned, val);
+	for (int i = 0; i < regs.Def.Count; i++)
+	{
+		int reg = regs.Def.Num + i;
+		FKonstReg *r = regs.Def.Type == REGT_INT && reg < numd ? &state[reg] :
+			regs.Def.Type == REGT_FLOAT && reg < numf ? &state[numd + reg] : nullptr;
+		if (r == nullptr)
+		{
+			continue;
+		}
+		if (known)
+		{
+			*r = val;
+		}
+		else
+		{
+			r->State = KONST_Varying;
+		}
+	}
+}
+
+bool VMFunctionBuilder::FindKonstInt(int val, unsigned limit, unsigned &index)
+{
+	unsigned *locp = IntConstantMap.CheckKey(val);
+	if (locp == NULL && IntConstantList.Size() > limit)
+	{
+		return false;
+	}
+	index = locp != NULL ? *locp : GetConstantInt(val);
+	return index <= limit;
+}
+
+bool VMFunctionBuilder::FindKonstFloat(double val, unsigned limit, unsigned &index)
+{
+	unsigned *locp = FloatConstantMap.CheckKey(val);
+	if (locp == NULL && FloatConstantList.Size() > limit)
+	{
+		return false;
+	}
+	index = locp != NULL ? *locp : GetConstantFloat(val);
+	return index <= limit;
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: RewriteKonst
+//
+// Makes one change to an instruction based on the known registers: a test
+// with a known outcome becomes a jump or nothing, a known result becomes a
+// load, and a known operand becomes a constant operand.
+//
+//==========================================================================
+
+bool VMFunctionBuilder::RewriteKonst(VMOP &op, const FKonstReg *state, const FRegSet &pinned)
+{
+	int mode = OpInfo[op.op].Mode;
+	int bmode = (mode & MODE_BTYPE) >> MODE_BSHIFT;
+	int cmode = (mode & MODE_CTYPE) >> MODE_CSHIFT;
+	FOpRegs regs;
+	FKonstReg val;
+	bool skip;
+	unsigned k;
+	int c;
+	double f;
+
+	if (EvalSkip(op, state, pinned, skip))
+	{
+		op = skip ? MakeJump(1) : MakeOp(OP_NOP, 0, 0, 0);
+		return true;
+	}
+
+	GetOpRegs(op, regs);
+	if (regs.Def.Count == 1 && op.op != OP_LI && op.op != OP_LK && op.op != OP_LKF && EvalKonst(op, state, pinned, val))
+	{
+		if (regs.Def.Type == REGT_INT && val.Int >= -32768 && val.Int <= 32767)
+		{
+			op = MakeOpBC(OP_LI, regs.Def.Num, 0);
+			op.i16 = val.Int;
+			return true;
+		}
+		if (regs.Def.Type == REGT_INT && FindKonstInt(val.Int, 65535, k))
+		{
+			op = MakeOpBC(OP_LK, regs.Def.Num, k);
+			return true;
+		}
+		if (regs.Def.Type == REGT_FLOAT && FindKonstFloat(val.Float, 65535, k))
+		{
+			op = MakeOpBC(OP_LKF, regs.Def.Num, k);
+			return true;
+		}
+		return false;
+	}
+
+	if ((op.op == OP_SLL_RR || op.op == OP_SRL_RR || op.op == OP_SRA_RR) &&
+		KonstInt(MODE_I, op.c, state, pinned, c) && c >= 0 && c <= 31)
+	{
+		op.op = op.op == OP_SLL_RR ? OP_SLL_RI : op.op == OP_SRL_RR ? OP_SRL_RI : OP_SRA_RI;
+		op.c = c;
+		return true;
+	}
+
+	// Try C first, then B, then B moved over to C.
+	for (int i = 0; i < 3; i++)
+	{
+		int field = i == 1 ? op.b : op.c;
+		int fieldmode = i == 0 ? cmode : bmode;
+		int newop = i == 1 ? KonstForms.B[op.op] : KonstForms.C[op.op];
+		if (newop == 0 || (i == 2 && !IsCommutative(op.op)))
+		{
+			continue;
+		}
+		if (i == 2)
+		{
+			field = op.b;
+		}
+		if (fieldmode == MODE_I ? !(KonstInt(MODE_I, field, state, pinned, c) && FindKonstInt(c, 255, k)) :
+			fieldmode == MODE_F ? !(KonstFloat(MODE_F, field, state, pinned, f) && FindKonstFloat(f, 255, k)) : true)
+		{
+			continue;
+		}
+		if (i == 1)
+		{
+			op.b = k;
+		}
+		else
+		{
+			if (i == 2) op.b = op.c;
+			op.c = k;
+		}
+		op.op = newop;
+		return true;
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: PropagateConstants
+//
+// Returns the number of instructions that were rewritten.
+//
+//==========================================================================
+
+int VMFunctionBuilder::PropagateConstants(const FRegSet &pinned)
+{
+	unsigned count = Code.Size();
+	unsigned width = Registers[REGT_INT].MostUsed + Registers[REGT_FLOAT].MostUsed;
+	TArray<bool> leader, queued;
+	TArray<unsigned> blockstart, blockof, work;
+	TArray<FKonstReg> in, state;
+	unsigned succ[2];
+	int folded = 0;
+
+	if (count == 0 || width == 0)
+	{
+		return 0;
+	}
+	FindLeaders(Code, leader);
+	blockof.Resize(count);
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (leader[i]) blockstart.Push(i);
+		blockof[i] = blockstart.Size() - 1;
+	}
+	unsigned numblocks = blockstart.Size();
+	blockstart.Push(count);
+
+	in.Resize(numblocks * width);
+	for (auto &reg : in)
+	{
+		reg.State = KONST_Unknown;
+		reg.Int = 0;
+		reg.Float = 0;
+	}
+	// Arguments and registers nothing has written yet could hold anything.
+	for (unsigned i = 0; i < width; i++)
+	{
+		in[i].State = KONST_Varying;
+	}
+	queued.Resize(numblocks);
+	for (unsigned b = 0; b < numblocks; b++)
+	{
+		queued[b] = b == 0;
+	}
+	state.Resize(width);
+	work.Push(0);
+
+	unsigned b;
+	while (work.Pop(b))
+	{
+		queued[b] = false;
+		memcpy(&state[0], &in[b * width], width * sizeof(FKonstReg));
+		unsigned last = blockstart[b + 1] - 1;
+		for (unsigned i = blockstart[b]; i <= last; i++)
+		{
+			StepKonst(Code[i], &state[0], pinned);
+		}
+		int num = GetSuccessors(Code, last, succ);
+		for (int s = 0; s < num; s++)
+		{
+			if (succ[s] >= count) continue;
+			unsigned sb = blockof[succ[s]];
+			if (MergeKonst(&in[sb * width], &state[0], width) && !queued[sb])
+			{
+				queued[sb] = true;
+				work.Push(sb);
+			}
+		}
+	}
+
+	for (b = 0; b < numblocks; b++)
+	{
+		memcpy(&state[0], &in[b * width], width * sizeof(FKonstReg));
+		for (unsigned i = blockstart[b]; i < blockstart[b + 1]; i++)
+		{
+			for (int n = 0; n < 4 && RewriteKonst(Code[i], &state[0], pinned); n++)
+			{
+				folded++;
+			}
+			StepKonst(Code[i], &state[0], pinned);
+		}
+	}
+	return folded;
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: CoalesceMoves
+//
+// Where a register is written only to be moved into another one and is
+// not read again, the instruction that writes it writes the other register
+// instead and the move goes. Returns the number of moves removed.
+//
+//==========================================================================
+
+int VMFunctionBuilder::CoalesceMoves(const FRegSet &pinned)
+{
+	TArray<FRegSet> livein, liveout;
+	TArray<bool> leader;
+	FOpRegs regs;
+	int coalesced = 0;
+
+	FindLeaders(Code, leader);
+	ComputeLiveness(Code, pinned, livein, liveout);
+	for (unsigned j = 1; j < Code.Size(); j++)
+	{
+		int op = Code[j].op;
+		int type = op == OP_MOVE ? REGT_INT : op == OP_MOVEF ? REGT_FLOAT : op == OP_MOVES ? REGT_STRING : op == OP_MOVEA ? REGT_POINTER : -1;
+		int to = Code[j].a, from = Code[j].b;
+
+		if (type < 0 || to == from || leader[j] || pinned.Test(type, to) || pinned.Test(type, from) || liveout[j].Test(type, from))
+		{
+			continue;
+		}
+		// Look back through the block for what wrote the moved register.
+		// Nothing in between may touch either register.
+		for (unsigned i = j; i-- > 0; )
+		{
+			GetOpRegs(Code[i], regs);
+			if (DefinesReg(regs, type, from))
+			{
+				if (regs.Def.Count == 1 && regs.Def.Type == type && (type != REGT_POINTER || WritesAtag(Code[i].op)))
+				{
+					if (Code[i].op == OP_RESULT) Code[i].c = to;
+					else Code[i].a = to;
+					Code[j] = MakeOp(OP_NOP, 0, 0, 0);
+					coalesced++;
+				}
+				break;
+			}
+			if (UsesReg(regs, type, from) || UsesReg(regs, type, to) || DefinesReg(regs, type, to) || leader[i])
+			{
+				break;
+			}
+		}
+	}
+	return coalesced;
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: RemoveDeadCode
+//
+// Turns instructions whose result is never read into no-ops.
+//
+//==========================================================================
+
+void VMFunctionBuilder::RemoveDeadCode(const FRegSet &pinned)
+{
+	TArray<FRegSet> livein, liveout;
+	FOpRegs regs;
+
+	for (int pass = 0; pass < 4; pass++)
+	{
+		bool changed = false;
+		ComputeLiveness(Code, pinned, livein, liveout);
+		for (unsigned i = 0; i < Code.Size(); i++)
+		{
+			if (!IsPureOp(Code[i].op))
+			{
+				continue;
+			}
+			GetOpRegs(Code[i], regs);
+			if (regs.Def.Count > 0 && !liveout[i].TestRange(regs.Def))
+			{
+				Code[i] = MakeOp(OP_NOP, 0, 0, 0);
+				changed = true;
+			}
+		}
+		if (!changed)
+		{
+			break;
+		}
+	}
+}
+
+// Code that uses jump tables or exception handlers depends on its exact
+// layout, so it only gets its jumps threaded.
+static bool HasFixedLayout(const TArray<VMOP> &code)
+{
+	for (auto &op : code)
+	{
+		if (op.op == OP_IJMP || op.op == OP_TRY || op.op == OP_CATCH)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: OptimizeCalls
+//
+// Inlines calls to small functions, so their code takes part in everything
+// OptimizeCode does. This is kept apart because it copies the callee's
+// string constants, and string reference counts must not be touched from
+// more than one thread at a time.
+//
+//==========================================================================
+
+void VMFunctionBuilder::OptimizeCalls()
+{
+	if (Code.Size() > 0 && !HasFixedLayout(Code))
+	{
+		NumInlined = InlineCalls();
+	}
+}
+
+//==========================================================================
+//
+// VMFunctionBuilder :: OptimizeCode
+//
+// Known constants are propagated, moves coalesced and unused results
+// dropped. Jumps to jumps are threaded, jumps to a final return become
+// that return unless a compare needs the jump, and instructions that can
+// never run or do nothing are removed. This only works on the builder's
+// own code and number constants, so different functions can be optimized
+// on different threads.
+//
+//==========================================================================
+
+void VMFunctionBuilder::OptimizeCode()
+{
+	unsigned count = Code.Size();
+	bool fixedlayout = HasFixedLayout(Code);
+	FRegSet pinned;
+
+	Optimized = true;
+	if (!fixedlayout && count > 0 && FindPinnedRegisters(Code, pinned))
+	{
+		NumFolded = PropagateConstants(pinned);
+		NumCoalesced = CoalesceMoves(pinned);
+		RemoveDeadCode(pinned);
+		count = Code.Size();
+	}
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (Code[i].op != OP_JMP)
+		{
+			continue;
+		}
+		unsigned target = i + 1 + Code[i].i24;
+		// The hop limit keeps a loop made only of jumps from hanging us.
+		for (int hops = 0; hops < 8 && target < count && target != i && Code[target].op == OP_JMP; hops++)
+		{
+			target = target + 1 + Code[target].i24;
+		}
+		if (target >= count)
+		{
+			continue;
+		}
+		if (!fixedlayout && IsFinalRet(Code[target]) && (i == 0 || !IsCompareOp(Code[i - 1])))
+		{
+			Code[i] = Code[target];
+		}
+		else
+		{
+			Code[i].i24 = int(target - i - 1);
+		}
+	}
+
+	if (fixedlayout || count == 0)
+	{
+		return;
+	}
+
+	// Removing code can turn a jump over it into a no-op, so repeat
+	// until nothing changes.
+	TArray<bool> reached;
+	TArray<unsigned> newindex;
+	TArray<unsigned> work;
+
+	for (int pass = 0; pass < 4; pass++)
+	{
+		count = Code.Size();
+		reached.Resize(count);
+		for (unsigned i = 0; i < count; i++)
+		{
+			reached[i] = false;
+		}
+
+		work.Clear();
+		work.Push(0);
+		unsigned pc;
+		while (work.Pop(pc))
+		{
+			while (pc < count && !reached[pc])
+			{
+				const VMOP &op = Code[pc];
+				reached[pc] = true;
+				if (op.op == OP_JMP)
+				{
+					pc = pc + 1 + op.i24;
+					continue;
+				}
+				if (IsFinalRet(op) || op.op == OP_TAIL || op.op == OP_TAIL_K || op.op == OP_THROW)
+				{
+					break;
+				}
+				if (IsSkipOp(op))
+				{
+					work.Push(pc + 2);
+				}
+				pc++;
+			}
+		}
+
+		// An instruction right after a skip is only executed conditionally,
+		// so even a no-op there has to stay.
+		unsigned kept = 0;
+		newindex.Resize(count + 1);
+		for (unsigned i = 0; i < count; i++)
+		{
+			newindex[i] = kept;
+			if (!reached[i] || ((i == 0 || !IsSkipOp(Code[i - 1])) && IsNoOp(Code[i])))
+			{
+				reached[i] = false;
+			}
+			else
+			{
+				kept++;
+			}
+		}
+		newindex[count] = kept;
+		if (kept == count)
+		{
+			break;
+		}
+
+		for (unsigned i = 0; i < count; i++)
+		{
+			if (!reached[i])
+			{
+				continue;
+			}
+			VMOP op = Code[i];
+			if (op.op == OP_JMP)
+			{
+				op.i24 = int(newindex[i + 1 + op.i24] - newindex[i] - 1);
+			}
+			Code[newindex[i]] = op;
+		}
+		Code.Resize(kept);
+
+		// Several statements may now start at the same instruction. PCToLine
+		// uses the last of them, which is the one whose code is still there.
+		unsigned lines = 0;
+		for (unsigned i = 0; i < LineNumbers.Size(); i++)
+		{
+			FStatementInfo si = LineNumbers[i];
+			si.InstructionIndex = (uint16_t)newindex[MIN<unsigned>(si.InstructionIndex, count)];
+			if (lines > 0 && LineNumbers[lines - 1].InstructionIndex == si.InstructionIndex)
+			{
+				lines--;
+			}
+			LineNumbers[lines++] = si;
+		}
+		LineNumbers.Resize(lines);
+		NumRemoved += count - kept;
+	}
+}
@@ -0,0 +1,400 @@
+/*
+** vmprofile.cpp
+** Sampling profiler for ZScript, DECORATE and ACS code
+**
+** A sampler thread counts off fixed intervals while script code is
+** running. The main thread notices this between two instructions and
+** charges the elapsed time to the function and line it is at and to
+** the chain of functions that called it. Functions run by the VM also
+** get their calls and executed instructions counted.
+**
+*/
+
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include "dobject.h"
+#include "c_dispatch.h"
+#include "templates.h"
+#include "v_text.h"
+#include "vm.h"
+
+// MACROS ------------------------------------------------------------------
+
+#define MAX_PROFILE_DEPTH	256
+
+// TYPES -------------------------------------------------------------------
+
+struct FProfileEntry
+{
+	FString Name;
+	unsigned Calls = 0;
+	uint64_t Ops = 0;
+	uint64_t SelfUS = 0;
+	uint64_t TotalUS = 0;
+};
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+bool VMProfiling;
+std::atomic<int> VMProfilePending;
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static VMProfileFrame *ProfileStack[MAX_PROFILE_DEPTH];
+static int ProfileDepth;
+static std::atomic<int> ProfileActive;	// VM frames and other interpreters
+
+static TMap<const void *, FProfileEntry> ProfileFunctions;
+static TMap<FString, uint64_t> ProfileLines;
+static TMap<FString, uint64_t> ProfileStacks;
+static uint64_t ProfileTotalUS;
+
+static std::thread SamplerThread;
+static std::atomic<bool> SamplerRunning;
+static int SampleUS;
+static int (*UnprofiledExec)(VMFrameStack *stack, const VMOP *pc, VMReturn *ret, int numret);
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// GetEntry
+//
+//==========================================================================
+
+static FProfileEntry &GetEntry(const void *id, const char *name)
+{
+	FProfileEntry *entry = ProfileFunctions.CheckKey(id);
+	if (entry == NULL)
+	{
+		entry = &ProfileFunctions[id];
+		entry->Name = name;
+		// Semicolons separate frames in the exported stacks.
+		entry->Name.ReplaceChars(';', ':');
+	}
+	return *entry;
+}
+
+//==========================================================================
+//
+// VMProfileFrame Constructor
+//
+//==========================================================================
+
+VMProfileFrame::VMProfileFrame(VMScriptFunction *func, const VMOP *const *pc)
+	: Func(func), PC(pc), Ops(0)
+{
+	if (ProfileDepth == 0 && ProfileActive == 0)
+	{
+		// Anything counted while no script code was running is not ours.
+		VMProfilePending = 0;
+	}
+	if (ProfileDepth < MAX_PROFILE_DEPTH)
+	{
+		ProfileStack[ProfileDepth] = this;
+	}
+	ProfileDepth++;
+	ProfileActive++;
+}
+
+//==========================================================================
+//
+// VMProfileFrame Destructor
+//
+//==========================================================================
+
+VMProfileFrame::~VMProfileFrame()
+{
+	ProfileDepth--;
+	ProfileActive--;
+	if (Func != NULL)
+	{
+		FProfileEntry &entry = GetEntry(Func, Func->PrintableName);
+		entry.Calls++;
+		entry.Ops += Ops;
+	}
+}
+
+//==========================================================================
+//
+// VMProfileEnter / VMProfileLeave
+//
+// For script interpreters that do not run on the VM, so that samples are
+// taken while they run.
+//
+//==========================================================================
+
+void VMProfileEnter()
+{
+	if (ProfileActive++ == 0)
+	{
+		VMProfilePending = 0;
+	}
+}
+
+void VMProfileLeave()
+{
+	ProfileActive--;
+}
+
+//==========================================================================
+//
+// VMProfileSample
+//
+// Charges the intervals that have passed to what is running now: the VM
+// functions on the profile stack, and, if given, the leaf function of an
+// interpreter called from there.
+//
+//==========================================================================
+
+void VMProfileSample(const void *id, const char *name, const char *line)
+{
+	int ticks = VMProfilePending.exchange(0);
+	if (ticks <= 0)
+	{
+		return;
+	}
+	uint64_t us = (uint64_t)ticks * SampleUS;
+	int depth = MIN(ProfileDepth, MAX_PROFILE_DEPTH);
+	const void *ids[MAX_PROFILE_DEPTH + 1];
+	int numids = 0;
+	FString stack, linename;
+
+	for (int i = 0; i < depth; i++)
+	{
+		VMScriptFunction *func = ProfileStack[i]->Func;
+		FProfileEntry &entry = GetEntry(func, func->PrintableName);
+		if (i > 0) stack << ';';
+		stack << entry.Name;
+		ids[numids++] = func;
+	}
+	if (name != NULL)
+	{
+		FProfileEntry &entry = GetEntry(id, name);
+		if (numids > 0) stack << ';';
+		stack << entry.Name;
+		ids[numids++] = id;
+		linename = line;
+	}
+	else if (depth > 0)
+	{
+		VMProfileFrame *top = ProfileStack[depth - 1];
+		linename.Format("%s:%d (%s)", top->Func->SourceFileName.GetChars(),
+			top->Func->PCToLine(*top->PC), top->Func->PrintableName.GetChars());
+	}
+	if (numids == 0)
+	{
+		return;
+	}
+
+	ProfileFunctions.CheckKey(ids[numids - 1])->SelfUS += us;
+	for (int i = 0; i < numids; i++)
+	{
+		// Recursive functions are only counted once per sample.
+		int j;
+		for (j = 0; j < i && ids[j] != ids[i]; j++)
+		{
+		}
+		if (j == i)
+		{
+			ProfileFunctions.CheckKey(ids[i])->TotalUS += us;
+		}
+	}
+	ProfileLines[linename] += us;
+	ProfileStacks[stack] += us;
+	ProfileTotalUS += us;
+}
+
+//==========================================================================
+//
+// SamplerLoop
+//
+//==========================================================================
+
+static void SamplerLoop()
+{
+	while (SamplerRunning)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(SampleUS));
+		if (ProfileActive.load(std::memory_order_relaxed) > 0)
+		{
+			VMProfilePending++;
+		}
+	}
+}
+
+//==========================================================================
+//
+// StartProfiling / StopProfiling
+//
+//==========================================================================
+
+static void StartProfiling(int us)
+{
+	if (VMProfiling)
+	{
+		return;
+	}
+	SampleUS = us;
+	VMProfilePending = 0;
+	SamplerRunning = true;
+	SamplerThread = std::thread(SamplerLoop);
+	UnprofiledExec = VMExec;
+	VMSelectEngine(VMEngine_Profiled);
+	VMProfiling = true;
+}
+
+static void StopProfiling()
+{
+	if (!VMProfiling)
+	{
+		return;
+	}
+	VMExec = UnprofiledExec;
+	VMProfiling = false;
+	SamplerRunning = false;
+	SamplerThread.join();
+	VMProfilePending = 0;
+}
+
+//==========================================================================
+//
+// SortByTime
+//
+//==========================================================================
+
+template<class T> static void SortByTime(TArray<T> &list)
+{
+	std::sort(&list[0], &list[0] + list.Size(), [](const T &a, const T &b) { return a.second > b.second; });
+}
+
+//==========================================================================
+//
+// PrintReport
+//
+//==========================================================================
+
+static void PrintReport(unsigned limit)
+{
+	TArray<std::pair<const FProfileEntry *, uint64_t>> funcs;
+	TArray<std::pair<const FString *, uint64_t>> lines;
+
+	TMap<const void *, FProfileEntry>::Iterator it(ProfileFunctions);
+	TMap<const void *, FProfileEntry>::Pair *pair;
+	while (it.NextPair(pair))
+	{
+		funcs.Push(std::make_pair(&pair->Value, pair->Value.SelfUS));
+	}
+	TMap<FString, uint64_t>::Iterator lit(ProfileLines);
+	TMap<FString, uint64_t>::Pair *lpair;
+	while (lit.NextPair(lpair))
+	{
+		lines.Push(std::make_pair(&lpair->Key, lpair->Value));
+	}
+	if (funcs.Size() == 0)
+	{
+		Printf("No script code has been profiled\n");
+		return;
+	}
+	SortByTime(funcs);
+
+	double total = ProfileTotalUS / 1000.;
+	Printf(TEXTCOLOR_YELLOW "%.2f ms of script time sampled every %d us%s\n", total, SampleUS, VMProfiling ? ", still running" : "");
+	Printf(TEXTCOLOR_YELLOW "    Self ms     Total ms      Calls   Instructions  Function\n");
+	for (unsigned i = 0; i < funcs.Size() && i < limit; i++)
+	{
+		const FProfileEntry *entry = funcs[i].first;
+		Printf("%11.2f %12.2f %10u %14llu  %s\n", entry->SelfUS / 1000., entry->TotalUS / 1000.,
+			entry->Calls, (unsigned long long)entry->Ops, entry->Name.GetChars());
+	}
+	if (lines.Size() > 0)
+	{
+		SortByTime(lines);
+		Printf(TEXTCOLOR_YELLOW "    Self ms  Line\n");
+		for (unsigned i = 0; i < lines.Size() && i < limit; i++)
+		{
+			Printf("%11.2f  %s\n", lines[i].second / 1000., lines[i].first->GetChars());
+		}
+	}
+}
+
+//==========================================================================
+//
+// WriteStacks
+//
+// Writes the sampled call stacks in the folded format taken by
+// flamegraph.pl and compatible viewers, with the time in microseconds.
+//
+//==========================================================================
+
+static bool WriteStacks(const char *filename)
+{
+	FILE *f = fopen(filename, "w");
+	if (f == NULL)
+	{
+		return false;
+	}
+	TMap<FString, uint64_t>::Iterator it(ProfileStacks);
+	TMap<FString, uint64_t>::Pair *pair;
+	while (it.NextPair(pair))
+	{
+		fprintf(f, "%s %llu\n", pair->Key.GetChars(), (unsigned long long)pair->Value);
+	}
+	fclose(f);
+	return true;
+}
+
+//==========================================================================
+//
+// CCMD vmprofile
+//
+// vmprofile start [interval in us]
+// vmprofile stop
+// vmprofile report [count]
+// vmprofile dump <file>
+// vmprofile clear
+//
+//==========================================================================
+
+CCMD(vmprofile)
+{
+	if (argv.argc() < 2)
+	{
+		Printf("Usage: vmprofile start [interval us] | stop | report [count] | dump <file> | clear\n");
+		Printf("The profiler is %s\n", VMProfiling ? "running" : "stopped");
+		return;
+	}
+	if (!stricmp(argv[1], "start"))
+	{
+		int us = argv.argc() > 2 ? atoi(argv[2]) : 1000;
+		StartProfiling(clamp(us, 50, 100000));
+	}
+	else if (!stricmp(argv[1], "stop"))
+	{
+		StopProfiling();
+	}
+	else if (!stricmp(argv[1], "report"))
+	{
+		PrintReport(argv.argc() > 2 ? atoi(argv[2]) : 20);
+	}
+	else if (!stricmp(argv[1], "dump") && argv.argc() > 2)
+	{
+		if (!WriteStacks(argv[2]))
+		{
+			Printf("Could not write %s\n", argv[2]);
+		}
+	}
+	else if (!stricmp(argv[1], "clear"))
+	{
+		ProfileFunctions.Clear();
+		ProfileLines.Clear();
+		ProfileStacks.Clear();
+		ProfileTotalUS = 0;
+	}
+	else
+	{
+		Printf("Unknown vmprofile command '%s'\n", argv[1]);
+	}
+}
@@ -0,0 +1,289 @@
+/*
+** vmtest.cpp
+** Runs small hand built functions through the optimizer and the VM
+**
+*/
+
+#include "dobject.h"
+#include "c_dispatch.h"
+#include "vm.h"
+#include "vmbuilder.h"
+
+//==========================================================================
+//
+// MakeIfAtEnd
+//
+// Creates the code the compiler makes for
+//
+//		int Test(int x) { int r = 3; if (x) { r = 7; } return r; }
+//
+// The compare's jump goes straight to the final return, which the
+// optimizer must not copy over it.
+//
+//==========================================================================
+
+static VMScriptFunction *MakeIfAtEnd()
+{
+	VMFunctionBuilder build(0);
+	int x = build.Registers[REGT_INT].Get(1);
+	int r = build.Registers[REGT_INT].Get(1);
+
+	build.EmitLoadInt(r, 3);
+	build.Emit(OP_EQ_K, 1, x, build.GetConstantInt(0));
+	size_t no = build.Emit(OP_JMP, 0);
+	build.EmitLoadInt(r, 7);
+	build.BackpatchToHere(no);
+	build.Emit(OP_RET, RET_FINAL, REGT_INT, r);
+
+	VMScriptFunction *sfunc = new VMScriptFunction(NAME_None);
+	sfunc->PrintableName = "vmopttest.IfAtEnd";
+	build.MakeFunction(sfunc);
+	sfunc->NumArgs = 1;
+	return sfunc;
+}
+
+//==========================================================================
+//
+// MakeKnownBranch
+//
+// Creates the code the compiler makes for
+//
+//		int Test(int x) { int a = 5; int b = a + 3; if (b == 8) return x + b; return 0; }
+//
+// b is always 8, so the compare goes and the add uses a constant.
+//
+//==========================================================================
+
+static VMScriptFunction *MakeKnownBranch()
+{
+	VMFunctionBuilder build(0);
+	int x = build.Registers[REGT_INT].Get(1);
+	int a = build.Registers[REGT_INT].Get(1);
+	int t = build.Registers[REGT_INT].Get(1);
+	int b = build.Registers[REGT_INT].Get(1);
+	int r = build.Registers[REGT_INT].Get(1);
+
+	build.EmitLoadInt(a, 5);
+	build.EmitLoadInt(t, 3);
+	build.Emit(OP_ADD_RR, b, a, t);
+	build.Emit(OP_EQ_K, 0, b, build.GetConstantInt(8));
+	size_t no = build.Emit(OP_JMP, 0);
+	build.Emit(OP_ADD_RR, r, x, b);
+	build.Emit(OP_RET, RET_FINAL, REGT_INT, r);
+	build.BackpatchToHere(no);
+	build.EmitRetInt(0, true, 0);
+
+	VMScriptFunction *sfunc = new VMScriptFunction(NAME_None);
+	sfunc->PrintableName = "vmopttest.KnownBranch";
+	build.MakeFunction(sfunc);
+	sfunc->NumArgs = 1;
+	return sfunc;
+}
+
+//==========================================================================
+//
+// MakeMovedResult
+//
+// Creates the code the compiler makes for
+//
+//		int Test(int x, int y) { int r = x + y; return r; }
+//
+// when the sum is worked out in a temporary register first. The add
+// should write r itself.
+//
+//==========================================================================
+
+static VMScriptFunction *MakeMovedResult()
+{
+	VMFunctionBuilder build(0);
+	int x = build.Registers[REGT_INT].Get(1);
+	int y = build.Registers[REGT_INT].Get(1);
+	int r = build.Registers[REGT_INT].Get(1);
+	int t = build.Registers[REGT_INT].Get(1);
+
+	build.Emit(OP_ADD_RR, t, x, y);
+	build.Emit(OP_MOVE, r, t);
+	build.Emit(OP_RET, RET_FINAL, REGT_INT, r);
+
+	VMScriptFunction *sfunc = new VMScriptFunction(NAME_None);
+	sfunc->PrintableName = "vmopttest.MovedResult";
+	build.MakeFunction(sfunc);
+	sfunc->NumArgs = 2;
+	return sfunc;
+}
+
+//==========================================================================
+//
+// MakeInlinedCall
+//
+// Creates the code the compiler makes for
+//
+//		int Add1(int v) { return v + 1; }
+//		int Test(int x) { return Add1(x) * 2; }
+//
+// with Add1 allowed to be inlined. Test should not call anything.
+//
+//==========================================================================
+
+static VMScriptFunction *MakeInlinedCall()
+{
+	TMap<VMFunction *, FInlineSource> sources;
+	int argregs[4] = { 1, 0, 0, 0 };
+
+	VMFunctionBuilder callee(0);
+	int v = callee.Registers[REGT_INT].Get(1);
+	int s = callee.Registers[REGT_INT].Get(1);
+	callee.Emit(OP_ADD_RK, s, v, callee.GetConstantInt(1));
+	callee.Emit(OP_RET, RET_FINAL, REGT_INT, s);
+
+	VMScriptFunction *add1 = new VMScriptFunction(NAME_None);
+	add1->PrintableName = "vmopttest.Add1";
+	if (!callee.MakeInlineSource(sources[add1], argregs))
+	{
+		Printf("%s cannot be inlined\n", add1->PrintableName.GetChars());
+	}
+	callee.MakeFunction(add1);
+	add1->NumArgs = 1;
+
+	VMFunctionBuilder build(0);
+	int x = build.Registers[REGT_INT].Get(1);
+	int t = build.Registers[REGT_INT].Get(1);
+	int r = build.Registers[REGT_INT].Get(1);
+	build.InlineSources = &sources;
+	build.Emit(OP_PARAM, 0, REGT_INT, x);
+	build.Emit(OP_CALL_K, build.GetConstantAddress(add1, ATAG_OBJECT), 1, 1);
+	build.Emit(OP_RESULT, 0, REGT_INT, t);
+	build.Emit(OP_MUL_RK, r, t, build.GetConstantInt(2));
+	build.Emit(OP_RET, RET_FINAL, REGT_INT, r);
+
+	VMScriptFunction *sfunc = new VMScriptFunction(NAME_None);
+	sfunc->PrintableName = "vmopttest.InlinedCall";
+	build.MakeFunction(sfunc);
+	sfunc->NumArgs = 1;
+	return sfunc;
+}
+
+//==========================================================================
+//
+// CheckNoOp
+//
+// Fails if the optimizer left an instruction it should have taken out.
+//
+//==========================================================================
+
+static bool CheckNoOp(VMScriptFunction *sfunc, int opcode)
+{
+	for (int i = 0; i < sfunc->CodeSize; i++)
+	{
+		if (sfunc->Code[i].op == opcode)
+		{
+			Printf("%s: %s at %d was not optimized away\n", sfunc->PrintableName.GetChars(), OpInfo[opcode].Name, i);
+			return false;
+		}
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// CheckCompareJumps
+//
+// Every compare has to be followed by the JMP it takes its offset from.
+//
+//==========================================================================
+
+static bool CheckCompareJumps(VMScriptFunction *sfunc)
+{
+	for (int i = 0; i < sfunc->CodeSize; i++)
+	{
+		int mode = OpInfo[sfunc->Code[i].op].Mode & MODE_ATYPE;
+		if (mode == MODE_ACMP || sfunc->Code[i].op == OP_CMPS)
+		{
+			if (i + 1 >= sfunc->CodeSize || sfunc->Code[i + 1].op != OP_JMP)
+			{
+				Printf("%s: compare at %d is not followed by a jump\n", sfunc->PrintableName.GetChars(), i);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// RunTest
+//
+// Calls a test function with the given arguments and checks its result.
+//
+//==========================================================================
+
+static bool RunTest(VMScriptFunction *sfunc, int x, int y, int expected)
+{
+	VMValue params[2] = { x, y };
+	VMReturn ret;
+	int result = -1;
+	ret.IntAt(&result);
+	try
+	{
+		GlobalVMStack.Call(sfunc, params, sfunc->NumArgs, &ret, 1, NULL);
+	}
+	catch (CVMAbortException &err)
+	{
+		err.MaybePrintMessage();
+		Printf("%s", err.stacktrace.GetChars());
+		err.stacktrace = "";
+		return false;
+	}
+	if (result != expected)
+	{
+		Printf("%s(%d, %d) returned %d instead of %d\n", sfunc->PrintableName.GetChars(), x, y, result, expected);
+		return false;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// CCMD vmopttest
+//
+// Checks that optimized code still runs both ways through an if statement
+// at the end of a function, and that constants are propagated, moves are
+// coalesced and small calls are inlined.
+//
+//==========================================================================
+
+CCMD(vmopttest)
+{
+	VMScriptFunction *ifatend = MakeIfAtEnd();
+	VMScriptFunction *known = MakeKnownBranch();
+	VMScriptFunction *moved = MakeMovedResult();
+	VMScriptFunction *inlined = MakeInlinedCall();
+	int failed = 0;
+
+	if (!CheckCompareJumps(ifatend) || !CheckCompareJumps(known) || !CheckCompareJumps(inlined))
+	{
+		failed++;
+	}
+	if (!CheckNoOp(known, OP_EQ_K) || !CheckNoOp(known, OP_ADD_RR) || known->FoldedOps == 0)
+	{
+		failed++;
+	}
+	if (!CheckNoOp(moved, OP_MOVE) || moved->CoalescedMoves != 1)
+	{
+		failed++;
+	}
+	if (!CheckNoOp(inlined, OP_CALL_K) || !CheckNoOp(inlined, OP_PARAM) || inlined->InlinedCalls != 1)
+	{
+		failed++;
+	}
+	for (int x = 0; x < 3; x++)
+	{
+		failed += !RunTest(ifatend, x, 0, x ? 7 : 3);
+		failed += !RunTest(known, x, 0, x + 8);
+		failed += !RunTest(moved, x, 5, x + 5);
+		failed += !RunTest(inlined, x, 0, (x + 1) * 2);
+	}
+	Printf("vmopttest: %s (%d instructions removed, %d folded, %d moves coalesced, %d calls inlined)\n", failed ? "failed" : "passed",
+		ifatend->RemovedOps + known->RemovedOps + moved->RemovedOps + inlined->RemovedOps,
+		known->FoldedOps, moved->CoalescedMoves, inlined->InlinedCalls);
+}
@@ -41,12 +41,16 @@
 #include "i_system.h"
 #include "m_argv.h"
 #include "v_text.h"
+#include "stats.h"
 #include "zcc_parser.h"
 #include "zcc_compile.h"
 
 TArray<FString> Includes;
 TArray<FScriptPosition> IncludeLocs;
 
+// Time spent in ZCCCompiler, as opposed to parsing.
+cycle_t ZScriptCompileTime;
+
 static FString ZCCTokenName(int terminal);
 void AddInclude(ZCC_ExprConstant *node)
 {
@@ -384,7 +388,9 @@ static void DoParse(int lumpnum)
 
 	PSymbolTable symtable;
 	ZCCCompiler cc(state, NULL, symtable, GlobalSymbols, lumpnum);
+	ZScriptCompileTime.Clock();
 	cc.Compile();
+	ZScriptCompileTime.Unclock();
 
 	if (FScriptPosition::ErrorCounter > 0)
 	{
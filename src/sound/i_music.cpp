@@ -295,6 +295,11 @@ FString MusInfo::GetStats()
 	return "No stats available for this song";
 }
 
+int MusInfo::GetVoiceCount()
+{
+	return -1;
+}
+
 MusInfo *MusInfo::GetOPLDumper(const char *filename)
 {
 	return NULL;
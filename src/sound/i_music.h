@@ -78,6 +78,7 @@ public:
 	virtual bool SetSubsong (int subsong);
 	virtual void Update();
 	virtual FString GetStats();
+	virtual int GetVoiceCount();			// -1 if the song can't tell
 	virtual MusInfo *GetOPLDumper(const char *filename);
 	virtual MusInfo *GetWaveDumper(const char *filename, int rate);
 	virtual void FluidSettingInt(const char *setting, int value);			// FluidSynth settings
@@ -105,6 +105,7 @@ public:
 	virtual void WildMidiSetOption(int opt, int set);
 	virtual bool Preprocess(MIDIStreamer *song, bool looping);
 	virtual FString GetStats();
+	virtual int GetVoiceCount();
 };
 
 // WinMM implementation of a MIDI output device -----------------------------
@@ -275,6 +276,7 @@ public:
 	void Close();
 	int GetTechnology() const;
 	FString GetStats();
+	int GetVoiceCount();
 
 protected:
 	void CalcTickRate();
@@ -309,6 +311,7 @@ public:
 	int Open(void (*callback)(unsigned int, void *, DWORD, DWORD), void *userdata);
 	void PrecacheInstruments(const WORD *instruments, int count);
 	FString GetStats();
+	int GetVoiceCount();
 
 protected:
 	Timidity::Renderer *Renderer;
@@ -343,6 +346,7 @@ public:
 	int Open(void (*callback)(unsigned int, void *, DWORD, DWORD), void *userdata);
 	void PrecacheInstruments(const WORD *instruments, int count);
 	FString GetStats();
+	int GetVoiceCount();
 
 protected:
 	WildMidi_Renderer *Renderer;
@@ -374,6 +378,7 @@ public:
 
 	int Open(void (*callback)(unsigned int, void *, DWORD, DWORD), void *userdata);
 	FString GetStats();
+	int GetVoiceCount();
 	void FluidSettingInt(const char *setting, int value);
 	void FluidSettingNum(const char *setting, double value);
 	void FluidSettingStr(const char *setting, const char *value);
@@ -444,6 +449,7 @@ public:
 	bool SetSubsong(int subsong);
 	void Update();
 	FString GetStats();
+	int GetVoiceCount();
 	void FluidSettingInt(const char *setting, int value);
 	void FluidSettingNum(const char *setting, double value);
 	void FluidSettingStr(const char *setting, const char *value);
@@ -773,6 +779,17 @@ MusInfo *MOD_OpenSong(FileReader &reader);
 const char *GME_CheckFormat(uint32 header);
 MusInfo *GME_OpenSong(FileReader &reader, const char *fmt);
 
+// Stream for synthesized music, rendered ahead on its own thread -----------
+
+SoundStream *CreateMusicStream(SoundStreamCallback callback, int buffbytes, int flags, int samplerate, void *userdata);
+
+// Offline rendering for the musicbench command -----------------------------
+
+class cycle_t;
+extern bool MusicBenchActive;
+extern thread_local cycle_t MusicEventCycles, MusicSynthCycles;
+SoundStream *CreateBenchStream(SoundStreamCallback callback, int buffbytes, int flags, int samplerate, void *userdata);
+
 // --------------------------------------------------------------------------
 
 extern MusInfo *currSong;
@@ -55,6 +55,7 @@ extern HINSTANCE g_hInst;
 #include "except.h"
 #include "fmodsound.h"
 #include "oalsound.h"
+#include "softsound.h"
 
 #include "mpg123_decoder.h"
 #include "sndfile_decoder.h"
@@ -271,6 +272,10 @@ void I_InitSound ()
 	{
 		GSnd = new NullSoundRenderer;
 	}
+	else if (stricmp(snd_backend, "soft") == 0)
+	{
+		GSnd = new SoftSoundRenderer;
+	}
 	else if(stricmp(snd_backend, "fmod") == 0)
 	{
 		#ifndef NO_FMOD
@@ -445,6 +450,10 @@ bool SoundStream::SetOrder(int order)
 	return false;
 }
 
+void SoundStream::Flush()
+{
+}
+
 FString SoundStream::GetStats()
 {
 	return "No stream stats available.";
@@ -79,6 +79,7 @@ public:
 	virtual bool IsEnded() = 0;
 	virtual bool SetPosition(unsigned int pos);
 	virtual bool SetOrder(int order);
+	virtual void Flush();
 	virtual FString GetStats();
 };
 
@@ -0,0 +1,278 @@
+/*
+** music_bench.cpp
+** Renders a song offline as fast as possible and reports where the time went
+**
+*/
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <stdio.h>
+
+#include "i_musicinterns.h"
+#include "c_dispatch.h"
+#include "cmdlib.h"
+#include "w_wad.h"
+#include "stats.h"
+#include "templates.h"
+
+// TYPES -------------------------------------------------------------------
+
+//==========================================================================
+//
+// FBenchStream
+//
+// Stands in for the backend stream of a song opened by the musicbench
+// command. Nothing ever plays it; the command pulls the song's fill
+// callback directly, one chunk at a time, on the calling thread.
+//
+//==========================================================================
+
+class FBenchStream : public SoundStream
+{
+public:
+	FBenchStream(SoundStreamCallback callback, int buffbytes, int flags, int samplerate, void *userdata);
+	~FBenchStream();
+
+	bool Play(bool looping, float volume) { Playing = true; return true; }
+	void Stop() { Playing = false; }
+	void SetVolume(float volume) {}
+	bool SetPaused(bool paused) { return true; }
+	unsigned int GetPosition() { return 0; }
+	bool IsEnded() { return !Playing; }
+
+	bool Render(void *buff) { return Callback(this, buff, ChunkBytes, UserData); }
+
+	SoundStreamCallback Callback;
+	void *UserData;
+	int ChunkBytes;
+	int Flags;
+	int SampleRate;
+	bool Playing;
+};
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+// Time spent by the synths processing song events and rendering output.
+// They are always counted, but only musicbench looks at them. Each thread
+// that renders music has its own, so a song streaming in the background
+// cannot touch the ones musicbench renders with on its own thread.
+thread_local cycle_t MusicEventCycles, MusicSynthCycles;
+
+bool MusicBenchActive;
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static FBenchStream *BenchStream;
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// CreateBenchStream
+//
+// Called by CreateMusicStream while musicbench is opening a song.
+//
+//==========================================================================
+
+SoundStream *CreateBenchStream(SoundStreamCallback callback, int buffbytes, int flags, int samplerate, void *userdata)
+{
+	if (BenchStream != NULL)
+	{
+		return NULL;
+	}
+	return BenchStream = new FBenchStream(callback, buffbytes, flags, samplerate, userdata);
+}
+
+//==========================================================================
+//
+// FBenchStream Constructor
+//
+//==========================================================================
+
+FBenchStream::FBenchStream(SoundStreamCallback callback, int buffbytes, int flags, int samplerate, void *userdata)
+	: Callback(callback), UserData(userdata), ChunkBytes(buffbytes), Flags(flags), SampleRate(samplerate), Playing(false)
+{
+}
+
+//==========================================================================
+//
+// FBenchStream Destructor
+//
+//==========================================================================
+
+FBenchStream::~FBenchStream()
+{
+	if (BenchStream == this)
+	{
+		BenchStream = NULL;
+	}
+}
+
+//==========================================================================
+//
+// OpenBenchReader
+//
+// Finds a song the same way S_ChangeMusic does.
+//
+//==========================================================================
+
+static FileReader *OpenBenchReader(const char *musicname)
+{
+	if (FileExists(musicname))
+	{
+		return new FileReader(musicname);
+	}
+	int lumpnum = Wads.CheckNumForFullName(musicname, true, ns_music);
+	if (lumpnum == -1 || Wads.LumpLength(lumpnum) == 0)
+	{
+		return NULL;
+	}
+	return Wads.ReopenLumpNumNewFile(lumpnum);
+}
+
+//==========================================================================
+//
+// CCMD musicbench
+//
+// Renders a song from start to end (or for the given number of seconds)
+// without a sound device, as fast as the synth allows, and reports the
+// realtime factor, the peak voice count and how the time was split
+// between event processing, synthesis and the rest of the song's fill
+// callback. Module and game music players do both in one call, so all of
+// their time is counted as synthesis. The output can optionally be written
+// to a raw PCM file to check changes to a synth for regressions.
+//
+// Only songs whose output is synthesized by the engine can be measured.
+// This can be run without starting the game with
+// zdoom +musicbench <song> -norun.
+//
+//==========================================================================
+
+CCMD (musicbench)
+{
+	if (argv.argc() < 2 || argv.argc() > 4)
+	{
+		Printf ("Usage: musicbench <lump or file> [seconds] [output file]\n");
+		return;
+	}
+
+	const char *musicname = argv[1];
+	double maxseconds = argv.argc() > 2 ? atof(argv[2]) : 600;
+	FILE *out = NULL;
+
+	if (nomusic)
+	{
+		Printf ("Music is disabled.\n");
+		return;
+	}
+	FileReader *reader = OpenBenchReader(musicname);
+	if (reader == NULL)
+	{
+		Printf ("Music \"%s\" not found\n", musicname);
+		return;
+	}
+	if (argv.argc() > 3 && (out = fopen(argv[3], "wb")) == NULL)
+	{
+		Printf ("Could not open %s for writing\n", argv[3]);
+		delete reader;
+		return;
+	}
+
+	// Keep whatever is playing right now from competing for the CPU.
+	bool paused = currSong != NULL && currSong->m_Status == MusInfo::STATE_Playing;
+	if (paused)
+	{
+		currSong->Pause();
+	}
+
+	cycle_t opentime, rendertime;
+	opentime.Reset();
+	rendertime.Reset();
+
+	// Songs create their stream either when they are loaded or when
+	// they start playing, so capture stays on until both are done.
+	MusicBenchActive = true;
+	opentime.Clock();
+	MusInfo *song = I_RegisterSong(reader, MidiDevices.CheckKey(musicname));
+	if (song != NULL)
+	{
+		song->Play(false, 0);
+	}
+	opentime.Unclock();
+	MusicBenchActive = false;
+
+	FBenchStream *stream = BenchStream;
+	if (song == NULL || stream == NULL || !stream->Playing)
+	{
+		Printf ("\"%s\" %s\n", musicname, song == NULL ? "could not be opened" : "is not played by an internal synth");
+		delete song;
+		if (out != NULL) fclose(out);
+		if (paused) currSong->Resume();
+		return;
+	}
+
+	// The stream goes away with the song, so keep what the report needs.
+	int flags = stream->Flags;
+	int rate = stream->SampleRate;
+	int chunkbytes = stream->ChunkBytes;
+	int samplebytes = (flags & (SoundStream::Bits32 | SoundStream::Float)) ? 4 : (flags & SoundStream::Bits8) ? 1 : 2;
+	int channels = (flags & SoundStream::Mono) ? 1 : 2;
+	double maxframes = maxseconds * rate;
+	double frames = 0;
+	int peakvoices = song->GetVoiceCount();
+	int chunks = 0;
+	TArray<BYTE> buffer;
+	buffer.Resize(chunkbytes);
+
+	MusicEventCycles.Reset();
+	MusicSynthCycles.Reset();
+
+	while (frames < maxframes)
+	{
+		rendertime.Clock();
+		bool more = stream->Render(&buffer[0]);
+		rendertime.Unclock();
+
+		frames += chunkbytes / (samplebytes * channels);
+		chunks++;
+		peakvoices = MAX(peakvoices, song->GetVoiceCount());
+		if (out != NULL)
+		{
+			fwrite(&buffer[0], 1, chunkbytes, out);
+		}
+		if (!more)
+		{
+			break;
+		}
+	}
+
+	double seconds = frames / rate;
+	double total = rendertime.TimeMS();
+	double events = MusicEventCycles.TimeMS();
+	double synth = MusicSynthCycles.TimeMS();
+
+	song->Stop();
+	delete song;
+	if (paused)
+	{
+		currSong->Resume();
+	}
+
+	Printf ("%s: %.2f sec rendered at %d Hz, %d-bit %s%s, in %d chunks of %d bytes\n",
+		musicname, seconds, rate, samplebytes * 8, (flags & SoundStream::Float) ? "float " : "",
+		channels == 1 ? "mono" : "stereo", chunks, chunkbytes);
+	Printf ("  open    %9.2f ms\n", opentime.TimeMS());
+	Printf ("  render  %9.2f ms  %.1fx realtime\n", total, total > 0 ? seconds * 1000 / total : 0.);
+	Printf ("    events %8.2f ms\n", events);
+	Printf ("    synth  %8.2f ms\n", synth);
+	Printf ("    other  %8.2f ms\n", MAX(total - events - synth, 0.));
+	if (peakvoices >= 0)
+	{
+		Printf ("  peak voices %d\n", peakvoices);
+	}
+	if (out != NULL)
+	{
+		fclose(out);
+		Printf ("  raw output written to %s\n", argv[3]);
+	}
+}
@@ -31,6 +31,7 @@
 #include "i_sound.h"
 #include "i_system.h"
 #include "files.h"
+#include "stats.h"
 
 #undef CDECL	// w32api's windef.h defines this
 #include "../dumb/include/dumb.h"
@@ -49,6 +50,7 @@ public:
 	bool SetSubsong(int subsong);
 	void Play(bool looping, int subsong);
 	FString GetStats();
+	int GetVoiceCount();
 
 	FString Codec;
 	FString TrackerVersion;
@@ -1013,7 +1015,7 @@ input_mod::input_mod(DUH *myduh)
 	{
 		srate = (int)GSnd->GetOutputRate();
 	}
-	m_Stream = GSnd->CreateStream(read, 32*1024, SoundStream::Float, srate, this);
+	m_Stream = CreateMusicStream(read, 32*1024, SoundStream::Float, srate, this);
 	delta = 65536.0 / srate;
 }
 
@@ -1077,6 +1079,10 @@ bool input_mod::SetSubsong(int order)
 	}
 	duh_end_sigrenderer(oldsr);
 	crit_sec.Leave();
+	if (m_Stream != NULL)
+	{
+		m_Stream->Flush();
+	}
 	return true;
 }
 
@@ -1165,7 +1171,9 @@ int input_mod::decode_run(void *buffer, unsigned int size)
 
 retry:
 	dumb_silence(buf[0], size * 2);
+	MusicSynthCycles.Clock();
 	written = render(1, delta, samples, buf);
+	MusicSynthCycles.Unclock();
 
 	if (eof) return false;
 	else if (written == 0) goto retry;
@@ -1187,16 +1195,7 @@ FString input_mod::GetStats()
 	DUMB_IT_SIGDATA *itsd = duh_get_it_sigdata(duh);
 	FString out;
 
-	int channels = 0;
-	for (int i = 0; i < DUMB_IT_N_CHANNELS; i++)
-	{
-		IT_PLAYING * playing = itsr->channel[i].playing;
-		if (playing && !(playing->flags & IT_PLAYING_DEAD)) channels++;
-	}
-	for (int i = 0; i < DUMB_IT_N_NNA_CHANNELS; i++)
-	{
-		if (itsr->playing[i]) channels++;
-	}
+	int channels = GetVoiceCount();
 
 	if (itsr == NULL || itsd == NULL)
 	{
@@ -1217,6 +1216,33 @@ FString input_mod::GetStats()
 	return out;
 }
 
+//==========================================================================
+//
+// input_mod :: GetVoiceCount
+//
+//==========================================================================
+
+int input_mod::GetVoiceCount()
+{
+	DUMB_IT_SIGRENDERER *itsr = duh_get_it_sigrenderer(sr);
+	if (itsr == NULL)
+	{
+		return -1;
+	}
+
+	int channels = 0;
+	for (int i = 0; i < DUMB_IT_N_CHANNELS; i++)
+	{
+		IT_PLAYING * playing = itsr->channel[i].playing;
+		if (playing && !(playing->flags & IT_PLAYING_DEAD)) channels++;
+	}
+	for (int i = 0; i < DUMB_IT_N_NNA_CHANNELS; i++)
+	{
+		if (itsr->playing[i]) channels++;
+	}
+	return channels;
+}
+
 //==========================================================================
 //
 // dumb_decode_vorbis
@@ -642,6 +642,24 @@ FString FluidSynthMIDIDevice::GetStats()
 	return out;
 }
 
+//==========================================================================
+//
+// FluidSynthMIDIDevice :: GetVoiceCount
+//
+//==========================================================================
+
+int FluidSynthMIDIDevice::GetVoiceCount()
+{
+	if (FluidSynth == NULL)
+	{
+		return -1;
+	}
+	CritSec.Enter();
+	int voices = fluid_synth_get_active_voice_count(FluidSynth);
+	CritSec.Leave();
+	return voices;
+}
+
 #ifdef DYN_FLUIDSYNTH
 
 //==========================================================================
@@ -43,6 +43,7 @@
 #include <gme/gme.h>
 #include "v_text.h"
 #include "files.h"
+#include "stats.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -161,7 +162,7 @@ GMESong::GMESong(Music_Emu *emu, int sample_rate)
 	SampleRate = sample_rate;
 	CurrTrack = 0;
 	TrackInfo = NULL;
-	m_Stream = GSnd->CreateStream(Read, 32*1024, 0, sample_rate, this);
+	m_Stream = CreateMusicStream(Read, 32*1024, 0, sample_rate, this);
 }
 
 //==========================================================================
@@ -217,7 +218,15 @@ bool GMESong::SetSubsong(int track)
 	{
 		return false;
 	}
-	return StartTrack(track);
+	if (!StartTrack(track))
+	{
+		return false;
+	}
+	if (m_Stream != NULL)
+	{
+		m_Stream->Flush();
+	}
+	return true;
 }
 
 //==========================================================================
@@ -351,7 +360,9 @@ bool GMESong::Read(SoundStream *stream, void *buff, int len, void *userdata)
 			return false;
 		}
 	}
+	MusicSynthCycles.Clock();
 	err = gme_play(song->Emu, len >> 1, (short *)buff);
+	MusicSynthCycles.Unclock();
 	song->CritSec.Leave();
 	return (err == NULL);
 }
@@ -1367,6 +1367,17 @@ FString MIDIStreamer::GetStats()
 	return MIDI->GetStats();
 }
 
+//==========================================================================
+//
+// MIDIStreamer :: GetVoiceCount
+//
+//==========================================================================
+
+int MIDIStreamer::GetVoiceCount()
+{
+	return MIDI != NULL ? MIDI->GetVoiceCount() : -1;
+}
+
 //==========================================================================
 //
 // MIDIStreamer :: SetSubsong
@@ -1562,3 +1573,17 @@ FString MIDIDevice::GetStats()
 {
 	return "This MIDI device does not have any stats.";
 }
+
+//==========================================================================
+//
+// MIDIDevice :: GetVoiceCount
+//
+// Returns the number of voices currently sounding, or -1 if the device
+// does not know.
+//
+//==========================================================================
+
+int MIDIDevice::GetVoiceCount()
+{
+	return -1;
+}
@@ -37,7 +37,7 @@ OPLMUSSong::OPLMUSSong (FileReader &reader, const char *args)
 	OPL_SetCore(args);
 	Music = new OPLmusicFile (&reader);
 
-	m_Stream = GSnd->CreateStream (FillStream, samples*4,
+	m_Stream = CreateMusicStream (FillStream, samples*4,
 		(current_opl_core == 0 ? SoundStream::Mono : 0) | SoundStream::Float, int(OPL_SAMPLE_RATE), this);
 	if (m_Stream == NULL)
 	{
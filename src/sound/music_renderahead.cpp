@@ -0,0 +1,484 @@
+/*
+** music_renderahead.cpp
+** Renders callback-driven music streams ahead of time on their own thread
+**
+*/
+
+// HEADER FILES ------------------------------------------------------------
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+
+#include "i_musicinterns.h"
+#include "c_cvars.h"
+#include "stats.h"
+#include "templates.h"
+
+// TYPES -------------------------------------------------------------------
+
+//==========================================================================
+//
+// FRenderAheadStream
+//
+// Wraps a backend stream. Instead of running the song's fill callback
+// inside the backend's own stream callback, a producer thread calls it
+// early and stores the output in a ring buffer, so a slow render only
+// eats into the lead instead of causing a dropout. The backend callback
+// does nothing but copy out of the ring.
+//
+// The producer is the only thread that advances Tail and the backend
+// callback is the only one that advances Head. Discarding the ring (for
+// Play and Flush) is done by stopping the producer first and then asking
+// the consumer to skip ahead to the producer's final Tail.
+//
+//==========================================================================
+
+class FRenderAheadStream : public SoundStream
+{
+public:
+	FRenderAheadStream(SoundStreamCallback callback, int buffbytes, int flags, int samplerate, void *userdata, int aheadms);
+	~FRenderAheadStream();
+
+	bool Init();
+
+	bool Play(bool looping, float volume);
+	void Stop();
+	void SetVolume(float volume);
+	bool SetPaused(bool paused);
+	unsigned int GetPosition();
+	bool IsEnded();
+	bool SetPosition(unsigned int pos);
+	bool SetOrder(int order);
+	void Flush();
+	FString GetStats();
+
+private:
+	static bool ReadRing(SoundStream *stream, void *buff, int len, void *userdata);
+	bool Read(void *buff, int len);
+	void ProducerProc();
+	void StartProducer();
+	void StopProducer();
+	void Discard();
+
+	SoundStream *Stream;
+	SoundStreamCallback Callback;
+	void *UserData;
+	int ChunkBytes;
+	int Flags;
+	int SampleRate;
+	int BytesPerSecond;
+	BYTE Silence;
+
+	TArray<BYTE> Ring;
+	unsigned int RingMask;
+	std::atomic<unsigned int> Head;
+	std::atomic<unsigned int> Tail;
+	std::atomic<unsigned int> DiscardTo;
+	std::atomic<bool> DiscardPending;
+
+	std::thread Producer;
+	std::mutex Lock;
+	std::condition_variable Wake;		// The consumer made room.
+	std::condition_variable Filled;		// The producer wrote something.
+	std::atomic<bool> QuitProducer;
+	std::atomic<bool> SongEnded;
+
+	std::atomic<unsigned int> Underruns;
+	std::atomic<unsigned int> MaxRenderMicroseconds;
+};
+
+// EXTERNAL DATA DECLARATIONS ----------------------------------------------
+
+extern SoundRenderer *GSnd;
+
+// PUBLIC DATA DEFINITIONS -------------------------------------------------
+
+// How far ahead of playback music is rendered. 0 renders it inside the
+// backend's stream callback as before. Takes effect for the next song.
+CUSTOM_CVAR(Int, snd_musicrenderahead, 200, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+{
+	if (self < 0) self = 0;
+	else if (self > 2000) self = 2000;
+}
+
+// PRIVATE DATA DEFINITIONS ------------------------------------------------
+
+static std::atomic<unsigned int> TotalUnderruns;
+static std::atomic<unsigned int> BufferedMS;
+static std::atomic<unsigned int> AheadMS;
+
+// CODE --------------------------------------------------------------------
+
+//==========================================================================
+//
+// CreateMusicStream
+//
+// Creates a stream for a song that synthesizes its own output. If render
+// ahead is enabled, the stream is wrapped so the callback runs on a
+// separate thread. While musicbench is opening a song, the stream is
+// captured for it instead.
+//
+//==========================================================================
+
+SoundStream *CreateMusicStream(SoundStreamCallback callback, int buffbytes, int flags, int samplerate, void *userdata)
+{
+	if (MusicBenchActive)
+	{
+		return CreateBenchStream(callback, buffbytes, flags, samplerate, userdata);
+	}
+	if (snd_musicrenderahead > 0)
+	{
+		FRenderAheadStream *stream = new FRenderAheadStream(callback, buffbytes, flags, samplerate, userdata, snd_musicrenderahead);
+		if (stream->Init())
+		{
+			return stream;
+		}
+		delete stream;
+		return NULL;
+	}
+	return GSnd->CreateStream(callback, buffbytes, flags, samplerate, userdata);
+}
+
+//==========================================================================
+//
+// FRenderAheadStream Constructor
+//
+//==========================================================================
+
+FRenderAheadStream::FRenderAheadStream(SoundStreamCallback callback, int buffbytes, int flags, int samplerate, void *userdata, int aheadms)
+	: Stream(NULL), Callback(callback), UserData(userdata), ChunkBytes(buffbytes), Flags(flags), SampleRate(samplerate),
+	  Head(0), Tail(0), DiscardTo(0), DiscardPending(false),
+	  QuitProducer(false), SongEnded(false), Underruns(0), MaxRenderMicroseconds(0)
+{
+	int samplebytes = (flags & (SoundStream::Bits32 | SoundStream::Float)) ? 4 : (flags & SoundStream::Bits8) ? 1 : 2;
+	int channels = (flags & SoundStream::Mono) ? 1 : 2;
+
+	BytesPerSecond = samplerate * samplebytes * channels;
+	Silence = (flags & SoundStream::Bits8) ? 0x80 : 0;
+
+	// The ring must hold the requested lead plus one chunk in flight on
+	// either side, rounded up so positions can be masked.
+	unsigned int want = unsigned(double(BytesPerSecond) * aheadms / 1000) + ChunkBytes * 2;
+	unsigned int size = 1;
+	while (size < want) size <<= 1;
+	Ring.Resize(size);
+	RingMask = size - 1;
+	AheadMS = aheadms;
+}
+
+//==========================================================================
+//
+// FRenderAheadStream Destructor
+//
+//==========================================================================
+
+FRenderAheadStream::~FRenderAheadStream()
+{
+	StopProducer();
+	if (Stream != NULL)
+	{
+		delete Stream;
+	}
+	BufferedMS = 0;
+}
+
+//==========================================================================
+//
+// FRenderAheadStream :: Init
+//
+//==========================================================================
+
+bool FRenderAheadStream::Init()
+{
+	Stream = GSnd->CreateStream(ReadRing, ChunkBytes, Flags, SampleRate, this);
+	return Stream != NULL;
+}
+
+//==========================================================================
+//
+// FRenderAheadStream :: StartProducer
+//
+//==========================================================================
+
+void FRenderAheadStream::StartProducer()
+{
+	if (!Producer.joinable())
+	{
+		QuitProducer = false;
+		Producer = std::thread([this]() { ProducerProc(); });
+	}
+}
+
+//==========================================================================
+//
+// FRenderAheadStream :: StopProducer
+//
+// Waits for the producer to finish whatever it is rendering. After this
+// returns, the song's callback is no longer being called.
+//
+//==========================================================================
+
+void FRenderAheadStream::StopProducer()
+{
+	if (Producer.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(Lock);
+			QuitProducer = true;
+		}
+		Wake.notify_one();
+		Producer.join();
+	}
+}
+
+//==========================================================================
+//
+// FRenderAheadStream :: Discard
+//
+// Throws away everything in the ring. The producer must be stopped.
+//
+//==========================================================================
+
+void FRenderAheadStream::Discard()
+{
+	DiscardTo.store(Tail.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	DiscardPending.store(true, std::memory_order_release);
+	SongEnded = false;
+}
+
+//==========================================================================
+//
+// FRenderAheadStream :: ProducerProc
+//
+//==========================================================================
+
+void FRenderAheadStream::ProducerProc()
+{
+	TArray<BYTE> chunk;
+	unsigned int ringsize = Ring.Size();
+
+	chunk.Resize(ChunkBytes);
+	while (!QuitProducer)
+	{
+		unsigned int tail = Tail.load(std::memory_order_relaxed);
+		unsigned int head = DiscardPending.load(std::memory_order_acquire) ?
+			DiscardTo.load(std::memory_order_relaxed) : Head.load(std::memory_order_acquire);
+
+		if (ringsize - (tail - head) < (unsigned)ChunkBytes)
+		{
+			std::unique_lock<std::mutex> lock(Lock);
+			if (!QuitProducer)
+			{
+				Wake.wait_for(lock, std::chrono::milliseconds(10));
+			}
+			continue;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		bool more = Callback(this, &chunk[0], ChunkBytes, UserData);
+		unsigned int us = (unsigned int)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+		if (us > MaxRenderMicroseconds.load(std::memory_order_relaxed))
+		{
+			MaxRenderMicroseconds.store(us, std::memory_order_relaxed);
+		}
+
+		unsigned int pos = tail & RingMask;
+		unsigned int first = MIN<unsigned int>(ChunkBytes, ringsize - pos);
+		memcpy(&Ring[pos], &chunk[0], first);
+		memcpy(&Ring[0], &chunk[first], ChunkBytes - first);
+		Tail.store(tail + ChunkBytes, std::memory_order_release);
+		Filled.notify_one();
+
+		if (!more)
+		{
+			SongEnded = true;
+			break;
+		}
+	}
+	Filled.notify_one();
+}
+
+//==========================================================================
+//
+// FRenderAheadStream :: ReadRing											static
+//
+// Called by the backend.
+//
+//==========================================================================
+
+bool FRenderAheadStream::ReadRing(SoundStream *stream, void *buff, int len, void *userdata)
+{
+	return ((FRenderAheadStream *)userdata)->Read(buff, len);
+}
+
+//==========================================================================
+//
+// FRenderAheadStream :: Read
+//
+//==========================================================================
+
+bool FRenderAheadStream::Read(void *buff, int len)
+{
+	BYTE *out = (BYTE *)buff;
+	unsigned int ringsize = Ring.Size();
+	unsigned int head;
+
+	if (DiscardPending.load(std::memory_order_acquire))
+	{
+		head = DiscardTo.load(std::memory_order_relaxed);
+		Head.store(head, std::memory_order_release);
+		DiscardPending.store(false, std::memory_order_relaxed);
+	}
+	else
+	{
+		head = Head.load(std::memory_order_relaxed);
+	}
+
+	// Check for the end before looking at Tail, so that everything the
+	// producer wrote before it set SongEnded is seen.
+	bool ended = SongEnded;
+	unsigned int avail = Tail.load(std::memory_order_acquire) - head;
+	unsigned int count = MIN<unsigned int>(avail, len);
+	unsigned int pos = head & RingMask;
+	unsigned int first = MIN(count, ringsize - pos);
+
+	memcpy(out, &Ring[pos], first);
+	memcpy(out + first, &Ring[0], count - first);
+	Head.store(head + count, std::memory_order_release);
+	Wake.notify_one();
+
+	BufferedMS.store(unsigned(QWORD(avail - count) * 1000 / BytesPerSecond), std::memory_order_relaxed);
+
+	if (count < (unsigned)len)
+	{
+		memset(out + count, Silence, len - count);
+		if (ended)
+		{
+			return false;
+		}
+		Underruns++;
+		TotalUnderruns++;
+	}
+	return true;
+}
+
+//==========================================================================
+//
+// FRenderAheadStream :: Play
+//
+// Throws away anything left over from a previous play and gives the
+// producer a chance to render the first chunk before playback begins.
+//
+//==========================================================================
+
+bool FRenderAheadStream::Play(bool looping, float volume)
+{
+	StopProducer();
+	Discard();
+	StartProducer();
+	{
+		std::unique_lock<std::mutex> lock(Lock);
+		Filled.wait_for(lock, std::chrono::milliseconds(100), [this]() {
+			return SongEnded || Tail.load(std::memory_order_acquire) != DiscardTo.load(std::memory_order_relaxed);
+		});
+	}
+	return Stream->Play(looping, volume);
+}
+
+//==========================================================================
+//
+// FRenderAheadStream :: Stop
+//
+//==========================================================================
+
+void FRenderAheadStream::Stop()
+{
+	Stream->Stop();
+	StopProducer();
+}
+
+//==========================================================================
+//
+// FRenderAheadStream :: Flush
+//
+// Called when the song jumps somewhere else, so the new position is heard
+// right away instead of after everything that was already rendered.
+//
+//==========================================================================
+
+void FRenderAheadStream::Flush()
+{
+	if (Producer.joinable())
+	{
+		StopProducer();
+		Discard();
+		StartProducer();
+	}
+}
+
+//==========================================================================
+//
+// FRenderAheadStream :: forwarded methods
+//
+//==========================================================================
+
+void FRenderAheadStream::SetVolume(float volume)
+{
+	Stream->SetVolume(volume);
+}
+
+bool FRenderAheadStream::SetPaused(bool paused)
+{
+	return Stream->SetPaused(paused);
+}
+
+unsigned int FRenderAheadStream::GetPosition()
+{
+	return Stream->GetPosition();
+}
+
+bool FRenderAheadStream::IsEnded()
+{
+	return Stream->IsEnded();
+}
+
+bool FRenderAheadStream::SetPosition(unsigned int pos)
+{
+	return Stream->SetPosition(pos);
+}
+
+bool FRenderAheadStream::SetOrder(int order)
+{
+	return Stream->SetOrder(order);
+}
+
+//==========================================================================
+//
+// FRenderAheadStream :: GetStats
+//
+//==========================================================================
+
+FString FRenderAheadStream::GetStats()
+{
+	FString out = Stream->GetStats();
+	out.AppendFormat("\nAhead: %u/%d ms, underruns: %u, slowest render: %u us",
+		BufferedMS.load(), int(AheadMS.load()), Underruns.load(), MaxRenderMicroseconds.load());
+	return out;
+}
+
+//==========================================================================
+//
+// STAT musicahead
+//
+//==========================================================================
+
+ADD_STAT(musicahead)
+{
+	FString out;
+	out.Format("Music rendered ahead: %u/%u ms, underruns: %u",
+		BufferedMS.load(), AheadMS.load(), TotalUnderruns.load());
+	return out;
+}
@@ -41,6 +41,7 @@
 #include "w_wad.h"
 #include "v_text.h"
 #include "i_system.h"
+#include "stats.h"
 
 // MACROS ------------------------------------------------------------------
 
@@ -102,7 +103,7 @@ int SoftSynthMIDIDevice::OpenStream(int chunks, int flags, void (*callback)(unsi
 	{
 		chunksize *= 2;
 	}
-	Stream = GSnd->CreateStream(FillStream, chunksize, SoundStream::Float | flags, SampleRate, this);
+	Stream = CreateMusicStream(FillStream, chunksize, SoundStream::Float | flags, SampleRate, this);
 	if (Stream == NULL)
 	{
 		return 2;
@@ -404,7 +405,9 @@ bool SoftSynthMIDIDevice::ServiceStream (void *buff, int numbytes)
 
 		if (samplesleft > 0)
 		{
+			MusicSynthCycles.Clock();
 			ComputeOutput(samples1, samplesleft);
+			MusicSynthCycles.Unclock();
 			assert(NextTickIn == ticky);
 			NextTickIn -= samplesleft;
 			assert(NextTickIn >= 0);
@@ -414,13 +417,17 @@ bool SoftSynthMIDIDevice::ServiceStream (void *buff, int numbytes)
 		
 		if (NextTickIn < 1)
 		{
+			MusicEventCycles.Clock();
 			int next = PlayTick();
+			MusicEventCycles.Unclock();
 			assert(next >= 0);
 			if (next == 0)
 			{ // end of song
 				if (numsamples > 0)
 				{
+					MusicSynthCycles.Clock();
 					ComputeOutput(samples1, numsamples);
+					MusicSynthCycles.Unclock();
 				}
 				res = false;
 				break;
@@ -238,6 +238,28 @@ FString TimidityMIDIDevice::GetStats()
 	return out;
 }
 
+//==========================================================================
+//
+// TimidityMIDIDevice :: GetVoiceCount
+//
+//==========================================================================
+
+int TimidityMIDIDevice::GetVoiceCount()
+{
+	int i, used;
+
+	CritSec.Enter();
+	for (i = used = 0; i < Renderer->voices; ++i)
+	{
+		if (Renderer->voice[i].status & Timidity::VOICE_RUNNING)
+		{
+			used++;
+		}
+	}
+	CritSec.Leave();
+	return used;
+}
+
 //==========================================================================
 //
 // TimidityWaveWriterMIDIDevice Constructor
@@ -222,6 +222,17 @@ FString WildMIDIDevice::GetStats()
 	return out;
 }
 
+//==========================================================================
+//
+// WildMIDIDevice :: GetVoiceCount
+//
+//==========================================================================
+
+int WildMIDIDevice::GetVoiceCount()
+{
+	return Renderer->GetVoiceCount();
+}
+
 //==========================================================================
 //
 // WildMIDIDevice :: GetStats
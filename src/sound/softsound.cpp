@@ -0,0 +1,1446 @@
+/*
+** softsound.cpp
+** Software mixing sound renderer
+**
+** Everything is mixed in floating point on a dedicated thread (or inside
+** the SDL audio callback) and the result is written as 16-bit stereo to
+** SDL, a .wav file, a pipe, or nowhere at all. Because the mixer does not
+** depend on any audio library, it also works for headless capture runs and
+** is not bound by a driver's hardware voice limit.
+**
+*/
+
+#include <functional>
+#include <chrono>
+#include <math.h>
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SOFTMIX_SSE2
+#endif
+
+#ifdef HAVE_SDL
+#include <SDL.h>
+#endif
+
+#include "doomtype.h"
+#include "templates.h"
+#include "softsound.h"
+#include "c_cvars.h"
+#include "c_dispatch.h"
+#include "i_system.h"
+#include "v_text.h"
+#include "files.h"
+#include "cmdlib.h"
+
+#ifdef HAVE_SDL
+#define DEF_SOFTDEVICE "sdl"
+#else
+#define DEF_SOFTDEVICE "null"
+#endif
+
+// "sdl", "null", "wav:<filename>" or "pipe:<command>"
+CVAR (String, snd_softdevice, DEF_SOFTDEVICE, CVAR_ARCHIVE|CVAR_GLOBALCONFIG)
+
+EXTERN_CVAR (Int, snd_channels)
+EXTERN_CVAR (Int, snd_samplerate)
+EXTERN_CVAR (Int, snd_buffersize)
+EXTERN_CVAR (Bool, snd_pitched)
+EXTERN_CVAR (Bool, snd_flipstereo)
+
+#define MAKE_PTRID(x)  ((void*)(uintptr_t)(x))
+#define GET_PTRID(x)  ((uint32)(uintptr_t)(x))
+
+#define AREA_SOUND_RADIUS  (32.f)
+
+#define PITCH_MULT (0.7937005f) /* Approx. 4 semitones lower; what Nash suggested */
+
+#define PITCH(pitch) (snd_pitched ? (pitch)/128.f : 1.f)
+
+// Largest number of frames mixed in one pass. Outputs that ask for more
+// are served in several passes.
+#define MAX_MIX_FRAMES		1024
+
+#define FRACUNIT32			(QWORD(1) << 32)
+
+//==========================================================================
+//
+// SoftSample
+//
+// A fully decoded sound, stored as normalized floats. One extra frame is
+// appended so the interpolator can always read one frame past the end.
+//
+//==========================================================================
+
+struct SoftSample
+{
+	TArray<float> Data;
+	int Channels;
+	int Frequency;
+	unsigned int Frames;
+	unsigned int LoopStart;
+	unsigned int LoopEnd;
+};
+
+static SoftSample *MakeSample(const BYTE *sfxdata, int length, int frequency, int channels, int bits, int loopstart, int loopend, bool monoize)
+{
+	int bytes = abs(bits) / 8;
+	if ((bytes != 1 && bytes != 2) || channels < 1 || channels > 2 || frequency <= 0)
+	{
+		Printf("Unhandled format: %d bit, %d channel, %d hz\n", bits, channels, frequency);
+		return NULL;
+	}
+	unsigned int frames = length / (bytes * channels);
+	if (frames == 0)
+	{
+		return NULL;
+	}
+	int outchans = monoize ? 1 : channels;
+
+	SoftSample *sample = new SoftSample;
+	sample->Channels = outchans;
+	sample->Frequency = frequency;
+	sample->Frames = frames;
+	sample->Data.Resize((frames + 1) * outchans);
+
+	for (unsigned int i = 0; i < frames; i++)
+	{
+		float in[2];
+		for (int c = 0; c < channels; c++)
+		{
+			int pos = i * channels + c;
+			if (bits == 8)
+				in[c] = (sfxdata[pos] - 128) / 128.f;
+			else if (bits == -8)
+				in[c] = SBYTE(sfxdata[pos]) / 128.f;
+			else
+				in[c] = SWORD(sfxdata[pos*2] | (sfxdata[pos*2+1] << 8)) / 32768.f;
+		}
+		if (outchans < channels)
+		{
+			sample->Data[i] = (in[0] + in[1]) * 0.5f;
+		}
+		else for (int c = 0; c < outchans; c++)
+		{
+			sample->Data[i*outchans + c] = in[c];
+		}
+	}
+
+	if (loopstart < 0 || unsigned(loopstart) >= frames)
+		loopstart = 0;
+	if (loopend <= loopstart || unsigned(loopend) > frames)
+		loopend = frames;
+	sample->LoopStart = loopstart;
+	sample->LoopEnd = loopend;
+
+	// The guard frame repeats the loop start, so looping voices interpolate
+	// seamlessly and one-shot voices only see it for their last half sample.
+	for (int c = 0; c < outchans; c++)
+	{
+		sample->Data[frames*outchans + c] = sample->Data[sample->LoopStart*outchans + c];
+	}
+	return sample;
+}
+
+//==========================================================================
+//
+// Mixing primitives
+//
+// The gain ramps linearly from g to g+d*count over the block, so changing
+// a voice's pan or volume from one tic to the next does not click.
+//
+//==========================================================================
+
+static void MixMonoToStereo(float *out, const float *in, int count, float gl, float gr, float dl, float dr)
+{
+	int i = 0;
+#ifdef SOFTMIX_SSE2
+	__m128 g = _mm_setr_ps(gl, gr, gl + dl, gr + dr);
+	const __m128 gstep = _mm_setr_ps(dl*2, dr*2, dl*2, dr*2);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 s = _mm_loadu_ps(in + i);
+		__m128 lo = _mm_unpacklo_ps(s, s);
+		__m128 hi = _mm_unpackhi_ps(s, s);
+		__m128 o0 = _mm_loadu_ps(out + i*2);
+		__m128 o1 = _mm_loadu_ps(out + i*2 + 4);
+		o0 = _mm_add_ps(o0, _mm_mul_ps(lo, g));
+		g = _mm_add_ps(g, gstep);
+		o1 = _mm_add_ps(o1, _mm_mul_ps(hi, g));
+		g = _mm_add_ps(g, gstep);
+		_mm_storeu_ps(out + i*2, o0);
+		_mm_storeu_ps(out + i*2 + 4, o1);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		out[i*2] += in[i] * (gl + dl*i);
+		out[i*2+1] += in[i] * (gr + dr*i);
+	}
+}
+
+static void MixStereoToStereo(float *out, const float *in, int count, float gl, float gr, float dl, float dr)
+{
+	int i = 0;
+#ifdef SOFTMIX_SSE2
+	__m128 g = _mm_setr_ps(gl, gr, gl + dl, gr + dr);
+	const __m128 gstep = _mm_setr_ps(dl*2, dr*2, dl*2, dr*2);
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128 s = _mm_loadu_ps(in + i*2);
+		__m128 o = _mm_loadu_ps(out + i*2);
+		_mm_storeu_ps(out + i*2, _mm_add_ps(o, _mm_mul_ps(s, g)));
+		g = _mm_add_ps(g, gstep);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		out[i*2] += in[i*2] * (gl + dl*i);
+		out[i*2+1] += in[i*2+1] * (gr + dr*i);
+	}
+}
+
+static void ConvertToS16(SWORD *out, const float *in, int count, float volume)
+{
+	int i = 0;
+#ifdef SOFTMIX_SSE2
+	const __m128 scale = _mm_set1_ps(volume * 32767.f);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), scale));
+		__m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale));
+		_mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(a, b));
+	}
+#endif
+	for (; i < count; i++)
+	{
+		int s = int(in[i] * volume * 32767.f);
+		out[i] = (SWORD)clamp(s, -32768, 32767);
+	}
+}
+
+// Linear interpolation; the source must have one readable frame past
+// the last position visited.
+static void Resample(float *out, const float *data, int chans, QWORD pos, QWORD step, int count)
+{
+	const float fracscale = 1.f / 4294967296.f;
+	if (chans == 1)
+	{
+		if (step == FRACUNIT32 && (pos & 0xffffffff) == 0)
+		{
+			memcpy(out, data + (pos >> 32), count * sizeof(float));
+			return;
+		}
+		for (int i = 0; i < count; i++, pos += step)
+		{
+			const float *s = data + (pos >> 32);
+			float frac = (pos & 0xffffffff) * fracscale;
+			out[i] = s[0] + (s[1] - s[0]) * frac;
+		}
+	}
+	else
+	{
+		for (int i = 0; i < count; i++, pos += step)
+		{
+			const float *s = data + (pos >> 32) * 2;
+			float frac = (pos & 0xffffffff) * fracscale;
+			out[i*2] = s[0] + (s[2] - s[0]) * frac;
+			out[i*2+1] = s[1] + (s[3] - s[1]) * frac;
+		}
+	}
+}
+
+static void PanGains(float pan, float gain, float out[2])
+{
+	// Constant power panning
+	out[0] = gain * sqrtf((1.f - pan) * 0.5f);
+	out[1] = gain * sqrtf((1.f + pan) * 0.5f);
+}
+
+
+//==========================================================================
+//
+// SoftSoundStream
+//
+//==========================================================================
+
+class SoftSoundStream : public SoundStream
+{
+	SoftSoundRenderer *Renderer;
+
+	SoundStreamCallback Callback;
+	void *UserData;
+
+	TArray<BYTE> Data;
+	TArray<float> Buffer;		// decoded stereo frames waiting to be resampled
+	unsigned int BufferFrames;
+	QWORD Pos;
+
+	int SampleRate;
+	int Flags;
+	int FrameSize;
+
+	std::atomic<bool> Playing;
+	std::atomic<bool> Paused;
+	std::atomic<float> Volume;
+	bool Looping;
+
+	FileReader *Reader;
+	SoundDecoder *Decoder;
+
+	static bool DecoderCallback(SoundStream *_sstream, void *ptr, int length, void *user)
+	{
+		SoftSoundStream *self = static_cast<SoftSoundStream*>(_sstream);
+		if (length < 0) return false;
+
+		size_t got = self->Decoder->read((char*)ptr, length);
+		if (got < (unsigned int)length)
+		{
+			if (!self->Looping || !self->Decoder->seek(0))
+				return false;
+			got += self->Decoder->read((char*)ptr+got, length-got);
+		}
+		return (got == (unsigned int)length);
+	}
+
+	// Converts one callback's worth of data and appends it to Buffer.
+	bool Refill()
+	{
+		if (!Callback(this, &Data[0], Data.Size(), UserData))
+			return false;
+
+		int chans = (Flags & Mono) ? 1 : 2;
+		unsigned int frames = Data.Size() / FrameSize;
+		Buffer.Resize((BufferFrames + frames) * 2);
+		float *out = &Buffer[BufferFrames * 2];
+		for (unsigned int i = 0; i < frames; i++)
+		{
+			float in[2];
+			for (int c = 0; c < chans; c++)
+			{
+				int pos = i * chans + c;
+				if (Flags & Bits8)
+					in[c] = (Data[pos] - 128) / 128.f;
+				else if (Flags & Float)
+					in[c] = ((float *)&Data[0])[pos];
+				else if (Flags & Bits32)
+					in[c] = ((int32_t *)&Data[0])[pos] / 2147483648.f;
+				else
+					in[c] = ((SWORD *)&Data[0])[pos] / 32768.f;
+			}
+			out[i*2] = in[0];
+			out[i*2+1] = in[chans - 1];
+		}
+		BufferFrames += frames;
+		return true;
+	}
+
+public:
+	SoftSoundStream(SoftSoundRenderer *renderer)
+		: Renderer(renderer), Callback(NULL), UserData(NULL), BufferFrames(0), Pos(0),
+		  SampleRate(0), Flags(0), FrameSize(0), Playing(false), Paused(false), Volume(1.f),
+		  Looping(false), Reader(NULL), Decoder(NULL)
+	{
+		Renderer->AddStream(this);
+	}
+
+	virtual ~SoftSoundStream()
+	{
+		Renderer->RemoveStream(this);
+		delete Decoder;
+		delete Reader;
+	}
+
+	virtual bool Play(bool loop, float vol)
+	{
+		SetVolume(vol);
+		Playing.store(true);
+		return true;
+	}
+
+	virtual void Stop()
+	{
+		std::lock_guard<std::mutex> lock(Renderer->StreamLock);
+		Playing.store(false);
+	}
+
+	virtual void SetVolume(float vol)
+	{
+		Volume.store(vol);
+	}
+
+	virtual bool SetPaused(bool pause)
+	{
+		Paused.store(pause);
+		return true;
+	}
+
+	virtual bool SetPosition(unsigned int ms_pos)
+	{
+		std::lock_guard<std::mutex> lock(Renderer->StreamLock);
+		if (Decoder == NULL || !Decoder->seek(ms_pos))
+			return false;
+		BufferFrames = 0;
+		Pos = 0;
+		return true;
+	}
+
+	virtual unsigned int GetPosition()
+	{
+		if (Decoder == NULL)
+			return 0;
+		std::lock_guard<std::mutex> lock(Renderer->StreamLock);
+		return (unsigned int)(Decoder->getSampleOffset() * 1000.0 / SampleRate);
+	}
+
+	virtual bool IsEnded()
+	{
+		return !Playing.load();
+	}
+
+	virtual FString GetStats()
+	{
+		FString stats;
+		stats.Format("%s, %u frames buffered, %uHz", Paused.load() ? "paused" : Playing.load() ? "playing" : "stopped",
+			BufferFrames - unsigned(Pos >> 32), SampleRate);
+		return stats;
+	}
+
+	// Called by the mixer with StreamLock held.
+	void Mix(float *out, int frames, int outrate, float musicvolume)
+	{
+		if (!Playing.load() || Paused.load())
+			return;
+
+		const QWORD step = (QWORD(SampleRate) << 32) / outrate;
+		const unsigned int needed = unsigned((Pos + step * (frames - 1)) >> 32) + 2;
+
+		if (BufferFrames < needed)
+		{
+			// Discard what has already been played before asking for more.
+			unsigned int drop = unsigned(Pos >> 32);
+			if (drop > 0)
+			{
+				memmove(&Buffer[0], &Buffer[drop * 2], (BufferFrames - drop) * 2 * sizeof(float));
+				BufferFrames -= drop;
+				Pos -= QWORD(drop) << 32;
+			}
+			unsigned int want = needed - drop;
+			while (BufferFrames < want)
+			{
+				if (!Refill())
+				{
+					Playing.store(false);
+					return;
+				}
+			}
+		}
+
+		float volume = musicvolume * Volume.load();
+		const float fracscale = 1.f / 4294967296.f;
+		const float *data = &Buffer[0];
+		QWORD pos = Pos;
+		for (int i = 0; i < frames; i++, pos += step)
+		{
+			const float *s = data + (pos >> 32) * 2;
+			float frac = (pos & 0xffffffff) * fracscale;
+			out[i*2] += (s[0] + (s[2] - s[0]) * frac) * volume;
+			out[i*2+1] += (s[1] + (s[3] - s[1]) * frac) * volume;
+		}
+		Pos = pos;
+	}
+
+	bool Init(SoundStreamCallback callback, int buffbytes, int flags, int samplerate, void *userdata)
+	{
+		Callback = callback;
+		UserData = userdata;
+		SampleRate = samplerate;
+		Flags = flags;
+
+		FrameSize = (flags & Bits8) ? 1 : (flags & (Bits32|Float)) ? 4 : 2;
+		if (!(flags & Mono))
+			FrameSize *= 2;
+
+		buffbytes += FrameSize-1;
+		buffbytes -= buffbytes%FrameSize;
+		if (buffbytes <= 0 || samplerate <= 0)
+			return false;
+		Data.Resize(buffbytes);
+		return true;
+	}
+
+	bool Init(FileReader *reader, bool loop)
+	{
+		Reader = reader;
+		Decoder = Renderer->CreateDecoder(Reader);
+		if (Decoder == NULL)
+			return false;
+
+		ChannelConfig chans;
+		SampleType type;
+		int srate;
+
+		Decoder->getInfo(&srate, &chans, &type);
+		if ((chans != ChannelConfig_Mono && chans != ChannelConfig_Stereo) ||
+			(type != SampleType_UInt8 && type != SampleType_Int16))
+		{
+			Printf("Unsupported audio format: %s, %s\n", GetChannelConfigName(chans),
+				GetSampleTypeName(type));
+			return false;
+		}
+		int flags = 0;
+		if (chans == ChannelConfig_Mono) flags |= Mono;
+		if (type == SampleType_UInt8) flags |= Bits8;
+		Looping = loop;
+
+		return Init(DecoderCallback, (srate / 5) * 4, flags, srate, NULL);
+	}
+};
+
+
+//==========================================================================
+//
+// SoftSoundRenderer
+//
+//==========================================================================
+
+SoftSoundRenderer::SoftSoundRenderer()
+	: SampleRate(44100), NumVoices(0), OutputType(OUTPUT_Null), OutputFile(NULL), OutputBytes(0),
+	  SDLDevice(0), Valid(false), QuitThread(false), MixVoices(NULL), GameVoices(NULL), Feedback(NULL),
+	  SfxVolume(1.f), MusicVolume(1.f), SFXPaused(0), SyncPaused(false), Inactive(INACTIVE_Active),
+	  MixClock(0), WasInWater(false), ActiveVoices(0), PeakVoices(0), MixMicroseconds(0), CommandOverflows(0)
+{
+	Printf("I_InitSound: Initializing software mixer\n");
+
+	if (*snd_samplerate > 0)
+		SampleRate = *snd_samplerate;
+
+	// The mixer is not limited by any driver, so take snd_channels at face value.
+	NumVoices = MAX<int>(*snd_channels, 2);
+	MixVoices = new FMixVoice[NumVoices];
+	GameVoices = new FGameVoice[NumVoices];
+	Feedback = new FVoiceFeedback[NumVoices];
+	memset(MixVoices, 0, sizeof(FMixVoice) * NumVoices);
+	memset(GameVoices, 0, sizeof(FGameVoice) * NumVoices);
+	for (int i = NumVoices - 1; i >= 0; i--)
+	{
+		Feedback[i].EndedGeneration.store(0);
+		Feedback[i].Position.store(0);
+		FreeVoices.Push(i);
+	}
+
+	MixBuffer.Resize(MAX_MIX_FRAMES * 2);
+	ResampleBuffer.Resize(MAX_MIX_FRAMES * 2);
+
+	Valid = OpenOutput();
+	if (Valid)
+	{
+		Printf("  Output: " TEXTCOLOR_ORANGE "%s" TEXTCOLOR_NORMAL ", %d Hz, %d voices\n", *OutputName, SampleRate, NumVoices);
+	}
+}
+
+SoftSoundRenderer::~SoftSoundRenderer()
+{
+	CloseOutput();
+
+	// Whatever the mixer did not get to, including freeing samples.
+	ProcessCommands();
+
+	delete[] MixVoices;
+	delete[] GameVoices;
+	delete[] Feedback;
+}
+
+//==========================================================================
+//
+// Output handling
+//
+//==========================================================================
+
+#ifdef HAVE_SDL
+static void SDLCALL SoftSoundCallback(void *userdata, Uint8 *stream, int len)
+{
+	static_cast<SoftSoundRenderer *>(userdata)->MixBlock((SWORD *)stream, len / 4);
+}
+#endif
+
+static void WriteLE(FILE *file, DWORD value, int size)
+{
+	for (int i = 0; i < size; i++)
+	{
+		fputc((value >> (i*8)) & 0xff, file);
+	}
+}
+
+static void WriteWaveHeader(FILE *file, int rate, DWORD databytes)
+{
+	fwrite("RIFF", 1, 4, file);
+	WriteLE(file, databytes + 36, 4);
+	fwrite("WAVEfmt ", 1, 8, file);
+	WriteLE(file, 16, 4);
+	WriteLE(file, 1, 2);			// PCM
+	WriteLE(file, 2, 2);			// channels
+	WriteLE(file, rate, 4);
+	WriteLE(file, rate * 4, 4);		// bytes per second
+	WriteLE(file, 4, 2);			// block align
+	WriteLE(file, 16, 2);			// bits per sample
+	fwrite("data", 1, 4, file);
+	WriteLE(file, databytes, 4);
+}
+
+bool SoftSoundRenderer::OpenOutput()
+{
+	const char *device = snd_softdevice;
+
+	if (strnicmp(device, "wav:", 4) == 0)
+	{
+		OutputType = OUTPUT_WaveFile;
+		OutputName = NicePath(device + 4);
+		OutputFile = fopen(OutputName, "wb");
+		if (OutputFile == NULL)
+		{
+			Printf(TEXTCOLOR_RED "Could not open %s for writing\n", *OutputName);
+			return false;
+		}
+		WriteWaveHeader(OutputFile, SampleRate, 0);
+	}
+	else if (strnicmp(device, "pipe:", 5) == 0)
+	{
+		OutputType = OUTPUT_Pipe;
+		OutputName = device + 5;
+#ifdef _WIN32
+		OutputFile = _popen(OutputName, "wb");
+#else
+		// Without this, writing to the pipe after the reader exits kills us
+		// instead of failing, so OutputProc never gets to close it.
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = SIG_IGN;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGPIPE, &sa, NULL);
+		OutputFile = popen(OutputName, "w");
+#endif
+		if (OutputFile == NULL)
+		{
+			Printf(TEXTCOLOR_RED "Could not start %s\n", *OutputName);
+			return false;
+		}
+		// A header with unknown length; most consumers accept that from a pipe.
+		WriteWaveHeader(OutputFile, SampleRate, 0xFFFFFFFF - 36);
+	}
+	else if (stricmp(device, "sdl") == 0)
+	{
+#ifdef HAVE_SDL
+		OutputType = OUTPUT_SDL;
+		OutputName = "SDL";
+		if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+		{
+			Printf(TEXTCOLOR_RED "Could not initialize SDL audio: %s\n", SDL_GetError());
+			return false;
+		}
+		SDL_AudioSpec want, have;
+		memset(&want, 0, sizeof(want));
+		want.freq = SampleRate;
+		want.format = AUDIO_S16SYS;
+		want.channels = 2;
+		want.samples = *snd_buffersize > 0 ? *snd_buffersize : 1024;
+		want.callback = SoftSoundCallback;
+		want.userdata = this;
+		SDLDevice = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+		if (SDLDevice == 0)
+		{
+			Printf(TEXTCOLOR_RED "Could not open SDL audio device: %s\n", SDL_GetError());
+			SDL_QuitSubSystem(SDL_INIT_AUDIO);
+			return false;
+		}
+		SampleRate = have.freq;
+		SDL_PauseAudioDevice(SDLDevice, 0);
+		return true;
+#else
+		Printf(TEXTCOLOR_RED "SDL output is not available in this build\n");
+		return false;
+#endif
+	}
+	else
+	{
+		if (stricmp(device, "null") != 0)
+		{
+			Printf(TEXTCOLOR_RED "%s: Unknown output device; mixing to nowhere\n", device);
+		}
+		OutputType = OUTPUT_Null;
+		OutputName = "null";
+	}
+
+	OutputThread = std::thread(std::mem_fn(&SoftSoundRenderer::OutputProc), this);
+	return true;
+}
+
+void SoftSoundRenderer::CloseOutput()
+{
+#ifdef HAVE_SDL
+	if (SDLDevice != 0)
+	{
+		SDL_CloseAudioDevice(SDLDevice);
+		SDL_QuitSubSystem(SDL_INIT_AUDIO);
+		SDLDevice = 0;
+	}
+#endif
+	if (OutputThread.joinable())
+	{
+		QuitThread.store(true);
+		OutputThread.join();
+	}
+	CloseOutputFile();
+}
+
+void SoftSoundRenderer::CloseOutputFile()
+{
+	if (OutputFile != NULL)
+	{
+		if (OutputType == OUTPUT_WaveFile)
+		{
+			fseek(OutputFile, 0, SEEK_SET);
+			WriteWaveHeader(OutputFile, SampleRate, OutputBytes);
+			fclose(OutputFile);
+		}
+		else
+		{
+#ifdef _WIN32
+			_pclose(OutputFile);
+#else
+			pclose(OutputFile);
+#endif
+		}
+		OutputFile = NULL;
+	}
+}
+
+bool SoftSoundRenderer::WriteOutput(const SWORD *data, int frames)
+{
+	if (OutputFile == NULL)
+		return true;
+
+#ifdef __BIG_ENDIAN__
+	for (int i = 0; i < frames * 2; i++)
+	{
+		WriteLE(OutputFile, WORD(data[i]), 2);
+	}
+#else
+	if (fwrite(data, 4, frames, OutputFile) != size_t(frames))
+		return false;
+#endif
+	OutputBytes += frames * 4;
+	return true;
+}
+
+// Drives outputs that do not pull data themselves. Mixing is paced against
+// the wall clock so that sounds stay in sync with the game.
+void SoftSoundRenderer::OutputProc()
+{
+	const int blockframes = clamp<int>(*snd_buffersize > 0 ? *snd_buffersize : 512, 64, 8192);
+	TArray<SWORD> block;
+	block.Resize(blockframes * 2);
+	auto start = std::chrono::steady_clock::now();
+	QWORD written = 0;
+
+	while (!QuitThread.load())
+	{
+		MixBlock(&block[0], blockframes);
+		if (!WriteOutput(&block[0], blockframes))
+		{
+			// The reader went away; keep mixing so that the game side
+			// still sees channels finish.
+			CloseOutputFile();
+			OutputType = OUTPUT_Null;
+		}
+		written += blockframes;
+		std::this_thread::sleep_until(start + std::chrono::microseconds(written * 1000000 / SampleRate));
+	}
+}
+
+//==========================================================================
+//
+// Mixer thread
+//
+//==========================================================================
+
+void SoftSoundRenderer::ProcessCommands()
+{
+	FCommand cmd;
+	while (Commands.Pop(cmd))
+	{
+		FMixVoice *voice = cmd.Voice >= 0 ? &MixVoices[cmd.Voice] : NULL;
+		switch (cmd.Type)
+		{
+		case CMD_Start:
+			voice->Sample = cmd.Sample;
+			voice->Pos = QWORD(cmd.Offset) << 32;
+			voice->Step = QWORD(cmd.Pitch * cmd.Sample->Frequency / SampleRate * 4294967296.0);
+			voice->Gain[0] = voice->TargetGain[0] = cmd.Gain[0];
+			voice->Gain[1] = voice->TargetGain[1] = cmd.Gain[1];
+			voice->Generation = cmd.Generation;
+			voice->Flags = cmd.Flags;
+			voice->Active = true;
+			Feedback[cmd.Voice].Position.store(cmd.Offset, std::memory_order_relaxed);
+			break;
+
+		case CMD_Stop:
+			if (voice->Generation == cmd.Generation)
+			{
+				voice->Active = false;
+			}
+			break;
+
+		case CMD_Update:
+			if (voice->Generation == cmd.Generation && voice->Active)
+			{
+				voice->TargetGain[0] = cmd.Gain[0];
+				voice->TargetGain[1] = cmd.Gain[1];
+				voice->Step = QWORD(cmd.Pitch * voice->Sample->Frequency / SampleRate * 4294967296.0);
+			}
+			break;
+
+		case CMD_FreeSample:
+			// Every voice using this sample was stopped by commands queued
+			// before this one.
+			delete cmd.Sample;
+			break;
+		}
+	}
+}
+
+void SoftSoundRenderer::MixVoice(FMixVoice &voice, int frames)
+{
+	SoftSample *sample = voice.Sample;
+	const int chans = sample->Channels;
+	const bool loop = !!(voice.Flags & VOICE_Loop);
+	const QWORD end = QWORD(loop ? sample->LoopEnd : sample->Frames) << 32;
+	float *res = &ResampleBuffer[0];
+	int done = 0;
+
+	while (done < frames)
+	{
+		if (voice.Pos >= end)
+		{
+			if (!loop || voice.Step == 0)
+			{
+				voice.Active = false;
+				break;
+			}
+			QWORD looplen = QWORD(sample->LoopEnd - sample->LoopStart) << 32;
+			voice.Pos = (QWORD(sample->LoopStart) << 32) + (voice.Pos - end) % looplen;
+		}
+		int count = int(MIN<QWORD>(frames - done, (end - voice.Pos + voice.Step - 1) / MAX<QWORD>(voice.Step, 1)));
+		Resample(res + done*chans, &sample->Data[0], chans, voice.Pos, voice.Step, count);
+		voice.Pos += voice.Step * count;
+		done += count;
+	}
+
+	if (done > 0)
+	{
+		float sfxvolume = SfxVolume.load(std::memory_order_relaxed);
+		float gl = voice.Gain[0] * sfxvolume, gr = voice.Gain[1] * sfxvolume;
+		float dl = (voice.TargetGain[0] * sfxvolume - gl) / frames;
+		float dr = (voice.TargetGain[1] * sfxvolume - gr) / frames;
+		if (chans == 1)
+			MixMonoToStereo(&MixBuffer[0], res, done, gl, gr, dl, dr);
+		else
+			MixStereoToStereo(&MixBuffer[0], res, done, gl, gr, dl, dr);
+	}
+	voice.Gain[0] = voice.TargetGain[0];
+	voice.Gain[1] = voice.TargetGain[1];
+}
+
+void SoftSoundRenderer::MixStreams(int frames)
+{
+	std::lock_guard<std::mutex> lock(StreamLock);
+	float musicvolume = MusicVolume.load(std::memory_order_relaxed);
+	for (unsigned int i = 0; i < Streams.Size(); i++)
+	{
+		Streams[i]->Mix(&MixBuffer[0], frames, SampleRate, musicvolume);
+	}
+}
+
+void SoftSoundRenderer::MixBlock(SWORD *out, int frames)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	ProcessCommands();
+
+	int inactive = Inactive.load();
+	if (inactive == INACTIVE_Complete)
+	{
+		memset(out, 0, frames * 4);
+		return;
+	}
+
+	int active = 0;
+	while (frames > 0)
+	{
+		int count = MIN(frames, MAX_MIX_FRAMES);
+		bool sfxpaused = SFXPaused.load() != 0;
+		bool syncpaused = SyncPaused.load();
+
+		memset(&MixBuffer[0], 0, count * 2 * sizeof(float));
+		active = 0;
+		for (int i = 0; i < NumVoices; i++)
+		{
+			FMixVoice &voice = MixVoices[i];
+			if (!voice.Active)
+				continue;
+
+			if (syncpaused || (sfxpaused && (voice.Flags & VOICE_Pausable)))
+			{
+				active++;
+				continue;
+			}
+			MixVoice(voice, count);
+			if (voice.Active)
+			{
+				Feedback[i].Position.store(DWORD(voice.Pos >> 32), std::memory_order_relaxed);
+				active++;
+			}
+			else
+			{
+				Feedback[i].Position.store(voice.Sample->Frames, std::memory_order_relaxed);
+				Feedback[i].EndedGeneration.store(voice.Generation, std::memory_order_release);
+			}
+		}
+		MixStreams(count);
+
+		ConvertToS16(out, &MixBuffer[0], count * 2, inactive == INACTIVE_Mute ? 0.f : 1.f);
+		out += count * 2;
+		frames -= count;
+		MixClock.fetch_add(count);
+	}
+
+	ActiveVoices.store(active);
+	if (active > PeakVoices.load())
+		PeakVoices.store(active);
+	MixMicroseconds.store((unsigned int)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count());
+}
+
+void SoftSoundRenderer::AddStream(SoftSoundStream *stream)
+{
+	std::lock_guard<std::mutex> lock(StreamLock);
+	Streams.Push(stream);
+}
+
+void SoftSoundRenderer::RemoveStream(SoftSoundStream *stream)
+{
+	std::lock_guard<std::mutex> lock(StreamLock);
+	unsigned int idx = Streams.Find(stream);
+	if (idx < Streams.Size())
+		Streams.Delete(idx);
+}
+
+//==========================================================================
+//
+// Game thread
+//
+//==========================================================================
+
+void SoftSoundRenderer::PostCommand(const FCommand &cmd)
+{
+	if (!Commands.Push(cmd))
+	{
+		// The mixer drains the queue at least once per block, so this
+		// can only wait a few milliseconds.
+		CommandOverflows.fetch_add(1);
+		while (!Commands.Push(cmd))
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void SoftSoundRenderer::PostUpdate(int voice)
+{
+	FGameVoice &gv = GameVoices[voice];
+	FCommand cmd;
+	cmd.Type = CMD_Update;
+	cmd.Flags = gv.Flags;
+	cmd.Voice = voice;
+	cmd.Generation = gv.Generation;
+	cmd.Sample = gv.Sample;
+	PanGains(gv.Pan, gv.Volume * gv.Atten, cmd.Gain);
+	cmd.Pitch = VoicePitch(gv.Pitch, gv.Flags);
+	cmd.Offset = 0;
+	PostCommand(cmd);
+}
+
+float SoftSoundRenderer::VoicePitch(int pitch, int flags)
+{
+	if (WasInWater && (flags & VOICE_Reverb))
+		return PITCH(pitch) * PITCH_MULT;
+	return PITCH(pitch);
+}
+
+float SoftSoundRenderer::CalcPan(SoundListener *listener, const FVector3 &dir, float dist_sqr, bool areasound)
+{
+	if (dist_sqr < (0.0004f*0.0004f))
+		return 0.f;
+
+	// The listener's right vector, in the same space as sound positions.
+	float rightx = sinf(listener->angle);
+	float rightz = -cosf(listener->angle);
+	float pan = (dir.X * rightx + dir.Z * rightz) / sqrtf(dist_sqr);
+
+	// Area sounds surround the listener when inside their radius.
+	if (areasound && dist_sqr < AREA_SOUND_RADIUS*AREA_SOUND_RADIUS)
+		pan *= sqrtf(dist_sqr) / AREA_SOUND_RADIUS;
+
+	if (snd_flipstereo)
+		pan = -pan;
+	return clamp(pan, -1.f, 1.f);
+}
+
+FSoundChan *SoftSoundRenderer::FindLowestChannel()
+{
+	FSoundChan *schan = Channels;
+	FSoundChan *lowest = NULL;
+	while (schan)
+	{
+		if (schan->SysChannel != NULL)
+		{
+			if (!lowest || schan->Priority < lowest->Priority ||
+				(schan->Priority == lowest->Priority &&
+				 schan->DistanceSqr > lowest->DistanceSqr))
+				lowest = schan;
+		}
+		schan = schan->NextChan;
+	}
+	return lowest;
+}
+
+int SoftSoundRenderer::AllocVoice(int priority, float dist_sqr)
+{
+	if (FreeVoices.Size() == 0)
+	{
+		// Some may have finished since the last update.
+		UpdateSounds();
+	}
+	if (FreeVoices.Size() == 0)
+	{
+		FSoundChan *lowest = FindLowestChannel();
+		if (lowest != NULL && (lowest->Priority < priority ||
+			(lowest->Priority == priority && lowest->DistanceSqr > dist_sqr)))
+		{
+			StopChannel(lowest);
+		}
+		if (FreeVoices.Size() == 0)
+			return -1;
+	}
+	int voice;
+	FreeVoices.Pop(voice);
+	return voice;
+}
+
+void SoftSoundRenderer::FreeVoice(int voice)
+{
+	GameVoices[voice].Chan = NULL;
+	GameVoices[voice].Sample = NULL;
+	FreeVoices.Push(voice);
+}
+
+FISoundChannel *SoftSoundRenderer::StartVoice(SoftSample *sample, float vol, float atten, float pan, int pitch,
+	int priority, float dist_sqr, int chanflags, FISoundChannel *reuse_chan)
+{
+	if (sample == NULL)
+		return NULL;
+
+	int voice = AllocVoice(priority, dist_sqr);
+	if (voice < 0)
+		return NULL;
+
+	FGameVoice &gv = GameVoices[voice];
+	gv.Sample = sample;
+	gv.Generation++;
+	gv.Volume = vol;
+	gv.Atten = atten;
+	gv.Pan = pan;
+	gv.Pitch = pitch;
+	gv.Flags = 0;
+	if (chanflags & SNDF_LOOP) gv.Flags |= VOICE_Loop;
+	if (!(chanflags & SNDF_NOPAUSE)) gv.Flags |= VOICE_Pausable;
+	if (!(chanflags & SNDF_NOREVERB)) gv.Flags |= VOICE_Reverb;
+
+	DWORD offset = 0;
+	if (reuse_chan != NULL && reuse_chan->StartTime.AsOne != 0)
+	{
+		if (chanflags & SNDF_ABSTIME)
+		{
+			offset = DWORD(QWORD(reuse_chan->StartTime.Lo) * sample->Frequency / 1000);
+		}
+		else
+		{
+			QWORD elapsed = MixClock.load() - reuse_chan->StartTime.AsOne;
+			offset = DWORD(elapsed * sample->Frequency / SampleRate);
+		}
+		if (offset >= sample->Frames)
+		{
+			offset = (gv.Flags & VOICE_Loop) ? sample->LoopStart +
+				(offset - sample->LoopStart) % (sample->LoopEnd - sample->LoopStart) : sample->Frames;
+		}
+	}
+
+	FCommand cmd;
+	cmd.Type = CMD_Start;
+	cmd.Flags = gv.Flags;
+	cmd.Voice = voice;
+	cmd.Generation = gv.Generation;
+	cmd.Sample = sample;
+	PanGains(pan, vol * atten, cmd.Gain);
+	cmd.Pitch = VoicePitch(pitch, gv.Flags);
+	cmd.Offset = offset;
+	Feedback[voice].Position.store(offset);
+	PostCommand(cmd);
+
+	FISoundChannel *chan = reuse_chan;
+	if (chan == NULL) chan = S_GetChannel(MAKE_PTRID(voice + 1));
+	else chan->SysChannel = MAKE_PTRID(voice + 1);
+	gv.Chan = chan;
+	return chan;
+}
+
+FISoundChannel *SoftSoundRenderer::StartSound(SoundHandle sfx, float vol, int pitch, int chanflags, FISoundChannel *reuse_chan)
+{
+	FISoundChannel *chan = StartVoice((SoftSample *)sfx.data, vol, 1.f, 0.f, pitch, INT_MAX, 0.f, chanflags, reuse_chan);
+	if (chan != NULL)
+	{
+		chan->Rolloff.RolloffType = ROLLOFF_Log;
+		chan->Rolloff.RolloffFactor = 0.f;
+		chan->Rolloff.MinDistance = 1.f;
+		chan->DistanceSqr = 0.f;
+		chan->ManualRolloff = false;
+	}
+	return chan;
+}
+
+FISoundChannel *SoftSoundRenderer::StartSound3D(SoundHandle sfx, SoundListener *listener, float vol,
+	FRolloffInfo *rolloff, float distscale, int pitch, int priority, const FVector3 &pos, const FVector3 &vel,
+	int channum, int chanflags, FISoundChannel *reuse_chan)
+{
+	FVector3 dir = pos - listener->position;
+	float dist_sqr = (float)dir.LengthSquared();
+	float atten = S_GetRolloff(rolloff, sqrtf(dist_sqr) * distscale, true);
+	float pan = CalcPan(listener, dir, dist_sqr, !!(chanflags & SNDF_AREA));
+
+	FISoundChannel *chan = StartVoice((SoftSample *)sfx.data, vol, atten, pan, pitch, priority, dist_sqr, chanflags, reuse_chan);
+	if (chan != NULL)
+	{
+		chan->Rolloff = *rolloff;
+		chan->DistanceSqr = dist_sqr;
+		chan->ManualRolloff = true;
+	}
+	return chan;
+}
+
+void SoftSoundRenderer::ChannelVolume(FISoundChannel *chan, float volume)
+{
+	if (chan == NULL || chan->SysChannel == NULL)
+		return;
+
+	int voice = GET_PTRID(chan->SysChannel) - 1;
+	GameVoices[voice].Volume = volume;
+	PostUpdate(voice);
+}
+
+void SoftSoundRenderer::StopChannel(FISoundChannel *chan)
+{
+	if (chan == NULL || chan->SysChannel == NULL)
+		return;
+
+	int voice = GET_PTRID(chan->SysChannel) - 1;
+	// Release first, so it can be properly marked as evicted if it's being
+	// forcefully killed
+	S_ChannelEnded(chan);
+
+	FCommand cmd;
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.Type = CMD_Stop;
+	cmd.Voice = voice;
+	cmd.Generation = GameVoices[voice].Generation;
+	PostCommand(cmd);
+	FreeVoice(voice);
+}
+
+unsigned int SoftSoundRenderer::GetPosition(FISoundChannel *chan)
+{
+	if (chan == NULL || chan->SysChannel == NULL)
+		return 0;
+
+	return Feedback[GET_PTRID(chan->SysChannel) - 1].Position.load(std::memory_order_relaxed);
+}
+
+void SoftSoundRenderer::UpdateSoundParams3D(SoundListener *listener, FISoundChannel *chan, bool areasound, const FVector3 &pos, const FVector3 &vel)
+{
+	if (chan == NULL || chan->SysChannel == NULL)
+		return;
+
+	int voice = GET_PTRID(chan->SysChannel) - 1;
+	FVector3 dir = pos - listener->position;
+	chan->DistanceSqr = (float)dir.LengthSquared();
+
+	FGameVoice &gv = GameVoices[voice];
+	float atten = S_GetRolloff(&chan->Rolloff, sqrtf(chan->DistanceSqr) * chan->DistanceScale, true);
+	float pan = CalcPan(listener, dir, chan->DistanceSqr, areasound);
+	if (atten != gv.Atten || pan != gv.Pan)
+	{
+		gv.Atten = atten;
+		gv.Pan = pan;
+		PostUpdate(voice);
+	}
+}
+
+void SoftSoundRenderer::UpdateListener(SoundListener *listener)
+{
+	if (!listener->valid)
+		return;
+
+	const ReverbContainer *env = listener->Environment;
+	bool inwater = listener->underwater || (env != NULL && env->SoftwareWater);
+	if (inwater != WasInWater)
+	{
+		// NOTE: Moving into and out of water will undo pitch variations on sounds.
+		WasInWater = inwater;
+		for (int i = 0; i < NumVoices; i++)
+		{
+			if (GameVoices[i].Chan != NULL && (GameVoices[i].Flags & VOICE_Reverb))
+			{
+				GameVoices[i].Pitch = 128;
+				PostUpdate(i);
+			}
+		}
+	}
+}
+
+void SoftSoundRenderer::UpdateSounds()
+{
+	for (int i = 0; i < NumVoices; i++)
+	{
+		FGameVoice &gv = GameVoices[i];
+		if (gv.Chan != NULL && Feedback[i].EndedGeneration.load(std::memory_order_acquire) == gv.Generation)
+		{
+			FISoundChannel *chan = gv.Chan;
+			S_ChannelEnded(chan);
+			FreeVoice(i);
+		}
+	}
+}
+
+void SoftSoundRenderer::SetSfxVolume(float volume)
+{
+	SfxVolume.store(volume);
+}
+
+void SoftSoundRenderer::SetMusicVolume(float volume)
+{
+	MusicVolume.store(volume);
+}
+
+void SoftSoundRenderer::Sync(bool sync)
+{
+	SyncPaused.store(sync);
+}
+
+void SoftSoundRenderer::SetSfxPaused(bool paused, int slot)
+{
+	if (paused)
+		SFXPaused.fetch_or(1 << slot);
+	else
+		SFXPaused.fetch_and(~(1 << slot));
+}
+
+void SoftSoundRenderer::SetInactive(SoundRenderer::EInactiveState state)
+{
+	Inactive.store(state);
+}
+
+void SoftSoundRenderer::MarkStartTime(FISoundChannel *chan)
+{
+	chan->StartTime.AsOne = MixClock.load();
+}
+
+float SoftSoundRenderer::GetAudibility(FISoundChannel *chan)
+{
+	if (chan == NULL || chan->SysChannel == NULL)
+		return 0.f;
+
+	FGameVoice &gv = GameVoices[GET_PTRID(chan->SysChannel) - 1];
+	return gv.Volume * gv.Atten * SfxVolume.load();
+}
+
+//==========================================================================
+//
+// Sample management
+//
+//==========================================================================
+
+std::pair<SoundHandle,bool> SoftSoundRenderer::LoadSoundRaw(BYTE *sfxdata, int length, int frequency, int channels, int bits, int loopstart, int loopend, bool monoize)
+{
+	SoundHandle retval = { NULL };
+
+	if (length == 0) return std::make_pair(retval, true);
+
+	SoftSample *sample = MakeSample(sfxdata, length, frequency, channels, bits, loopstart, loopend, channels > 1 && monoize);
+	retval.data = sample;
+	return std::make_pair(retval, sample == NULL || sample->Channels == 1);
+}
+
+std::pair<SoundHandle,bool> SoftSoundRenderer::LoadSound(BYTE *sfxdata, int length, bool monoize)
+{
+	SoundHandle retval = { NULL };
+	MemoryReader reader((const char*)sfxdata, length);
+	ChannelConfig chans;
+	SampleType type;
+	int srate;
+
+	SoundDecoder *decoder = CreateDecoder(&reader);
+	if (decoder == NULL) return std::make_pair(retval, true);
+
+	decoder->getInfo(&srate, &chans, &type);
+	if ((chans != ChannelConfig_Mono && chans != ChannelConfig_Stereo) ||
+		(type != SampleType_UInt8 && type != SampleType_Int16))
+	{
+		Printf("Unsupported audio format: %s, %s\n", GetChannelConfigName(chans),
+			GetSampleTypeName(type));
+		delete decoder;
+		return std::make_pair(retval, true);
+	}
+
+	TArray<char> data = decoder->readAll();
+	delete decoder;
+	if (data.Size() == 0) return std::make_pair(retval, true);
+
+	int channels = (chans == ChannelConfig_Stereo) ? 2 : 1;
+	SoftSample *sample = MakeSample((BYTE *)&data[0], data.Size(), srate, channels,
+		type == SampleType_UInt8 ? 8 : 16, -1, -1, channels > 1 && monoize);
+	retval.data = sample;
+	return std::make_pair(retval, sample == NULL || sample->Channels == 1);
+}
+
+void SoftSoundRenderer::UnloadSound(SoundHandle sfx)
+{
+	if (sfx.data == NULL)
+		return;
+
+	FSoundChan *schan = Channels;
+	while (schan != NULL)
+	{
+		FSoundChan *next = schan->NextChan;
+		if (schan->SysChannel != NULL && GameVoices[GET_PTRID(schan->SysChannel) - 1].Sample == sfx.data)
+		{
+			StopChannel(schan);
+		}
+		schan = next;
+	}
+
+	// The mixer owns the sample until it has seen the stops above.
+	FCommand cmd;
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.Type = CMD_FreeSample;
+	cmd.Voice = -1;
+	cmd.Sample = (SoftSample *)sfx.data;
+	PostCommand(cmd);
+}
+
+unsigned int SoftSoundRenderer::GetMSLength(SoundHandle sfx)
+{
+	SoftSample *sample = (SoftSample *)sfx.data;
+	if (sample == NULL)
+		return 0;
+	return (unsigned int)(sample->Frames * 1000. / sample->Frequency);
+}
+
+unsigned int SoftSoundRenderer::GetSampleLength(SoundHandle sfx)
+{
+	SoftSample *sample = (SoftSample *)sfx.data;
+	return sample != NULL ? sample->Frames : 0;
+}
+
+float SoftSoundRenderer::GetOutputRate()
+{
+	return (float)SampleRate;
+}
+
+//==========================================================================
+//
+// Streams
+//
+//==========================================================================
+
+SoundStream *SoftSoundRenderer::CreateStream(SoundStreamCallback callback, int buffbytes, int flags, int samplerate, void *userdata)
+{
+	SoftSoundStream *stream = new SoftSoundStream(this);
+	if (!stream->Init(callback, buffbytes, flags, samplerate, userdata))
+	{
+		delete stream;
+		return NULL;
+	}
+	return stream;
+}
+
+SoundStream *SoftSoundRenderer::OpenStream(FileReader *reader, int flags)
+{
+	SoftSoundStream *stream = new SoftSoundStream(this);
+	if (!stream->Init(reader, !!(flags&SoundStream::Loop)))
+	{
+		delete stream;
+		return NULL;
+	}
+	return stream;
+}
+
+//==========================================================================
+//
+// Status
+//
+//==========================================================================
+
+bool SoftSoundRenderer::IsValid()
+{
+	return Valid;
+}
+
+void SoftSoundRenderer::PrintStatus()
+{
+	Printf("Software mixer output: " TEXTCOLOR_ORANGE "%s\n", *OutputName);
+	Printf("Sample rate: " TEXTCOLOR_ORANGE "%d" TEXTCOLOR_NORMAL " Hz\n", SampleRate);
+	Printf("Voices: " TEXTCOLOR_ORANGE "%d" TEXTCOLOR_NORMAL ", SIMD mixing: " TEXTCOLOR_ORANGE "%s\n", NumVoices,
+#ifdef SOFTMIX_SSE2
+		"SSE2"
+#else
+		"no"
+#endif
+		);
+	if (OutputType == OUTPUT_WaveFile)
+	{
+		Printf("Written: " TEXTCOLOR_ORANGE "%u" TEXTCOLOR_NORMAL " bytes\n", OutputBytes);
+	}
+}
+
+FString SoftSoundRenderer::GatherStats()
+{
+	FString out;
+	unsigned int us = MixMicroseconds.load();
+	out.Format("%d/%d voices (peak %d), %u streams, mix %u.%03u ms, %u queued, %u overflows",
+		ActiveVoices.load(), NumVoices, PeakVoices.load(), Streams.Size(), us / 1000, us % 1000,
+		Commands.Count(), CommandOverflows.load());
+	return out;
+}
+
+void SoftSoundRenderer::PrintDriversList()
+{
+	Printf("Software mixer outputs (snd_softdevice):\n");
+#ifdef HAVE_SDL
+	Printf("  sdl\n");
+#endif
+	Printf("  wav:<filename>\n");
+	Printf("  pipe:<command>\n");
+	Printf("  null\n");
+}
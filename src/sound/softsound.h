@@ -0,0 +1,271 @@
+/*
+** softsound.h
+** Software mixing sound renderer
+**
+*/
+
+#ifndef SOFTSOUND_H
+#define SOFTSOUND_H
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "i_sound.h"
+#include "s_sound.h"
+
+//==========================================================================
+//
+// TSPSCQueue
+//
+// Fixed size single producer/single consumer queue. The producer only
+// ever writes Tail and the consumer only ever writes Head, so neither
+// side needs a lock. Size must be a power of two.
+//
+//==========================================================================
+
+template<class T, unsigned int Size>
+class TSPSCQueue
+{
+public:
+	TSPSCQueue() : Head(0), Tail(0) {}
+
+	bool Push(const T &item)
+	{
+		unsigned int tail = Tail.load(std::memory_order_relaxed);
+		if (tail - Head.load(std::memory_order_acquire) >= Size)
+			return false;
+		Items[tail & (Size - 1)] = item;
+		Tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool Pop(T &item)
+	{
+		unsigned int head = Head.load(std::memory_order_relaxed);
+		if (head == Tail.load(std::memory_order_acquire))
+			return false;
+		item = Items[head & (Size - 1)];
+		Head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	unsigned int Count() const
+	{
+		return Tail.load(std::memory_order_acquire) - Head.load(std::memory_order_acquire);
+	}
+
+private:
+	T Items[Size];
+	std::atomic<unsigned int> Head;
+	std::atomic<unsigned int> Tail;
+};
+
+struct SoftSample;
+class SoftSoundStream;
+
+//==========================================================================
+//
+// SoftSoundRenderer
+//
+// A sound renderer that does all mixing itself and only needs something
+// to hand 16-bit stereo PCM to. The game thread never touches mixer state
+// directly: every change to a voice is posted to a lock-free command queue
+// that the mixer drains at the start of each block, and the mixer reports
+// playback position and ended voices back through per-voice atomics.
+//
+//==========================================================================
+
+class SoftSoundRenderer : public SoundRenderer
+{
+public:
+	SoftSoundRenderer();
+	virtual ~SoftSoundRenderer();
+
+	virtual void SetSfxVolume(float volume);
+	virtual void SetMusicVolume(float volume);
+	virtual std::pair<SoundHandle,bool> LoadSound(BYTE *sfxdata, int length, bool monoize);
+	virtual std::pair<SoundHandle,bool> LoadSoundRaw(BYTE *sfxdata, int length, int frequency, int channels, int bits, int loopstart, int loopend = -1, bool monoize = false);
+	virtual void UnloadSound(SoundHandle sfx);
+	virtual unsigned int GetMSLength(SoundHandle sfx);
+	virtual unsigned int GetSampleLength(SoundHandle sfx);
+	virtual float GetOutputRate();
+
+	// Streaming sounds.
+	virtual SoundStream *CreateStream(SoundStreamCallback callback, int buffbytes, int flags, int samplerate, void *userdata);
+	virtual SoundStream *OpenStream(FileReader *reader, int flags);
+
+	// Starts a sound.
+	virtual FISoundChannel *StartSound(SoundHandle sfx, float vol, int pitch, int chanflags, FISoundChannel *reuse_chan);
+	virtual FISoundChannel *StartSound3D(SoundHandle sfx, SoundListener *listener, float vol, FRolloffInfo *rolloff, float distscale, int pitch, int priority, const FVector3 &pos, const FVector3 &vel, int channum, int chanflags, FISoundChannel *reuse_chan);
+
+	// Changes a channel's volume.
+	virtual void ChannelVolume(FISoundChannel *chan, float volume);
+
+	// Stops a sound channel.
+	virtual void StopChannel(FISoundChannel *chan);
+
+	// Returns position of sound on this channel, in samples.
+	virtual unsigned int GetPosition(FISoundChannel *chan);
+
+	// Synchronizes following sound startups.
+	virtual void Sync(bool sync);
+
+	// Pauses or resumes all sound effect channels.
+	virtual void SetSfxPaused(bool paused, int slot);
+
+	// Pauses or resumes *every* channel, including environmental reverb.
+	virtual void SetInactive(SoundRenderer::EInactiveState inactive);
+
+	// Updates the volume, separation, and pitch of a sound channel.
+	virtual void UpdateSoundParams3D(SoundListener *listener, FISoundChannel *chan, bool areasound, const FVector3 &pos, const FVector3 &vel);
+
+	virtual void UpdateListener(SoundListener *);
+	virtual void UpdateSounds();
+
+	virtual void MarkStartTime(FISoundChannel*);
+	virtual float GetAudibility(FISoundChannel*);
+
+	virtual bool IsValid();
+	virtual void PrintStatus();
+	virtual void PrintDriversList();
+	virtual FString GatherStats();
+
+	// Called by the output to produce the next frames of 16-bit stereo.
+	void MixBlock(SWORD *out, int frames);
+
+private:
+	enum EOutputType
+	{
+		OUTPUT_Null,
+		OUTPUT_WaveFile,
+		OUTPUT_Pipe,
+		OUTPUT_SDL
+	};
+
+	enum ECommand
+	{
+		CMD_Start,
+		CMD_Stop,
+		CMD_Update,
+		CMD_FreeSample
+	};
+
+	enum
+	{
+		VOICE_Loop = 1,
+		VOICE_Pausable = 2,
+		VOICE_Reverb = 4
+	};
+
+	struct FCommand
+	{
+		BYTE Type;
+		BYTE Flags;
+		int Voice;
+		DWORD Generation;
+		SoftSample *Sample;
+		float Gain[2];
+		float Pitch;
+		DWORD Offset;
+	};
+
+	// Mixer-side voice state. Only touched by the mixing thread.
+	struct FMixVoice
+	{
+		SoftSample *Sample;
+		QWORD Pos;			// 32.32 fixed point frame position
+		QWORD Step;
+		float Gain[2];
+		float TargetGain[2];
+		DWORD Generation;
+		BYTE Flags;
+		bool Active;
+	};
+
+	// Game-side voice state. Only touched by the game thread.
+	struct FGameVoice
+	{
+		FISoundChannel *Chan;
+		SoftSample *Sample;
+		DWORD Generation;
+		float Volume;
+		float Atten;
+		float Pan;
+		int Pitch;
+		BYTE Flags;
+	};
+
+	// Shared between both; written by the mixer, read by the game.
+	struct FVoiceFeedback
+	{
+		std::atomic<DWORD> EndedGeneration;
+		std::atomic<DWORD> Position;
+	};
+
+	bool OpenOutput();
+	void CloseOutput();
+	void CloseOutputFile();
+	void OutputProc();
+	bool WriteOutput(const SWORD *data, int frames);
+
+	int AllocVoice(int priority, float dist_sqr);
+	void FreeVoice(int voice);
+	void PostCommand(const FCommand &cmd);
+	void PostUpdate(int voice);
+	FISoundChannel *StartVoice(SoftSample *sample, float vol, float atten, float pan, int pitch, int priority, float dist_sqr, int chanflags, FISoundChannel *reuse_chan);
+	float VoicePitch(int pitch, int chanflags);
+	static float CalcPan(SoundListener *listener, const FVector3 &dir, float dist_sqr, bool areasound);
+	static FSoundChan *FindLowestChannel();
+
+	void ProcessCommands();
+	void MixVoice(FMixVoice &voice, int frames);
+	void MixStreams(int frames);
+	void AddStream(SoftSoundStream *stream);
+	void RemoveStream(SoftSoundStream *stream);
+
+	int SampleRate;
+	int NumVoices;
+
+	EOutputType OutputType;
+	FString OutputName;
+	FILE *OutputFile;
+	DWORD OutputBytes;
+	unsigned int SDLDevice;
+	bool Valid;
+
+	std::thread OutputThread;
+	std::atomic<bool> QuitThread;
+
+	TSPSCQueue<FCommand, 8192> Commands;
+
+	FMixVoice *MixVoices;
+	FGameVoice *GameVoices;
+	FVoiceFeedback *Feedback;
+	TArray<int> FreeVoices;
+
+	TArray<float> MixBuffer;
+	TArray<float> ResampleBuffer;
+
+	std::atomic<float> SfxVolume;
+	std::atomic<float> MusicVolume;
+	std::atomic<int> SFXPaused;
+	std::atomic<bool> SyncPaused;
+	std::atomic<int> Inactive;
+	std::atomic<QWORD> MixClock;
+
+	bool WasInWater;
+
+	// Statistics, written by the mixer.
+	std::atomic<int> ActiveVoices;
+	std::atomic<int> PeakVoices;
+	std::atomic<unsigned int> MixMicroseconds;
+	std::atomic<unsigned int> CommandOverflows;
+
+	std::mutex StreamLock;
+	TArray<SoftSoundStream*> Streams;
+	friend class SoftSoundStream;
+};
+
+#endif
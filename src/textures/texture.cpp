@@ -222,6 +222,104 @@ void FTexture::HackHack (int newheight)
 {
 }
 
+//==========================================================================
+//
+// FTexture :: GetMipLevels
+//
+// Makes the mip levels on first use. Each one averages 2x2 texels of the
+// level above it, working on their colors rather than on their palette
+// indices so that matching them back to the palette does not add up.
+//
+//==========================================================================
+
+int FTexture::GetMipLevels ()
+{
+	if (bMipsDone)
+	{
+		return NumMipLevels;
+	}
+	bMipsDone = true;
+
+	if (UseType == TEX_Null || bHasCanvas || bWarped ||
+		Width != (1 << WidthBits) || Height != (1 << HeightBits))
+	{
+		return 0;
+	}
+
+	// Textures only find out whether they have holes when they are made.
+	const BYTE *pixels = GetPixels();
+	if (bMasked)
+	{
+		return 0;
+	}
+
+	int levels = 0;
+	unsigned size = 0;
+	while (levels < MAX_MIPLEVELS && (Width >> (levels + 1)) >= 2 && (Height >> (levels + 1)) >= 2)
+	{
+		levels++;
+		MipOffsets[levels] = size;
+		size += (Width >> levels) * (Height >> levels);
+	}
+	if (levels == 0)
+	{
+		return 0;
+	}
+
+	TArray<int> rgb[2];
+	TArray<int> matched;
+	int w = Width, h = Height;
+
+	rgb[0].Resize(w * h * 3);
+	for (int i = 0; i < w * h; i++)
+	{
+		PalEntry color = GPalette.BaseColors[pixels[i]];
+		rgb[0][i*3] = color.r;
+		rgb[0][i*3+1] = color.g;
+		rgb[0][i*3+2] = color.b;
+	}
+	// ColorMatcher searches the whole palette, so remember what it found.
+	matched.Resize(32768);
+	for (int i = 0; i < 32768; i++)
+	{
+		matched[i] = -1;
+	}
+	MipPixels.Resize(size);
+
+	for (int level = 1; level <= levels; level++)
+	{
+		const int *src = &rgb[(level - 1) & 1][0];
+		TArray<int> &next = rgb[level & 1];
+		int nw = w >> 1, nh = h >> 1;
+		BYTE *dest = &MipPixels[MipOffsets[level]];
+
+		next.Resize(nw * nh * 3);
+		for (int x = 0; x < nw; x++)
+		{
+			for (int y = 0; y < nh; y++)
+			{
+				const int *a = src + (x * 2 * h + y * 2) * 3;
+				const int *b = a + h * 3;
+				int *c = &next[(x * nh + y) * 3];
+				c[0] = (a[0] + a[3] + b[0] + b[3] + 2) >> 2;
+				c[1] = (a[1] + a[4] + b[1] + b[4] + 2) >> 2;
+				c[2] = (a[2] + a[5] + b[2] + b[5] + 2) >> 2;
+
+				int key = ((c[0] >> 3) << 10) | ((c[1] >> 3) << 5) | (c[2] >> 3);
+				if (matched[key] < 0)
+				{
+					matched[key] = ColorMatcher.Pick(c[0], c[1], c[2]);
+				}
+				dest[x * nh + y] = (BYTE)matched[key];
+			}
+		}
+		w = nw;
+		h = nh;
+	}
+	NumMipLevels = levels;
+	return levels;
+}
+
 FTexture::Span **FTexture::CreateSpans (const BYTE *pixels) const
 {
 	Span **spans, *span;
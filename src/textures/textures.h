@@ -174,6 +174,20 @@ public:
 
 	// Returns the whole texture, stored in column-major order
 	virtual const BYTE *GetPixels () = 0;
+
+	// Box filtered copies of the texture at half, quarter, etc. the size, laid
+	// out like GetPixels. They are only made for solid textures whose sides
+	// are powers of two, and GetMipLevels returns 0 for all others.
+	// GetMipColumn takes the column in full size texels.
+	int GetMipLevels ();
+	const BYTE *GetMipPixels (int level)
+	{
+		return &MipPixels[MipOffsets[level]];
+	}
+	const BYTE *GetMipColumn (int level, int column)
+	{
+		return GetMipPixels(level) + ((column >> level) & ((Width >> level) - 1)) * (Height >> level);
+	}
 	
 	virtual int CopyTrueColorPixels(FBitmap *bmp, int x, int y, int rotate=0, FCopyInfo *inf = NULL);
 	int CopyTrueColorTranslated(FBitmap *bmp, int x, int y, int rotate, FRemapTable *remap, FCopyInfo *inf = NULL);
@@ -262,10 +276,17 @@ protected:
 	}
 
 private:
+	enum { MAX_MIPLEVELS = 15 };
+
 	bool bSWSkyColorDone = false;
 	PalEntry FloorSkyColor;
 	PalEntry CeilingSkyColor;
 
+	bool bMipsDone = false;
+	BYTE NumMipLevels = 0;
+	unsigned MipOffsets[MAX_MIPLEVELS + 1];
+	TArray<BYTE> MipPixels;
+
 public:
 	static void FlipSquareBlock (BYTE *block, int x, int y);
 	static void FlipSquareBlockRemap (BYTE *block, int x, int y, const BYTE *remap);
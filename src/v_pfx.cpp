@@ -32,10 +32,22 @@
 **
 */
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PFX_SSE2
+#endif
+
 #include "doomtype.h"
 #include "i_system.h"
 #include "v_palette.h"
 #include "v_pfx.h"
+#include "r_thread.h"
+
+// Rows converted in one go by a drawer thread
+#define PFX_BAND_HEIGHT		16
+
+// Buffers smaller than this are not worth waking up the drawer threads for
+#define PFX_MIN_THREADED	(640*400)
 
 extern "C"
 {
@@ -148,6 +160,67 @@ void PfxState::SetFormat (int bits, uint32 redMask, uint32 greenMask, uint32 blu
 	}
 }
 
+//==========================================================================
+//
+// PfxConvertCommand
+//
+// Runs the converter over bands of rows, with the bands dealt out to the
+// drawer threads the same way the drawers deal out single rows.
+//
+//==========================================================================
+
+class PfxConvertCommand : public DrawerCommand
+{
+public:
+	PfxConvertCommand (BYTE *src, int srcpitch, BYTE *dest, int destpitch, int destwidth, int destheight,
+		fixed_t xstep, fixed_t ystep, fixed_t xfrac, fixed_t yfrac)
+		: Src(src), SrcPitch(srcpitch), Dest(dest), DestPitch(destpitch), DestWidth(destwidth), DestHeight(destheight),
+		  XStep(xstep), YStep(ystep), XFrac(xfrac), YFrac(yfrac)
+	{
+	}
+
+	void Execute (DrawerThread *thread) override
+	{
+		for (int band = 0; band * PFX_BAND_HEIGHT < DestHeight; band++)
+		{
+			if (thread->line_skipped_by_thread(band))
+				continue;
+
+			int y = band * PFX_BAND_HEIGHT;
+			int64_t pos = YFrac + (int64_t)y * YStep;
+			GPfx.Convert (Src + (pos >> FRACBITS) * SrcPitch, SrcPitch,
+				Dest + y * DestPitch, DestPitch, DestWidth, MIN(PFX_BAND_HEIGHT, DestHeight - y),
+				XStep, YStep, XFrac, (fixed_t)(pos & (FRACUNIT - 1)));
+		}
+	}
+
+	FString DebugInfo () override { return "PfxConvertCommand"; }
+
+private:
+	BYTE *Src;
+	int SrcPitch;
+	BYTE *Dest;
+	int DestPitch, DestWidth, DestHeight;
+	fixed_t XStep, YStep, XFrac, YFrac;
+};
+
+void PfxState::ConvertThreaded (BYTE *src, int srcpitch,
+	void *dest, int destpitch, int destwidth, int destheight,
+	fixed_t xstep, fixed_t ystep, fixed_t xfrac, fixed_t yfrac)
+{
+	// Drawer commands cannot be created before the renderer has set up
+	// a view buffer to draw into.
+	if (!r_multithreaded || destwidth * destheight < PFX_MIN_THREADED || swrenderer::drawerargs::dc_pitch == 0)
+	{
+		Convert (src, srcpitch, dest, destpitch, destwidth, destheight, xstep, ystep, xfrac, yfrac);
+		return;
+	}
+	R_BeginDrawerCommands ();
+	DrawerCommandQueue::QueueCommand<PfxConvertCommand> (src, srcpitch, (BYTE *)dest, destpitch,
+		destwidth, destheight, xstep, ystep, xfrac, yfrac);
+	R_EndDrawerCommands ();
+}
+
 static bool AnalyzeMask (DWORD mask, BYTE *shiftout)
 {
 	BYTE shift = 0;
@@ -612,7 +685,7 @@ static void Convert24 (BYTE *src, int srcpitch,
 				dest[1] = pe[1];
 				dest[2] = pe[2];
 				xf += xstep;
-				dest += 2;
+				dest += 3;
 			}
 			yfrac += ystep;
 			while (yfrac >= FRACUNIT)
@@ -643,6 +716,28 @@ static void Convert32 (BYTE *src, int srcpitch,
 		srcpitch -= destwidth;
 		for (y = destheight; y != 0; y--)
 		{
+#ifdef PFX_SSE2
+			// The destination is usually a texture that is never read back,
+			// so write it around the cache.
+			x = destwidth;
+			while (((size_t)dest & 15) && x != 0)
+			{
+				*dest++ = GPfxPal.Pal32[*src++];
+				x--;
+			}
+			for (savedx = x, x >>= 2; x != 0; x--)
+			{
+				_mm_stream_si128 ((__m128i *)dest, _mm_setr_epi32 (
+					GPfxPal.Pal32[src[0]], GPfxPal.Pal32[src[1]],
+					GPfxPal.Pal32[src[2]], GPfxPal.Pal32[src[3]]));
+				dest += 4;
+				src += 4;
+			}
+			for (x = savedx & 3; x != 0; x--)
+			{
+				*dest++ = GPfxPal.Pal32[*src++];
+			}
+#else
 			for (savedx = x = destwidth, x >>= 3; x != 0; x--)
 			{
 				dest[0] = GPfxPal.Pal32[src[0]];
@@ -660,9 +755,38 @@ static void Convert32 (BYTE *src, int srcpitch,
 			{
 				*dest++ = GPfxPal.Pal32[*src++];
 			}
+#endif
 			dest += destpitch;
 			src += srcpitch;
 		}
+#ifdef PFX_SSE2
+		_mm_sfence ();
+#endif
+	}
+	else if (xstep == FRACUNIT/2 && xfrac == 0)
+	{ // Pixel doubling: look up each source pixel once
+		for (y = destheight; y != 0; y--)
+		{
+			BYTE *s = src;
+			for (x = destwidth >> 1; x != 0; x--)
+			{
+				DWORD color = GPfxPal.Pal32[*s++];
+				dest[0] = color;
+				dest[1] = color;
+				dest += 2;
+			}
+			if (destwidth & 1)
+			{
+				*dest++ = GPfxPal.Pal32[*s];
+			}
+			yfrac += ystep;
+			while (yfrac >= FRACUNIT)
+			{
+				yfrac -= FRACUNIT;
+				src += srcpitch;
+			}
+			dest += destpitch;
+		}
 	}
 	else
 	{
@@ -75,6 +75,11 @@ struct PfxState
 	void (*Convert) (BYTE *src, int srcpitch,
 		void *dest, int destpitch, int destwidth, int destheight,
 		fixed_t xstep, fixed_t ystep, fixed_t xfrac, fixed_t yfrac);
+
+	// Same as Convert, but with the rows split between the drawer threads
+	void ConvertThreaded (BYTE *src, int srcpitch,
+		void *dest, int destpitch, int destwidth, int destheight,
+		fixed_t xstep, fixed_t ystep, fixed_t xfrac, fixed_t yfrac);
 };
 
 extern "C"
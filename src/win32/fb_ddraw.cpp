@@ -1136,7 +1136,7 @@ void DDrawFB::Update ()
 				LOG3 ("Copy %dx%d (%d)\n", Width, Height, BufferPitch);
 				if (UsePfx)
 				{
-					GPfx.Convert (MemBuffer, BufferPitch,
+					GPfx.ConvertThreaded (MemBuffer, BufferPitch,
 						writept, Pitch, Width << PixelDoubling, Height << PixelDoubling,
 						FRACUNIT >> PixelDoubling, FRACUNIT >> PixelDoubling, 0, 0);
 				}
@@ -1238,7 +1238,7 @@ bool DDrawFB::PaintToWindow ()
 			LOG ("Paint to window\n");
 			if (LockSurf (NULL, NULL) != NoGood)
 			{
-				GPfx.Convert (MemBuffer, BufferPitch,
+				GPfx.ConvertThreaded (MemBuffer, BufferPitch,
 					Buffer, Pitch, Width << PixelDoubling, Height << PixelDoubling,
 					FRACUNIT >> PixelDoubling, FRACUNIT >> PixelDoubling, 0, 0);
 				LockingSurf->Unlock (NULL);